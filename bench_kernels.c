@@ -0,0 +1,262 @@
+/*
+ * bench_kernels.c - Runtime kernels wrapped for bench_splash.c
+ * by seb3773 - https://github.com/seb3773
+ *
+ * Includes a backend source unchanged, with its own freestanding flags, and
+ * exports the entry points declared in bench_splash.h. Built twice:
+ *   (default)   splash_anim_delta.c - decoders, alpha blend, fbdev blitters
+ *   BENCH_KMS   splash_anim_kms.c   - XRGB8888 dumb-buffer blitter and fill
+ * The backend's main() is renamed and never called.
+ */
+
+#ifdef BENCH_KMS
+
+#define main kms_main
+#include "splash_anim_kms.c"
+#undef main
+#include "bench_splash.h"
+
+void bench_drm_simd(int mask) {
+    cpu_detect();
+    cpu_features &= mask;
+}
+
+void bench_drm_blit(unsigned char *fb, int fb_w, int fb_h, int pitch, const unsigned short *frame,
+                    int stride, const bench_rect_t *r, int x, int y, int stream) {
+    fb_stream = stream;
+    blit_to_drm(fb, fb_w, fb_h, pitch, frame + r->y0 * stride + r->x0, stride,
+                r->x1 - r->x0, r->y1 - r->y0, x + r->x0, y + r->y0);
+}
+
+void bench_drm_fill(unsigned char *fb, int fb_w, int fb_h, int pitch, int stream) {
+    fb_stream = stream;
+    fill_fb_color(fb, fb_w, fb_h, pitch, BACKGROUND_COLOR);
+}
+
+#else
+
+/* Asset builds open the container named on the command line */
+#ifdef ASSET_PATH
+static const char *bench_asset_path = ASSET_PATH;
+#undef ASSET_PATH
+#define ASSET_PATH bench_asset_path
+#endif
+
+#define main fbdev_main
+#include "splash_anim_delta.c"
+#undef main
+#include "bench_splash.h"
+
+static void *bench_alloc(size_t size) {
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return p == MAP_FAILED ? NULL : p;
+}
+
+/* Same buffers as main() sets up before the first frame */
+int bench_open(const char *asset_path, bench_theme_t *t) {
+#ifdef ASSET_PATH
+    if (asset_path) bench_asset_path = asset_path;
+    if (asset_load() != 0) return -1;
+#else
+    (void)asset_path;
+#endif
+    cpu_detect();
+    
+    frame_buffer = bench_alloc(FRAME_W * FRAME_H * 2);
+    if (!frame_buffer) return -1;
+#ifdef TILE_REF
+    if (TILE_REF && !(tile_ref = bench_alloc(FRAME_W * FRAME_H * 2))) return -1;
+#endif
+#if DISPLAY_MODE == 1 || DISPLAY_MODE == 2
+    /* The whole image, where the runtime keeps only what is redrawn later */
+    if (BG_W > 0 && !(bg_buffer = bench_alloc(BG_W * BG_H * 2))) return -1;
+    bg_rect.x0 = 0;
+    bg_rect.y0 = 0;
+    bg_rect.x1 = BG_W;
+    bg_rect.y1 = BG_H;
+#endif
+#ifdef FRAME_ALPHA
+    alpha_buffer = bench_alloc(FRAME_W * FRAME_H);
+    comp_buffer = bench_alloc(FRAME_W * (FRAME_H + 1) * 2);
+    if (!alpha_buffer || !comp_buffer) return -1;
+    for (int i = 0; i < FRAME_W; i++) comp_buffer[FRAME_W * FRAME_H + i] = BACKGROUND_COLOR;
+#endif
+
+    memset(t, 0, sizeof(*t));
+    t->display_mode = DISPLAY_MODE;
+    t->frame_w = FRAME_W;
+    t->frame_h = FRAME_H;
+    t->simd = cpu_features;
+#if DISPLAY_MODE != 3 && DISPLAY_MODE != 4
+    t->nframes = NFRAMES;
+#endif
+#if DISPLAY_MODE == 1 || DISPLAY_MODE == 2
+    t->bg_w = BG_W;
+    t->bg_h = BG_H;
+#endif
+#ifdef HORIZONTAL_OFFSET
+    t->x_offset = HORIZONTAL_OFFSET;
+#endif
+#ifdef VERTICAL_OFFSET
+    t->y_offset = VERTICAL_OFFSET;
+#endif
+#ifdef LOOP_DELTA
+    t->loop_delta = LOOP_DELTA ? 1 : 0;
+#endif
+#ifdef FRAME_ALPHA
+    t->alpha = 1;
+#endif
+    return 0;
+}
+
+void bench_simd(int mask) {
+    cpu_features = 0;
+    cpu_detect();
+    cpu_features &= mask;
+}
+
+void bench_decode_bg(void) {
+#if DISPLAY_MODE == 1 || DISPLAY_MODE == 2
+    if (bg_buffer) {
+        decompress_palette_lzss(bg_compressed, BG_COMPRESSED_SIZE, bg_palette, BG_PALETTE_SIZE,
+                                bg_buffer, BG_W * BG_H);
+    }
+#endif
+}
+
+#if DISPLAY_MODE == 1 || DISPLAY_MODE == 2
+static bg_image_t bench_bg;
+static int bench_bw, bench_bh;
+static uint16_t *bench_band;
+#endif
+
+int bench_bg_pick(int w, int h, int *bw, int *bh) {
+#if DISPLAY_MODE == 1 || DISPLAY_MODE == 2
+    if (BG_W <= 0) return 0;
+    bg_pick(w, h, &bench_bg, &bench_bw, &bench_bh);
+    bench_band = bench_alloc(bench_bw * BG_BAND_ROWS * 2 + bg_scratch_size(&bench_bg, bench_bw, bench_bh));
+    if (!bench_band) return 0;
+    *bw = bench_bw;
+    *bh = bench_bh;
+    return bench_bw != bench_bg.w || bench_bh != bench_bg.h;
+#else
+    (void)w;
+    (void)h;
+    (void)bw;
+    (void)bh;
+    return 0;
+#endif
+}
+
+void bench_bg_stream(void) {
+#if DISPLAY_MODE == 1 || DISPLAY_MODE == 2
+    if (!bench_band) return;
+    int scaled = bench_bw != bench_bg.w || bench_bh != bench_bg.h;
+    bg_reader_t rd;
+    bg_begin(&rd, &bench_bg, bench_bw, bench_bh, scaled ? bench_band + bench_bw * BG_BAND_ROWS : NULL);
+    for (int by0 = 0; by0 < bench_bh; by0 += BG_BAND_ROWS) {
+        bg_read(&rd, bench_band, bench_bh - by0 < BG_BAND_ROWS ? bench_bh - by0 : BG_BAND_ROWS);
+    }
+#endif
+}
+
+#if DISPLAY_MODE != 3 && DISPLAY_MODE != 4
+/* Decoder a delta stream goes to */
+static const char *bench_codec(const uint8_t *delta, size_t size) {
+#if COMPRESS_METHOD == 6
+    static const char *const names[8] = {
+        "delta rle_xor", "delta rle_direct", "delta sparse_xor", "delta raw",
+        NULL, NULL, NULL, "delta tile"
+    };
+    if (size > 0 && delta[0] < 8 && names[delta[0]]) return names[delta[0]];
+    return "delta (unknown tag)";
+#else
+    (void)delta;
+    (void)size;
+#if COMPRESS_METHOD == 7
+    return "delta tile";
+#elif COMPRESS_METHOD == 1
+    return "delta rle_direct";
+#elif COMPRESS_METHOD == 2
+    return "delta sparse_xor";
+#elif COMPRESS_METHOD == 3
+    return "delta raw";
+#else
+    return "delta rle_xor";
+#endif
+#endif
+}
+#endif
+
+const char *bench_decode(int f, bench_rect_t *r) {
+    const char *name;
+    
+    dirty_reset(&dirty);
+#if DISPLAY_MODE == 3 || DISPLAY_MODE == 4
+    (void)f;
+#if defined(COMPRESS_METHOD) && COMPRESS_METHOD == 5
+    decompress_palette_lzss(img_compressed, IMG_COMPRESSED_SIZE, palette, PALETTE_SIZE,
+                            frame_buffer, FRAME_W * FRAME_H);
+    name = "image palette_lzss";
+#else
+    for (int i = 0; i < FRAME_W * FRAME_H; i++) {
+        frame_buffer[i] = frame_0[i];
+    }
+    name = "image raw";
+#endif
+    dirty_mark_full(&dirty);
+#else
+    if (f == 0) {
+        load_frame_0(frames[0], frame_sizes[0]);
+#ifdef ASSET_PATH
+        int method = asset->frame0_method;
+#else
+        int method = FRAME0_METHOD;
+#endif
+        name = method == 5 ? "frame0 palette_lzss" : method == 1 ? "frame0 rle_direct" : "frame0 raw";
+    } else {
+        name = bench_codec(frames[f], frame_sizes[f]);
+        apply_delta(frames[f], frame_sizes[f], f);
+    }
+#endif
+    r->x0 = dirty.x0;
+    r->y0 = dirty.y0;
+    r->x1 = dirty.x1;
+    r->y1 = dirty.y1;
+    return name;
+}
+
+void bench_compose(const bench_rect_t *r, int x, int y) {
+#ifdef FRAME_ALPHA
+    dirty_rect_t d = { r->x0, r->y0, r->x1, r->y1 };
+    alpha_compose(&d, x, y);
+#else
+    (void)r;
+    (void)x;
+    (void)y;
+#endif
+}
+
+const unsigned short *bench_frame_out(void) {
+#if DISPLAY_MODE == 3 || DISPLAY_MODE == 4
+    return frame_buffer;
+#else
+    return FRAME_OUT;
+#endif
+}
+
+void bench_fb_blit(unsigned char *fb, int fb_w, int fb_h, int pitch, int bpp,
+                   int r_off, int g_off, int b_off, const bench_rect_t *r, int x, int y,
+                   int stream) {
+    fb_stream = stream;
+    blit_frame(fb, fb_w, fb_h, pitch, bpp, bench_frame_out() + r->y0 * FRAME_W + r->x0, FRAME_W,
+               r->x1 - r->x0, r->y1 - r->y0, x + r->x0, y + r->y0, r_off, g_off, b_off);
+}
+
+void bench_fb_fill(unsigned char *fb, int fb_w, int fb_h, int pitch, int bpp,
+                   int r_off, int g_off, int b_off, int stream) {
+    fb_stream = stream;
+    fill_fb_color(fb, fb_w, fb_h, pitch, bpp, BACKGROUND_COLOR, r_off, g_off, b_off);
+}
+
+#endif
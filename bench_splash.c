@@ -0,0 +1,308 @@
+/*
+ * bench_splash.c - Headless benchmark of the runtime decoders and blitters
+ * by seb3773 - https://github.com/seb3773
+ *
+ * Build: make bench                 (replays the compiled-in frames_delta.h)
+ *        make bench ASSET_PATH=...  (replays theme containers, generate_splash -A)
+ * Usage: ./xbootsplash_bench [options] [theme.xbs]
+ *
+ * The kernels are the runtime's own (bench_kernels.c includes the backend
+ * sources with their freestanding flags); only this driver uses libc. No
+ * /dev/fb0 is needed: every framebuffer format is a buffer in memory.
+ *
+ * The animation is replayed in the order the runtime plays it and each
+ * call is timed on its own. Per kernel the report gives wall time per call,
+ * bytes written per call (the dirty box for decoders, the visible pixels for
+ * blits) and TSC cycles per pixel written.
+ *
+ * Options:
+ *   -r <w>x<h>     Framebuffer size (default: 1920x1080)
+ *   -n <passes>    Measured passes over the animation (default: 20, after one warm-up)
+ *   -s <simd>      Kernels to dispatch to: auto (default), ssse3 (no AVX2), sse2
+ *   -h             Show help
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <x86intrin.h>
+
+#include "bench_splash.h"
+
+/* Same bits as CPU_SSSE3 / CPU_AVX2 in the runtimes */
+#define SIMD_SSSE3  (1 << 0)
+#define SIMD_AVX2   (1 << 1)
+
+/* Memory framebuffer formats, with the offsets the runtime reads from fb_var_screeninfo */
+/* (bit positions at 32bpp, byte positions at 24bpp) */
+typedef struct {
+    const char *name;
+    int bpp;
+    int r_off, g_off, b_off;
+    int drm;                    /* blit_to_drm instead of blit_frame */
+} bench_format_t;
+
+static const bench_format_t formats[] = {
+    { "fb 16bpp rgb565",   16, 11, 5, 0, 0 },
+    { "fb 24bpp rgb888",   24, 2, 1, 0, 0 },
+    { "fb 24bpp bgr888",   24, 0, 1, 2, 0 },
+    { "fb 32bpp xrgb8888", 32, 16, 8, 0, 0 },
+    { "fb 32bpp xbgr8888", 32, 0, 8, 16, 0 },
+    { "drm xrgb8888",      32, 16, 8, 0, 1 },
+};
+#define NFORMATS ((int)(sizeof(formats) / sizeof(formats[0])))
+
+/* Accumulated cost of one kernel */
+typedef struct {
+    char name[48];
+    long calls;
+    uint64_t ns;
+    uint64_t cycles;
+    uint64_t bytes;
+    uint64_t pixels;
+} bench_stat_t;
+
+#define MAX_STATS 64
+static bench_stat_t stats[MAX_STATS];
+static int nstats = 0;
+static int measuring = 0;       /* 0 during the warm-up pass */
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static bench_stat_t *stat_get(const char *name) {
+    for (int i = 0; i < nstats; i++) {
+        if (strcmp(stats[i].name, name) == 0) return &stats[i];
+    }
+    if (nstats == MAX_STATS) return NULL;
+    bench_stat_t *s = &stats[nstats++];
+    snprintf(s->name, sizeof(s->name), "%s", name);
+    return s;
+}
+
+static void stat_add(const char *name, uint64_t ns, uint64_t cycles, uint64_t bytes, uint64_t pixels) {
+    if (!measuring) return;
+    bench_stat_t *s = stat_get(name);
+    if (!s) return;
+    s->calls++;
+    s->ns += ns;
+    s->cycles += cycles;
+    s->bytes += bytes;
+    s->pixels += pixels;
+}
+
+/* Time one call of stmt under name */
+#define TIMED(name, bytes, pixels, stmt) do { \
+    uint64_t t0_ = now_ns(), c0_ = __rdtsc(); \
+    stmt; \
+    uint64_t c1_ = __rdtsc(), t1_ = now_ns(); \
+    stat_add(name, t1_ - t0_, c1_ - c0_, bytes, pixels); \
+} while (0)
+
+/* Pixels of rect r, placed at (x, y), that land on a w x h screen */
+static uint64_t visible_pixels(const bench_rect_t *r, int x, int y, int w, int h) {
+    int x0 = x + r->x0, y0 = y + r->y0, x1 = x + r->x1, y1 = y + r->y1;
+    if (x0 < 0) x0 = 0;
+    if (y0 < 0) y0 = 0;
+    if (x1 > w) x1 = w;
+    if (y1 > h) y1 = h;
+    if (x1 <= x0 || y1 <= y0) return 0;
+    return (uint64_t)(x1 - x0) * (y1 - y0);
+}
+
+static uint64_t rect_pixels(const bench_rect_t *r) {
+    if (r->x1 <= r->x0 || r->y1 <= r->y0) return 0;
+    return (uint64_t)(r->x1 - r->x0) * (r->y1 - r->y0);
+}
+
+static void print_usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [options] [theme.xbs]\n", prog);
+    fprintf(stderr, "  -r <w>x<h>   Framebuffer size (default: 1920x1080)\n");
+    fprintf(stderr, "  -n <passes>  Measured passes over the animation (default: 20)\n");
+    fprintf(stderr, "  -s <simd>    auto (default), ssse3 (no AVX2), sse2\n");
+    fprintf(stderr, "  -h           Show help\n");
+    fprintf(stderr, "A theme container is only accepted by ASSET_PATH builds.\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char *asset_path = NULL;
+    int screen_w = 1920, screen_h = 1080;
+    int passes = 20;
+    int simd_mask = SIMD_SSSE3 | SIMD_AVX2;
+    
+    /* Parse arguments */
+    int arg_idx = 1;
+    while (arg_idx < argc) {
+        if (strcmp(argv[arg_idx], "-r") == 0 && arg_idx + 1 < argc) {
+            sscanf(argv[++arg_idx], "%dx%d", &screen_w, &screen_h);
+            arg_idx++;
+        } else if (strcmp(argv[arg_idx], "-n") == 0 && arg_idx + 1 < argc) {
+            passes = atoi(argv[++arg_idx]);
+            arg_idx++;
+        } else if (strcmp(argv[arg_idx], "-s") == 0 && arg_idx + 1 < argc) {
+            const char *s = argv[++arg_idx];
+            if (strcmp(s, "auto") == 0) simd_mask = SIMD_SSSE3 | SIMD_AVX2;
+            else if (strcmp(s, "ssse3") == 0) simd_mask = SIMD_SSSE3;
+            else if (strcmp(s, "sse2") == 0) simd_mask = 0;
+            else fprintf(stderr, "Warning: Unknown SIMD level '%s', using auto\n", s);
+            arg_idx++;
+        } else if (strcmp(argv[arg_idx], "-h") == 0) {
+            print_usage(argv[0]);
+            return 0;
+        } else if (argv[arg_idx][0] != '-') {
+            asset_path = argv[arg_idx];
+            arg_idx++;
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (screen_w <= 0 || screen_h <= 0 || passes <= 0) {
+        fprintf(stderr, "Error: Invalid screen size or pass count\n");
+        return 1;
+    }
+    
+    bench_theme_t t;
+    if (bench_open(asset_path, &t) != 0) {
+        fprintf(stderr, "Error: Cannot load theme%s%s\n", asset_path ? " " : "", asset_path ? asset_path : "");
+        return 1;
+    }
+    bench_simd(simd_mask);
+    bench_drm_simd(simd_mask);
+    int simd = t.simd & simd_mask;
+    
+    /* Same placement as the runtimes */
+    int x = (screen_w - t.frame_w) / 2 + t.x_offset;
+    int y = (screen_h - t.frame_h) / 2 + t.y_offset;
+    
+    /* Play order: frame 0, then 1..n-1; later passes wrap through the closing */
+    /* delta when the theme has one. Static images are one decode per pass. */
+    int nplay = t.nframes > 0 ? t.nframes : 1;
+    bench_rect_t *blits = malloc(sizeof(*blits) * nplay);   /* Dirty box per presented frame */
+    if (!blits) {
+        fprintf(stderr, "Error: Out of memory\n");
+        return 1;
+    }
+    
+    /* Background as bg_load() streams it for this screen: the closest */
+    /* variant, resampled when it is near enough */
+    int bg_draw_w = 0, bg_draw_h = 0;
+    int bg_scaled = t.bg_w > 0 && bench_bg_pick(screen_w, screen_h, &bg_draw_w, &bg_draw_h);
+    
+    /* Decoders; pass 0 is the warm-up. Pass 1 is the first to wrap, so the */
+    /* boxes it leaves are what the runtime blits from then on. */
+    for (int pass = 0; pass <= passes; pass++) {
+        measuring = pass > 0;
+        
+        if (t.bg_w > 0) {
+            uint64_t px = (uint64_t)t.bg_w * t.bg_h;
+            TIMED("bg palette_lzss", px * 2, px, bench_decode_bg());
+            px = (uint64_t)bg_draw_w * bg_draw_h;
+            TIMED(bg_scaled ? "bg stream resampled" : "bg stream", px * 2, px, bench_bg_stream());
+        }
+        
+        for (int i = 0; i < nplay; i++) {
+            int f = (i == 0 && pass > 0 && t.loop_delta) ? t.nframes : i;
+            bench_rect_t r;
+            const char *name;
+            uint64_t t0 = now_ns(), c0 = __rdtsc();
+            name = bench_decode(f, &r);
+            uint64_t c1 = __rdtsc(), t1 = now_ns();
+            uint64_t px = rect_pixels(&r);
+            stat_add(name, t1 - t0, c1 - c0, px * 2, px);
+            if (pass <= 1) blits[i] = r;
+        }
+    }
+    
+    /* Alpha blend into the composition buffer */
+    if (t.alpha) {
+        for (int pass = 0; pass <= passes; pass++) {
+            measuring = pass > 0;
+            for (int i = 0; i < nplay; i++) {
+                uint64_t px = rect_pixels(&blits[i]);
+                TIMED("alpha_compose", px * 2, px, bench_compose(&blits[i], x, y));
+            }
+        }
+    }
+    
+    /* Blitters and fills, streaming (as on fb0 and dumb buffers) and cached */
+    for (int fi = 0; fi < NFORMATS; fi++) {
+        const bench_format_t *fmt = &formats[fi];
+        int bytes_pp = fmt->bpp / 8;
+        int pitch = (screen_w * bytes_pp + 63) & ~63;
+        size_t size = (size_t)pitch * screen_h;
+        unsigned char *fb = aligned_alloc(64, size);
+        if (!fb) {
+            fprintf(stderr, "Error: Out of memory\n");
+            return 1;
+        }
+        memset(fb, 0, size);
+    
+        for (int stream = 1; stream >= 0; stream--) {
+            char blit_name[48], fill_name[48];
+            snprintf(blit_name, sizeof(blit_name), "blit %s%s", fmt->name, stream ? " nt" : "");
+            snprintf(fill_name, sizeof(fill_name), "fill %s%s", fmt->name, stream ? " nt" : "");
+    
+            for (int pass = 0; pass <= passes; pass++) {
+                measuring = pass > 0;
+                uint64_t fill_px = (uint64_t)screen_w * screen_h;
+                if (fmt->drm) {
+                    TIMED(fill_name, fill_px * bytes_pp, fill_px,
+                          bench_drm_fill(fb, screen_w, screen_h, pitch, stream));
+                } else {
+                    TIMED(fill_name, fill_px * bytes_pp, fill_px,
+                          bench_fb_fill(fb, screen_w, screen_h, pitch, fmt->bpp,
+                                        fmt->r_off, fmt->g_off, fmt->b_off, stream));
+                }
+    
+                for (int i = 0; i < nplay; i++) {
+                    uint64_t px = visible_pixels(&blits[i], x, y, screen_w, screen_h);
+                    if (fmt->drm) {
+                        TIMED(blit_name, px * bytes_pp, px,
+                              bench_drm_blit(fb, screen_w, screen_h, pitch, bench_frame_out(),
+                                             t.frame_w, &blits[i], x, y, stream));
+                    } else {
+                        TIMED(blit_name, px * bytes_pp, px,
+                              bench_fb_blit(fb, screen_w, screen_h, pitch, fmt->bpp,
+                                            fmt->r_off, fmt->g_off, fmt->b_off, &blits[i], x, y,
+                                            stream));
+                    }
+                }
+            }
+        }
+        free(fb);
+    }
+    
+    /* Report */
+    printf("Theme: mode %d, ", t.display_mode);
+    if (t.nframes > 0) {
+        printf("%d frames of %dx%d", t.nframes, t.frame_w, t.frame_h);
+    } else {
+        printf("static %dx%d", t.frame_w, t.frame_h);
+    }
+    if (t.bg_w > 0) printf(", background %dx%d", t.bg_w, t.bg_h);
+    if (bg_draw_w > 0 && (bg_draw_w != t.bg_w || bg_draw_h != t.bg_h)) {
+        printf(" drawn %dx%d", bg_draw_w, bg_draw_h);
+    }
+    if (t.loop_delta) printf(", loop delta");
+    if (t.alpha) printf(", alpha");
+    printf("\n");
+    printf("Screen: %dx%d at (%d, %d), %d passes, SIMD: sse2%s%s\n", screen_w, screen_h, x, y, passes,
+           (simd & SIMD_SSSE3) ? " ssse3" : "", (simd & SIMD_AVX2) ? " avx2" : "");
+    printf("\n%-34s %8s %12s %12s %8s\n", "kernel", "calls", "ns/call", "bytes/call", "cyc/px");
+    for (int i = 0; i < nstats; i++) {
+        const bench_stat_t *s = &stats[i];
+        if (s->calls == 0) continue;
+        printf("%-34s %8ld %12.0f %12.0f %8.2f\n", s->name, s->calls,
+               (double)s->ns / s->calls, (double)s->bytes / s->calls,
+               s->pixels ? (double)s->cycles / s->pixels : 0.0);
+    }
+    
+    free(blits);
+    return 0;
+}
@@ -0,0 +1,71 @@
+/*
+ * bench_splash.h - Interface between bench_splash.c and the backend kernels
+ *
+ * bench_kernels.c is compiled twice with the runtime's own flags: once
+ * around splash_anim_delta.c (decoders, fbdev blitters) and once, with
+ * BENCH_KMS, around splash_anim_kms.c (the XRGB8888 dumb-buffer blitter,
+ * shared with splash_anim_drm.c). The driver only sees these wrappers, so
+ * the hosted and freestanding halves never share a header besides this one.
+ */
+
+#pragma once
+
+typedef struct {
+    int x0, y0, x1, y1;             /* Half-open, frame coordinates */
+} bench_rect_t;
+
+typedef struct {
+    int display_mode;
+    int nframes;                    /* 0 for static images */
+    int frame_w, frame_h;
+    int bg_w, bg_h;                 /* 0 without a background image */
+    int x_offset, y_offset;
+    int loop_delta;                 /* bench_decode(nframes) closes the loop */
+    int alpha;                      /* FRAME_ALPHA: blits go through bench_compose */
+    int simd;                       /* CPU_SSSE3 | CPU_AVX2 as detected */
+} bench_theme_t;
+
+/* --- Decoders and fbdev blitters (splash_anim_delta.c) --- */
+
+/* Map the working buffers (and the theme container in asset builds, path */
+/* NULL for the built-in one) and fill t. Returns 0 on success. */
+int bench_open(const char *asset_path, bench_theme_t *t);
+
+/* Limit SIMD dispatch to the detected CPU_* bits in mask (0 = SSE2 only) */
+void bench_simd(int mask);
+
+/* Decompress the background image into bg_buffer */
+void bench_decode_bg(void);
+
+/* Pick the background bg_load() draws on a w x h screen and map its band; */
+/* returns 1 when it is resampled, its drawn size in bw x bh */
+int bench_bg_pick(int w, int h, int *bw, int *bh);
+
+/* Stream the picked background band by band, as bg_load() does */
+void bench_bg_stream(void);
+
+/* Decode frame f over frame f - 1 (0: load frame 0 or the static image, */
+/* nframes: the closing loop delta). Stores the changed region in r and */
+/* returns the name of the kernel that ran. */
+const char *bench_decode(int f, bench_rect_t *r);
+
+/* Alpha themes: blend rect r over the background for screen position (x, y) */
+void bench_compose(const bench_rect_t *r, int x, int y);
+
+/* The frame the blitters read (the blended one for alpha themes) */
+const unsigned short *bench_frame_out(void);
+
+/* blit_frame / fill_fb_color into a memory framebuffer; stream selects */
+/* the write-combined (non-temporal) store paths the runtime uses on fb0 */
+void bench_fb_blit(unsigned char *fb, int fb_w, int fb_h, int pitch, int bpp,
+                   int r_off, int g_off, int b_off, const bench_rect_t *r, int x, int y,
+                   int stream);
+void bench_fb_fill(unsigned char *fb, int fb_w, int fb_h, int pitch, int bpp,
+                   int r_off, int g_off, int b_off, int stream);
+
+/* --- DRM/KMS blitter (splash_anim_kms.c) --- */
+
+void bench_drm_simd(int mask);
+void bench_drm_blit(unsigned char *fb, int fb_w, int fb_h, int pitch, const unsigned short *frame,
+                    int stride, const bench_rect_t *r, int x, int y, int stream);
+void bench_drm_fill(unsigned char *fb, int fb_w, int fb_h, int pitch, int stream);
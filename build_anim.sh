@@ -20,6 +20,7 @@
 #   -c, --bg-color   Background color as RRGGBB hex (default: 000000)
 #   -b, --bg-image   Background image for mode 1
 #   -r, --resolution Target resolution WxH for full screen modes
+#                    (mode 2: comma-separated list, see README)
 #
 # Input:
 #   - Animation modes: directory containing PNG frames
@@ -212,8 +213,8 @@ detect_screen_size() {
         SCREEN_W=$(echo "$fb_size" | cut -d',' -f1)
         SCREEN_H=$(echo "$fb_size" | cut -d',' -f2)
     elif [ -n "$TARGET_RES" ]; then
-        SCREEN_W=$(echo "$TARGET_RES" | cut -d'x' -f1)
-        SCREEN_H=$(echo "$TARGET_RES" | cut -d'x' -f2)
+        SCREEN_W=$(echo "${TARGET_RES%%,*}" | cut -d'x' -f1)
+        SCREEN_H=$(echo "${TARGET_RES%%,*}" | cut -d'x' -f2)
     else
         # Default fallback
         SCREEN_W=1920
@@ -752,7 +753,7 @@ select_mode() {
     
     # Mode 2 (fullscreen anim): target resolution for background
     if [ $DISPLAY_MODE -eq 2 ] && [ -z "$TARGET_RES" ]; then
-        echo -e "${YELLOW}Target resolution (e.g., 1920x1080) or ENTER for auto-detect: ${NC}"
+        echo -e "${YELLOW}Target resolution(s) (e.g., 1920x1080 or 1920x1080,1366x768) or ENTER for auto-detect: ${NC}"
         read -r TARGET_RES
         
         if [ -z "$TARGET_RES" ]; then
@@ -1113,7 +1114,7 @@ build_animation() {
     # Check generator exists
     if [ ! -f "generate_splash" ]; then
         print_info "⚙ Compiling splash generator..."
-        gcc -O2 -o generate_splash generate_splash.c -lpng -lm
+        gcc -O2 -o generate_splash generate_splash.c -lpng -lm -lpthread
         print_success "Generator compiled"
     fi
     
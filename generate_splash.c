@@ -2,7 +2,7 @@
  * generate_splash.c - Generate bootsplash data for multiple display modes
  * by seb3773 - https://github.com/seb3773
  * 
- * Build: gcc -O2 -o generate_splash generate_splash.c -lpng -lm
+ * Build: gcc -O2 -o generate_splash generate_splash.c -lpng -lm -lpthread
  * Usage: ./generate_splash [options] <input> > splash_data.h
  * 
  * Display modes:
@@ -20,7 +20,13 @@
  *   -c <color>     Background color as RRGGBB hex (default: 000000)
  *   -b <image>     Background image for mode 1
  *   -r <w>x<h>     Target resolution for full screen modes (auto-detect if not set)
- *   -z <method>    Compression method: auto, rle_xor, rle_direct, sparse, raw (default: auto)
+ *   -z <method>    Compression method: auto, rle_xor, rle_direct, sparse, raw, tile (default: auto)
+ *   -j <threads>   Worker threads for frame processing (default: one per CPU)
+ *   -D <0|1>       Dither images quantized to 256 colours: 0=off (default), 1=Floyd-Steinberg
+ *   -F <filter>    Resize filter: bilinear (default), area, lanczos
+ *   -t <levels>    Lossy: treat pixels within <levels> (0-255 per channel) of the previous frame as unchanged
+ *   -a <0|1>       Modes 1/2: keep frame transparency as 4-bit alpha, blended over the background at runtime
+ *   -A <file>      Write a theme container for ASSET_PATH runtimes instead of the header
  *   -h             Show help
  */
 
@@ -35,6 +41,12 @@
 #include <unistd.h>
 #include <ctype.h>
 #include <math.h>
+#include <pthread.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "splash_asset.h"
 
 /* Configuration */
 static int display_mode = 0;
@@ -46,7 +58,16 @@ static uint32_t bg_color = 0x000000;  /* RRGGBB */
 static char *bg_image_path = NULL;
 static int target_w = 0;
 static int target_h = 0;
+/* -r WxH,WxH,...: mode 2 also stores the background at the extra sizes */
+#define MAX_BG_VARIANTS 8
+static int extra_w[MAX_BG_VARIANTS - 1];
+static int extra_h[MAX_BG_VARIANTS - 1];
+static int n_extra = 0;
 static int transp_warned = 0;  /* Only warn once about transparency */
+static int num_threads = 0;  /* 0 = one per online CPU */
+static const char *asset_path = NULL;  /* -A: write a theme container, not a header */
+static int near_dup_tolerance = 0;  /* -t: per-channel 8-bit levels, 0 = lossless */
+static int frame_alpha = 0;  /* -a: frames keep 4-bit alpha instead of being flattened */
 
 /* Display modes */
 #define MODE_ANIM_SOLID         0  /* Animation on solid background */
@@ -62,12 +83,14 @@ static int transp_warned = 0;  /* Only warn once about transparency */
 #define COMPRESS_RAW        3
 #define COMPRESS_AUTO       4
 #define COMPRESS_PALETTE_LZSS 5  /* Static image: 8-bit palette + LZSS */
+#define COMPRESS_PER_FRAME  6  /* Delta frames: tag byte (method 0-2, 7) + that stream */
+#define COMPRESS_TILE       7  /* 8x8 tiles: skip, motion copy, fill or RLE XOR */
 static int compress_method = COMPRESS_RLE_XOR;
+static int lzss_level = 0;  /* 0 = greedy, 1 = optimal parse (smaller, slower) */
 
 /* Frame data */
 typedef struct {
     char *path;
-    char *tmp_path;
     int index;
 } frame_entry_t;
 
@@ -78,16 +101,19 @@ typedef struct {
     int h;
 } image_t;
 
+/* Full-precision image as decoded, before RGB565: 8-bit R, G, B and A per */
+/* pixel. Transparency is flattened onto bg_color (A = 255) unless the image */
+/* was loaded with keep_alpha. */
+typedef struct {
+    uint8_t *pixels;
+    int w;
+    int h;
+} rgbx_image_t;
+
 static uint16_t rgb_to_rgb565(uint8_t r, uint8_t g, uint8_t b) {
     return ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
 }
 
-static void rgb565_to_rgb(uint16_t pixel, uint8_t *r, uint8_t *g, uint8_t *b) {
-    *r = ((pixel >> 11) & 0x1F) << 3;
-    *g = ((pixel >> 5) & 0x3F) << 2;
-    *b = (pixel & 0x1F) << 3;
-}
-
 /* Extract frame index from filename using a more robust heuristic.
  * It looks for the number that changes between files.
  * If multiple numbers exist, it compares with the first frame found.
@@ -172,199 +198,471 @@ static void shell_escape(char *dst, size_t dstsize, const char *src) {
     dst[j] = '\0';
 }
 
-/* Check if PNG has transparency (alpha channel or tRNS chunk) */
-static int png_has_alpha(const char *path) {
-    FILE *fp = fopen(path, "rb");
-    if (!fp) return 0;
-    
-    unsigned char sig[8];
-    if (fread(sig, 1, 8, fp) != 8 || png_sig_cmp(sig, 0, 8)) {
-        fclose(fp);
-        return 0;
-    }
-    
-    png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-    png_infop info = png_create_info_struct(png);
-    
-    if (setjmp(png_jmpbuf(png))) {
-        png_destroy_read_struct(&png, &info, NULL);
-        fclose(fp);
-        return 0;
-    }
-    
-    png_init_io(png, fp);
-    png_read_info(png, info);
-    
-    png_byte color_type = png_get_color_type(png, info);
-    int has_alpha = (color_type == PNG_COLOR_TYPE_RGBA || 
-                     color_type == PNG_COLOR_TYPE_GRAY_ALPHA ||
-                     png_get_valid(png, info, PNG_INFO_tRNS)) ? 1 : 0;
-    
-    png_destroy_read_struct(&png, &info, NULL);
-    fclose(fp);
-    
-    return has_alpha;
+/* Blend one 8-bit channel over the background (PNG alpha is straight, not premultiplied) */
+static inline uint8_t blend_channel(uint8_t c, uint8_t bg, uint8_t a) {
+    return (uint8_t)((c * a + bg * (255 - a) + 127) / 255);
 }
 
-/* Flatten transparent PNG using imagemagick onto solid background */
-static char *flatten_png(const char *path, uint32_t bg_hex) {
-    static char tmp_path[512];
+static int load_png_rgbx(const char *path, rgbx_image_t *img, int keep_alpha);
+
+/* Non-PNG input (JPEG etc.): let imagemagick transcode it to a temporary PNG */
+static int load_converted(const char *path, rgbx_image_t *img, int keep_alpha) {
     static int counter = 0;
+    char tmp_path[512];
     char cmd[1024];
     char escaped_path[512];
     char escaped_tmp[512];
     
-    /* Create unique temp file path per image */
-    snprintf(tmp_path, sizeof(tmp_path), "/tmp/flatten_%d_%d.png", getpid(), counter++);
-    
-    /* Build convert command: flatten onto background color */
-    char bg_color_str[16];
-    snprintf(bg_color_str, sizeof(bg_color_str), "#%06X", bg_hex);
+    /* Unique temp file per call; workers may convert concurrently */
+    snprintf(tmp_path, sizeof(tmp_path), "/tmp/splash_conv_%d_%d.png", getpid(),
+             __atomic_fetch_add(&counter, 1, __ATOMIC_RELAXED));
     
     shell_escape(escaped_path, sizeof(escaped_path), path);
     shell_escape(escaped_tmp, sizeof(escaped_tmp), tmp_path);
     
     snprintf(cmd, sizeof(cmd),
-             "convert \"%s\" -background \"%s\" -flatten \"%s\" 2>/dev/null",
-             escaped_path, bg_color_str, escaped_tmp);
-    
+             "convert \"%s\" -type %s -depth 8 %s:\"%s\" 2>/dev/null",
+             escaped_path, keep_alpha ? "TrueColorAlpha" : "TrueColor",
+             keep_alpha ? "PNG32" : "PNG24", escaped_tmp);
     if (system(cmd) != 0) {
-        /* Fallback: just copy without flattening */
-        snprintf(cmd, sizeof(cmd), "cp \"%s\" \"%s\"", escaped_path, escaped_tmp);
-        system(cmd);
+        unlink(tmp_path);
+        return -1;
     }
     
-    return tmp_path;
+    int ret = load_png_rgbx(tmp_path, img, keep_alpha);
+    unlink(tmp_path);
+    return ret;
 }
 
-/* Load PNG into RGB565 buffer */
-static int load_png(const char *path, image_t *img) {
-    const char *load_path = path;
-    char *flattened_path = NULL;
+/* Load PNG into an RGBA buffer, flattening any transparency onto bg_color */
+/* unless keep_alpha */
+static int load_png_rgbx(const char *path, rgbx_image_t *img, int keep_alpha) {
+    FILE *fp = fopen(path, "rb");
+    if (!fp) return -1;
     
-    /* Check for transparency and flatten if needed */
-    if (png_has_alpha(path)) {
-        if (!transp_warned) {
-            fprintf(stderr, "Warning: Transparent PNG detected in '%s'\n", path);
-            fprintf(stderr, "         Flattening onto background color #%06X\n", bg_color);
-            transp_warned = 1;
-        }
-        flattened_path = flatten_png(path, bg_color);
-        load_path = flattened_path;
+    unsigned char sig[8];
+    if (fread(sig, 1, 8, fp) != 8 || png_sig_cmp(sig, 0, 8)) {
+        fclose(fp);
+        return load_converted(path, img, keep_alpha);
     }
     
-    FILE *fp = fopen(load_path, "rb");
-    if (!fp) return -1;
-    
     png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
     png_infop info = png_create_info_struct(png);
+    png_bytep *volatile rows = NULL;
+    png_bytep volatile row_data = NULL;
     
     if (setjmp(png_jmpbuf(png))) {
+        free(rows);
+        free(row_data);
+        png_destroy_read_struct(&png, &info, NULL);
         fclose(fp);
         return -1;
     }
     
     png_init_io(png, fp);
+    png_set_sig_bytes(png, 8);
     png_read_info(png, info);
     
     int w = png_get_image_width(png, info);
     int h = png_get_image_height(png, info);
     png_byte color_type = png_get_color_type(png, info);
     png_byte bit_depth = png_get_bit_depth(png, info);
+    int has_alpha = (color_type & PNG_COLOR_MASK_ALPHA) ||
+                    png_get_valid(png, info, PNG_INFO_tRNS);
     
     if (bit_depth == 16) png_set_strip_16(png);
     if (color_type == PNG_COLOR_TYPE_PALETTE) png_set_palette_to_rgb(png);
     if (color_type == PNG_COLOR_TYPE_GRAY && bit_depth < 8)
         png_set_expand_gray_1_2_4_to_8(png);
     if (png_get_valid(png, info, PNG_INFO_tRNS)) png_set_tRNS_to_alpha(png);
-    if (color_type == PNG_COLOR_TYPE_RGB || color_type == PNG_COLOR_TYPE_GRAY)
+    if (!has_alpha)
         png_set_filler(png, 0xFF, PNG_FILLER_AFTER);
     if (color_type == PNG_COLOR_TYPE_GRAY || color_type == PNG_COLOR_TYPE_GRAY_ALPHA)
         png_set_gray_to_rgb(png);
+    png_set_interlace_handling(png);
     
     png_read_update_info(png, info);
     
-    png_bytep *rows = malloc(sizeof(png_bytep) * h);
+    size_t rowbytes = png_get_rowbytes(png, info);
+    rows = malloc(sizeof(png_bytep) * h);
+    row_data = malloc(rowbytes * h);
     for (int y = 0; y < h; y++) {
-        rows[y] = malloc(png_get_rowbytes(png, info));
+        rows[y] = row_data + rowbytes * y;
     }
     png_read_image(png, rows);
     
-    img->w = w;
-    img->h = h;
-    img->pixels = malloc(w * h * sizeof(uint16_t));
+    if (has_alpha && !keep_alpha && !__atomic_exchange_n(&transp_warned, 1, __ATOMIC_RELAXED)) {
+        fprintf(stderr, "Warning: Transparent PNG detected in '%s'\n", path);
+        fprintf(stderr, "         Flattening onto background color #%06X\n", bg_color);
+    }
     
+    uint8_t bg_r = (bg_color >> 16) & 0xFF;
+    uint8_t bg_g = (bg_color >> 8) & 0xFF;
+    uint8_t bg_b = bg_color & 0xFF;
+    
+    /* Flatten in place: row_data becomes the RGBX image */
     for (int y = 0; y < h; y++) {
-        for (int x = 0; x < w; x++) {
-            uint8_t r = rows[y][x * 4 + 0];
-            uint8_t g = rows[y][x * 4 + 1];
-            uint8_t b = rows[y][x * 4 + 2];
-            img->pixels[y * w + x] = rgb_to_rgb565(r, g, b);
+        uint8_t *px = rows[y];
+        uint8_t *out = row_data + (size_t)y * w * 4;
+        for (int x = 0; x < w; x++, px += 4, out += 4) {
+            uint8_t r = px[0], g = px[1], b = px[2], a = px[3];
+            if (a != 0xFF && !keep_alpha) {
+                r = blend_channel(r, bg_r, a);
+                g = blend_channel(g, bg_g, a);
+                b = blend_channel(b, bg_b, a);
+                a = 0xFF;
+            }
+            out[0] = r;
+            out[1] = g;
+            out[2] = b;
+            out[3] = a;
         }
     }
     
-    for (int y = 0; y < h; y++) free(rows[y]);
+    img->w = w;
+    img->h = h;
+    img->pixels = row_data;
+    
     free(rows);
-    fclose(fp);
     png_destroy_read_struct(&png, &info, NULL);
+    fclose(fp);
     
-    /* Clean up flattened temp file if created */
-    if (flattened_path) {
-        unlink(flattened_path);
+    return 0;
+}
+
+static void rgbx_to_rgb565(const rgbx_image_t *src, image_t *dst) {
+    int pixels = src->w * src->h;
+    dst->w = src->w;
+    dst->h = src->h;
+    dst->pixels = malloc(pixels * sizeof(uint16_t));
+    for (int i = 0; i < pixels; i++) {
+        const uint8_t *px = src->pixels + i * 4;
+        dst->pixels[i] = rgb_to_rgb565(px[0], px[1], px[2]);
     }
-    
+}
+
+/* Load PNG into RGB565 buffer, flattening any transparency onto bg_color */
+static int load_png(const char *path, image_t *img) {
+    rgbx_image_t rgbx;
+    if (load_png_rgbx(path, &rgbx, 0) != 0) return -1;
+    rgbx_to_rgb565(&rgbx, img);
+    free(rgbx.pixels);
     return 0;
 }
 
-/* Bilinear interpolation for resizing */
-static uint16_t sample_bilinear(const image_t *src, float x, float y) {
-    int x0 = (int)x;
-    int y0 = (int)y;
-    int x1 = x0 + 1;
-    int y1 = y0 + 1;
-    
-    if (x0 < 0) x0 = 0;
-    if (y0 < 0) y0 = 0;
-    if (x1 >= src->w) x1 = src->w - 1;
-    if (y1 >= src->h) y1 = src->h - 1;
-    
-    float fx = x - x0;
-    float fy = y - y0;
+/* --- Alpha frames (-a) --- */
+
+/* Coverage is quantized to 4 bits (0 = transparent, 15 = opaque) and colours */
+/* are premultiplied by it, so the runtime computes fg + bg * (15 - a) / 15 */
+/* and transparent pixels are all 0, which keeps them out of the deltas. */
+/* The plane sits right after the pixels, in the same allocation. */
+#define ALPHA_MAX 15
+
+static inline const uint8_t *alpha_plane(const uint16_t *pixels, int w, int h) {
+    return (const uint8_t *)(pixels + w * h);
+}
+
+static void rgbx_to_rgb565_alpha(const rgbx_image_t *src, image_t *dst) {
+    int pixels = src->w * src->h;
+    dst->w = src->w;
+    dst->h = src->h;
+    dst->pixels = malloc(pixels * (sizeof(uint16_t) + 1));
+    uint8_t *alpha = (uint8_t *)(dst->pixels + pixels);
+    for (int i = 0; i < pixels; i++) {
+        const uint8_t *px = src->pixels + i * 4;
+        int a = (px[3] * ALPHA_MAX + 127) / 255;
+        alpha[i] = a;
+        dst->pixels[i] = rgb_to_rgb565((px[0] * a + 7) / ALPHA_MAX, (px[1] * a + 7) / ALPHA_MAX,
+                                       (px[2] * a + 7) / ALPHA_MAX);
+    }
+}
+
+/* Animation frame: flattened, or premultiplied with its alpha plane (-a) */
+static int load_frame_png(const char *path, image_t *img) {
+    if (!frame_alpha) return load_png(path, img);
+    
+    rgbx_image_t rgbx;
+    if (load_png_rgbx(path, &rgbx, 1) != 0) return -1;
+    rgbx_to_rgb565_alpha(&rgbx, img);
+    free(rgbx.pixels);
+    return 0;
+}
+
+/* --- Worker pool --- */
+
+/* Runs fn(i, ctx) for every i in [0, n) across num_threads threads. Items are */
+/* claimed one at a time from a shared counter, so a slow frame never stalls a */
+/* fixed slice of the work. fn must only write state owned by item i. */
+#define MAX_THREADS 64
+
+typedef void (*parallel_fn_t)(int i, void *ctx);
+
+typedef struct {
+    parallel_fn_t fn;
+    void *ctx;
+    int n;
+    int next;
+} parallel_job_t;
+
+static void *parallel_worker(void *arg) {
+    parallel_job_t *job = arg;
+    int i;
+    while ((i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) < job->n) {
+        job->fn(i, job->ctx);
+    }
+    return NULL;
+}
+
+static int pool_threads(void) {
+    int nt = num_threads > 0 ? num_threads : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (nt < 1) nt = 1;
+    return nt > MAX_THREADS ? MAX_THREADS : nt;
+}
+
+static void parallel_for(int n, parallel_fn_t fn, void *ctx) {
+    parallel_job_t job = { fn, ctx, n, 0 };
+    pthread_t threads[MAX_THREADS];
     
-    uint8_t r0, g0, b0, r1, g1, b1, r2, g2, b2, r3, g3, b3;
-    rgb565_to_rgb(src->pixels[y0 * src->w + x0], &r0, &g0, &b0);
-    rgb565_to_rgb(src->pixels[y0 * src->w + x1], &r1, &g1, &b1);
-    rgb565_to_rgb(src->pixels[y1 * src->w + x0], &r2, &g2, &b2);
-    rgb565_to_rgb(src->pixels[y1 * src->w + x1], &r3, &g3, &b3);
+    int nt = pool_threads();
+    if (nt > n) nt = n;
     
-    uint8_t r = (uint8_t)(r0 * (1-fx) * (1-fy) + r1 * fx * (1-fy) + 
-                          r2 * (1-fx) * fy + r3 * fx * fy);
-    uint8_t g = (uint8_t)(g0 * (1-fx) * (1-fy) + g1 * fx * (1-fy) + 
-                          g2 * (1-fx) * fy + g3 * fx * fy);
-    uint8_t b = (uint8_t)(b0 * (1-fx) * (1-fy) + b1 * fx * (1-fy) + 
-                          b2 * (1-fx) * fy + b3 * fx * fy);
+    int started = 0;
+    for (int t = 1; t < nt; t++) {
+        if (pthread_create(&threads[started], NULL, parallel_worker, &job) != 0) break;
+        started++;
+    }
+    parallel_worker(&job);  /* Calling thread takes items too */
+    for (int t = 0; t < started; t++) {
+        pthread_join(threads[t], NULL);
+    }
+}
+
+/* --- Resampler --- */
+
+/* Separable fixed-point resize of the full-precision RGBX image, converted to */
+/* RGB565 only once at the end. Each axis gets a table of ntaps source indices */
+/* and 14-bit weights per output pixel, scaled by the reduction factor so */
+/* downscaling averages every source pixel instead of skipping some. The SSE2 */
+/* path feeds two taps to each multiply-add (pmaddwd); the scalar path computes */
+/* the same sums. */
+#define FILTER_BILINEAR 0
+#define FILTER_AREA     1  /* Box: exact coverage average, cleanest for downscaling */
+#define FILTER_LANCZOS  2  /* Lanczos-3: sharpest downscale, slight ringing */
+static int resize_filter = FILTER_BILINEAR;
+
+#define RESAMPLE_BITS 14  /* Weight precision */
+#define RESAMPLE_MID  6   /* Extra fraction bits kept between the two passes */
+
+typedef struct {
+    int ntaps;
+    int *start;       /* First source index per output index */
+    int16_t *weights; /* [dst][ntaps], each row sums to 1 << RESAMPLE_BITS */
+} resample_axis_t;
+
+static double filter_weight(int filter, double x) {
+    x = fabs(x);
+    if (filter == FILTER_LANCZOS) {
+        if (x < 1e-9) return 1.0;
+        if (x >= 3.0) return 0.0;
+        double px = M_PI * x;
+        return 3.0 * sin(px) * sin(px / 3.0) / (px * px);
+    }
+    return x < 1.0 ? 1.0 - x : 0.0;
+}
+
+static void resample_axis_init(resample_axis_t *ax, int src_n, int dst_n, int filter) {
+    double scale = (double)src_n / dst_n;
+    double fscale = scale > 1.0 ? scale : 1.0;
+    double support = filter == FILTER_LANCZOS ? 3.0 * fscale :
+                     filter == FILTER_AREA ? 0.5 * scale : fscale;
+    
+    /* Weigh a window wide enough for any output, then keep only the taps */
+    /* that are really used; source pixel j spans [j, j + 1) */
+    int win = (int)ceil(2.0 * support) + 2;
+    if (win > src_n) win = src_n;
+    double *w = malloc(sizeof(double) * (size_t)dst_n * win);
+    int *lo = malloc(sizeof(int) * dst_n);
+    int *n = malloc(sizeof(int) * dst_n);
+    int ntaps = 1;
+    
+    for (int i = 0; i < dst_n; i++) {
+        double center = (i + 0.5) * scale;
+        int first = (int)floor(center - support);
+        if (first > src_n - win) first = src_n - win;
+        if (first < 0) first = 0;
+        
+        double *wi = w + (size_t)i * win;
+        int a = -1, b = 0;
+        double sum = 0;
+        for (int t = 0; t < win; t++) {
+            int j = first + t;
+            if (filter == FILTER_AREA) {
+                double x0 = center - 0.5 * scale, x1 = center + 0.5 * scale;
+                if (x0 < j) x0 = j;
+                if (x1 > j + 1) x1 = j + 1;
+                wi[t] = x1 > x0 ? x1 - x0 : 0.0;
+            } else {
+                wi[t] = filter_weight(filter, (j + 0.5 - center) / fscale);
+            }
+            if (fabs(wi[t]) > 1e-6) {
+                if (a < 0) a = t;
+                b = t;
+            }
+            sum += wi[t];
+        }
+        /* The pixel under the centre always has weight, so a >= 0 */
+        for (int k = 0; k <= b - a; k++) wi[k] = wi[a + k] / sum;
+        lo[i] = first + a;
+        n[i] = b - a + 1;
+        if (n[i] > ntaps) ntaps = n[i];
+    }
     
-    return rgb_to_rgb565(r, g, b);
+    ax->ntaps = ntaps;
+    ax->start = malloc(sizeof(int) * dst_n);
+    ax->weights = calloc((size_t)dst_n * ntaps, sizeof(int16_t));
+    for (int i = 0; i < dst_n; i++) {
+        /* Near the end, shift the taps left so reads stay inside the line */
+        int start = lo[i] < src_n - ntaps ? lo[i] : src_n - ntaps;
+        int off = lo[i] - start;
+        const double *wi = w + (size_t)i * win;
+        int16_t *q = ax->weights + (size_t)i * ntaps;
+        
+        /* Quantize; the rounding error goes to the largest tap so rows sum exactly */
+        int total = 0, big = off;
+        for (int k = 0; k < n[i]; k++) {
+            q[off + k] = (int16_t)lrint(wi[k] * (1 << RESAMPLE_BITS));
+            total += q[off + k];
+            if (abs(q[off + k]) > abs(q[big])) big = off + k;
+        }
+        q[big] += (1 << RESAMPLE_BITS) - total;
+        ax->start[i] = start;
+    }
+    free(w);
+    free(lo);
+    free(n);
+}
+
+static void resample_axis_free(resample_axis_t *ax) {
+    free(ax->start);
+    free(ax->weights);
+}
+
+typedef struct {
+    const rgbx_image_t *src;
+    image_t *dst;
+    resample_axis_t hx, vy;
+    int16_t *mid;     /* Horizontal pass: src->h rows of dst->w RGBX pixels */
+} resize_job_t;
+
+/* Source row y to dst->w pixels, RESAMPLE_MID fraction bits per channel */
+static void resize_row_h(int y, void *ctx) {
+    resize_job_t *job = ctx;
+    const uint8_t *row = job->src->pixels + (size_t)y * job->src->w * 4;
+    int16_t *out = job->mid + (size_t)y * job->dst->w * 4;
+    int ntaps = job->hx.ntaps;
+    const int round = 1 << (RESAMPLE_BITS - RESAMPLE_MID - 1);
+    
+    for (int x = 0; x < job->dst->w; x++, out += 4) {
+        const uint8_t *px = row + job->hx.start[x] * 4;
+        const int16_t *w = job->hx.weights + (size_t)x * ntaps;
+#ifdef __SSE2__
+        const __m128i zero = _mm_setzero_si128();
+        __m128i acc = _mm_set1_epi32(round);
+        int t = 0;
+        for (; t + 1 < ntaps; t += 2) {
+            /* r0 r1 g0 g1 b0 b1 x0 x1 against w0 w1 w0 w1 ... */
+            __m128i p = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(px + t * 4)), zero);
+            p = _mm_unpacklo_epi16(p, _mm_srli_si128(p, 8));
+            __m128i wt = _mm_set1_epi32((uint16_t)w[t] | ((uint32_t)(uint16_t)w[t+1] << 16));
+            acc = _mm_add_epi32(acc, _mm_madd_epi16(p, wt));
+        }
+        if (t < ntaps) {
+            int32_t last;
+            memcpy(&last, px + t * 4, 4);
+            __m128i p = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(last), zero), zero);
+            acc = _mm_add_epi32(acc, _mm_madd_epi16(p, _mm_set1_epi32((uint16_t)w[t])));
+        }
+        acc = _mm_srai_epi32(acc, RESAMPLE_BITS - RESAMPLE_MID);
+        _mm_storel_epi64((__m128i *)out, _mm_packs_epi32(acc, acc));
+#else
+        for (int c = 0; c < 4; c++) {
+            int32_t acc = round;
+            for (int t = 0; t < ntaps; t++) acc += px[t * 4 + c] * w[t];
+            out[c] = (int16_t)(acc >> (RESAMPLE_BITS - RESAMPLE_MID));
+        }
+#endif
+    }
+}
+
+/* Output row y from the horizontal pass, clamped to 0..255 and packed to RGB565 */
+static void resize_row_v(int y, void *ctx) {
+    resize_job_t *job = ctx;
+    int w4 = job->dst->w * 4;
+    int ntaps = job->vy.ntaps;
+    const int16_t *rows = job->mid + (size_t)job->vy.start[y] * w4;
+    const int16_t *weights = job->vy.weights + (size_t)y * ntaps;
+    uint16_t *out = job->dst->pixels + (size_t)y * job->dst->w;
+    const int round = 1 << (RESAMPLE_BITS + RESAMPLE_MID - 1);
+    int x = 0;
+    
+#ifdef __SSE2__
+    /* Two pixels per step: interleave rows t and t+1 so each pmaddwd sums both taps */
+    const __m128i zero = _mm_setzero_si128();
+    for (; x + 8 <= w4; x += 8) {
+        __m128i acc0 = _mm_set1_epi32(round), acc1 = acc0;
+        int t = 0;
+        for (; t < ntaps; t += 2) {
+            __m128i a = _mm_loadu_si128((const __m128i *)(rows + (size_t)t * w4 + x));
+            __m128i b = zero;
+            uint32_t wt = (uint16_t)weights[t];
+            if (t + 1 < ntaps) {
+                b = _mm_loadu_si128((const __m128i *)(rows + (size_t)(t + 1) * w4 + x));
+                wt |= (uint32_t)(uint16_t)weights[t+1] << 16;
+            }
+            __m128i wv = _mm_set1_epi32(wt);
+            acc0 = _mm_add_epi32(acc0, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), wv));
+            acc1 = _mm_add_epi32(acc1, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), wv));
+        }
+        acc0 = _mm_srai_epi32(acc0, RESAMPLE_BITS + RESAMPLE_MID);
+        acc1 = _mm_srai_epi32(acc1, RESAMPLE_BITS + RESAMPLE_MID);
+        /* Saturating packs clamp Lanczos overshoot to 0..255 */
+        __m128i px = _mm_packus_epi16(_mm_packs_epi32(acc0, acc1), zero);
+        uint8_t rgbx[8];
+        _mm_storel_epi64((__m128i *)rgbx, px);
+        out[x / 4] = rgb_to_rgb565(rgbx[0], rgbx[1], rgbx[2]);
+        out[x / 4 + 1] = rgb_to_rgb565(rgbx[4], rgbx[5], rgbx[6]);
+    }
+#endif
+    for (; x < w4; x += 4) {
+        uint8_t rgb[3];
+        for (int c = 0; c < 3; c++) {
+            int32_t acc = round;
+            for (int t = 0; t < ntaps; t++) acc += rows[(size_t)t * w4 + x + c] * weights[t];
+            acc >>= RESAMPLE_BITS + RESAMPLE_MID;
+            rgb[c] = acc < 0 ? 0 : acc > 255 ? 255 : acc;
+        }
+        out[x / 4] = rgb_to_rgb565(rgb[0], rgb[1], rgb[2]);
+    }
 }
 
-/* Resize image using bilinear interpolation */
-static image_t* resize_image(const image_t *src, int new_w, int new_h) {
+/* Resize to new_w x new_h with resize_filter (rows spread over the worker pool) */
+static image_t* resize_image(const rgbx_image_t *src, int new_w, int new_h) {
     image_t *dst = malloc(sizeof(image_t));
     dst->w = new_w;
     dst->h = new_h;
-    dst->pixels = malloc(new_w * new_h * sizeof(uint16_t));
+    dst->pixels = malloc((size_t)new_w * new_h * sizeof(uint16_t));
     
-    float x_ratio = (float)src->w / new_w;
-    float y_ratio = (float)src->h / new_h;
+    resize_job_t job = { .src = src, .dst = dst };
+    resample_axis_init(&job.hx, src->w, new_w, resize_filter);
+    resample_axis_init(&job.vy, src->h, new_h, resize_filter);
+    job.mid = malloc(sizeof(int16_t) * 4 * (size_t)src->h * new_w);
     
-    for (int y = 0; y < new_h; y++) {
-        for (int x = 0; x < new_w; x++) {
-            float src_x = x * x_ratio;
-            float src_y = y * y_ratio;
-            dst->pixels[y * new_w + x] = sample_bilinear(src, src_x, src_y);
-        }
-    }
+    parallel_for(src->h, resize_row_h, &job);
+    parallel_for(new_h, resize_row_v, &job);
     
+    free(job.mid);
+    resample_axis_free(&job.hx);
+    resample_axis_free(&job.vy);
     return dst;
 }
 
@@ -424,6 +722,9 @@ static size_t compress_rle_xor(const uint16_t *curr, const uint16_t *prev, int c
             zeros++;
         }
         
+        /* Trailing unchanged pixels need no skip: the decoder stops at 0x00 */
+        if (zeros > 0 && i + zeros >= count) break;
+        
         if (zeros > 0) {
             out[pos++] = 0x80 | (zeros - 1);
             i += zeros;
@@ -450,6 +751,44 @@ static size_t compress_rle_xor(const uint16_t *curr, const uint16_t *prev, int c
     return pos;
 }
 
+/* Alpha XOR compression: RLE XOR over the 4-bit alpha plane */
+/*   0x00       end of frame */
+/*   0x01-0x7F  N changed pixels: N XOR nibbles follow, two per byte, low first */
+/*   0x80-0xFF  skip (cmd & 0x7F) + 1 unchanged pixels */
+static size_t compress_alpha_xor(const uint8_t *curr, const uint8_t *prev, int count, uint8_t *out) {
+    size_t pos = 0;
+    int i = 0;
+    
+    while (i < count) {
+        int zeros = 0;
+        while (i + zeros < count && zeros < 128 && curr[i + zeros] == prev[i + zeros]) zeros++;
+        
+        /* Trailing unchanged pixels need no skip: the decoder stops at 0x00 */
+        if (zeros > 0 && i + zeros >= count) break;
+        
+        if (zeros > 0) {
+            out[pos++] = 0x80 | (zeros - 1);
+            i += zeros;
+        }
+        
+        int nonzeros = 0;
+        while (i + nonzeros < count && nonzeros < 127 && curr[i + nonzeros] != prev[i + nonzeros]) nonzeros++;
+        
+        if (nonzeros > 0) {
+            out[pos++] = nonzeros;
+            for (int j = 0; j < nonzeros; j += 2) {
+                uint8_t lo = curr[i + j] ^ prev[i + j];
+                uint8_t hi = j + 1 < nonzeros ? curr[i + j + 1] ^ prev[i + j + 1] : 0;
+                out[pos++] = lo | (hi << 4);
+            }
+            i += nonzeros;
+        }
+    }
+    
+    out[pos++] = 0x00;
+    return pos;
+}
+
 /* Sparse XOR compression (position + value for changed pixels) */
 /* WARNING: Limited to frames <= 65535 pixels (16-bit index overflow) */
 static size_t compress_sparse_xor(const uint16_t *curr, const uint16_t *prev, int count, uint8_t *out) {
@@ -506,164 +845,691 @@ static size_t compress_raw_direct(const uint16_t *pixels, int count, uint8_t *ou
     return count * 2;
 }
 
-/* --- Palette + LZSS compression for static images --- */
+/* --- Per-frame dirty boxes --- */
 
-/* Build palette from image, return number of unique colors (max 256) */
-static int build_palette(const uint16_t *pixels, int count, uint16_t *palette, uint8_t *indices) {
-    int num_colors = 0;
+/* Changed bounding box between two frames (half-open: x0 <= x < x1, y0 <= y < y1) */
+/* Identical frames give an empty box (all zero) */
+typedef struct {
+    int x0, y0, x1, y1;
+} dirty_box_t;
+
+/* With -a, pixels whose alpha changed count as changed too */
+static dirty_box_t compute_dirty_box(const uint16_t *curr, const uint16_t *prev, int w, int h) {
+    dirty_box_t box = {w, h, 0, 0};
+    const uint8_t *ca = frame_alpha ? alpha_plane(curr, w, h) : NULL;
+    const uint8_t *pa = frame_alpha ? alpha_plane(prev, w, h) : NULL;
     
-    /* Simple linear search - good enough for 256 colors */
-    for (int i = 0; i < count; i++) {
-        uint16_t color = pixels[i];
-        int found = -1;
-        
-        /* Search in existing palette */
-        for (int j = 0; j < num_colors; j++) {
-            if (palette[j] == color) {
-                found = j;
-                break;
+    for (int y = 0; y < h; y++) {
+        const uint16_t *c = curr + y * w;
+        const uint16_t *p = prev + y * w;
+        int x = 0;
+        while (x < w && c[x] == p[x]) x++;
+        int xe = w;
+        while (xe > x && c[xe - 1] == p[xe - 1]) xe--;
+        if (ca) {
+            const uint8_t *cr = ca + y * w, *pr = pa + y * w;
+            int ax = 0, axe = w;
+            while (ax < x && cr[ax] == pr[ax]) ax++;
+            while (axe > xe && cr[axe - 1] == pr[axe - 1]) axe--;
+            if (x == w) {
+                /* Colours unchanged: the alpha span alone */
+                while (axe > ax && cr[axe - 1] == pr[axe - 1]) axe--;
             }
+            x = ax;
+            xe = axe;
         }
-        
-        if (found >= 0) {
-            indices[i] = (uint8_t)found;
-        } else if (num_colors < 256) {
-            palette[num_colors] = color;
-            indices[i] = (uint8_t)num_colors;
-            num_colors++;
-        } else {
-            /* Palette full - should not happen if image was quantized */
-            /* Use closest color (simple: just use last) */
-            indices[i] = 255;
-        }
+        if (xe <= x) continue;  /* Row unchanged */
+        if (x < box.x0) box.x0 = x;
+        if (xe > box.x1) box.x1 = xe;
+        if (y < box.y0) box.y0 = y;
+        box.y1 = y + 1;
     }
     
-    return num_colors;
+    if (box.x1 <= box.x0) {
+        box.x0 = box.y0 = box.x1 = box.y1 = 0;
+    }
+    return box;
 }
 
-/* LZSS compression parameters */
-#define LZSS_WINDOW_SIZE 4096
-#define LZSS_MIN_MATCH  3
-#define LZSS_MAX_MATCH  18
+/* --- Tile codec (8x8 block motion) --- */
 
-/* LZSS compress byte array (indices) */
-static size_t compress_lzss(const uint8_t *data, int count, uint8_t *out) {
-    size_t out_pos = 0;
-    int in_pos = 0;
-    uint8_t window[LZSS_WINDOW_SIZE];
-    int window_pos = 0;
-    
-    /* Initialize window with zeros */
-    memset(window, 0, LZSS_WINDOW_SIZE);
-    
-    /* Flag byte: 1 = literal, 0 = back-reference */
-    /* Format: [flag_byte][8 items] */
-    /*   literal: 1 byte */
-    /*   back-ref: 2 bytes (offset:12bits, length:4bits) */
-    
-    uint8_t flag_byte = 0;
-    uint8_t items[16];  /* Max 8 literals or 16 bytes for 8 back-refs */
-    int item_count = 0;
-    int bit_pos = 0;
+/* Tiles are visited in raster order, starting at the tile row holding box->y0: */
+/*   0x00               end of frame                                           */
+/*   0x01-0x3E          skip N unchanged tiles                                 */
+/*   0x3F lo hi         skip a 16-bit count of unchanged tiles                 */
+/*   0x40|(N-1) dx dy   N tiles copied from the previous frame at (x+dx, y+dy) */
+/*   0x80|(N-1) lo hi   N tiles filled with one RGB565 value                   */
+/*   0xC0|(N-1) ...     N tiles, each an RLE XOR stream (0x00-terminated) over */
+/*                      the tile's pixels against the same tile in prev frame  */
+/* Edge tiles are clipped to the frame; dx and dy are signed bytes. */
+#define TILE 8
+#define TILE_SEARCH 16  /* Motion search window: |dx|, |dy| <= 16 */
+
+enum { TILE_SKIP, TILE_COPY, TILE_FILL, TILE_XOR };
+
+typedef struct {
+    int kind;
+    int dx, dy;
+    uint16_t val;
+} tile_op_t;
+
+/* Compare a tw x th block at a against b (both with row stride w) */
+static int tile_equal(const uint16_t *a, const uint16_t *b, int w, int tw, int th) {
+    for (int r = 0; r < th; r++) {
+        if (memcmp(a + r * w, b + r * w, tw * sizeof(uint16_t)) != 0) return 0;
+    }
+    return 1;
+}
+
+static int tile_uniform(const uint16_t *a, int w, int tw, int th) {
+    for (int r = 0; r < th; r++) {
+        for (int c = 0; c < tw; c++) {
+            if (a[r * w + c] != a[0]) return 0;
+        }
+    }
+    return 1;
+}
+
+/* Cheapest exact encoding of one changed tile; last is the previous tile's op */
+static tile_op_t tile_choose(const uint16_t *curr, const uint16_t *prev, int w, int h,
+                             int x, int y, int tw, int th, const tile_op_t *last) {
+    const uint16_t *cur = curr + y * w + x;
+    tile_op_t op = { TILE_XOR, 0, 0, 0 };
+    
+    /* Extending the previous run costs nothing */
+    if (last->kind == TILE_COPY) {
+        int sx = x + last->dx, sy = y + last->dy;
+        if (sx >= 0 && sy >= 0 && sx + tw <= w && sy + th <= h &&
+            tile_equal(cur, prev + sy * w + sx, w, tw, th)) {
+            return *last;
+        }
+    }
+    if (tile_uniform(cur, w, tw, th)) {
+        op.kind = TILE_FILL;
+        op.val = cur[0];
+        return op;
+    }
     
-    while (in_pos < count) {
-        /* Find longest match in window */
-        int best_len = 0;
-        int best_off = 0;
-        
-        int search_start = (window_pos > LZSS_WINDOW_SIZE) ? window_pos - LZSS_WINDOW_SIZE : 0;
-        int max_search = (window_pos < LZSS_WINDOW_SIZE) ? window_pos : LZSS_WINDOW_SIZE;
-        
-        for (int off = 1; off <= max_search; off++) {
-            int win_idx = (window_pos - off + LZSS_WINDOW_SIZE) % LZSS_WINDOW_SIZE;
-            int len = 0;
-            
-            while (len < LZSS_MAX_MATCH && in_pos + len < count) {
-                int w = (win_idx + len) % LZSS_WINDOW_SIZE;
-                if (window[w] != data[in_pos + len]) break;
-                len++;
-            }
-            
-            if (len >= LZSS_MIN_MATCH && len > best_len) {
-                best_len = len;
-                best_off = off;
+    for (int dy = -TILE_SEARCH; dy <= TILE_SEARCH; dy++) {
+        int sy = y + dy;
+        if (sy < 0 || sy + th > h) continue;
+        for (int dx = -TILE_SEARCH; dx <= TILE_SEARCH; dx++) {
+            int sx = x + dx;
+            if (sx < 0 || sx + tw > w || (dx == 0 && dy == 0)) continue;
+            if (tile_equal(cur, prev + sy * w + sx, w, tw, th)) {
+                op.kind = TILE_COPY;
+                op.dx = dx;
+                op.dy = dy;
+                return op;
             }
         }
-        
-        if (best_len >= LZSS_MIN_MATCH) {
-            /* Back-reference: flag bit = 0 */
-            /* Encode: offset (12 bits) + length-3 (4 bits) */
-            int encoded_len = best_len - LZSS_MIN_MATCH;
-            items[item_count++] = best_off & 0xFF;
-            items[item_count++] = ((best_off >> 4) & 0xF0) | (encoded_len & 0x0F);
-            /* flag bit already 0 */
-            
-            /* Advance */
-            for (int i = 0; i < best_len; i++) {
-                window[window_pos] = data[in_pos];
-                window_pos = (window_pos + 1) % LZSS_WINDOW_SIZE;
-                in_pos++;
-            }
+    }
+    return op;
+}
+
+/* Do two adjacent tile ops fit in one run? */
+static int tile_same_run(const tile_op_t *a, const tile_op_t *b) {
+    if (a->kind != b->kind) return 0;
+    if (a->kind == TILE_COPY) return a->dx == b->dx && a->dy == b->dy;
+    if (a->kind == TILE_FILL) return a->val == b->val;
+    return 1;
+}
+
+static size_t compress_tile(const uint16_t *curr, const uint16_t *prev, int w, int h,
+                            const dirty_box_t *box, uint8_t *out) {
+    int tiles_x = (w + TILE - 1) / TILE;
+    int ntiles = tiles_x * ((h + TILE - 1) / TILE);
+    int t0 = (box->y0 / TILE) * tiles_x;
+    tile_op_t *ops = malloc(sizeof(tile_op_t) * ntiles);
+    uint16_t cur_px[TILE * TILE], prev_px[TILE * TILE];
+    
+    /* Pass 1: classify every tile */
+    tile_op_t last = { TILE_SKIP, 0, 0, 0 };
+    for (int t = t0; t < ntiles; t++) {
+        int x = (t % tiles_x) * TILE, y = (t / tiles_x) * TILE;
+        int tw = w - x < TILE ? w - x : TILE;
+        int th = h - y < TILE ? h - y : TILE;
+        
+        if (tile_equal(curr + y * w + x, prev + y * w + x, w, tw, th)) {
+            ops[t] = (tile_op_t){ TILE_SKIP, 0, 0, 0 };
         } else {
-            /* Literal: flag bit = 1 */
-            flag_byte |= (1 << bit_pos);
-            items[item_count++] = data[in_pos];
-            
-            window[window_pos] = data[in_pos];
-            window_pos = (window_pos + 1) % LZSS_WINDOW_SIZE;
-            in_pos++;
-        }
-        
-        bit_pos++;
-        
-        /* Flush when we have 8 bits */
-        if (bit_pos == 8) {
-            out[out_pos++] = flag_byte;
-            for (int i = 0; i < item_count; i++) {
-                out[out_pos++] = items[i];
-            }
-            flag_byte = 0;
-            item_count = 0;
-            bit_pos = 0;
+            ops[t] = tile_choose(curr, prev, w, h, x, y, tw, th, &last);
         }
+        last = ops[t];
     }
     
-    /* Flush remaining */
-    if (bit_pos > 0) {
-        out[out_pos++] = flag_byte;
-        for (int i = 0; i < item_count; i++) {
-            out[out_pos++] = items[i];
+    /* Pass 2: emit runs */
+    size_t pos = 0;
+    int t = t0;
+    while (t < ntiles) {
+        int n = 1;
+        int max_run = ops[t].kind == TILE_SKIP ? 65535 : 64;
+        while (t + n < ntiles && n < max_run && tile_same_run(&ops[t], &ops[t + n])) n++;
+        
+        switch (ops[t].kind) {
+            case TILE_SKIP:
+                if (t + n >= ntiles) break;  /* Trailing skip: the decoder stops at 0x00 */
+                if (n < 0x3F) {
+                    out[pos++] = n;
+                } else {
+                    out[pos++] = 0x3F;
+                    out[pos++] = n & 0xFF;
+                    out[pos++] = (n >> 8) & 0xFF;
+                }
+                break;
+            case TILE_COPY:
+                out[pos++] = 0x40 | (n - 1);
+                out[pos++] = (uint8_t)(int8_t)ops[t].dx;
+                out[pos++] = (uint8_t)(int8_t)ops[t].dy;
+                break;
+            case TILE_FILL:
+                out[pos++] = 0x80 | (n - 1);
+                out[pos++] = ops[t].val & 0xFF;
+                out[pos++] = (ops[t].val >> 8) & 0xFF;
+                break;
+            case TILE_XOR:
+                out[pos++] = 0xC0 | (n - 1);
+                for (int k = t; k < t + n; k++) {
+                    int x = (k % tiles_x) * TILE, y = (k / tiles_x) * TILE;
+                    int tw = w - x < TILE ? w - x : TILE;
+                    int th = h - y < TILE ? h - y : TILE;
+                    for (int r = 0; r < th; r++) {
+                        memcpy(cur_px + r * tw, curr + (y + r) * w + x, tw * sizeof(uint16_t));
+                        memcpy(prev_px + r * tw, prev + (y + r) * w + x, tw * sizeof(uint16_t));
+                    }
+                    pos += compress_rle_xor(cur_px, prev_px, tw * th, out + pos);
+                }
+                break;
         }
+        t += n;
     }
     
-    return out_pos;
+    out[pos++] = 0x00;
+    free(ops);
+    return pos;
 }
 
-/* Output palette + LZSS compressed background image (for hybrid modes) */
-static void output_bg_palette_lzss(const uint16_t *palette, int num_colors,
-                                   const uint8_t *compressed, size_t comp_size) {
-    printf("static const uint16_t bg_palette[%d] = {\n", num_colors);
-    for (int i = 0; i < num_colors; i++) {
-        if (i % 12 == 0) printf("    ");
-        printf("0x%04X", palette[i]);
-        if (i < num_colors - 1) printf(",");
-        if ((i + 1) % 12 == 0) printf("\n");
+/* Compress one delta frame with the given method */
+/* RLE codecs only encode rows [box->y0, box->y1): the runtime starts decoding at */
+/* pixel box->y0 * w using the frame_dirty[] table. Sparse keeps absolute indices. */
+static size_t compress_delta_frame(int method, const uint16_t *curr, const uint16_t *prev,
+                                   int w, int h, const dirty_box_t *box, uint8_t *out) {
+    int start = box->y0 * w;
+    int count = (box->y1 - box->y0) * w;
+    
+    switch (method) {
+        case COMPRESS_RLE_DIRECT:
+            return compress_rle_direct(curr + start, count, out);
+        case COMPRESS_SPARSE:
+            return compress_sparse_xor(curr, prev, w * h, out);
+        case COMPRESS_RAW:
+            return compress_raw_direct(curr, w * h, out);
+        case COMPRESS_TILE:
+            return compress_tile(curr, prev, w, h, box, out);
+        case COMPRESS_RLE_XOR:
+        default:
+            return compress_rle_xor(curr + start, prev + start, count, out);
     }
-    printf("\n};\n\n");
-    
-    printf("static const uint8_t bg_compressed[%zu] = {\n", comp_size);
-    for (size_t i = 0; i < comp_size; i++) {
-        if (i % 16 == 0) printf("    ");
-        printf("0x%02X", compressed[i]);
-        if (i < comp_size - 1) printf(",");
-        if ((i + 1) % 16 == 0) printf("\n");
+}
+
+/* --- Palette + LZSS compression for static images --- */
+
+/* Images with at most 256 colours get an exact palette, in first-seen order. */
+/* Above that, median cut splits the colour histogram into 256 boxes and each */
+/* colour maps to its nearest box average, with optional Floyd-Steinberg */
+/* dithering (-D 1). Lookups go through a 64K table indexed by the RGB565 */
+/* value, so the cost no longer depends on the palette size. */
+static int palette_dither = 0;
+
+typedef struct {
+    uint16_t color;
+    uint8_t rgb[3];   /* 8-bit expansion of color */
+    uint32_t count;
+} palette_color_t;
+
+typedef struct {
+    int begin, end;   /* Range of the colour array */
+    int axis, range;  /* Widest channel and its extent */
+} palette_box_t;
+
+static inline void rgb565_expand(uint16_t c, int *r, int *g, int *b) {
+    *r = ((c >> 11) << 3) | (c >> 13);
+    *g = (((c >> 5) & 0x3F) << 2) | ((c >> 9) & 0x3);
+    *b = ((c & 0x1F) << 3) | ((c >> 2) & 0x7);
+}
+
+static int palette_sort_axis;
+
+static int compare_palette_color(const void *a, const void *b) {
+    const palette_color_t *ca = a, *cb = b;
+    return ca->rgb[palette_sort_axis] - cb->rgb[palette_sort_axis];
+}
+
+static void palette_box_measure(palette_box_t *box, const palette_color_t *colors) {
+    int lo[3] = {255, 255, 255}, hi[3] = {0, 0, 0};
+    for (int i = box->begin; i < box->end; i++) {
+        for (int c = 0; c < 3; c++) {
+            if (colors[i].rgb[c] < lo[c]) lo[c] = colors[i].rgb[c];
+            if (colors[i].rgb[c] > hi[c]) hi[c] = colors[i].rgb[c];
+        }
     }
-    printf("\n};\n\n");
+    box->axis = 0;
+    for (int c = 1; c < 3; c++) {
+        if (hi[c] - lo[c] > hi[box->axis] - lo[box->axis]) box->axis = c;
+    }
+    box->range = hi[box->axis] - lo[box->axis];
 }
 
-/* Output palette + LZSS compressed static image */
-static void output_palette_lzss(const uint16_t *palette, int num_colors,
-                                 const uint8_t *compressed, size_t comp_size,
+/* Median cut over the n distinct colours; returns the palette size */
+static int palette_median_cut(palette_color_t *colors, int n, uint16_t *palette) {
+    palette_box_t boxes[256];
+    int nboxes = 1;
+    boxes[0] = (palette_box_t){0, n, 0, 0};
+    palette_box_measure(&boxes[0], colors);
+    
+    while (nboxes < 256) {
+        /* Split the box with the widest channel, at its pixel-weighted median */
+        int best = -1;
+        for (int b = 0; b < nboxes; b++) {
+            if (boxes[b].end - boxes[b].begin < 2) continue;
+            if (best < 0 || boxes[b].range > boxes[best].range) best = b;
+        }
+        if (best < 0) break;
+        
+        palette_box_t *box = &boxes[best];
+        palette_sort_axis = box->axis;
+        qsort(colors + box->begin, box->end - box->begin, sizeof(palette_color_t), compare_palette_color);
+        
+        uint64_t total = 0, acc = 0;
+        for (int i = box->begin; i < box->end; i++) total += colors[i].count;
+        int split = box->begin + 1;
+        for (int i = box->begin; i < box->end - 1; i++) {
+            acc += colors[i].count;
+            split = i + 1;
+            if (acc * 2 >= total) break;
+        }
+        
+        boxes[nboxes] = (palette_box_t){split, box->end, 0, 0};
+        box->end = split;
+        palette_box_measure(box, colors);
+        palette_box_measure(&boxes[nboxes], colors);
+        nboxes++;
+    }
+    
+    /* Entry = pixel-weighted mean of the box, rounded to RGB565 */
+    for (int b = 0; b < nboxes; b++) {
+        uint64_t sum[3] = {0, 0, 0}, total = 0;
+        for (int i = boxes[b].begin; i < boxes[b].end; i++) {
+            uint16_t c = colors[i].color;
+            sum[0] += (uint64_t)(c >> 11) * colors[i].count;
+            sum[1] += (uint64_t)((c >> 5) & 0x3F) * colors[i].count;
+            sum[2] += (uint64_t)(c & 0x1F) * colors[i].count;
+            total += colors[i].count;
+        }
+        palette[b] = (uint16_t)((((sum[0] + total / 2) / total) << 11) |
+                                (((sum[1] + total / 2) / total) << 5) |
+                                 ((sum[2] + total / 2) / total));
+    }
+    return nboxes;
+}
+
+/* Nearest palette entry to an 8-bit colour */
+static uint8_t palette_nearest(const int (*pal_rgb)[3], int num_colors, int r, int g, int b) {
+    int best = 0, best_d = INT32_MAX;
+    for (int i = 0; i < num_colors; i++) {
+        int dr = r - pal_rgb[i][0], dg = g - pal_rgb[i][1], db = b - pal_rgb[i][2];
+        int d = dr * dr + dg * dg + db * db;
+        if (d < best_d) {
+            best_d = d;
+            best = i;
+        }
+    }
+    return (uint8_t)best;
+}
+
+/* Build palette from image, return number of colors (max 256) */
+static int build_palette(const image_t *img, uint16_t *palette, uint8_t *indices) {
+    int count = img->w * img->h;
+    int16_t *lut = malloc(sizeof(int16_t) * 65536);
+    memset(lut, 0xFF, sizeof(int16_t) * 65536);  /* -1: not seen / not mapped */
+    
+    /* Exact palette while the image has at most 256 colours */
+    int num_colors = 0;
+    int i;
+    for (i = 0; i < count; i++) {
+        uint16_t color = img->pixels[i];
+        if (lut[color] < 0) {
+            if (num_colors == 256) break;
+            palette[num_colors] = color;
+            lut[color] = num_colors++;
+        }
+        indices[i] = (uint8_t)lut[color];
+    }
+    if (i == count) {
+        free(lut);
+        return num_colors;
+    }
+    
+    /* Quantize: histogram of the distinct colours, then median cut */
+    uint32_t *hist = calloc(65536, sizeof(uint32_t));
+    for (i = 0; i < count; i++) hist[img->pixels[i]]++;
+    int distinct = 0;
+    for (int c = 0; c < 65536; c++) distinct += hist[c] != 0;
+    palette_color_t *colors = malloc(sizeof(palette_color_t) * distinct);
+    int n = 0;
+    for (int c = 0; c < 65536; c++) {
+        if (!hist[c]) continue;
+        int r, g, b;
+        rgb565_expand(c, &r, &g, &b);
+        colors[n++] = (palette_color_t){(uint16_t)c, {r, g, b}, hist[c]};
+    }
+    num_colors = palette_median_cut(colors, distinct, palette);
+    free(colors);
+    free(hist);
+    
+    int (*pal_rgb)[3] = malloc(sizeof(int[3]) * num_colors);
+    for (int p = 0; p < num_colors; p++) {
+        rgb565_expand(palette[p], &pal_rgb[p][0], &pal_rgb[p][1], &pal_rgb[p][2]);
+    }
+    memset(lut, 0xFF, sizeof(int16_t) * 65536);
+    
+    if (!palette_dither) {
+        for (i = 0; i < count; i++) {
+            uint16_t color = img->pixels[i];
+            if (lut[color] < 0) {
+                int r, g, b;
+                rgb565_expand(color, &r, &g, &b);
+                lut[color] = palette_nearest(pal_rgb, num_colors, r, g, b);
+            }
+            indices[i] = (uint8_t)lut[color];
+        }
+    } else {
+        /* Floyd-Steinberg in 8-bit space; the target colour is rounded to */
+        /* RGB565 so lookups still go through lut */
+        int w = img->w;
+        int (*err)[3] = calloc((size_t)(w + 2) * 2, sizeof(int[3]));
+        for (int y = 0; y < img->h; y++) {
+            int (*cur)[3] = err + (y & 1) * (w + 2) + 1;
+            int (*next)[3] = err + (~y & 1) * (w + 2) + 1;
+            memset(next - 1, 0, sizeof(int[3]) * (w + 2));
+            for (int x = 0; x < w; x++) {
+                int v[3];
+                rgb565_expand(img->pixels[y * w + x], &v[0], &v[1], &v[2]);
+                for (int c = 0; c < 3; c++) {
+                    v[c] += (cur[x][c] + 8) >> 4;
+                    v[c] = v[c] < 0 ? 0 : v[c] > 255 ? 255 : v[c];
+                }
+                uint16_t target = rgb_to_rgb565(v[0], v[1], v[2]);
+                if (lut[target] < 0) {
+                    int r, g, b;
+                    rgb565_expand(target, &r, &g, &b);
+                    lut[target] = palette_nearest(pal_rgb, num_colors, r, g, b);
+                }
+                uint8_t idx = (uint8_t)lut[target];
+                indices[y * w + x] = idx;
+                for (int c = 0; c < 3; c++) {
+                    int e = v[c] - pal_rgb[idx][c];
+                    cur[x + 1][c] += e * 7;
+                    next[x - 1][c] += e * 3;
+                    next[x][c] += e * 5;
+                    next[x + 1][c] += e;
+                }
+            }
+        }
+        free(err);
+    }
+    
+    fprintf(stderr, "Quantized %d colours to %d (median cut%s)\n",
+            distinct, num_colors, palette_dither ? ", dithered" : "");
+    free(pal_rgb);
+    free(lut);
+    return num_colors;
+}
+
+/* LZSS compression parameters */
+#define LZSS_WINDOW_SIZE 4096
+#define LZSS_MIN_MATCH  3
+#define LZSS_MAX_MATCH  18
+#define LZSS_MAX_OFFSET (LZSS_WINDOW_SIZE - 1)  /* 12-bit offset field */
+
+/* Hash-chain match finder: head[] holds the newest position for each hash of */
+/* 3 bytes, prev[] links every position in the window to the previous one */
+/* with the same hash. Positions older than the window fall off the chains. */
+#define LZSS_HASH_BITS  15
+#define LZSS_HASH_SIZE  (1 << LZSS_HASH_BITS)
+#define LZSS_CHAIN_GREEDY  256            /* Candidates tried per position */
+#define LZSS_CHAIN_OPTIMAL LZSS_WINDOW_SIZE
+
+typedef struct {
+    int head[LZSS_HASH_SIZE];
+    int prev[LZSS_WINDOW_SIZE];
+} lzss_finder_t;
+
+static inline unsigned lzss_hash(const uint8_t *p) {
+    uint32_t v = p[0] | (p[1] << 8) | ((uint32_t)p[2] << 16);
+    return (v * 2654435761u) >> (32 - LZSS_HASH_BITS);
+}
+
+static void lzss_finder_init(lzss_finder_t *mf) {
+    for (int i = 0; i < LZSS_HASH_SIZE; i++) mf->head[i] = -1;
+}
+
+/* Add position pos (needs 3 bytes of lookahead) to its hash chain */
+static inline void lzss_insert(lzss_finder_t *mf, const uint8_t *data, int count, int pos) {
+    if (pos + LZSS_MIN_MATCH > count) return;
+    unsigned h = lzss_hash(data + pos);
+    mf->prev[pos & (LZSS_WINDOW_SIZE - 1)] = mf->head[h];
+    mf->head[h] = pos;
+}
+
+/* Longest match for pos among earlier positions within the window. */
+/* Matches may overlap pos (offset < length): the decoder copies byte by byte. */
+/* Returns the length (0 if below LZSS_MIN_MATCH) and sets *off. */
+static int lzss_find(const lzss_finder_t *mf, const uint8_t *data, int count, int pos,
+                     int max_chain, int *off) {
+    if (pos + LZSS_MIN_MATCH > count) return 0;
+    
+    int max_len = count - pos < LZSS_MAX_MATCH ? count - pos : LZSS_MAX_MATCH;
+    int best_len = 0;
+    int cand = mf->head[lzss_hash(data + pos)];
+    
+    while (cand >= 0 && pos - cand <= LZSS_MAX_OFFSET && max_chain-- > 0) {
+        /* Cheap reject: a longer match must also differ nowhere up to best_len */
+        if (data[cand + best_len] == data[pos + best_len]) {
+            int len = 0;
+            while (len < max_len && data[cand + len] == data[pos + len]) len++;
+            if (len > best_len) {
+                best_len = len;
+                *off = pos - cand;
+                if (len == max_len) break;
+            }
+        }
+        cand = mf->prev[cand & (LZSS_WINDOW_SIZE - 1)];
+    }
+    
+    return best_len >= LZSS_MIN_MATCH ? best_len : 0;
+}
+
+/* Output stream: a flag byte per group of 8 items, 1 = literal, 0 = back-ref */
+/*   literal: 1 byte */
+/*   back-ref: 2 bytes (offset:12bits, length-3:4bits) */
+typedef struct {
+    uint8_t *out;
+    size_t out_pos;
+    size_t flag_pos;
+    int bit_pos;
+} lzss_writer_t;
+
+static inline void lzss_begin_item(lzss_writer_t *w) {
+    if (w->bit_pos == 0) {
+        w->flag_pos = w->out_pos;
+        w->out[w->out_pos++] = 0;
+    }
+}
+
+static inline void lzss_end_item(lzss_writer_t *w) {
+    w->bit_pos = (w->bit_pos + 1) & 7;
+}
+
+static void lzss_put_literal(lzss_writer_t *w, uint8_t val) {
+    lzss_begin_item(w);
+    w->out[w->flag_pos] |= 1 << w->bit_pos;
+    w->out[w->out_pos++] = val;
+    lzss_end_item(w);
+}
+
+static void lzss_put_match(lzss_writer_t *w, int off, int len) {
+    lzss_begin_item(w);
+    w->out[w->out_pos++] = off & 0xFF;
+    w->out[w->out_pos++] = ((off >> 4) & 0xF0) | ((len - LZSS_MIN_MATCH) & 0x0F);
+    lzss_end_item(w);
+}
+
+/* Optimal parse: every literal costs 9 bits and every match 17, so a */
+/* backward pass over the longest match at each position (any shorter prefix */
+/* of it is a match too) finds the cheapest item sequence exactly. */
+static size_t compress_lzss_optimal(const uint8_t *data, int count, uint8_t *out,
+                                    lzss_finder_t *mf) {
+    uint8_t *len = malloc(count);
+    uint16_t *off = malloc(count * sizeof(uint16_t));
+    uint32_t *cost = malloc((count + 1) * sizeof(uint32_t));
+    
+    for (int pos = 0; pos < count; pos++) {
+        int o = 0;
+        len[pos] = (uint8_t)lzss_find(mf, data, count, pos, LZSS_CHAIN_OPTIMAL, &o);
+        off[pos] = (uint16_t)o;
+        lzss_insert(mf, data, count, pos);
+    }
+    
+    cost[count] = 0;
+    for (int pos = count - 1; pos >= 0; pos--) {
+        uint32_t best = cost[pos + 1] + 9;
+        int choice = 0;
+        for (int l = LZSS_MIN_MATCH; l <= len[pos]; l++) {
+            uint32_t c = cost[pos + l] + 17;
+            if (c < best) {
+                best = c;
+                choice = l;
+            }
+        }
+        cost[pos] = best;
+        len[pos] = (uint8_t)choice;
+    }
+    
+    lzss_writer_t w = { out, 0, 0, 0 };
+    for (int pos = 0; pos < count; ) {
+        if (len[pos]) {
+            lzss_put_match(&w, off[pos], len[pos]);
+            pos += len[pos];
+        } else {
+            lzss_put_literal(&w, data[pos++]);
+        }
+    }
+    
+    free(len);
+    free(off);
+    free(cost);
+    return w.out_pos;
+}
+
+/* LZSS compress byte array (indices) */
+static size_t compress_lzss(const uint8_t *data, int count, uint8_t *out) {
+    lzss_finder_t *mf = malloc(sizeof(*mf));
+    lzss_finder_init(mf);
+    
+    if (lzss_level > 0) {
+        size_t size = compress_lzss_optimal(data, count, out, mf);
+        free(mf);
+        return size;
+    }
+    
+    /* Greedy: take the longest match at each position */
+    lzss_writer_t w = { out, 0, 0, 0 };
+    int in_pos = 0;
+    while (in_pos < count) {
+        int best_off = 0;
+        int best_len = lzss_find(mf, data, count, in_pos, LZSS_CHAIN_GREEDY, &best_off);
+        
+        if (best_len) {
+            lzss_put_match(&w, best_off, best_len);
+            for (int i = 0; i < best_len; i++) {
+                lzss_insert(mf, data, count, in_pos++);
+            }
+        } else {
+            lzss_put_literal(&w, data[in_pos]);
+            lzss_insert(mf, data, count, in_pos++);
+        }
+    }
+    
+    free(mf);
+    return w.out_pos;
+}
+
+/* Output palette + LZSS compressed background image (for hybrid modes) */
+/* suffix names a background variant's arrays ("" for the first) */
+static void output_bg_palette_lzss(const uint16_t *palette, int num_colors,
+                                   const uint8_t *compressed, size_t comp_size,
+                                   const char *suffix) {
+    printf("static const uint16_t bg_palette%s[%d] = {\n", suffix, num_colors);
+    for (int i = 0; i < num_colors; i++) {
+        if (i % 12 == 0) printf("    ");
+        printf("0x%04X", palette[i]);
+        if (i < num_colors - 1) printf(",");
+        if ((i + 1) % 12 == 0) printf("\n");
+    }
+    printf("\n};\n\n");
+    
+    printf("static const uint8_t bg_compressed%s[%zu] = {\n", suffix, comp_size);
+    for (size_t i = 0; i < comp_size; i++) {
+        if (i % 16 == 0) printf("    ");
+        printf("0x%02X", compressed[i]);
+        if (i < comp_size - 1) printf(",");
+        if ((i + 1) % 16 == 0) printf("\n");
+    }
+    printf("\n};\n\n");
+}
+
+/* A background image as it is stored: palette and LZSS-compressed indices */
+typedef struct {
+    int w, h;
+    uint16_t palette[256];
+    int num_colors;
+    uint8_t *compressed;
+    size_t comp_size;
+} bg_encoded_t;
+
+/* Resize src to w x h (0 x 0: keep its size), then quantize and compress it */
+static void bg_encode(const rgbx_image_t *src, int w, int h, bg_encoded_t *out) {
+    image_t bg;
+    if (w > 0 && h > 0 && (src->w != w || src->h != h)) {
+        fprintf(stderr, "Resizing background to %dx%d...\n", w, h);
+        image_t *resized = resize_image(src, w, h);
+        bg = *resized;
+        free(resized);
+    } else {
+        rgbx_to_rgb565(src, &bg);
+    }
+    
+    int pixel_count = bg.w * bg.h;
+    uint8_t *indices = malloc(pixel_count);
+    out->w = bg.w;
+    out->h = bg.h;
+    out->compressed = malloc(pixel_count * 2);
+    
+    out->num_colors = build_palette(&bg, out->palette, indices);
+    fprintf(stderr, "Background palette: %d unique colors\n", out->num_colors);
+    
+    out->comp_size = compress_lzss(indices, pixel_count, out->compressed);
+    fprintf(stderr, "Background LZSS: %zu bytes (%.1f%% of raw)\n",
+            out->comp_size, 100.0 * out->comp_size / (pixel_count * 2));
+    
+    free(indices);
+    free(bg.pixels);
+}
+
+/* Output palette + LZSS compressed static image */
+static void output_palette_lzss(const uint16_t *palette, int num_colors,
+                                 const uint8_t *compressed, size_t comp_size,
                                  int w, int h) {
     printf("/* Palette + LZSS compressed static image */\n");
     printf("#define PALETTE_SIZE %d\n", num_colors);
@@ -701,8 +1567,8 @@ static void output_image_data(const char *name, const uint16_t *pixels, int w, i
 }
 
 /* Output compressed frame data */
-static void output_frame_data(int frame_num, const uint8_t *data, size_t size) {
-    printf("static const uint8_t frame_%d[%zu] = {\n", frame_num, size);
+static void output_frame_data(const char *name, const uint8_t *data, size_t size) {
+    printf("static const uint8_t %s[%zu] = {\n", name, size);
     for (size_t i = 0; i < size; i++) {
         if (i % 16 == 0) printf("    ");
         printf("0x%02X", data[i]);
@@ -712,6 +1578,730 @@ static void output_frame_data(int frame_num, const uint8_t *data, size_t size) {
     printf("\n};\n\n");
 }
 
+/* Output palette for a palette + LZSS frame 0 */
+static void output_frame0_palette(const uint16_t *palette, int num_colors) {
+    printf("#define FRAME0_PALETTE_SIZE %d\n", num_colors);
+    printf("static const uint16_t frame0_palette[%d] = {\n", num_colors);
+    for (int i = 0; i < num_colors; i++) {
+        if (i % 12 == 0) printf("    ");
+        printf("0x%04X", palette[i]);
+        if (i < num_colors - 1) printf(",");
+        if ((i + 1) % 12 == 0) printf("\n");
+    }
+    printf("\n};\n\n");
+}
+
+/* Output per-frame dirty box table (nentries: C size expression of the table) */
+static void output_frame_dirty(const dirty_box_t *boxes, int nframes, const char *nentries) {
+    printf("/* Per-frame changed region {x0, y0, x1, y1} (half-open, frame coords) */\n");
+    printf("/* Delta RLE streams only cover rows y0..y1-1 of their frame */\n");
+    printf("#define FRAME_DIRTY_TABLE 1\n");
+    printf("static const uint16_t frame_dirty[%s][4] = {\n", nentries);
+    for (int f = 0; f < nframes; f++) {
+        printf("    {%d, %d, %d, %d},\n", boxes[f].x0, boxes[f].y0, boxes[f].x1, boxes[f].y1);
+    }
+    printf("};\n");
+}
+
+/* Report average dirty area of delta frames */
+static void report_dirty_boxes(const dirty_box_t *boxes, int nframes, int w, int h) {
+    if (nframes < 2) return;
+    double area = 0;
+    for (int f = 1; f < nframes; f++) {
+        area += (double)(boxes[f].x1 - boxes[f].x0) * (boxes[f].y1 - boxes[f].y0);
+    }
+    fprintf(stderr, "Dirty region: %.1f%% of frame on average\n",
+            100.0 * area / ((double)w * h * (nframes - 1)));
+}
+
+/* --- Frame pipeline (modes 0-2) --- */
+
+/* Collect and order the frame files of an animation directory */
+static frame_entry_t *collect_frames(const char *dir_path, int *count) {
+    DIR *dir = opendir(dir_path);
+    if (!dir) {
+        fprintf(stderr, "Error: Cannot open directory: %s\n", dir_path);
+        return NULL;
+    }
+    
+    int cap = 64;
+    frame_entry_t *frames = malloc(sizeof(frame_entry_t) * cap);
+    int nframes = 0;
+    struct dirent *ent;
+    
+    /* First pass: collect all frame filenames */
+    while ((ent = readdir(dir)) != NULL) {
+        if (strstr(ent->d_name, ".png") || strstr(ent->d_name, ".PNG") ||
+            strstr(ent->d_name, ".jpg") || strstr(ent->d_name, ".JPG") ||
+            strstr(ent->d_name, ".jpeg") || strstr(ent->d_name, ".JPEG")) {
+            if (nframes == cap) {
+                cap *= 2;
+                frames = realloc(frames, sizeof(frame_entry_t) * cap);
+            }
+            frames[nframes].path = malloc(512);
+            snprintf(frames[nframes].path, 512, "%s/%s", dir_path, ent->d_name);
+            frames[nframes].index = -1;  /* Will be set after sorting */
+            nframes++;
+        }
+    }
+    closedir(dir);
+    
+    if (nframes == 0) {
+        fprintf(stderr, "Error: No frames found\n");
+        free(frames);
+        return NULL;
+    }
+    
+    /* Sort by filename first to ensure consistent reference frame */
+    qsort(frames, nframes, sizeof(frame_entry_t), compare_frames);
+    
+    /* Second pass: extract frame indices using sorted first frame as reference */
+    const char *reference_name = NULL;
+    for (int i = 0; i < nframes; i++) {
+        const char *filename = strrchr(frames[i].path, '/');
+        filename = filename ? filename + 1 : frames[i].path;
+        
+        if (i == 0) {
+            /* First frame: extract initial number */
+            frames[i].index = extract_frame_index_smart(filename, NULL);
+            reference_name = filename;
+        } else {
+            /* Subsequent frames: compare with first frame to find varying number */
+            frames[i].index = extract_frame_index_smart(filename, reference_name);
+        }
+        
+        if (frames[i].index < 0) {
+            fprintf(stderr, "Warning: Could not extract index from %s, using position %d\n", filename, i);
+            frames[i].index = i;
+        }
+    }
+    
+    /* Re-sort by extracted index */
+    qsort(frames, nframes, sizeof(frame_entry_t), compare_frames);
+    
+    *count = nframes;
+    return frames;
+}
+
+typedef struct {
+    const frame_entry_t *frames;
+    image_t *imgs;
+    int *failed;
+} load_job_t;
+
+static void load_frame(int i, void *ctx) {
+    load_job_t *job = ctx;
+    job->failed[i] = load_frame_png(job->frames[i].path, &job->imgs[i]) != 0;
+}
+
+/* Decode and flatten n frames (animation index first..) in parallel into imgs; */
+/* each must be w x h. On failure nothing is left allocated. */
+static int load_frames(const frame_entry_t *frames, int n, image_t *imgs, int w, int h, int first) {
+    int *failed = calloc(n, sizeof(int));
+    load_job_t job = { frames, imgs, failed };
+    
+    memset(imgs, 0, sizeof(image_t) * n);
+    parallel_for(n, load_frame, &job);
+    
+    int ok = 1;
+    for (int i = 0; i < n && ok; i++) {
+        if (failed[i]) {
+            fprintf(stderr, "Error: Failed to load frame %d\n", first + i);
+            ok = 0;
+        } else if (imgs[i].w != w || imgs[i].h != h) {
+            fprintf(stderr, "Error: Frame %d is %dx%d, expected %dx%d\n",
+                    first + i, imgs[i].w, imgs[i].h, w, h);
+            ok = 0;
+        }
+    }
+    free(failed);
+    
+    if (!ok) {
+        for (int i = 0; i < n; i++) free(imgs[i].pixels);
+        return -1;
+    }
+    return 0;
+}
+
+/* --- Theme container (-A, see splash_asset.h) --- */
+
+/* Written as the header would be printed: blobs are appended as they are */
+/* produced, the index and the final header once everything is known */
+static struct {
+    FILE *fp;
+    xbs_header_t hdr;
+    size_t pos;
+    int nslots, cap;
+    uint32_t *offsets;
+    uint32_t *sizes;
+    uint16_t (*dirty)[4];
+} asset;
+
+static inline size_t asset_align(size_t pos) {
+    return (pos + 3) & ~(size_t)3;
+}
+
+/* Create the container with a placeholder header */
+static int asset_open(const char *path) {
+    asset.fp = fopen(path, "wb");
+    if (!asset.fp) {
+        fprintf(stderr, "Error: cannot write %s\n", path);
+        return -1;
+    }
+    fwrite(&asset.hdr, sizeof(asset.hdr), 1, asset.fp);
+    asset.pos = sizeof(asset.hdr);
+    return 0;
+}
+
+/* Append a blob at the next 4-byte boundary; returns its offset */
+static uint32_t asset_put(const void *data, size_t size) {
+    static const uint8_t pad[3];
+    size_t off = asset_align(asset.pos);
+    fwrite(pad, 1, off - asset.pos, asset.fp);
+    fwrite(data, 1, size, asset.fp);
+    asset.pos = off + size;
+    return off;
+}
+
+/* Append the next stream (frame 0, deltas, closing delta) with its dirty box */
+static void asset_add_stream(const uint8_t *data, size_t size, const dirty_box_t *box) {
+    if (asset.nslots == asset.cap) {
+        asset.cap = asset.cap ? asset.cap * 2 : 64;
+        asset.offsets = realloc(asset.offsets, sizeof(uint32_t) * asset.cap);
+        asset.sizes = realloc(asset.sizes, sizeof(uint32_t) * asset.cap);
+        asset.dirty = realloc(asset.dirty, sizeof(*asset.dirty) * asset.cap);
+    }
+    int d = asset.nslots++;
+    asset.offsets[d] = asset_put(data, size);
+    asset.sizes[d] = size;
+    asset.dirty[d][0] = box->x0;
+    asset.dirty[d][1] = box->y0;
+    asset.dirty[d][2] = box->x1;
+    asset.dirty[d][3] = box->y1;
+}
+
+/* Append the index and rewrite the header over the placeholder */
+static int asset_close(const char *path) {
+    xbs_header_t *h = &asset.hdr;
+    int n = asset.nslots;
+    
+    h->index_offset = asset_put(asset.offsets, sizeof(uint32_t) * n);
+    asset_put(asset.sizes, sizeof(uint32_t) * n);
+    asset_put(asset.dirty, sizeof(*asset.dirty) * n);
+    h->file_size = asset.pos;
+    
+    int ok = 1;
+    if (asset.pos > UINT32_MAX) {
+        fprintf(stderr, "Error: theme too large for a container (%zu bytes)\n", asset.pos);
+        ok = 0;
+    } else if (fseek(asset.fp, 0, SEEK_SET) != 0 || fwrite(h, sizeof(*h), 1, asset.fp) != 1 ||
+               ferror(asset.fp)) {
+        ok = 0;
+    }
+    if (fclose(asset.fp) != 0) ok = 0;
+    if (ok) {
+        fprintf(stderr, "Asset: %s, %zu bytes (%d streams)\n", path, asset.pos, n);
+    } else {
+        fprintf(stderr, "Error: cannot write %s\n", path);
+        remove(path);
+    }
+    
+    free(asset.offsets);
+    free(asset.sizes);
+    free(asset.dirty);
+    return ok ? 0 : -1;
+}
+
+/* Delta methods tried by -z auto, in report order */
+#define AUTO_METHODS 4
+static const int auto_methods[AUTO_METHODS] = {COMPRESS_RLE_XOR, COMPRESS_SPARSE, COMPRESS_RLE_DIRECT, COMPRESS_TILE};
+static const char *auto_method_names[AUTO_METHODS] = {"RLE_XOR", "SPARSE", "RLE_DIRECT", "TILE"};
+
+/* Delta d turns frame d-1 into frame d % nframes: d == nframes is the closing */
+/* delta from the last frame back to frame 0 for looping animations. Deltas are */
+/* processed a window at a time; curr/prev/compressed are indexed by window */
+/* slot, everything else by delta. */
+typedef struct {
+    int nframes;
+    int w, h;
+    int first;                /* Delta of window slot 0 */
+    const uint16_t **curr, **prev;
+    dirty_box_t *boxes;
+    size_t (*auto_sizes)[AUTO_METHODS];  /* Per-delta size for each auto method, NULL if not auto */
+    int method;
+    int *frame_methods;       /* COMPRESS_PER_FRAME: method chosen for each delta */
+    uint8_t **compressed;
+    size_t *comp_sizes;
+    uint8_t **alpha_compressed;  /* -a: alpha stream of each window slot */
+    size_t *alpha_sizes;      /* -a: per delta, NULL without alpha */
+    size_t frame0_size;       /* Frame 0 streams + palette: the closing delta must beat it */
+    int loop_kept;
+    size_t total_size;
+    size_t changed, snapped;  /* -t: differing pixels, and those within tolerance */
+} delta_job_t;
+
+/* Dirty box of window slot i and, for auto, its size under each candidate method */
+static void analyze_frame(int i, void *ctx) {
+    delta_job_t *job = ctx;
+    int d = job->first + i;
+    const uint16_t *curr = job->curr[i];
+    const uint16_t *prev = job->prev[i];
+    
+    job->boxes[d] = compute_dirty_box(curr, prev, job->w, job->h);
+    if (!job->auto_sizes) return;
+    
+    uint8_t *test_buf = malloc(job->w * job->h * 6);
+    for (int m = 0; m < AUTO_METHODS; m++) {
+        /* Sparse can't index past 65535 pixels; 0 marks the method unusable */
+        if (auto_methods[m] == COMPRESS_SPARSE && job->w * job->h > 65535) {
+            job->auto_sizes[d][m] = 0;
+            continue;
+        }
+        job->auto_sizes[d][m] = compress_delta_frame(auto_methods[m], curr, prev, job->w, job->h,
+                                                     &job->boxes[d], test_buf);
+    }
+    free(test_buf);
+}
+
+/* Compress window slot i with the selected method, keeping an exact-size copy */
+static void compress_frame(int i, void *ctx) {
+    delta_job_t *job = ctx;
+    int d = job->first + i;
+    const uint16_t *curr = job->curr[i];
+    const uint16_t *prev = job->prev[i];
+    uint8_t *buf = malloc(job->w * job->h * 6);
+    size_t size;
+    
+    if (job->method == COMPRESS_PER_FRAME) {
+        int method = job->frame_methods[d];
+        buf[0] = method;
+        size = 1 + compress_delta_frame(method, curr, prev, job->w, job->h, &job->boxes[d], buf + 1);
+    } else {
+        size = compress_delta_frame(job->method, curr, prev, job->w, job->h, &job->boxes[d], buf);
+    }
+    
+    job->compressed[i] = realloc(buf, size ? size : 1);
+    job->comp_sizes[d] = size;
+    
+    /* Alpha deltas cover the same rows as the colour stream */
+    if (job->alpha_sizes) {
+        int start = job->boxes[d].y0 * job->w;
+        int count = (job->boxes[d].y1 - job->boxes[d].y0) * job->w;
+        uint8_t *abuf = malloc(count + count / 2 + 2);
+        size = compress_alpha_xor(alpha_plane(curr, job->w, job->h) + start,
+                                  alpha_plane(prev, job->w, job->h) + start, count, abuf);
+        job->alpha_compressed[i] = realloc(abuf, size);
+        job->alpha_sizes[d] = size;
+    }
+}
+
+/* Fixed method: the dirty box is only needed just before compressing */
+static void analyze_compress_frame(int i, void *ctx) {
+    analyze_frame(i, ctx);
+    compress_frame(i, ctx);
+}
+
+/* Print (and store) the stream of window slot i, in delta order */
+static void emit_frame(delta_job_t *job, int i) {
+    int d = job->first + i;
+    uint8_t *data = job->compressed[i];
+    uint8_t *alpha = job->alpha_sizes ? job->alpha_compressed[i] : NULL;
+    size_t size = job->comp_sizes[d];
+    size_t alpha_size = alpha ? job->alpha_sizes[d] : 0;
+    char name[32];
+    
+    if (d == job->nframes) {
+        /* The closing delta only pays off when it beats reloading frame 0 */
+        job->loop_kept = size + alpha_size < job->frame0_size;
+        if (!job->loop_kept) {
+            free(data);
+            free(alpha);
+            return;
+        }
+        snprintf(name, sizeof(name), "frame_loop");
+    } else {
+        snprintf(name, sizeof(name), "frame_%d", d);
+    }
+    output_frame_data(name, data, size);
+    if (asset_path) asset_add_stream(data, size, &job->boxes[d]);
+    job->total_size += size;
+    free(data);
+    
+    if (alpha) {
+        if (d == job->nframes) {
+            snprintf(name, sizeof(name), "alpha_loop");
+        } else {
+            snprintf(name, sizeof(name), "alpha_%d", d);
+        }
+        output_frame_data(name, alpha, alpha_size);
+        job->total_size += alpha_size;
+        free(alpha);
+    }
+}
+
+/* Lossy near-duplicates (-t): pixels of curr within tolerance of prev take */
+/* prev's exact value, so they drop out of the delta. prev is the frame the */
+/* runtime will really show (itself already snapped), so a pixel never drifts */
+/* more than the tolerance from its source. One 565 step is 8 levels of red or */
+/* blue and 4 of green. */
+static void snap_near_duplicates(uint16_t *curr, const uint16_t *prev, int pixels, int tol,
+                                 size_t *changed, size_t *snapped) {
+    for (int i = 0; i < pixels; i++) {
+        uint16_t c = curr[i], p = prev[i];
+        if (c == p) continue;
+        (*changed)++;
+        int dr = abs((c >> 11) - (p >> 11)) * 8;
+        int dg = abs(((c >> 5) & 0x3F) - ((p >> 5) & 0x3F)) * 4;
+        int db = abs((c & 0x1F) - (p & 0x1F)) * 8;
+        if (dr <= tol && dg <= tol && db <= tol) {
+            curr[i] = p;
+            (*snapped)++;
+        }
+    }
+}
+
+/* Run fn over deltas 1..nslots-1, a window of frames at a time, so only the */
+/* window, the frame before it and frame 0 are ever decoded at once. With emit, */
+/* each window's streams are handed over in order before the next is loaded. */
+static int run_deltas(const frame_entry_t *entries, const image_t *frame0, int nslots,
+                      delta_job_t *job, parallel_fn_t fn, int emit) {
+    /* Enough frames per window to keep every worker busy */
+    int win = 2 * pool_threads();
+    image_t *imgs = malloc(sizeof(image_t) * win);
+    const uint16_t *prev = frame0->pixels;
+    uint16_t *prev_owned = NULL;
+    int ret = 0;
+    
+    job->changed = job->snapped = 0;
+    for (int first = 1; first < nslots; first += win) {
+        int k = nslots - first < win ? nslots - first : win;
+        int nload = job->nframes - first < k ? job->nframes - first : k;  /* Closing delta reuses frame 0 */
+        if (nload > 0 && load_frames(entries + first, nload, imgs, frame0->w, frame0->h, first) != 0) {
+            ret = -1;
+            break;
+        }
+        
+        for (int i = 0; i < k; i++) {
+            job->curr[i] = i < nload ? imgs[i].pixels : frame0->pixels;
+            job->prev[i] = i == 0 ? prev : imgs[i-1].pixels;
+            /* In order: each frame snaps against its predecessor's snapped pixels */
+            if (near_dup_tolerance > 0 && i < nload) {
+                snap_near_duplicates(imgs[i].pixels, job->prev[i], job->w * job->h, near_dup_tolerance,
+                                     &job->changed, &job->snapped);
+            }
+        }
+        job->first = first;
+        parallel_for(k, fn, job);
+        if (emit) {
+            for (int i = 0; i < k; i++) emit_frame(job, i);
+        }
+        
+        /* The last frame of this window is the predecessor of the next */
+        if (nload > 0) {
+            free(prev_owned);
+            for (int i = 0; i < nload - 1; i++) free(imgs[i].pixels);
+            prev = prev_owned = imgs[nload-1].pixels;
+        }
+    }
+    
+    free(prev_owned);
+    free(imgs);
+    return ret;
+}
+
+static void free_delta_job(delta_job_t *job) {
+    free(job->curr);
+    free(job->prev);
+    free(job->auto_sizes);
+    free(job->compressed);
+    free(job->comp_sizes);
+    free(job->alpha_compressed);
+    free(job->alpha_sizes);
+    free(job->boxes);
+    free(job->frame_methods);
+}
+
+/* Frame 0 has no predecessor: keep the smallest of raw, RLE Direct and, when it */
+/* has at most 256 colours, palette + LZSS. Returns the FRAME0_METHOD id. */
+static int compress_frame_0(const image_t *img, uint8_t **out, size_t *size,
+                            uint16_t *palette, int *num_colors) {
+    int pixels = img->w * img->h;
+    uint8_t *buf = malloc(pixels * 3);
+    int method = COMPRESS_RAW;
+    *size = compress_raw_direct(img->pixels, pixels, buf);
+    *num_colors = 0;
+    
+    uint8_t *rle = malloc(pixels * 3);
+    size_t rle_size = compress_rle_direct(img->pixels, pixels, rle);
+    if (rle_size < *size) {
+        free(buf);
+        buf = rle;
+        *size = rle_size;
+        method = COMPRESS_RLE_DIRECT;
+    } else {
+        free(rle);
+    }
+    
+    /* Count distinct colours first: build_palette is lossy past 256 */
+    uint8_t *seen = calloc(65536, 1);
+    int distinct = 0;
+    for (int i = 0; i < pixels && distinct <= 256; i++) {
+        if (!seen[img->pixels[i]]) {
+            seen[img->pixels[i]] = 1;
+            distinct++;
+        }
+    }
+    free(seen);
+    
+    if (distinct <= 256) {
+        uint8_t *indices = malloc(pixels);
+        uint8_t *lz = malloc(pixels * 2);
+        int n = build_palette(img, palette, indices);
+        size_t lz_size = compress_lzss(indices, pixels, lz);
+        if (lz_size + n * 2 < *size) {
+            free(buf);
+            buf = lz;
+            *size = lz_size;
+            *num_colors = n;
+            method = COMPRESS_PALETTE_LZSS;
+        } else {
+            free(lz);
+        }
+        free(indices);
+    }
+    
+    *out = buf;
+    return method;
+}
+
+/* Select the delta method, then compress and emit the frames window by window. */
+/* -z auto sizes every method on a first pass, so it decodes the frames twice. */
+static int output_animation(const frame_entry_t *entries, int nframes, const image_t *frame0) {
+    int frame_w = frame0->w;
+    int frame_h = frame0->h;
+    int pixels = frame_w * frame_h;
+    int win = 2 * pool_threads();
+    
+    /* Looping animations get a candidate closing delta at index nframes */
+    int loop_delta = loop && nframes > 1;
+    int nslots = nframes + loop_delta;
+    
+    delta_job_t job = {
+        .nframes = nframes, .w = frame_w, .h = frame_h,
+        .curr = malloc(sizeof(uint16_t *) * win),
+        .prev = malloc(sizeof(uint16_t *) * win),
+        .boxes = malloc(sizeof(dirty_box_t) * nslots),
+        .auto_sizes = compress_method == COMPRESS_AUTO ? calloc(nslots, sizeof(size_t[AUTO_METHODS])) : NULL,
+        .compressed = malloc(sizeof(uint8_t *) * win),
+        .comp_sizes = malloc(sizeof(size_t) * nslots),
+        .alpha_compressed = frame_alpha ? malloc(sizeof(uint8_t *) * win) : NULL,
+        .alpha_sizes = frame_alpha ? malloc(sizeof(size_t) * nslots) : NULL,
+    };
+    
+    /* Frame 0 */
+    uint16_t frame0_palette[256];
+    int frame0_colors;
+    uint8_t *frame0_data;
+    int frame0_method = compress_frame_0(frame0, &frame0_data, &job.comp_sizes[0],
+                                         frame0_palette, &frame0_colors);
+    job.frame0_size = job.comp_sizes[0] + frame0_colors * 2;
+    fprintf(stderr, "Frame 0: %s, %zu bytes (%.1f%% of raw)\n",
+            frame0_method == COMPRESS_PALETTE_LZSS ? "PALETTE_LZSS" :
+            frame0_method == COMPRESS_RLE_DIRECT ? "RLE_DIRECT" : "RAW",
+            job.frame0_size, 100.0 * job.frame0_size / (pixels * 2));
+    
+    /* Frame 0 alpha: a delta against a fully transparent plane */
+    uint8_t *alpha0_data = NULL;
+    if (frame_alpha) {
+        uint8_t *clear = calloc(pixels, 1);
+        alpha0_data = malloc(pixels + pixels / 2 + 2);
+        job.alpha_sizes[0] = compress_alpha_xor(alpha_plane(frame0->pixels, frame_w, frame_h), clear,
+                                                pixels, alpha0_data);
+        job.frame0_size += job.alpha_sizes[0];
+        free(clear);
+        fprintf(stderr, "Frame 0 alpha: %zu bytes\n", job.alpha_sizes[0]);
+    }
+    
+    /* Changed region of each frame vs. previous; frame 0 is full */
+    job.boxes[0] = (dirty_box_t){0, 0, frame_w, frame_h};
+    
+    /* Auto compression: pick the method with the smallest total */
+    int tile_ref;
+    if (job.auto_sizes) {
+        if (run_deltas(entries, frame0, nslots, &job, analyze_frame, 0) != 0) {
+            free(frame0_data);
+            free(alpha0_data);
+            free_delta_job(&job);
+            return -1;
+        }
+        report_dirty_boxes(job.boxes, nframes, frame_w, frame_h);
+        fprintf(stderr, "Testing best compression method...\n\n");
+        
+        size_t best_size = SIZE_MAX;
+        int best = 0;
+        
+        for (int m = 0; m < AUTO_METHODS; m++) {
+            size_t total = job.frame0_size;
+            int method_valid = 1;
+            
+            for (int d = 1; d < nslots; d++) {
+                if (job.auto_sizes[d][m] == 0) {
+                    method_valid = 0;
+                    break;
+                }
+                total += job.auto_sizes[d][m];
+            }
+            
+            if (!method_valid) {
+                fprintf(stderr, "  %d/%d: method %-12s ...... SKIPPED (frame too large for 16-bit indices)\n",
+                        m + 1, AUTO_METHODS, auto_method_names[m]);
+                continue;
+            }
+            fprintf(stderr, "  %d/%d: method %-12s ...... %zu bytes (%.1f KB)\n",
+                    m + 1, AUTO_METHODS, auto_method_names[m], total, total / 1024.0);
+            
+            if (total < best_size) {
+                best_size = total;
+                best = m;
+            }
+        }
+        
+        /* Per frame: smallest usable method, plus one tag byte */
+        job.frame_methods = malloc(sizeof(int) * nslots);
+        int picks[AUTO_METHODS] = {0};
+        size_t tagged_size = job.frame0_size;
+        for (int d = 1; d < nslots; d++) {
+            int m_best = -1;
+            for (int m = 0; m < AUTO_METHODS; m++) {
+                if (job.auto_sizes[d][m] == 0) continue;
+                if (m_best < 0 || job.auto_sizes[d][m] < job.auto_sizes[d][m_best]) m_best = m;
+            }
+            job.frame_methods[d] = auto_methods[m_best];
+            tagged_size += 1 + job.auto_sizes[d][m_best];
+            picks[m_best]++;
+        }
+        
+        /* Only worth a tag byte per frame when frames actually disagree */
+        int used = 0;
+        for (int m = 0; m < AUTO_METHODS; m++) used += picks[m] > 0;
+        int mixed = used > 1;
+        if (mixed) {
+            fprintf(stderr, "  mix: method %-12s ...... %zu bytes (%.1f KB; %d RLE_XOR, %d SPARSE, %d RLE_DIRECT, %d TILE)\n",
+                    "PER_FRAME", tagged_size, tagged_size / 1024.0, picks[0], picks[1], picks[2], picks[3]);
+        }
+        
+        if (mixed && tagged_size < best_size) {
+            fprintf(stderr, "\n  ---> Best method: PER_FRAME (%zu bytes)\n\n", tagged_size);
+            compress_method = COMPRESS_PER_FRAME;
+            printf("#define COMPRESS_METHOD %d  /* Auto-selected: PER_FRAME (tag byte per delta frame) */\n",
+                   compress_method);
+        } else {
+            fprintf(stderr, "\n  ---> Best method: %s (%zu bytes)\n\n", auto_method_names[best], best_size);
+            compress_method = auto_methods[best];
+            printf("#define COMPRESS_METHOD %d  /* Auto-selected: %s */\n",
+                   compress_method, auto_method_names[best]);
+        }
+        
+        /* Tile copies read the previous frame: the runtime keeps a reference copy */
+        tile_ref = compress_method == COMPRESS_TILE || (compress_method == COMPRESS_PER_FRAME && picks[3] > 0);
+    } else {
+        printf("#define COMPRESS_METHOD %d  /* 0=RLE_XOR, 1=RLE_DIRECT, 2=SPARSE, 3=RAW, 7=TILE */\n", compress_method);
+        tile_ref = compress_method == COMPRESS_TILE;
+    }
+    if (tile_ref) {
+        printf("#define TILE_REF 1\n");
+        asset.hdr.flags |= XBS_TILE_REF;
+    }
+    
+    printf("#define FRAME0_METHOD %d  /* 1=RLE_DIRECT, 3=RAW, 5=PALETTE_LZSS */\n", frame0_method);
+    printf("\n");
+    asset.hdr.frame0_method = frame0_method;
+    if (frame0_method == COMPRESS_PALETTE_LZSS) {
+        output_frame0_palette(frame0_palette, frame0_colors);
+        asset.hdr.frame0_palette_size = frame0_colors;
+        if (asset_path) asset.hdr.frame0_palette_offset = asset_put(frame0_palette, frame0_colors * 2);
+    }
+    
+    output_frame_data("frame_0", frame0_data, job.comp_sizes[0]);
+    if (asset_path) asset_add_stream(frame0_data, job.comp_sizes[0], &job.boxes[0]);
+    if (alpha0_data) output_frame_data("alpha_0", alpha0_data, job.alpha_sizes[0]);
+    job.total_size = job.frame0_size;
+    
+    /* Compress and emit delta frames with the selected method; container */
+    /* streams always carry their codec tag */
+    job.method = compress_method;
+    if (asset_path && compress_method != COMPRESS_PER_FRAME) {
+        if (!job.frame_methods) job.frame_methods = malloc(sizeof(int) * nslots);
+        for (int d = 1; d < nslots; d++) job.frame_methods[d] = compress_method;
+        job.method = COMPRESS_PER_FRAME;
+    }
+    if (run_deltas(entries, frame0, nslots, &job,
+                   job.auto_sizes ? compress_frame : analyze_compress_frame, 1) != 0) {
+        free(frame0_data);
+        free(alpha0_data);
+        free_delta_job(&job);
+        return -1;
+    }
+    if (!job.auto_sizes) report_dirty_boxes(job.boxes, nframes, frame_w, frame_h);
+    if (near_dup_tolerance > 0) {
+        fprintf(stderr, "Near-duplicates: %zu of %zu changed pixels kept from the previous frame (%.1f%%, tolerance %d)\n",
+                job.snapped, job.changed, job.changed ? 100.0 * job.snapped / job.changed : 0.0,
+                near_dup_tolerance);
+    }
+    
+    if (loop_delta && !job.loop_kept) {
+        loop_delta = 0;
+        nslots = nframes;
+    }
+    const char *nentries = "NFRAMES";
+    if (loop_delta) {
+        asset.hdr.flags |= XBS_LOOP_DELTA;
+        printf("#define LOOP_DELTA 1  /* frames[NFRAMES]: last frame back to frame 0 */\n\n");
+        fprintf(stderr, "Loop: closing delta %zu bytes instead of reloading frame 0\n", job.comp_sizes[nframes]);
+        nentries = "NFRAMES + 1";
+    }
+    
+    /* Frame array */
+    printf("static const uint8_t* const frames[%s] = {\n", nentries);
+    for (int f = 0; f < nframes; f++) {
+        printf("    frame_%d,\n", f);
+    }
+    if (loop_delta) printf("    frame_loop,\n");
+    printf("};\n\n");
+    
+    printf("static const uint32_t frame_sizes[%s] = {\n", nentries);
+    for (int d = 0; d < nslots; d++) {
+        printf("    %zu,\n", job.comp_sizes[d]);
+    }
+    printf("};\n\n");
+    
+    if (frame_alpha) {
+        printf("/* 4-bit alpha deltas (same rows as the frame streams); colours are premultiplied */\n");
+        printf("#define FRAME_ALPHA 1\n");
+        printf("static const uint8_t* const alphas[%s] = {\n", nentries);
+        for (int f = 0; f < nframes; f++) {
+            printf("    alpha_%d,\n", f);
+        }
+        if (loop_delta) printf("    alpha_loop,\n");
+        printf("};\n\n");
+        
+        printf("static const uint32_t alpha_sizes[%s] = {\n", nentries);
+        for (int d = 0; d < nslots; d++) {
+            printf("    %zu,\n", job.alpha_sizes[d]);
+        }
+        printf("};\n\n");
+    }
+    
+    output_frame_dirty(job.boxes, nslots, nentries);
+    
+    fprintf(stderr, "Total compressed: %zu bytes (%.1f KB)\n", job.total_size, job.total_size / 1024.0);
+    
+    free(frame0_data);
+    free(alpha0_data);
+    free_delta_job(&job);
+    return 0;
+}
+
 static void print_help(const char *prog) {
     fprintf(stderr, "Usage: %s [options] <input>\n", prog);
     fprintf(stderr, "\nDisplay modes:\n");
@@ -728,8 +2318,19 @@ static void print_help(const char *prog) {
     fprintf(stderr, "  -l <0|1>       Loop animation: 1=loop (default), 0=stay on last frame\n");
     fprintf(stderr, "  -c <color>     Background color RRGGBB hex (default: 000000)\n");
     fprintf(stderr, "  -b <image>     Background image for modes 1,2\n");
-    fprintf(stderr, "  -r <W>x<H>     Target resolution for fullscreen modes\n");
-    fprintf(stderr, "  -z <method>    Compression: rle_xor, rle_direct, sparse, raw, auto\n");
+    fprintf(stderr, "  -r <W>x<H>     Target resolution for fullscreen modes; mode 2 takes a list\n");
+    fprintf(stderr, "                 (-r 1920x1080,1366x768,...) and stores the background at each\n");
+    fprintf(stderr, "                 size, the runtime drawing the one closest to the screen\n");
+    fprintf(stderr, "  -z <method>    Compression: rle_xor, rle_direct, sparse, raw, tile, auto\n");
+    fprintf(stderr, "  -O <0|1>       LZSS level for images: 0=greedy (default), 1=optimal parse\n");
+    fprintf(stderr, "  -j <threads>   Worker threads for frame processing (default: one per CPU)\n");
+    fprintf(stderr, "  -D <0|1>       Dither images with more than 256 colours: 0=off (default), 1=Floyd-Steinberg\n");
+    fprintf(stderr, "  -F <filter>    Resize filter for -r: bilinear (default), area, lanczos\n");
+    fprintf(stderr, "  -t <levels>    Lossy: pixels within <levels> (0-255 per channel) of the previous\n");
+    fprintf(stderr, "                 frame count as unchanged (default: 0 = lossless)\n");
+    fprintf(stderr, "  -a <0|1>       Modes 1,2: 1=keep frame transparency (4-bit alpha) and blend over the\n");
+    fprintf(stderr, "                 background at runtime, 0=flatten onto -c (default)\n");
+    fprintf(stderr, "  -A <file>      Write a theme container for ASSET_PATH runtimes instead of the header\n");
     fprintf(stderr, "  -h             Show help\n");
 }
 
@@ -761,7 +2362,24 @@ int main(int argc, char *argv[]) {
             bg_image_path = argv[++arg_idx];
             arg_idx++;
         } else if (strcmp(argv[arg_idx], "-r") == 0 && arg_idx + 1 < argc) {
-            sscanf(argv[++arg_idx], "%dx%d", &target_w, &target_h);
+            /* First size, then any extra ones after commas */
+            const char *res = argv[++arg_idx];
+            sscanf(res, "%dx%d", &target_w, &target_h);
+            n_extra = 0;
+            while ((res = strchr(res, ',')) != NULL) {
+                res++;
+                int w = 0, h = 0;
+                if (sscanf(res, "%dx%d", &w, &h) != 2 || w <= 0 || h <= 0) {
+                    fprintf(stderr, "Warning: Ignoring resolution '%s'\n", res);
+                } else if (n_extra == MAX_BG_VARIANTS - 1) {
+                    fprintf(stderr, "Warning: At most %d resolutions, ignoring '%s'\n", MAX_BG_VARIANTS, res);
+                    break;
+                } else {
+                    extra_w[n_extra] = w;
+                    extra_h[n_extra] = h;
+                    n_extra++;
+                }
+            }
             arg_idx++;
         } else if (strcmp(argv[arg_idx], "-z") == 0 && arg_idx + 1 < argc) {
             const char *method = argv[++arg_idx];
@@ -769,9 +2387,37 @@ int main(int argc, char *argv[]) {
             else if (strcmp(method, "rle_direct") == 0) compress_method = COMPRESS_RLE_DIRECT;
             else if (strcmp(method, "sparse") == 0) compress_method = COMPRESS_SPARSE;
             else if (strcmp(method, "raw") == 0) compress_method = COMPRESS_RAW;
+            else if (strcmp(method, "tile") == 0) compress_method = COMPRESS_TILE;
             else if (strcmp(method, "auto") == 0) compress_method = COMPRESS_AUTO;
             else fprintf(stderr, "Warning: Unknown compression method '%s', using default\n", method);
             arg_idx++;
+        } else if (strcmp(argv[arg_idx], "-O") == 0 && arg_idx + 1 < argc) {
+            lzss_level = atoi(argv[++arg_idx]);
+            arg_idx++;
+        } else if (strcmp(argv[arg_idx], "-j") == 0 && arg_idx + 1 < argc) {
+            num_threads = atoi(argv[++arg_idx]);
+            arg_idx++;
+        } else if (strcmp(argv[arg_idx], "-D") == 0 && arg_idx + 1 < argc) {
+            palette_dither = atoi(argv[++arg_idx]) != 0;
+            arg_idx++;
+        } else if (strcmp(argv[arg_idx], "-F") == 0 && arg_idx + 1 < argc) {
+            const char *f = argv[++arg_idx];
+            if (strcmp(f, "bilinear") == 0) resize_filter = FILTER_BILINEAR;
+            else if (strcmp(f, "area") == 0) resize_filter = FILTER_AREA;
+            else if (strcmp(f, "lanczos") == 0) resize_filter = FILTER_LANCZOS;
+            else fprintf(stderr, "Warning: Unknown resize filter '%s', using bilinear\n", f);
+            arg_idx++;
+        } else if (strcmp(argv[arg_idx], "-t") == 0 && arg_idx + 1 < argc) {
+            near_dup_tolerance = atoi(argv[++arg_idx]);
+            if (near_dup_tolerance < 0) near_dup_tolerance = 0;
+            if (near_dup_tolerance > 255) near_dup_tolerance = 255;
+            arg_idx++;
+        } else if (strcmp(argv[arg_idx], "-a") == 0 && arg_idx + 1 < argc) {
+            frame_alpha = atoi(argv[++arg_idx]) != 0;
+            arg_idx++;
+        } else if (strcmp(argv[arg_idx], "-A") == 0 && arg_idx + 1 < argc) {
+            asset_path = argv[++arg_idx];
+            arg_idx++;
         } else if (strcmp(argv[arg_idx], "-h") == 0) {
             print_help(argv[0]);
             return 0;
@@ -802,6 +2448,30 @@ int main(int argc, char *argv[]) {
     fprintf(stderr, "Offsets: X=%d, Y=%d\n", offset_x, offset_y);
     fprintf(stderr, "Background color: #%06X\n", bg_color);
     
+    /* Alpha only pays off over a background image; theme containers have no */
+    /* alpha streams */
+    if (frame_alpha && display_mode != MODE_ANIM_IMAGE_CENTER && display_mode != MODE_ANIM_IMAGE_FULL) {
+        fprintf(stderr, "Warning: -a only applies to modes 1 and 2, flattening frames\n");
+        frame_alpha = 0;
+    }
+    if (n_extra > 0 && (display_mode != MODE_ANIM_IMAGE_FULL || target_w <= 0 || target_h <= 0)) {
+        fprintf(stderr, "Warning: several -r resolutions only apply to mode 2, using the first\n");
+        n_extra = 0;
+    }
+    if (frame_alpha && asset_path) {
+        fprintf(stderr, "Warning: theme containers do not carry alpha, flattening frames\n");
+        frame_alpha = 0;
+    }
+    
+    /* The container replaces the header: header output is discarded */
+    if (asset_path && !freopen("/dev/null", "w", stdout)) {
+        fprintf(stderr, "Error: cannot discard header output\n");
+        return 1;
+    }
+    if (asset_path && asset_open(asset_path) != 0) {
+        return 1;
+    }
+    
     /* Output header preamble */
     printf("/* Auto-generated splash data - DO NOT EDIT */\n");
     printf("/* Mode: %s */\n\n", mode_names[display_mode]);
@@ -816,53 +2486,42 @@ int main(int argc, char *argv[]) {
     if (display_mode == MODE_ANIM_SOLID || display_mode == MODE_ANIM_IMAGE_CENTER || display_mode == MODE_ANIM_IMAGE_FULL) {
         printf("#define FRAME_DURATION_MS %d\n", frame_delay_ms);
         printf("#define LOOP %d  /* 1=loop, 0=stay on last frame */\n", loop);
+        if (loop) asset.hdr.flags |= XBS_LOOP;
     }
     
+    asset.hdr.magic = XBS_MAGIC;
+    asset.hdr.version = XBS_VERSION;
+    asset.hdr.display_mode = display_mode;
+    asset.hdr.frame_ms = frame_delay_ms;
+    asset.hdr.x_offset = offset_x;
+    asset.hdr.y_offset = offset_y;
+    asset.hdr.bg_color = rgb_to_rgb565((bg_color >> 16) & 0xFF, (bg_color >> 8) & 0xFF, bg_color & 0xFF);
+    
     /* Handle different modes */
     if (display_mode == MODE_STATIC_CENTER || display_mode == MODE_STATIC_FULLSCREEN) {
-        /* Single static image - convert to standard format first */
-        char tmp_path[512];
-        char cmd[1024];
-        char escaped_path[512];
-        char escaped_tmp[512];
-        char bg_color_str[16];
-        
-        snprintf(bg_color_str, sizeof(bg_color_str), "#%06X", bg_color);
-        snprintf(tmp_path, sizeof(tmp_path), "/tmp/splash_static_%d.png", getpid());
-        
-        shell_escape(escaped_path, sizeof(escaped_path), input_path);
-        shell_escape(escaped_tmp, sizeof(escaped_tmp), tmp_path);
-        
-        /* Convert to RGB, flatten alpha - handles colormap and transparent PNGs */
-        snprintf(cmd, sizeof(cmd),
-                 "convert \"%s\" -background \"%s\" -flatten -type TrueColor -depth 8 PNG24:\"%s\" 2>/dev/null",
-                 escaped_path, bg_color_str, escaped_tmp);
-        if (system(cmd) != 0) {
-            /* Fallback: try without flatten */
-            snprintf(cmd, sizeof(cmd), "cp \"%s\" \"%s\"", escaped_path, escaped_tmp);
-            system(cmd);
-        }
-        
-        image_t img;
-        if (load_png(tmp_path, &img) != 0) {
+        /* Single static image; transparency is flattened onto bg_color, and it */
+        /* is only reduced to RGB565 after any resize */
+        rgbx_image_t src;
+        if (load_png_rgbx(input_path, &src, 0) != 0) {
             fprintf(stderr, "Error: Failed to load image: %s\n", input_path);
-            unlink(tmp_path);
             return 1;
         }
         
-        /* Clean up temp file */
-        unlink(tmp_path);
+        fprintf(stderr, "Image: %dx%d\n", src.w, src.h);
         
-        fprintf(stderr, "Image: %dx%d\n", img.w, img.h);
+        image_t img;
+        if (display_mode == MODE_STATIC_FULLSCREEN && target_w > 0 && target_h > 0 &&
+            (src.w != target_w || src.h != target_h)) {
+            fprintf(stderr, "Resizing to %dx%d...\n", target_w, target_h);
+            image_t *resized = resize_image(&src, target_w, target_h);
+            img = *resized;
+            free(resized);
+        } else {
+            rgbx_to_rgb565(&src, &img);
+        }
+        free(src.pixels);
         
         if (display_mode == MODE_STATIC_FULLSCREEN && target_w > 0 && target_h > 0) {
-            if (img.w != target_w || img.h != target_h) {
-                fprintf(stderr, "Resizing to %dx%d...\n", target_w, target_h);
-                image_t *resized = resize_image(&img, target_w, target_h);
-                free(img.pixels);
-                img = *resized;
-                free(resized);
-            }
             printf("#define FRAME_W %d\n", img.w);
             printf("#define FRAME_H %d\n", img.h);
         } else {
@@ -879,7 +2538,7 @@ int main(int argc, char *argv[]) {
         uint8_t *compressed = malloc(pixel_count * 2);  /* Worst case */
         
         /* Build palette from image */
-        int num_colors = build_palette(img.pixels, pixel_count, palette, indices);
+        int num_colors = build_palette(&img, palette, indices);
         fprintf(stderr, "Palette: %d unique colors\n", num_colors);
         
         /* Compress indices with LZSS */
@@ -891,6 +2550,18 @@ int main(int argc, char *argv[]) {
         printf("#define COMPRESS_METHOD %d  /* PALETTE_LZSS */\n", COMPRESS_PALETTE_LZSS);
         output_palette_lzss(palette, num_colors, compressed, comp_size, img.w, img.h);
         
+        /* Container: a one-frame animation that does not loop */
+        asset.hdr.frame_w = img.w;
+        asset.hdr.frame_h = img.h;
+        asset.hdr.nframes = 1;
+        asset.hdr.frame0_method = COMPRESS_PALETTE_LZSS;
+        asset.hdr.frame0_palette_size = num_colors;
+        if (asset_path) {
+            dirty_box_t full = {0, 0, img.w, img.h};
+            asset.hdr.frame0_palette_offset = asset_put(palette, num_colors * 2);
+            asset_add_stream(compressed, comp_size, &full);
+        }
+        
         free(palette);
         free(indices);
         free(compressed);
@@ -898,252 +2569,35 @@ int main(int argc, char *argv[]) {
         
     } else if (display_mode == MODE_ANIM_SOLID) {
         /* Animation on solid background */
-        DIR *dir = opendir(input_path);
-        if (!dir) {
-            fprintf(stderr, "Error: Cannot open directory: %s\n", input_path);
-            return 1;
-        }
-        
-        /* Collect frames */
-        frame_entry_t *frames = malloc(sizeof(frame_entry_t) * 256);
         int nframes = 0;
-        struct dirent *ent;
-        char tmpdir[256];
-        snprintf(tmpdir, sizeof(tmpdir), "/tmp/splash_frames_%d", getpid());
-        mkdir(tmpdir, 0755);
+        frame_entry_t *frames = collect_frames(input_path, &nframes);
+        if (!frames) return 1;
         
-        /* First pass: collect all frame filenames */
-        while ((ent = readdir(dir)) != NULL && nframes < 256) {
-            if (strstr(ent->d_name, ".png") || strstr(ent->d_name, ".PNG") ||
-                strstr(ent->d_name, ".jpg") || strstr(ent->d_name, ".JPG") ||
-                strstr(ent->d_name, ".jpeg") || strstr(ent->d_name, ".JPEG")) {
-                frames[nframes].path = malloc(512);
-                frames[nframes].tmp_path = malloc(512);
-                snprintf(frames[nframes].path, 512, "%s/%s", input_path, ent->d_name);
-                snprintf(frames[nframes].tmp_path, 512, "%s/%s", tmpdir, ent->d_name);
-                frames[nframes].index = -1;  /* Will be set after sorting */
-                nframes++;
-                if (nframes >= 256) {
-                    fprintf(stderr, "Warning: Frame limit reached (256 max). Additional frames will be ignored.\n");
-                }
-            }
-        }
-        closedir(dir);
-        
-        if (nframes == 0) {
-            fprintf(stderr, "Error: No frames found\n");
+        /* Only frame 0 stays loaded; the rest are decoded a window at a time */
+        image_t frame0;
+        if (load_frame_png(frames[0].path, &frame0) != 0) {
+            fprintf(stderr, "Error: Failed to load frame 0\n");
             return 1;
         }
         
-        if (nframes >= 256) {
-            fprintf(stderr, "Warning: Animation truncated to 256 frames. Consider splitting into multiple sequences.\n");
-        }
-        
-        /* Sort by filename first to ensure consistent reference frame */
-        qsort(frames, nframes, sizeof(frame_entry_t), compare_frames);
-        
-        /* Second pass: extract frame indices using sorted first frame as reference */
-        const char *reference_name = NULL;
-        for (int i = 0; i < nframes; i++) {
-            const char *filename = strrchr(frames[i].path, '/');
-            filename = filename ? filename + 1 : frames[i].path;
-            
-            if (i == 0) {
-                /* First frame: extract initial number */
-                frames[i].index = extract_frame_index_smart(filename, NULL);
-                reference_name = filename;
-            } else {
-                /* Subsequent frames: compare with first frame to find varying number */
-                frames[i].index = extract_frame_index_smart(filename, reference_name);
-            }
-            
-            if (frames[i].index < 0) {
-                fprintf(stderr, "Warning: Could not extract index from %s, using position %d\n", filename, i);
-                frames[i].index = i;
-            }
-        }
-        
-        /* Re-sort by extracted index */
-        qsort(frames, nframes, sizeof(frame_entry_t), compare_frames);
-        
-        /* Convert frames to standard format */
-        for (int i = 0; i < nframes; i++) {
-            char cmd[1024];
-            char escaped_path[512];
-            char escaped_tmp[512];
-            char bg_color_str[16];
-            snprintf(bg_color_str, sizeof(bg_color_str), "#%06X", bg_color);
-            shell_escape(escaped_path, sizeof(escaped_path), frames[i].path);
-            shell_escape(escaped_tmp, sizeof(escaped_tmp), frames[i].tmp_path);
-            snprintf(cmd, sizeof(cmd), 
-                     "convert \"%s\" -background \"%s\" -flatten -type TrueColor -depth 8 PNG24:\"%s\" 2>/dev/null",
-                     escaped_path, bg_color_str, escaped_tmp);
-            if (system(cmd) != 0) {
-                snprintf(cmd, sizeof(cmd), "cp \"%s\" \"%s\"",
-                         escaped_path, escaped_tmp);
-                system(cmd);
-            }
-        }
-        
-        /* Load all frames */
-        image_t *frame_imgs = malloc(sizeof(image_t) * nframes);
-        for (int i = 0; i < nframes; i++) {
-            frames[i].index = i;
-            if (load_png(frames[i].tmp_path, &frame_imgs[i]) != 0) {
-                fprintf(stderr, "Error: Failed to load frame %d\n", i);
-                return 1;
-            }
-        }
-        
-        fprintf(stderr, "Found %d frames, size %dx%d\n", nframes, frame_imgs[0].w, frame_imgs[0].h);
+        fprintf(stderr, "Found %d frames, size %dx%d\n", nframes, frame0.w, frame0.h);
         
         printf("#define NFRAMES %d\n", nframes);
-        printf("#define FRAME_W %d\n", frame_imgs[0].w);
-        printf("#define FRAME_H %d\n\n", frame_imgs[0].h);
-        
-        int pixels = frame_imgs[0].w * frame_imgs[0].h;
-        
-        /* Auto compression: test all methods and pick best */
-        if (compress_method == COMPRESS_AUTO) {
-            fprintf(stderr, "Testing best compression method...\n\n");
-            
-            size_t best_size = SIZE_MAX;
-            int best_method = COMPRESS_RLE_XOR;
-            const char *method_names[] = {"RLE_XOR", "SPARSE", "RLE_DIRECT"};
-            int method_ids[] = {COMPRESS_RLE_XOR, COMPRESS_SPARSE, COMPRESS_RLE_DIRECT};
-            
-            /* Allocate temporary buffers for testing */
-            uint8_t *test_buf = malloc(pixels * 6);
-            uint8_t *frame0_buf = malloc(pixels * 3);
-            size_t frame0_size = compress_raw_direct(frame_imgs[0].pixels, pixels, frame0_buf);
-            
-            for (int m = 0; m < 3; m++) {
-                size_t total = frame0_size;
-                int method_valid = 1;  /* Track if method is valid for this animation */
-                
-                for (int f = 1; f < nframes; f++) {
-                    size_t size = 0;  /* Initialize to prevent undefined behavior */
-                    switch (method_ids[m]) {
-                        case COMPRESS_RLE_XOR:
-                            size = compress_rle_xor(frame_imgs[f].pixels, frame_imgs[f-1].pixels, pixels, test_buf);
-                            break;
-                        case COMPRESS_SPARSE:
-                            size = compress_sparse_xor(frame_imgs[f].pixels, frame_imgs[f-1].pixels, pixels, test_buf);
-                            break;
-                        case COMPRESS_RLE_DIRECT:
-                            size = compress_rle_direct(frame_imgs[f].pixels, pixels, test_buf);
-                            break;
-                        default:
-                            size = 0;  /* Should never happen */
-                            break;
-                    }
-                    /* If size is 0 (overflow/error), mark method as invalid */
-                    if (size == 0 && f > 0) {
-                        method_valid = 0;
-                        total = SIZE_MAX;  /* Ensure this method won't be selected */
-                        break;
-                    }
-                    total += size;
-                }
-                
-                if (!method_valid) {
-                    fprintf(stderr, "  %d/3: method %-12s ...... SKIPPED (frame too large for 16-bit indices)\n", 
-                            m + 1, method_names[m]);
-                } else {
-                    fprintf(stderr, "  %d/3: method %-12s ...... %zu bytes (%.1f KB)\n", 
-                            m + 1, method_names[m], total, total / 1024.0);
-                }
-                
-                if (total < best_size) {
-                    best_size = total;
-                    best_method = method_ids[m];
-                }
-            }
-            
-            free(test_buf);
-            free(frame0_buf);
-            
-            fprintf(stderr, "\n  ---> Best method: %s (%zu bytes)\n\n", 
-                    method_names[best_method == COMPRESS_RLE_XOR ? 0 : 
-                                 best_method == COMPRESS_SPARSE ? 1 : 2], best_size);
-            
-            compress_method = best_method;
-            printf("#define COMPRESS_METHOD %d  /* Auto-selected: %s */\n", 
-                   compress_method, 
-                   method_names[compress_method == COMPRESS_RLE_XOR ? 0 : 
-                                compress_method == COMPRESS_SPARSE ? 1 : 2]);
-        } else {
-            printf("#define COMPRESS_METHOD %d  /* 0=RLE_XOR, 1=RLE_DIRECT, 2=SPARSE, 3=RAW */\n", compress_method);
-        }
-        
-        /* Compress frames with selected method */
-        uint8_t *compressed[256];
-        size_t comp_sizes[256];
-        size_t total_size = 0;
+        printf("#define FRAME_W %d\n", frame0.w);
+        printf("#define FRAME_H %d\n\n", frame0.h);
+        asset.hdr.nframes = nframes;
+        asset.hdr.frame_w = frame0.w;
+        asset.hdr.frame_h = frame0.h;
         
-        /* Frame 0: always raw RGB565 (no previous frame for XOR) */
-        compressed[0] = malloc(pixels * 3);
-        comp_sizes[0] = compress_raw_direct(frame_imgs[0].pixels, pixels, compressed[0]);
-        total_size += comp_sizes[0];
-        
-        output_frame_data(0, compressed[0], comp_sizes[0]);
-        
-        /* Delta frames */
-        for (int f = 1; f < nframes; f++) {
-            compressed[f] = malloc(pixels * 6);
-            switch (compress_method) {
-                case COMPRESS_RLE_XOR:
-                    comp_sizes[f] = compress_rle_xor(frame_imgs[f].pixels,
-                                                     frame_imgs[f-1].pixels, pixels, compressed[f]);
-                    break;
-                case COMPRESS_RLE_DIRECT:
-                    comp_sizes[f] = compress_rle_direct(frame_imgs[f].pixels, pixels, compressed[f]);
-                    break;
-                case COMPRESS_SPARSE:
-                    comp_sizes[f] = compress_sparse_xor(frame_imgs[f].pixels,
-                                                        frame_imgs[f-1].pixels, pixels, compressed[f]);
-                    break;
-                case COMPRESS_RAW:
-                    comp_sizes[f] = compress_raw_direct(frame_imgs[f].pixels, pixels, compressed[f]);
-                    break;
-                default:
-                    comp_sizes[f] = compress_rle_xor(frame_imgs[f].pixels,
-                                                     frame_imgs[f-1].pixels, pixels, compressed[f]);
-            }
-            total_size += comp_sizes[f];
-            output_frame_data(f, compressed[f], comp_sizes[f]);
-        }
-        
-        /* Frame array */
-        printf("static const uint8_t* const frames[NFRAMES] = {\n");
-        for (int f = 0; f < nframes; f++) {
-            printf("    frame_%d,\n", f);
-        }
-        printf("};\n\n");
-        
-        printf("static const uint32_t frame_sizes[NFRAMES] = {\n");
-        for (int f = 0; f < nframes; f++) {
-            printf("    %zu,\n", comp_sizes[f]);
-        }
-        printf("};\n");
-        
-        fprintf(stderr, "Total compressed: %zu bytes (%.1f KB)\n", total_size, total_size / 1024.0);
+        int ret = output_animation(frames, nframes, &frame0);
         
         /* Cleanup */
         for (int i = 0; i < nframes; i++) {
-            free(frame_imgs[i].pixels);
-            free(compressed[i]);
             free(frames[i].path);
-            free(frames[i].tmp_path);
         }
-        free(frame_imgs);
+        free(frame0.pixels);
         free(frames);
-        
-        char cleanup[512];
-        char escaped_tmpdir[256];
-        shell_escape(escaped_tmpdir, sizeof(escaped_tmpdir), tmpdir);
-        snprintf(cleanup, sizeof(cleanup), "rm -rf %s", escaped_tmpdir);
-        system(cleanup);
+        if (ret != 0) return 1;
         
     } else if (display_mode == MODE_ANIM_IMAGE_CENTER || display_mode == MODE_ANIM_IMAGE_FULL) {
         /* Animation on background image */
@@ -1152,311 +2606,128 @@ int main(int argc, char *argv[]) {
             return 1;
         }
         
-        /* Convert background to standard PNG first to handle JPEG and other formats */
-        char bg_tmp_path[512];
-        char bg_cmd[1024];
-        char escaped_bg_path[512];
-        char escaped_bg_tmp[512];
-        
-        snprintf(bg_tmp_path, sizeof(bg_tmp_path), "/tmp/splash_bg_%d.png", getpid());
-        shell_escape(escaped_bg_path, sizeof(escaped_bg_path), bg_image_path);
-        shell_escape(escaped_bg_tmp, sizeof(escaped_bg_tmp), bg_tmp_path);
-        
-        snprintf(bg_cmd, sizeof(bg_cmd),
-                 "convert \"%s\" -type TrueColor -depth 8 PNG24:\"%s\" 2>/dev/null",
-                 escaped_bg_path, escaped_bg_tmp);
-        
-        if (system(bg_cmd) != 0) {
-            fprintf(stderr, "Error: Failed to convert background image: %s\n", bg_image_path);
-            return 1;
-        }
-
-        /* Load background from the converted PNG */
-        image_t bg;
-        if (load_png(bg_tmp_path, &bg) != 0) {
+        /* Load background (non-PNG formats go through load_converted) */
+        rgbx_image_t bg_src;
+        if (load_png_rgbx(bg_image_path, &bg_src, 0) != 0) {
             fprintf(stderr, "Error: Failed to load background: %s\n", bg_image_path);
-            unlink(bg_tmp_path);
             return 1;
         }
-        unlink(bg_tmp_path);
         
-        fprintf(stderr, "Background: %dx%d\n", bg.w, bg.h);
+        fprintf(stderr, "Background: %dx%d\n", bg_src.w, bg_src.h);
         
         /* Fullscreen mode: resize background to target resolution */
-        if (display_mode == MODE_ANIM_IMAGE_FULL && target_w > 0 && target_h > 0 && (bg.w != target_w || bg.h != target_h)) {
-            fprintf(stderr, "Resizing background to %dx%d...\n", target_w, target_h);
-            image_t *resized = resize_image(&bg, target_w, target_h);
-            free(bg.pixels);
-            bg = *resized;
-            free(resized);
+        bg_encoded_t bg;
+        if (display_mode == MODE_ANIM_IMAGE_FULL) {
+            bg_encode(&bg_src, target_w, target_h, &bg);
+        } else {
+            bg_encode(&bg_src, 0, 0, &bg);
         }
         
         /* Load animation frames */
-        DIR *dir = opendir(input_path);
-        if (!dir) {
-            fprintf(stderr, "Error: Cannot open directory: %s\n", input_path);
-            return 1;
-        }
-        
-        frame_entry_t *frames = malloc(sizeof(frame_entry_t) * 256);
         int nframes = 0;
-        struct dirent *ent;
-        char tmpdir[256];
-        snprintf(tmpdir, sizeof(tmpdir), "/tmp/splash_frames_%d", getpid());
-        mkdir(tmpdir, 0755);
-        
-        /* First pass: collect all frame filenames */
-        while ((ent = readdir(dir)) != NULL && nframes < 256) {
-            if (strstr(ent->d_name, ".png") || strstr(ent->d_name, ".PNG") ||
-                strstr(ent->d_name, ".jpg") || strstr(ent->d_name, ".JPG") ||
-                strstr(ent->d_name, ".jpeg") || strstr(ent->d_name, ".JPEG")) {
-                frames[nframes].path = malloc(512);
-                frames[nframes].tmp_path = malloc(512);
-                snprintf(frames[nframes].path, 512, "%s/%s", input_path, ent->d_name);
-                snprintf(frames[nframes].tmp_path, 512, "%s/%s", tmpdir, ent->d_name);
-                frames[nframes].index = -1;  /* Will be set after sorting */
-                nframes++;
-                if (nframes >= 256) {
-                    fprintf(stderr, "Warning: Frame limit reached (256 max). Additional frames will be ignored.\n");
-                }
-            }
-        }
-        closedir(dir);
+        frame_entry_t *frames = collect_frames(input_path, &nframes);
+        if (!frames) return 1;
         
-        if (nframes == 0) {
-            fprintf(stderr, "Error: No frames found\n");
+        /* Only frame 0 stays loaded; the rest are decoded a window at a time */
+        image_t frame0;
+        if (load_frame_png(frames[0].path, &frame0) != 0) {
+            fprintf(stderr, "Error: Failed to load frame 0\n");
             return 1;
         }
         
-        /* Sort by filename first to ensure consistent reference frame */
-        qsort(frames, nframes, sizeof(frame_entry_t), compare_frames);
-        
-        /* Second pass: extract frame indices using sorted first frame as reference */
-        const char *reference_name = NULL;
-        for (int i = 0; i < nframes; i++) {
-            const char *filename = strrchr(frames[i].path, '/');
-            filename = filename ? filename + 1 : frames[i].path;
-            
-            if (i == 0) {
-                frames[i].index = extract_frame_index_smart(filename, NULL);
-                reference_name = filename;
-            } else {
-                frames[i].index = extract_frame_index_smart(filename, reference_name);
-            }
-            
-            if (frames[i].index < 0) {
-                fprintf(stderr, "Warning: Could not extract index from %s, using position %d\n", filename, i);
-                frames[i].index = i;
-            }
-        }
-        
-        /* Re-sort by extracted index */
-        qsort(frames, nframes, sizeof(frame_entry_t), compare_frames);
-        
-        /* Convert frames to standard format */
-        for (int i = 0; i < nframes; i++) {
-            char cmd[1024];
-            char escaped_path[512];
-            char escaped_tmp[512];
-            char bg_color_str[16];
-            snprintf(bg_color_str, sizeof(bg_color_str), "#%06X", bg_color);
-            shell_escape(escaped_path, sizeof(escaped_path), frames[i].path);
-            shell_escape(escaped_tmp, sizeof(escaped_tmp), frames[i].tmp_path);
-            snprintf(cmd, sizeof(cmd),
-                     "convert \"%s\" -background \"%s\" -flatten -type TrueColor -depth 8 PNG24:\"%s\" 2>/dev/null",
-                     escaped_path, bg_color_str, escaped_tmp);
-            if (system(cmd) != 0) {
-                snprintf(cmd, sizeof(cmd), "cp \"%s\" \"%s\"",
-                         escaped_path, escaped_tmp);
-                system(cmd);
-            }
-        }
-        
-        if (nframes >= 256) {
-            fprintf(stderr, "Warning: Animation truncated to 256 frames. Consider splitting into multiple sequences.\n");
-        }
-        
-        qsort(frames, nframes, sizeof(frame_entry_t), compare_frames);
-        
-        image_t *frame_imgs = malloc(sizeof(image_t) * nframes);
-        for (int i = 0; i < nframes; i++) {
-            frames[i].index = i;
-            if (load_png(frames[i].tmp_path, &frame_imgs[i]) != 0) {
-                fprintf(stderr, "Error: Failed to load frame %d\n", i);
-                return 1;
-            }
-        }
-        
-        fprintf(stderr, "Found %d frames, size %dx%d\n", nframes, frame_imgs[0].w, frame_imgs[0].h);
+        fprintf(stderr, "Found %d frames, size %dx%d\n", nframes, frame0.w, frame0.h);
         
         printf("#define NFRAMES %d\n", nframes);
-        printf("#define FRAME_W %d\n", frame_imgs[0].w);
-        printf("#define FRAME_H %d\n\n", frame_imgs[0].h);
+        printf("#define FRAME_W %d\n", frame0.w);
+        printf("#define FRAME_H %d\n\n", frame0.h);
         printf("#define BG_W %d\n", bg.w);
         printf("#define BG_H %d\n\n", bg.h);
-        
-        int pixels = frame_imgs[0].w * frame_imgs[0].h;
-        
-        /* Compress background with palette + LZSS */
-        int bg_pixel_count = bg.w * bg.h;
-        uint16_t *bg_palette = malloc(256 * sizeof(uint16_t));
-        uint8_t *bg_indices = malloc(bg_pixel_count);
-        uint8_t *bg_compressed = malloc(bg_pixel_count * 2);
-        
-        int bg_num_colors = build_palette(bg.pixels, bg_pixel_count, bg_palette, bg_indices);
-        fprintf(stderr, "Background palette: %d unique colors\n", bg_num_colors);
-        
-        size_t bg_comp_size = compress_lzss(bg_indices, bg_pixel_count, bg_compressed);
-        fprintf(stderr, "Background LZSS: %zu bytes (%.1f%% of raw)\n", 
-                bg_comp_size, 100.0 * bg_comp_size / (bg_pixel_count * 2));
-        
-        printf("#define BG_PALETTE_SIZE %d\n", bg_num_colors);
-        printf("#define BG_COMPRESSED_SIZE %zu\n\n", bg_comp_size);
-        
-        output_bg_palette_lzss(bg_palette, bg_num_colors, bg_compressed, bg_comp_size);
-        
-        free(bg_palette);
-        free(bg_indices);
-        free(bg_compressed);
-        free(bg.pixels);
-        
-        /* Auto compression: test all methods and pick best */
-        if (compress_method == COMPRESS_AUTO) {
-            fprintf(stderr, "Testing best compression method...\n\n");
-            
-            size_t best_size = SIZE_MAX;
-            int best_method = COMPRESS_RLE_XOR;
-            const char *method_names[] = {"RLE_XOR", "SPARSE", "RLE_DIRECT"};
-            int method_ids[] = {COMPRESS_RLE_XOR, COMPRESS_SPARSE, COMPRESS_RLE_DIRECT};
-            
-            uint8_t *test_buf = malloc(pixels * 6);
-            uint8_t *frame0_buf = malloc(pixels * 3);
-            size_t frame0_size = compress_raw_direct(frame_imgs[0].pixels, pixels, frame0_buf);
-            
-            for (int m = 0; m < 3; m++) {
-                size_t total = frame0_size;
-                int method_valid = 1;  /* Track if method is valid for this animation */
-                
-                for (int f = 1; f < nframes; f++) {
-                    size_t size = 0;  /* Initialize to prevent undefined behavior */
-                    switch (method_ids[m]) {
-                        case COMPRESS_RLE_XOR:
-                            size = compress_rle_xor(frame_imgs[f].pixels, frame_imgs[f-1].pixels, pixels, test_buf);
-                            break;
-                        case COMPRESS_SPARSE:
-                            size = compress_sparse_xor(frame_imgs[f].pixels, frame_imgs[f-1].pixels, pixels, test_buf);
-                            break;
-                        case COMPRESS_RLE_DIRECT:
-                            size = compress_rle_direct(frame_imgs[f].pixels, pixels, test_buf);
-                            break;
-                        default:
-                            size = 0;  /* Should never happen */
-                            break;
-                    }
-                    /* If size is 0 (overflow/error), mark method as invalid */
-                    if (size == 0 && f > 0) {
-                        method_valid = 0;
-                        total = SIZE_MAX;  /* Ensure this method won't be selected */
-                        break;
-                    }
-                    total += size;
-                }
-                
-                if (!method_valid) {
-                    fprintf(stderr, "  %d/3: method %-12s ...... SKIPPED (frame too large for 16-bit indices)\n", 
-                            m + 1, method_names[m]);
-                } else {
-                    fprintf(stderr, "  %d/3: method %-12s ...... %zu bytes (%.1f KB)\n", 
-                            m + 1, method_names[m], total, total / 1024.0);
-                }
-                
-                if (total < best_size) {
-                    best_size = total;
-                    best_method = method_ids[m];
+        asset.hdr.nframes = nframes;
+        asset.hdr.frame_w = frame0.w;
+        asset.hdr.frame_h = frame0.h;
+        asset.hdr.bg_w = bg.w;
+        asset.hdr.bg_h = bg.h;
+        
+        printf("#define BG_PALETTE_SIZE %d\n", bg.num_colors);
+        printf("#define BG_COMPRESSED_SIZE %zu\n\n", bg.comp_size);
+        
+        output_bg_palette_lzss(bg.palette, bg.num_colors, bg.compressed, bg.comp_size, "");
+        asset.hdr.bg_palette_size = bg.num_colors;
+        asset.hdr.bg_size = bg.comp_size;
+        if (asset_path) {
+            asset.hdr.bg_palette_offset = asset_put(bg.palette, bg.num_colors * 2);
+            asset.hdr.bg_offset = asset_put(bg.compressed, bg.comp_size);
+        }
+        free(bg.compressed);
+        
+        /* The same background at the other -r sizes, then a table of all of */
+        /* them for the runtime to pick from (entry 0 is BG_W x BG_H) */
+        if (n_extra > 0) {
+            xbs_bg_variant_t table[MAX_BG_VARIANTS] = {{0}};
+            table[0].w = bg.w;
+            table[0].h = bg.h;
+            table[0].palette_size = bg.num_colors;
+            table[0].size = bg.comp_size;
+            for (int v = 1; v <= n_extra; v++) {
+                char suffix[8];
+                snprintf(suffix, sizeof(suffix), "_%d", v);
+                bg_encoded_t var;
+                bg_encode(&bg_src, extra_w[v - 1], extra_h[v - 1], &var);
+                output_bg_palette_lzss(var.palette, var.num_colors, var.compressed, var.comp_size, suffix);
+                table[v].w = var.w;
+                table[v].h = var.h;
+                table[v].palette_size = var.num_colors;
+                table[v].size = var.comp_size;
+                if (asset_path) {
+                    table[v].palette_offset = asset_put(var.palette, var.num_colors * 2);
+                    table[v].offset = asset_put(var.compressed, var.comp_size);
                 }
+                free(var.compressed);
             }
             
-            free(test_buf);
-            free(frame0_buf);
-            
-            fprintf(stderr, "\n  ---> Best method: %s (%zu bytes)\n\n", 
-                    method_names[best_method == COMPRESS_RLE_XOR ? 0 : 
-                                 best_method == COMPRESS_SPARSE ? 1 : 2], best_size);
+            int n = n_extra + 1;
+            printf("/* Background resolutions, the runtime draws the closest to the screen */\n");
+            printf("#define BG_VARIANTS %d\n", n);
+            printf("static const uint16_t bg_variant_dims[BG_VARIANTS][2] = {");
+            for (int v = 0; v < n; v++) printf("%s{%d, %d}", v ? ", " : "", table[v].w, table[v].h);
+            printf("};\n");
+            printf("static const uint16_t bg_variant_palette_sizes[BG_VARIANTS] = {");
+            for (int v = 0; v < n; v++) printf("%s%d", v ? ", " : "", table[v].palette_size);
+            printf("};\n");
+            printf("static const uint32_t bg_variant_sizes[BG_VARIANTS] = {");
+            for (int v = 0; v < n; v++) printf("%s%u", v ? ", " : "", table[v].size);
+            printf("};\n");
+            printf("static const uint16_t *const bg_variant_palettes[BG_VARIANTS] = {bg_palette");
+            for (int v = 1; v < n; v++) printf(", bg_palette_%d", v);
+            printf("};\n");
+            printf("static const uint8_t *const bg_variant_data[BG_VARIANTS] = {bg_compressed");
+            for (int v = 1; v < n; v++) printf(", bg_compressed_%d", v);
+            printf("};\n\n");
             
-            compress_method = best_method;
-            printf("#define COMPRESS_METHOD %d  /* Auto-selected: %s */\n", 
-                   compress_method, 
-                   method_names[compress_method == COMPRESS_RLE_XOR ? 0 : 
-                                compress_method == COMPRESS_SPARSE ? 1 : 2]);
-        } else {
-            printf("#define COMPRESS_METHOD %d  /* 0=RLE_XOR, 1=RLE_DIRECT, 2=SPARSE, 3=RAW */\n", compress_method);
-        }
-        
-        /* Compress frames with selected method */
-        uint8_t *compressed[256];
-        size_t comp_sizes[256];
-        size_t total_size = 0;
-        
-        /* Frame 0: always raw RGB565 (no previous frame for XOR) */
-        compressed[0] = malloc(pixels * 3);
-        comp_sizes[0] = compress_raw_direct(frame_imgs[0].pixels, pixels, compressed[0]);
-        total_size += comp_sizes[0];
-        output_frame_data(0, compressed[0], comp_sizes[0]);
-        
-        for (int f = 1; f < nframes; f++) {
-            compressed[f] = malloc(pixels * 6);
-            switch (compress_method) {
-                case COMPRESS_RLE_XOR:
-                    comp_sizes[f] = compress_rle_xor(frame_imgs[f].pixels,
-                                                     frame_imgs[f-1].pixels, pixels, compressed[f]);
-                    break;
-                case COMPRESS_RLE_DIRECT:
-                    comp_sizes[f] = compress_rle_direct(frame_imgs[f].pixels, pixels, compressed[f]);
-                    break;
-                case COMPRESS_SPARSE:
-                    comp_sizes[f] = compress_sparse_xor(frame_imgs[f].pixels,
-                                                        frame_imgs[f-1].pixels, pixels, compressed[f]);
-                    break;
-                case COMPRESS_RAW:
-                    comp_sizes[f] = compress_raw_direct(frame_imgs[f].pixels, pixels, compressed[f]);
-                    break;
-                default:
-                    comp_sizes[f] = compress_rle_xor(frame_imgs[f].pixels,
-                                                     frame_imgs[f-1].pixels, pixels, compressed[f]);
+            if (asset_path) {
+                /* Entry 0 is the header's own background: only the others */
+                uint32_t count = n_extra;
+                asset.hdr.bg_variants_offset = asset_put(&count, sizeof(count));
+                asset_put(table + 1, sizeof(*table) * n_extra);
             }
-            total_size += comp_sizes[f];
-            output_frame_data(f, compressed[f], comp_sizes[f]);
-        }
-        
-        printf("static const uint8_t* const frames[NFRAMES] = {\n");
-        for (int f = 0; f < nframes; f++) {
-            printf("    frame_%d,\n", f);
+            fprintf(stderr, "Background variants: %d\n", n);
         }
-        printf("};\n\n");
-        
-        printf("static const uint32_t frame_sizes[NFRAMES] = {\n");
-        for (int f = 0; f < nframes; f++) {
-            printf("    %zu,\n", comp_sizes[f]);
-        }
-        printf("};\n");
+        free(bg_src.pixels);
         
-        fprintf(stderr, "Total compressed: %zu bytes (%.1f KB)\n", total_size, total_size / 1024.0);
+        int ret = output_animation(frames, nframes, &frame0);
         
         /* Cleanup */
         for (int i = 0; i < nframes; i++) {
-            free(frame_imgs[i].pixels);
-            free(compressed[i]);
             free(frames[i].path);
-            free(frames[i].tmp_path);
         }
-        free(frame_imgs);
+        free(frame0.pixels);
         free(frames);
+        if (ret != 0) return 1;
         
-        char cleanup[512];
-        char escaped_tmpdir[256];
-        shell_escape(escaped_tmpdir, sizeof(escaped_tmpdir), tmpdir);
-        snprintf(cleanup, sizeof(cleanup), "rm -rf %s", escaped_tmpdir);
-        system(cleanup);
+    }
+    
+    if (asset_path && asset_close(asset_path) != 0) {
+        return 1;
     }
     
     return 0;
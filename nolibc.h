@@ -36,6 +36,21 @@ typedef long int64_t;
 #define O_TRUNC     01000
 #define O_APPEND    02000
 #define O_WRONLY    1
+#define O_CLOEXEC   02000000
+#define O_NONBLOCK  04000
+
+/* File types for mknod */
+#define S_IFIFO     0010000
+
+/* Error numbers (syscalls return -errno) */
+#define ENOENT      2
+#define EINTR       4
+#define EAGAIN      11
+#define ENOMEM      12
+#define EBUSY       16
+#define EEXIST      17
+#define ENODEV      19
+#define ENOSYS      38
 
 /* Memory protection */
 #define PROT_READ   0x1
@@ -46,6 +61,7 @@ typedef long int64_t;
 #define MAP_SHARED  0x01
 #define MAP_PRIVATE 0x02
 #define MAP_ANONYMOUS 0x20
+#define MAP_POPULATE  0x8000
 
 /* Signal */
 #define SIGTERM     15
@@ -57,24 +73,34 @@ typedef long int64_t;
 /* Signal actions for rt_sigaction */
 #define SA_SIGINFO  0x00000004
 #define SA_RESTART  0x10000000
+#define SA_RESTORER 0x04000000  /* Mandatory on x86_64: no restorer, no signal frame */
 
 /* Syscall numbers for x86_64 */
 #define SYS_read    0
 #define SYS_write   1
 #define SYS_open    2
 #define SYS_close   3
+#define SYS_lseek   8
 #define SYS_mmap    9
 #define SYS_munmap  11
 #define SYS_exit    60
 #define SYS_nanosleep 35
+#define SYS_poll    7
 #define SYS_ioctl   16
 #define SYS_rt_sigaction 13
 #define SYS_rt_sigprocmask 14
 #define SYS_clock_gettime 228
+#define SYS_clock_nanosleep 230
+#define SYS_ppoll   271
+#define SYS_mknod   133
 
 /* Clock IDs for clock_gettime */
+#define CLOCK_MONOTONIC     1
 #define CLOCK_MONOTONIC_RAW 4
 
+/* clock_nanosleep flags */
+#define TIMER_ABSTIME 1
+
 /* Inline syscall wrappers */
 static inline __attribute__((always_inline)) long syscall1(long n, long a1) {
     long ret;
@@ -145,6 +171,10 @@ static inline __attribute__((always_inline)) int open(const char *path, int flag
     return (int)syscall3(SYS_open, (long)path, flags, mode);
 }
 
+static inline __attribute__((always_inline)) int mknod(const char *path, mode_t mode, unsigned int dev) {
+    return (int)syscall3(SYS_mknod, (long)path, mode, dev);
+}
+
 static inline __attribute__((always_inline)) int close(int fd) {
     return (int)syscall1(SYS_close, fd);
 }
@@ -157,6 +187,13 @@ static inline __attribute__((always_inline)) ssize_t write(int fd, const void *b
     return syscall3(SYS_write, fd, (long)buf, count);
 }
 
+#define SEEK_SET 0
+#define SEEK_END 2
+
+static inline __attribute__((always_inline)) long lseek(int fd, long offset, int whence) {
+    return syscall3(SYS_lseek, fd, offset, whence);
+}
+
 static inline __attribute__((always_inline)) void *mmap(void *addr, size_t length, int prot, int flags, int fd, long offset) {
     return (void*)syscall6(SYS_mmap, (long)addr, length, prot, flags, fd, offset);
 }
@@ -169,6 +206,19 @@ static inline __attribute__((always_inline)) int ioctl(int fd, unsigned long req
     return (int)syscall3(SYS_ioctl, fd, request, (long)arg);
 }
 
+/* poll */
+#define POLLIN      0x001
+
+struct pollfd {
+    int fd;
+    short events;
+    short revents;
+};
+
+static inline __attribute__((always_inline)) int poll(struct pollfd *fds, unsigned long nfds, int timeout) {
+    return (int)syscall3(SYS_poll, (long)fds, nfds, timeout);
+}
+
 /* memset - x86_64 rep stosb for minimal binary size */
 static inline __attribute__((always_inline)) void *memset(void *s, int c, size_t n) {
     void *ret = s;
@@ -239,6 +289,44 @@ static inline __attribute__((always_inline)) int nanosleep(const struct timespec
     return (int)syscall2(SYS_nanosleep, (long)req, (long)rem);
 }
 
+static inline __attribute__((always_inline)) int clock_gettime(int clk, struct timespec *ts) {
+    return (int)syscall2(SYS_clock_gettime, (long)clk, (long)ts);
+}
+
+/* Returns 0 or -errno (like the raw syscall; glibc returns +errno) */
+static inline __attribute__((always_inline)) int clock_nanosleep(int clk, int flags,
+                                                                 const struct timespec *req,
+                                                                 struct timespec *rem) {
+    return (int)syscall4(SYS_clock_nanosleep, (long)clk, (long)flags, (long)req, (long)rem);
+}
+
+/* Kernel sigset_t: one bit per signal (64 on x86_64), not glibc's 128 bytes.
+ * Own name because the SSE headers drag in glibc's <stdlib.h> and its sigset_t. */
+typedef unsigned long kernel_sigset_t;
+
+#define SIG_BLOCK   0
+#define SIG_UNBLOCK 1
+#define SIG_SETMASK 2
+
+static inline void sigemptyset(kernel_sigset_t *set) { *set = 0; }
+static inline void sigaddset(kernel_sigset_t *set, int sig) { *set |= 1UL << (sig - 1); }
+static inline void sigdelset(kernel_sigset_t *set, int sig) { *set &= ~(1UL << (sig - 1)); }
+
+static inline __attribute__((always_inline)) int sigprocmask(int how, const kernel_sigset_t *set, kernel_sigset_t *old) {
+    return (int)syscall4(SYS_rt_sigprocmask, how, (long)set, (long)old, sizeof(kernel_sigset_t));
+}
+
+/* poll with the signal mask swapped in atomically for the duration of the wait.
+ * The kernel writes the remaining time back, so the timeout is copied first. */
+static inline __attribute__((always_inline)) int ppoll(struct pollfd *fds, unsigned long nfds,
+                                                       const struct timespec *timeout,
+                                                       const kernel_sigset_t *mask) {
+    struct timespec ts;
+    if (timeout) ts = *timeout;
+    return (int)syscall6(SYS_ppoll, (long)fds, (long)nfds, timeout ? (long)&ts : 0,
+                         (long)mask, sizeof(kernel_sigset_t), 0);
+}
+
 /* Signal handling - proper rt_sigaction implementation */
 typedef void (*sighandler_t)(int);
 #define SIG_DFL ((sighandler_t)0)
@@ -268,14 +356,12 @@ struct sigaction {
     unsigned long sa_mask[16];  /* sigset_t, 64-bit on x86_64 */
 };
 
-/* Restorer function for signal handler (required on x86_64) */
-static void __attribute__((noinline)) __restore_rt(void) {
+/* Restorer function for signal handler (required on x86_64).
+ * Naked: a prologue would move rsp off the signal frame rt_sigreturn reads. */
+static void __attribute__((naked, noinline)) __restore_rt(void) {
     __asm__ volatile (
-        "movq $15, %%rax\n\t"    /* SYS_rt_sigreturn */
+        "movq $15, %rax\n\t"    /* SYS_rt_sigreturn */
         "syscall"
-        :
-        :
-        : "memory"
     );
 }
 
@@ -291,7 +377,7 @@ static inline sighandler_t signal(int sig, sighandler_t handler) {
     struct sigaction old = {0};
     
     sa.__sa_handler.sa_handler = handler;
-    sa.sa_flags = SA_RESTART;
+    sa.sa_flags = SA_RESTART | SA_RESTORER;
     sa.sa_restorer = __restore_rt;
     
     if (rt_sigaction(sig, &sa, &old, 8) != 0) {
@@ -362,4 +448,168 @@ struct fb_fix_screeninfo {
 #define FBIO_WAITFORVSYNC   0x460c
 #define FBIOGET_FSCREENINFO 0x4602
 
+/* DRM/KMS uapi (subset of <drm/drm.h> and <drm/drm_mode.h>) */
+struct drm_get_cap {
+    uint64_t capability;
+    uint64_t value;
+};
+
+struct drm_mode_modeinfo {
+    uint32_t clock;
+    uint16_t hdisplay, hsync_start, hsync_end, htotal, hskew;
+    uint16_t vdisplay, vsync_start, vsync_end, vtotal, vscan;
+    uint32_t vrefresh;
+    uint32_t flags;
+    uint32_t type;
+    char name[32];
+};
+
+struct drm_mode_card_res {
+    uint64_t fb_id_ptr;
+    uint64_t crtc_id_ptr;
+    uint64_t connector_id_ptr;
+    uint64_t encoder_id_ptr;
+    uint32_t count_fbs;
+    uint32_t count_crtcs;
+    uint32_t count_connectors;
+    uint32_t count_encoders;
+    uint32_t min_width, max_width;
+    uint32_t min_height, max_height;
+};
+
+struct drm_mode_crtc {
+    uint64_t set_connectors_ptr;
+    uint32_t count_connectors;
+    uint32_t crtc_id;
+    uint32_t fb_id;
+    uint32_t x, y;
+    uint32_t gamma_size;
+    uint32_t mode_valid;
+    struct drm_mode_modeinfo mode;
+};
+
+struct drm_mode_get_encoder {
+    uint32_t encoder_id;
+    uint32_t encoder_type;
+    uint32_t crtc_id;
+    uint32_t possible_crtcs;
+    uint32_t possible_clones;
+};
+
+struct drm_mode_get_connector {
+    uint64_t encoders_ptr;
+    uint64_t modes_ptr;
+    uint64_t props_ptr;
+    uint64_t prop_values_ptr;
+    uint32_t count_modes;
+    uint32_t count_props;
+    uint32_t count_encoders;
+    uint32_t encoder_id;
+    uint32_t connector_id;
+    uint32_t connector_type;
+    uint32_t connector_type_id;
+    uint32_t connection;
+    uint32_t mm_width, mm_height;
+    uint32_t subpixel;
+    uint32_t pad;
+};
+
+struct drm_mode_fb_cmd {
+    uint32_t fb_id;
+    uint32_t width, height;
+    uint32_t pitch;
+    uint32_t bpp;
+    uint32_t depth;
+    uint32_t handle;
+};
+
+struct drm_mode_crtc_page_flip {
+    uint32_t crtc_id;
+    uint32_t fb_id;
+    uint32_t flags;
+    uint32_t reserved;
+    uint64_t user_data;
+};
+
+struct drm_clip_rect {
+    unsigned short x1, y1;
+    unsigned short x2, y2;
+};
+
+struct drm_mode_fb_dirty_cmd {
+    uint32_t fb_id;
+    uint32_t flags;
+    uint32_t color;
+    uint32_t num_clips;
+    uint64_t clips_ptr;
+};
+
+struct drm_mode_create_dumb {
+    uint32_t height;
+    uint32_t width;
+    uint32_t bpp;
+    uint32_t flags;
+    uint32_t handle;
+    uint32_t pitch;
+    uint64_t size;
+};
+
+struct drm_mode_map_dumb {
+    uint32_t handle;
+    uint32_t pad;
+    uint64_t offset;
+};
+
+struct drm_mode_destroy_dumb {
+    uint32_t handle;
+};
+
+struct drm_mode_closefb {
+    uint32_t fb_id;
+    uint32_t pad;
+};
+
+/* Event header read() from the DRM fd */
+struct drm_event {
+    uint32_t type;
+    uint32_t length;
+};
+
+/* DRM_EVENT_FLIP_COMPLETE payload; tv_* is CLOCK_MONOTONIC when DRM_CAP_TIMESTAMP_MONOTONIC */
+struct drm_event_vblank {
+    struct drm_event base;
+    uint64_t user_data;
+    uint32_t tv_sec;
+    uint32_t tv_usec;
+    uint32_t sequence;
+    uint32_t crtc_id;
+};
+
+#define DRM_IO(nr)          (('d' << 8) | (nr))
+#define DRM_IOWR(nr, type)  ((3UL << 30) | ((unsigned long)sizeof(type) << 16) | ('d' << 8) | (nr))
+
+#define DRM_IOCTL_GET_CAP               DRM_IOWR(0x0C, struct drm_get_cap)
+#define DRM_IOCTL_SET_MASTER            DRM_IO(0x1E)
+#define DRM_IOCTL_DROP_MASTER           DRM_IO(0x1F)
+#define DRM_IOCTL_MODE_GETRESOURCES     DRM_IOWR(0xA0, struct drm_mode_card_res)
+#define DRM_IOCTL_MODE_GETCRTC          DRM_IOWR(0xA1, struct drm_mode_crtc)
+#define DRM_IOCTL_MODE_SETCRTC          DRM_IOWR(0xA2, struct drm_mode_crtc)
+#define DRM_IOCTL_MODE_GETENCODER       DRM_IOWR(0xA6, struct drm_mode_get_encoder)
+#define DRM_IOCTL_MODE_GETCONNECTOR     DRM_IOWR(0xA7, struct drm_mode_get_connector)
+#define DRM_IOCTL_MODE_ADDFB            DRM_IOWR(0xAE, struct drm_mode_fb_cmd)
+#define DRM_IOCTL_MODE_RMFB             DRM_IOWR(0xAF, unsigned int)
+#define DRM_IOCTL_MODE_PAGE_FLIP        DRM_IOWR(0xB0, struct drm_mode_crtc_page_flip)
+#define DRM_IOCTL_MODE_DIRTYFB          DRM_IOWR(0xB1, struct drm_mode_fb_dirty_cmd)
+#define DRM_IOCTL_MODE_CREATE_DUMB      DRM_IOWR(0xB2, struct drm_mode_create_dumb)
+#define DRM_IOCTL_MODE_MAP_DUMB         DRM_IOWR(0xB3, struct drm_mode_map_dumb)
+#define DRM_IOCTL_MODE_DESTROY_DUMB     DRM_IOWR(0xB4, struct drm_mode_destroy_dumb)
+#define DRM_IOCTL_MODE_CLOSEFB          DRM_IOWR(0xD0, struct drm_mode_closefb)
+
+#define DRM_CAP_DUMB_BUFFER         0x1
+#define DRM_CAP_TIMESTAMP_MONOTONIC 0x6
+#define DRM_MODE_CONNECTED          1
+#define DRM_MODE_TYPE_PREFERRED     (1 << 3)
+#define DRM_MODE_PAGE_FLIP_EVENT    0x01
+#define DRM_EVENT_FLIP_COMPLETE     0x02
+
 #endif /* NOLIBC_H */
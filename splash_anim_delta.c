@@ -17,6 +17,11 @@
  *   2 = Sparse XOR - Position + value for changed pixels
  *   3 = Raw XOR    - No compression
  *   5 = Palette LZSS - 8-bit palette + LZSS (static images only)
+ *   6 = Per-frame  - Each delta frame starts with its codec tag (0-2, 7)
+ *   7 = Tile       - 8x8 tiles: skip, copy from previous frame, fill or RLE XOR
+ * 
+ * With ASSET_PATH the same settings come from a theme container mapped at
+ * startup instead (splash_asset.h, generate_splash -A).
  * 
  * Constraints:
  *   - Complexity: O(n) per frame where n = changed pixels
@@ -27,10 +32,11 @@
 
 #include "nolibc.h"
 #include <emmintrin.h>  /* SSE2 intrinsics for x86_64 */
+#include <immintrin.h>  /* SSSE3/AVX2 intrinsics - only reached through cpuid dispatch */
 
 /* Frame buffer - allocated via mmap at runtime */
 static uint16_t *frame_buffer = NULL;
-static uint16_t *bg_buffer = NULL;  /* For mode 1 */
+static uint16_t *bg_buffer = NULL;  /* For modes 1/2, see bg_load() */
 
 /* Double buffering context */
 static int fb_fd = -1;
@@ -38,13 +44,24 @@ static int fb_has_dblbuf = 0;           /* Runtime detection */
 static int fb_page = 0;                  /* Current page: 0 or 1 */
 static unsigned int fb_yres = 0;        /* Visible height */
 static unsigned int fb_line_len = 0;    /* Line length in bytes */
+static struct fb_var_screeninfo fb_vinfo;  /* Current mode, reused for FBIOPAN_DISPLAY */
+static int fb_stream = 0;               /* Target is write-combined/uncached: use streaming stores */
 
 /* Blit function pointer - set at runtime based on double buffer availability */
+/* stride is the source row pitch in pixels, so sub-rectangles of a frame can be blitted */
 typedef void (*blit_func_t)(uint8_t *fbmem, int fb_w, int fb_h, int line_len, int bpp,
-                           const uint16_t *frame, int fw, int fh, int x, int y,
+                           const uint16_t *frame, int stride, int fw, int fh, int x, int y,
                            int r_off, int g_off, int b_off);
 static blit_func_t blit_func = NULL;
 
+/* Dirty rectangle in frame coordinates (half-open: x0 <= x < x1, y0 <= y < y1) */
+/* Accumulated by the delta decoders, consumed by the blit in the animation loop */
+typedef struct {
+    int x0, y0, x1, y1;
+} dirty_rect_t;
+static dirty_rect_t dirty;
+static dirty_rect_t bg_rect;            /* Part of the background image in bg_buffer */
+
 /* Volatile flag for signal handling */
 static volatile int terminate_requested = 0;
 
@@ -54,69 +71,412 @@ static void signal_handler(int sig) {
     terminate_requested = 1;
 }
 
+/* SIGTERM/SIGINT stay blocked except inside the waits below, which unblock */
+/* them atomically with ppoll: a signal can never land between checking */
+/* terminate_requested and going to sleep, and it always ends the wait at once */
+static kernel_sigset_t wait_sigmask;
+
+static void signals_init(void) {
+    kernel_sigset_t block;
+    sigemptyset(&block);
+    sigaddset(&block, SIGTERM);
+    sigaddset(&block, SIGINT);
+    
+    signal(SIGTERM, signal_handler);
+    signal(SIGINT, signal_handler);
+    sigprocmask(SIG_BLOCK, &block, &wait_sigmask);
+    
+    /* Mask while waiting: whatever we inherited, minus the two we handle */
+    sigdelset(&wait_sigmask, SIGTERM);
+    sigdelset(&wait_sigmask, SIGINT);
+}
+
+/* Block until a termination signal has been handled */
+static void wait_for_signal(void) {
+    while (!terminate_requested) {
+        ppoll(NULL, 0, NULL, &wait_sigmask);
+    }
+}
+
+#ifdef ASSET_PATH
+/* --- Theme asset (make ASSET_PATH=...) --- */
+/* Instead of compiling frames_delta.h in, map the container generate_splash -A */
+/* wrote and decode from it in place. The header settings below read the mapped */
+/* xbs_header_t; all codecs are built in and delta streams carry their tag. */
+#include "splash_asset.h"
+
+static const uint8_t *asset_base;
+static const xbs_header_t *asset;
+static const uint8_t **asset_frames;        /* Stream pointers into the mapping */
+static const uint32_t *asset_sizes;
+static const uint16_t (*asset_dirty)[4];
+static const xbs_bg_variant_t *asset_bg_variants;  /* Other background resolutions */
+static int asset_bg_nvariants;
+
+#define DISPLAY_MODE        1  /* Animation; a background image if the theme has one */
+#define COMPRESS_METHOD     6
+#define FRAME_DIRTY_TABLE   1
+#define TILE_REF            (asset->flags & XBS_TILE_REF)
+#define LOOP                (asset->flags & XBS_LOOP)
+#define LOOP_DELTA          (asset->flags & XBS_LOOP_DELTA)
+#define NFRAMES             ((int)asset->nframes)
+#define FRAME_W             ((int)asset->frame_w)
+#define FRAME_H             ((int)asset->frame_h)
+#define BG_W                ((int)asset->bg_w)
+#define BG_H                ((int)asset->bg_h)
+#define HORIZONTAL_OFFSET   asset->x_offset
+#define VERTICAL_OFFSET     asset->y_offset
+#define BACKGROUND_COLOR    asset->bg_color
+#define FRAME_DURATION_MS   asset->frame_ms
+#define FRAME0_PALETTE_SIZE asset->frame0_palette_size
+#define BG_PALETTE_SIZE     asset->bg_palette_size
+#define BG_COMPRESSED_SIZE  asset->bg_size
+#define frame0_palette      ((const uint16_t *)(asset_base + asset->frame0_palette_offset))
+#define bg_palette          ((const uint16_t *)(asset_base + asset->bg_palette_offset))
+#define bg_compressed       (asset_base + asset->bg_offset)
+#define BG_FULLSCREEN       (asset->display_mode == 2)
+#define frames              asset_frames
+#define frame_sizes         asset_sizes
+#define frame_dirty         asset_dirty
+
+/* 1 if [off, off + len) lies inside the mapped file */
+static inline int asset_range(uint64_t off, uint64_t len) {
+    return off + len <= asset->file_size;
+}
+
+/* Map ASSET_PATH and check every offset once, so decoding never leaves the file */
+static int asset_load(void) {
+    int fd = open(ASSET_PATH, O_RDONLY, 0);
+    if (fd < 0) return -1;
+    long size = lseek(fd, 0, SEEK_END);
+    if (size < (long)sizeof(xbs_header_t)) {
+        close(fd);
+        return -1;
+    }
+    /* Read-only private mapping: pages fault in as frames first use them */
+    asset_base = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if ((unsigned long)asset_base >= (unsigned long)-4095) return -1;
+    
+    asset = (const xbs_header_t *)asset_base;
+    if (asset->magic != XBS_MAGIC || asset->version != XBS_VERSION ||
+        asset->file_size != (uint64_t)size || asset->nframes == 0 ||
+        asset->frame_w == 0 || asset->frame_h == 0 ||
+        asset->frame0_palette_size > 256 || asset->bg_palette_size > 256) {
+        return -1;
+    }
+    
+    int nslots = NFRAMES + (LOOP_DELTA ? 1 : 0);
+    if ((asset->index_offset & 3) || !asset_range(asset->index_offset, (uint64_t)nslots * 16) ||
+        (asset->frame0_palette_offset & 1) ||
+        !asset_range(asset->frame0_palette_offset, asset->frame0_palette_size * 2) ||
+        (asset->bg_palette_offset & 1) ||
+        !asset_range(asset->bg_palette_offset, asset->bg_palette_size * 2) ||
+        !asset_range(asset->bg_offset, asset->bg_size)) {
+        return -1;
+    }
+    
+    /* Other resolutions of the background, if the theme has some */
+    if (asset->bg_variants_offset) {
+        uint32_t off = asset->bg_variants_offset;
+        if ((off & 3) || !asset_range(off, 4)) return -1;
+        uint32_t n = *(const uint32_t *)(asset_base + off);
+        if (n > 255 || !asset_range(off + 4, (uint64_t)n * sizeof(xbs_bg_variant_t))) return -1;
+        asset_bg_variants = (const xbs_bg_variant_t *)(asset_base + off + 4);
+        for (uint32_t i = 0; i < n; i++) {
+            const xbs_bg_variant_t *v = &asset_bg_variants[i];
+            if (v->w == 0 || v->h == 0 || v->palette_size > 256 || (v->palette_offset & 1) ||
+                !asset_range(v->palette_offset, v->palette_size * 2) || !asset_range(v->offset, v->size)) {
+                return -1;
+            }
+        }
+        asset_bg_nvariants = n;
+    }
+    
+    const uint32_t *offsets = (const uint32_t *)(asset_base + asset->index_offset);
+    asset_sizes = offsets + nslots;
+    asset_dirty = (const uint16_t (*)[4])(asset_sizes + nslots);
+    
+    asset_frames = mmap(NULL, nslots * sizeof(*asset_frames), PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if ((unsigned long)asset_frames >= (unsigned long)-4095) return -1;
+    for (int f = 0; f < nslots; f++) {
+        const uint16_t *box = asset_dirty[f];
+        if (!asset_range(offsets[f], asset_sizes[f]) ||
+            box[0] > box[2] || box[2] > FRAME_W || box[1] > box[3] || box[3] > FRAME_H) {
+            return -1;
+        }
+        asset_frames[f] = asset_base + offsets[f];
+    }
+    return 0;
+}
+#else
 #include "frames_delta.h"
+#endif
+
+/* Control channel (make CONTROL_FIFO=...), see below: animations only */
+#if defined(CONTROL_FIFO) && DISPLAY_MODE != 3 && DISPLAY_MODE != 4
+#define USE_CONTROL 1
+#else
+#define USE_CONTROL 0
+#endif
+
+/* --- Dirty rectangle tracking --- */
+
+/* With a generator-provided frame_dirty[] table the decoders skip all tracking */
+/* and delta streams start at the first changed row; otherwise track at runtime */
+#ifdef FRAME_DIRTY_TABLE
+#define TRACK_DIRTY 0
+#else
+#define TRACK_DIRTY 1
+#endif
+
+/* Reset to empty (x1 <= x0) */
+static inline void dirty_reset(dirty_rect_t *r) {
+    r->x0 = FRAME_W;
+    r->y0 = FRAME_H;
+    r->x1 = 0;
+    r->y1 = 0;
+}
+
+static inline void dirty_mark_full(dirty_rect_t *r) {
+    r->x0 = 0;
+    r->y0 = 0;
+    r->x1 = FRAME_W;
+    r->y1 = FRAME_H;
+}
+
+static inline int dirty_empty(const dirty_rect_t *r) {
+    return r->x1 <= r->x0 || r->y1 <= r->y0;
+}
+
+/* Grow r to cover a linear pixel span [start, end) of the frame */
+/* Called once per decoded run, never per pixel (except sparse) */
+static inline void dirty_add_span(dirty_rect_t *r, int start, int end) {
+    if (end <= start) return;
+    int y0 = start / FRAME_W;
+    int y1 = (end - 1) / FRAME_W;
+    int x0, x1;
+    if (y0 == y1) {
+        x0 = start - y0 * FRAME_W;
+        x1 = end - y0 * FRAME_W;
+    } else {
+        /* Span wraps a row boundary: covers full width */
+        x0 = 0;
+        x1 = FRAME_W;
+    }
+    if (x0 < r->x0) r->x0 = x0;
+    if (x1 > r->x1) r->x1 = x1;
+    if (y0 < r->y0) r->y0 = y0;
+    if (y1 + 1 > r->y1) r->y1 = y1 + 1;
+}
+
+/* Grow r to also cover o */
+static inline void dirty_union(dirty_rect_t *r, const dirty_rect_t *o) {
+    if (dirty_empty(o)) return;
+    if (o->x0 < r->x0) r->x0 = o->x0;
+    if (o->y0 < r->y0) r->y0 = o->y0;
+    if (o->x1 > r->x1) r->x1 = o->x1;
+    if (o->y1 > r->y1) r->y1 = o->y1;
+}
+
+/* Grow r to cover the precomputed region of frame f (no-op without table) */
+static inline void dirty_add_frame(dirty_rect_t *r, int f) {
+#if TRACK_DIRTY
+    (void)r;
+    (void)f;
+#else
+    dirty_rect_t box = { frame_dirty[f][0], frame_dirty[f][1], frame_dirty[f][2], frame_dirty[f][3] };
+    dirty_union(r, &box);
+#endif
+}
+
+/* First pixel covered by the delta stream of frame f */
+static inline int delta_start(int f) {
+#if TRACK_DIRTY
+    (void)f;
+    return 0;
+#else
+    return frame_dirty[f][1] * FRAME_W;
+#endif
+}
 
 /* --- LZSS decompression for palette+LZSS compressed data --- */
-#if (defined(COMPRESS_METHOD) && COMPRESS_METHOD == 5) || (defined(DISPLAY_MODE) && (DISPLAY_MODE == 1 || DISPLAY_MODE == 2))
+#if (defined(COMPRESS_METHOD) && COMPRESS_METHOD == 5) || (defined(FRAME0_METHOD) && FRAME0_METHOD == 5) || \
+    (defined(DISPLAY_MODE) && (DISPLAY_MODE == 1 || DISPLAY_MODE == 2)) || defined(ASSET_PATH)
 
-#define LZSS_WINDOW_SIZE 4096
+#define LZSS_WINDOW_SIZE 4096   /* Power of two: positions wrap with a mask */
 #define LZSS_MIN_MATCH  3
 
-/* Decompress LZSS data to indices, then expand via palette */
-static void decompress_palette_lzss(const uint8_t *compressed, size_t comp_size,
-                                     const uint16_t *pal, int num_colors,
-                                     uint16_t *out, int pixel_count) {
+/* Decoder state, so a stream can be expanded a piece at a time */
+typedef struct {
+    const uint8_t *in;
+    size_t in_pos, in_size;
+    const uint16_t *pal;
+    int num_colors;
+    int flag;                       /* Current flag byte, shifted as it is used */
+    int bits;                       /* Flag bits left in it */
+    int match_offset, match_left;   /* Back-reference cut short by the last call */
+    int window_pos;
     uint8_t window[LZSS_WINDOW_SIZE];
-    int window_pos = 0;
-    int out_pos = 0;
-    size_t in_pos = 0;
+} lzss_stream_t;
+
+static void lzss_begin(lzss_stream_t *s, const uint8_t *compressed, size_t comp_size,
+                       const uint16_t *pal, int num_colors) {
+    s->in = compressed;
+    s->in_pos = 0;
+    s->in_size = comp_size;
+    s->pal = pal;
+    s->num_colors = num_colors;
+    s->bits = 0;
+    s->match_left = 0;
+    s->window_pos = 0;
     
     /* Initialize window */
-    for (int i = 0; i < LZSS_WINDOW_SIZE; i++) window[i] = 0;
+    for (int i = 0; i < LZSS_WINDOW_SIZE; i++) s->window[i] = 0;
+}
+
+/* Expand the next pixel_count pixels of the stream into out. Returns how */
+/* many were written: fewer only once the stream runs out. */
+static int lzss_decode(lzss_stream_t *s, uint16_t *out, int pixel_count) {
+    const uint8_t *compressed = s->in;
+    const uint16_t *pal = s->pal;
+    uint8_t *window = s->window;
+    size_t in_pos = s->in_pos, comp_size = s->in_size;
+    int num_colors = s->num_colors;
+    int flag = s->flag, bits = s->bits;
+    int offset = s->match_offset, left = s->match_left;
+    int window_pos = s->window_pos;
+    int out_pos = 0;
     
-    while (in_pos < comp_size && out_pos < pixel_count) {
-        uint8_t flag = compressed[in_pos++];
-        
-        for (int bit = 0; bit < 8 && out_pos < pixel_count; bit++) {
-            if (in_pos >= comp_size) break;
-            
-            if (flag & (1 << bit)) {
-                /* Literal byte */
-                uint8_t val = compressed[in_pos++];
+    while (out_pos < pixel_count) {
+        if (left) {
+            /* Copy from window */
+            int length = left < pixel_count - out_pos ? left : pixel_count - out_pos;
+            left -= length;
+            for (int i = 0; i < length; i++) {
+                int win_idx = (window_pos - offset + LZSS_WINDOW_SIZE) & (LZSS_WINDOW_SIZE - 1);
+                uint8_t val = window[win_idx];
                 window[window_pos] = val;
-                window_pos = (window_pos + 1) % LZSS_WINDOW_SIZE;
+                window_pos = (window_pos + 1) & (LZSS_WINDOW_SIZE - 1);
                 
                 /* Expand via palette */
                 out[out_pos++] = pal[val < num_colors ? val : 0];
-            } else {
-                /* Back-reference: 2 bytes */
-                if (in_pos + 1 >= comp_size) break;
-                uint8_t b1 = compressed[in_pos++];
-                uint8_t b2 = compressed[in_pos++];
-                
-                int offset = (b1 | ((b2 & 0xF0) << 4));
-                int length = (b2 & 0x0F) + LZSS_MIN_MATCH;
-                
-                /* Copy from window */
-                for (int i = 0; i < length && out_pos < pixel_count; i++) {
-                    int win_idx = (window_pos - offset + LZSS_WINDOW_SIZE) % LZSS_WINDOW_SIZE;
-                    uint8_t val = window[win_idx];
-                    window[window_pos] = val;
-                    window_pos = (window_pos + 1) % LZSS_WINDOW_SIZE;
-                    
-                    /* Expand via palette */
-                    out[out_pos++] = pal[val < num_colors ? val : 0];
-                }
             }
+            continue;
+        }
+        
+        if (in_pos >= comp_size) break;
+        if (!bits) {
+            flag = compressed[in_pos++];
+            bits = 8;
+            if (in_pos >= comp_size) break;
+        }
+        int literal = flag & 1;
+        flag >>= 1;
+        bits--;
+        
+        if (literal) {
+            /* Literal byte */
+            uint8_t val = compressed[in_pos++];
+            window[window_pos] = val;
+            window_pos = (window_pos + 1) & (LZSS_WINDOW_SIZE - 1);
+            
+            /* Expand via palette */
+            out[out_pos++] = pal[val < num_colors ? val : 0];
+        } else {
+            /* Back-reference: 2 bytes */
+            if (in_pos + 1 >= comp_size) {
+                in_pos = comp_size;
+                break;
+            }
+            uint8_t b1 = compressed[in_pos++];
+            uint8_t b2 = compressed[in_pos++];
+            
+            offset = (b1 | ((b2 & 0xF0) << 4));
+            left = (b2 & 0x0F) + LZSS_MIN_MATCH;
         }
     }
+    
+    s->in_pos = in_pos;
+    s->flag = flag;
+    s->bits = bits;
+    s->match_offset = offset;
+    s->match_left = left;
+    s->window_pos = window_pos;
+    return out_pos;
+}
+
+/* Decompress LZSS data to indices, then expand via palette */
+static void decompress_palette_lzss(const uint8_t *compressed, size_t comp_size,
+                                     const uint16_t *pal, int num_colors,
+                                     uint16_t *out, int pixel_count) {
+    lzss_stream_t s;
+    lzss_begin(&s, compressed, comp_size, pal, num_colors);
+    lzss_decode(&s, out, pixel_count);
 }
 #endif
 
-/* Decode RLE XOR delta and apply to frame_buffer */
-static void apply_delta_rle_xor(const uint8_t *delta, size_t delta_size) {
+/* --- SSE2 pixel runs --- */
+/* Stream payloads are little-endian RGB565, the same layout as frame_buffer, */
+/* so literal runs are loaded 8 pixels at a time straight from the stream. */
+/* Neither side is aligned in general (runs start anywhere): loadu/storeu. */
+
+/* dst[0..n) ^= n stream pixels at src */
+static inline void run_xor(uint16_t *dst, const uint8_t *src, int n) {
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + i * 2));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_xor_si128(d, s));
+    }
+    for (src += i * 2; i < n; i++, src += 2) dst[i] ^= src[0] | (src[1] << 8);
+}
+
+/* dst[0..n) = n stream pixels at src */
+static inline void run_copy(uint16_t *dst, const uint8_t *src, int n) {
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_loadu_si128((const __m128i *)(src + i * 2)));
+    }
+    for (src += i * 2; i < n; i++, src += 2) dst[i] = src[0] | (src[1] << 8);
+}
+
+/* dst[0..n) = val */
+static inline void run_fill(uint16_t *dst, uint16_t val, int n) {
+    __m128i v = _mm_set1_epi16((short)val);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) _mm_storeu_si128((__m128i *)(dst + i), v);
+    for (; i < n; i++) dst[i] = val;
+}
+
+/* Extend dirty by the pixels a copy/fill run at frame_buffer[idx] would change */
+static inline void dirty_add_copy(int idx, const uint8_t *src, int n) {
+    int lo = -1, hi = -1;
+    for (int i = 0; i < n; i++) {
+        if (frame_buffer[idx + i] != (uint16_t)(src[i * 2] | (src[i * 2 + 1] << 8))) {
+            if (lo < 0) lo = i;
+            hi = i;
+        }
+    }
+    if (lo >= 0) dirty_add_span(&dirty, idx + lo, idx + hi + 1);
+}
+
+static inline void dirty_add_fill(int idx, uint16_t val, int n) {
+    int lo = -1, hi = -1;
+    for (int i = 0; i < n; i++) {
+        if (frame_buffer[idx + i] != val) {
+            if (lo < 0) lo = i;
+            hi = i;
+        }
+    }
+    if (lo >= 0) dirty_add_span(&dirty, idx + lo, idx + hi + 1);
+}
+
+/* Decode RLE XOR delta and apply to frame_buffer, starting at pixel start */
+static void apply_delta_rle_xor(const uint8_t *delta, size_t delta_size, int start) {
     size_t pos = 0;
-    int pixel_idx = 0;
+    int pixel_idx = start;
     int max_pixels = FRAME_W * FRAME_H;
     
     while (pos < delta_size) {
@@ -131,22 +491,22 @@ static void apply_delta_rle_xor(const uint8_t *delta, size_t delta_size) {
             /* Clamp to max to prevent overflow in next iteration */
             if (pixel_idx > max_pixels) pixel_idx = max_pixels;
         } else {
+            /* Clip the run to the frame and to the bytes left in the stream */
             int count = cmd;
-            for (int i = 0; i < count && pixel_idx < max_pixels; i++) {
-                /* Bounds check before reading 2 bytes */
-                if (pos + 1 >= delta_size) break;
-                uint16_t xor_val = delta[pos] | (delta[pos + 1] << 8);
-                pos += 2;
-                frame_buffer[pixel_idx++] ^= xor_val;
-            }
+            if (count > max_pixels - pixel_idx) count = max_pixels - pixel_idx;
+            if (count > (int)((delta_size - pos) / 2)) count = (delta_size - pos) / 2;
+            run_xor(frame_buffer + pixel_idx, delta + pos, count);
+            if (TRACK_DIRTY) dirty_add_span(&dirty, pixel_idx, pixel_idx + count);
+            pixel_idx += count;
+            pos += count * 2;
         }
     }
 }
 
-/* Decode RLE Direct (no XOR, direct pixel values) */
-static void apply_delta_rle_direct(const uint8_t *delta, size_t delta_size) {
+/* Decode RLE Direct (no XOR, direct pixel values), starting at pixel start */
+static void apply_delta_rle_direct(const uint8_t *delta, size_t delta_size, int start) {
     size_t pos = 0;
-    int pixel_idx = 0;
+    int pixel_idx = start;
     int max_pixels = FRAME_W * FRAME_H;
     
     while (pos < delta_size) {
@@ -160,17 +520,19 @@ static void apply_delta_rle_direct(const uint8_t *delta, size_t delta_size) {
             if (pos + 1 >= delta_size) break;
             uint16_t val = delta[pos] | (delta[pos + 1] << 8);
             pos += 2;
-            for (int i = 0; i < count && pixel_idx < max_pixels; i++) {
-                frame_buffer[pixel_idx++] = val;
-            }
+            if (count > max_pixels - pixel_idx) count = max_pixels - pixel_idx;
+            /* Every pixel is rewritten: only changed ones extend the dirty span */
+            if (TRACK_DIRTY) dirty_add_fill(pixel_idx, val, count);
+            run_fill(frame_buffer + pixel_idx, val, count);
+            pixel_idx += count;
         } else {
             int count = cmd;
-            for (int i = 0; i < count && pixel_idx < max_pixels; i++) {
-                /* Bounds check before reading 2 bytes */
-                if (pos + 1 >= delta_size) break;
-                frame_buffer[pixel_idx++] = delta[pos] | (delta[pos + 1] << 8);
-                pos += 2;
-            }
+            if (count > max_pixels - pixel_idx) count = max_pixels - pixel_idx;
+            if (count > (int)((delta_size - pos) / 2)) count = (delta_size - pos) / 2;
+            if (TRACK_DIRTY) dirty_add_copy(pixel_idx, delta + pos, count);
+            run_copy(frame_buffer + pixel_idx, delta + pos, count);
+            pixel_idx += count;
+            pos += count * 2;
         }
     }
 }
@@ -190,6 +552,7 @@ static void apply_delta_sparse_xor(const uint8_t *delta, size_t delta_size) {
         
         if (idx < FRAME_W * FRAME_H) {
             frame_buffer[idx] ^= xor_val;
+            if (TRACK_DIRTY) dirty_add_span(&dirty, idx, idx + 1);
         }
     }
 }
@@ -199,191 +562,617 @@ static void apply_delta_raw(const uint8_t *raw, size_t size) {
     int pixels = size / 2;
     if (pixels > FRAME_W * FRAME_H) pixels = FRAME_W * FRAME_H;
     
-    for (int i = 0; i < pixels; i++) {
-        frame_buffer[i] = raw[i * 2] | (raw[i * 2 + 1] << 8);
-    }
+    run_copy(frame_buffer, raw, pixels);
 }
 
-/* Apply delta based on compression method */
-static void apply_delta(const uint8_t *delta, size_t delta_size) {
-#if COMPRESS_METHOD == 0
-    apply_delta_rle_xor(delta, delta_size);
-#elif COMPRESS_METHOD == 1
-    apply_delta_rle_direct(delta, delta_size);
-#elif COMPRESS_METHOD == 2
-    apply_delta_sparse_xor(delta, delta_size);
-#elif COMPRESS_METHOD == 3
-    apply_delta_raw(delta, delta_size);
+#ifdef TILE_REF
+/* --- Tile codec (COMPRESS_METHOD 7, or tag 7 under 6) --- */
+/* 8x8 tiles in raster order. Copies read the previous frame from tile_ref, */
+/* which only gets the area decoded since the last tile frame copied back in */
+#define TILE 8
+#define TILES_X ((FRAME_W + TILE - 1) / TILE)
+#define TILES_N (TILES_X * ((FRAME_H + TILE - 1) / TILE))
+
+static uint16_t *tile_ref = NULL;
+static dirty_rect_t tile_stale;  /* Where frame_buffer may differ from tile_ref */
+
+/* Record that frame f has been decoded into frame_buffer */
+static inline void tile_mark_stale(int f) {
+#if TRACK_DIRTY
+    (void)f;
+    dirty_mark_full(&tile_stale);
+#else
+    dirty_add_frame(&tile_stale, f);
 #endif
 }
 
-/* Load frame 0 based on compression method */
-static void load_frame_0(const uint8_t *raw, size_t size) {
-    /* Frame 0 is always stored as raw RGB565 for all methods */
-    apply_delta_raw(raw, size);
+static void tile_ref_sync(void) {
+    if (dirty_empty(&tile_stale)) return;
+    int bytes = (tile_stale.x1 - tile_stale.x0) * 2;
+    for (int y = tile_stale.y0; y < tile_stale.y1; y++) {
+        int o = y * FRAME_W + tile_stale.x0;
+        memcpy(tile_ref + o, frame_buffer + o, bytes);
+    }
+    dirty_reset(&tile_stale);
 }
 
-/* Fill framebuffer with solid color - optimized */
-static void fill_fb_color(uint8_t *fbmem, int fb_w, int fb_h, int line_len, 
-                          int bpp, uint16_t color, int r_off, int g_off, int b_off) {
-    /* Fast path for black (0x0000) - use memset */
-    if (color == 0x0000) {
-        for (int y = 0; y < fb_h; y++) {
-            memset(fbmem + y * line_len, 0, line_len);
-        }
-        return;
-    }
+/* Pixel rect of tile t, clipped to the frame */
+static inline dirty_rect_t tile_rect(int t) {
+    dirty_rect_t r;
+    r.x0 = (t % TILES_X) * TILE;
+    r.y0 = (t / TILES_X) * TILE;
+    r.x1 = r.x0 + TILE < FRAME_W ? r.x0 + TILE : FRAME_W;
+    r.y1 = r.y0 + TILE < FRAME_H ? r.y0 + TILE : FRAME_H;
+    return r;
+}
+
+static void tile_copy(int t, int dx, int dy) {
+    dirty_rect_t r = tile_rect(t);
+    int sx = r.x0 + dx, sy = r.y0 + dy;
+    if (sx < 0 || sy < 0 || sx + (r.x1 - r.x0) > FRAME_W || sy + (r.y1 - r.y0) > FRAME_H) return;
     
-    /* For 32bpp with standard layout, use SSE2 */
-    if (bpp == 32 && r_off == 16 && g_off == 8 && b_off == 0) {
-        /* XRGB8888 standard layout */
-        uint32_t r = (color >> 11) & 0x1F;
-        uint32_t g = (color >> 5) & 0x3F;
-        uint32_t b = color & 0x1F;
-        uint32_t pixel = (r << 19) | (g << 10) | (b << 3);
-        
-        /* Fill with SSE2 (4 pixels at a time) */
-        __m128i fill_val = _mm_set1_epi32(pixel);
-        
-        for (int y = 0; y < fb_h; y++) {
-            uint32_t *dst = (uint32_t *)(fbmem + y * line_len);
-            int x = 0;
-            for (; x + 3 < fb_w; x += 4) {
-                _mm_storeu_si128((__m128i*)(dst + x), fill_val);
-            }
-            for (; x < fb_w; x++) dst[x] = pixel;
-        }
-        return;
+    int bytes = (r.x1 - r.x0) * 2;
+    for (int y = r.y0; y < r.y1; y++, sy++) {
+        memcpy(frame_buffer + y * FRAME_W + r.x0, tile_ref + sy * FRAME_W + sx, bytes);
     }
-    
-    /* Fallback for other cases */
-    for (int y = 0; y < fb_h; y++) {
-        if (bpp == 32) {
-            uint32_t *dst = (uint32_t *)(fbmem + y * line_len);
-            uint32_t r = (color >> 11) & 0x1F;
-            uint32_t g = (color >> 5) & 0x3F;
-            uint32_t b = color & 0x1F;
-            uint32_t pixel = ((r << 3) << r_off) | ((g << 2) << g_off) | ((b << 3) << b_off);
-            for (int x = 0; x < fb_w; x++) dst[x] = pixel;
-        } else if (bpp == 16) {
-            uint16_t *dst = (uint16_t *)(fbmem + y * line_len);
-            uint16_t pattern = color;
-            for (int x = 0; x < fb_w; x++) dst[x] = pattern;
-        } else if (bpp == 24) {
-            uint8_t *dst = fbmem + y * line_len;
-            uint32_t r = (color >> 11) & 0x1F;
-            uint32_t g = (color >> 5) & 0x3F;
-            uint32_t b = color & 0x1F;
-            uint8_t r8 = r << 3;
-            uint8_t g8 = g << 2;
-            uint8_t b8 = b << 3;
-            for (int x = 0; x < fb_w; x++) {
-                uint8_t *pixel = dst + x * 3;
-                pixel[r_off] = r8;
-                pixel[g_off] = g8;
-                pixel[b_off] = b8;
-            }
-        }
+    if (TRACK_DIRTY) dirty_union(&dirty, &r);
+}
+
+static void tile_fill(int t, uint16_t val) {
+    dirty_rect_t r = tile_rect(t);
+    for (int y = r.y0; y < r.y1; y++) {
+        uint16_t *row = frame_buffer + y * FRAME_W;
+        for (int x = r.x0; x < r.x1; x++) row[x] = val;
     }
+    if (TRACK_DIRTY) dirty_union(&dirty, &r);
 }
 
-/* Fill a rectangular area with solid color - for partial clearing */
-/* Only used when frames don't fully cover their area (future optimization) */
-#if DISPLAY_MODE == 0
-static void fill_rect(uint8_t *fbmem, int fb_w, int fb_h, int line_len, int bpp,
-                      int rect_x, int rect_y, int rect_w, int rect_h,
-                      uint16_t color, int r_off, int g_off, int b_off) {
-    /* Clip to framebuffer bounds */
-    if (rect_x < 0) { rect_w += rect_x; rect_x = 0; }
-    if (rect_y < 0) { rect_h += rect_y; rect_y = 0; }
-    if (rect_x + rect_w > fb_w) rect_w = fb_w - rect_x;
-    if (rect_y + rect_h > fb_h) rect_h = fb_h - rect_y;
-    if (rect_w <= 0 || rect_h <= 0) return;
+/* RLE XOR over the tile's pixels in place; returns the position after its 0x00 */
+static size_t tile_xor(int t, const uint8_t *delta, size_t delta_size, size_t pos) {
+    dirty_rect_t r = tile_rect(t);
+    int tw = r.x1 - r.x0;
+    int n = tw * (r.y1 - r.y0);
+    int i = 0;
     
-    /* Fast path for black */
-    if (color == 0x0000) {
-        for (int y = rect_y; y < rect_y + rect_h; y++) {
-            if (bpp == 32) {
-                memset(fbmem + y * line_len + rect_x * 4, 0, rect_w * 4);
-            } else if (bpp == 16) {
-                memset(fbmem + y * line_len + rect_x * 2, 0, rect_w * 2);
-            }
+    while (pos < delta_size) {
+        uint8_t cmd = delta[pos++];
+        if (cmd == 0x00) break;
+        if (cmd & 0x80) {
+            i += (cmd & 0x7F) + 1;
+            continue;
+        }
+        for (int k = 0; k < cmd && i < n; k++, i++) {
+            /* Bounds check before reading 2 bytes */
+            if (pos + 1 >= delta_size) return delta_size;
+            uint16_t xor_val = delta[pos] | (delta[pos + 1] << 8);
+            pos += 2;
+            frame_buffer[(r.y0 + i / tw) * FRAME_W + r.x0 + i % tw] ^= xor_val;
         }
-        return;
     }
+    if (TRACK_DIRTY) dirty_union(&dirty, &r);
+    return pos;
+}
+
+/* Decode a tile stream; start is the first pixel of the frame's dirty rows */
+static void apply_delta_tile(const uint8_t *delta, size_t delta_size, int start) {
+    tile_ref_sync();
     
-    /* Fill rect with color */
-    for (int y = rect_y; y < rect_y + rect_h; y++) {
-        if (bpp == 32) {
-            uint32_t *dst = (uint32_t *)(fbmem + y * line_len + rect_x * 4);
-            uint32_t r = (color >> 11) & 0x1F;
-            uint32_t g = (color >> 5) & 0x3F;
-            uint32_t b = color & 0x1F;
-            uint32_t pixel = ((r << 3) << r_off) | ((g << 2) << g_off) | ((b << 3) << b_off);
-            for (int x = 0; x < rect_w; x++) dst[x] = pixel;
-        } else if (bpp == 16) {
-            uint16_t *dst = (uint16_t *)(fbmem + y * line_len + rect_x * 2);
-            for (int x = 0; x < rect_w; x++) dst[x] = color;
+    size_t pos = 0;
+    int t = (start / FRAME_W / TILE) * TILES_X;
+    
+    while (pos < delta_size && t < TILES_N) {
+        uint8_t cmd = delta[pos++];
+        int n = (cmd & 0x3F) + 1;
+        
+        if (cmd == 0x00) {
+            break;
+        } else if (cmd < 0x40) {
+            /* Skip unchanged tiles, 0x3F carries a 16-bit count */
+            if (cmd == 0x3F) {
+                if (pos + 1 >= delta_size) break;
+                t += delta[pos] | (delta[pos + 1] << 8);
+                pos += 2;
+            } else {
+                t += cmd;
+            }
+        } else if (cmd < 0x80) {
+            /* Copy from the previous frame at a fixed displacement */
+            if (pos + 1 >= delta_size) break;
+            int dx = (int8_t)delta[pos];
+            int dy = (int8_t)delta[pos + 1];
+            pos += 2;
+            for (; n > 0 && t < TILES_N; n--) tile_copy(t++, dx, dy);
+        } else if (cmd < 0xC0) {
+            if (pos + 1 >= delta_size) break;
+            uint16_t val = delta[pos] | (delta[pos + 1] << 8);
+            pos += 2;
+            for (; n > 0 && t < TILES_N; n--) tile_fill(t++, val);
+        } else {
+            for (; n > 0 && t < TILES_N; n--) pos = tile_xor(t++, delta, delta_size, pos);
         }
     }
 }
 #endif
 
-/* SSE2 optimized RGB565 to XRGB8888 conversion (standard layout: R=16, G=8, B=0) */
-/* Processes 8 pixels at once. Requires SSE2 capable CPU (all x86_64 have it). */
-static void blit_to_fb_32bpp_sse2(uint32_t *dst, const uint16_t *src, int count) {
-    int i = 0;
-    
-    /* Process 8 pixels at a time */
-    for (; i + 7 < count; i += 8) {
-        /* Load 8 RGB565 pixels (16 bytes) */
-        __m128i pixels = _mm_loadu_si128((__m128i*)(src + i));
-        
-        /* Expand to 32-bit: unpack low 4 pixels */
-        __m128i lo = _mm_unpacklo_epi16(pixels, _mm_setzero_si128());
-        /* Expand to 32-bit: unpack high 4 pixels */
-        __m128i hi = _mm_unpackhi_epi16(pixels, _mm_setzero_si128());
-        
-        /* RGB565 layout: RRRRRGGGGGGBBBBB (R5@11-15, G6@5-10, B5@0-4) */
-        /* XRGB8888 target: R@16-23, G@8-15, B@0-7 */
+#if COMPRESS_METHOD == 6
+/* Sparse indices are absolute, so the start row is not needed */
+static void apply_delta_sparse_tagged(const uint8_t *delta, size_t delta_size, int start) {
+    (void)start;
+    apply_delta_sparse_xor(delta, delta_size);
+}
+
+#ifdef ASSET_PATH
+/* Raw frames are whole frames. Only the container tags them: -z raw themes */
+static void apply_delta_raw_tagged(const uint8_t *delta, size_t delta_size, int start) {
+    (void)start;
+    apply_delta_raw(delta, delta_size);
+}
+#endif
+
+/* Per-frame codec: byte 0 of a delta stream selects its decoder */
+static void (*const delta_codecs[8])(const uint8_t *, size_t, int) = {
+    [0] = apply_delta_rle_xor,        /* RLE XOR */
+    [1] = apply_delta_rle_direct,     /* RLE Direct */
+    [2] = apply_delta_sparse_tagged,  /* Sparse XOR */
+#ifdef ASSET_PATH
+    [3] = apply_delta_raw_tagged,     /* Raw */
+#endif
+#ifdef TILE_REF
+    [7] = apply_delta_tile,           /* 8x8 tiles */
+#endif
+};
+#endif
+
+#ifdef FRAME_ALPHA
+/* --- Alpha frames (generate_splash -a) --- */
+/* Frames carry a 4-bit coverage plane next to premultiplied colours. Each */
+/* delta has an alpha stream over the same rows (RLE XOR, see the generator): */
+/*   0x00 end, 0x01-0x7F N XOR nibbles (two per byte, low first), */
+/*   0x80-0xFF skip (cmd & 0x7F) + 1 pixels. */
+/* Before a blit the dirty region is blended over the background into comp_buffer: */
+/* out = fg + bg * (15 - a) / 15 per RGB565 channel. */
+#define ALPHA_MAX 15
+
+static uint8_t *alpha_buffer = NULL;    /* FRAME_W * FRAME_H coverage, 0-15 */
+static uint16_t *comp_buffer = NULL;    /* Blended frame, plus one BACKGROUND_COLOR row */
+
+static void apply_alpha(const uint8_t *delta, size_t delta_size, int start) {
+    size_t pos = 0;
+    int idx = start;
+    
+    while (pos < delta_size) {
+        uint8_t cmd = delta[pos++];
+        if (cmd == 0x00) break;
+        if (cmd & 0x80) {
+            idx += (cmd & 0x7F) + 1;
+            continue;
+        }
+        if (pos + (cmd + 1) / 2 > delta_size) break;
+        if (TRACK_DIRTY) dirty_add_span(&dirty, idx, idx + cmd);
+        for (int i = 0; i < cmd; i += 2) {
+            uint8_t b = delta[pos++];
+            alpha_buffer[idx + i] ^= b & 0x0F;
+            if (i + 1 < cmd) alpha_buffer[idx + i + 1] ^= b >> 4;
+        }
+        idx += cmd;
+    }
+}
+
+/* c * (15 - a) / 15 rounded, exact for c * (15 - a) <= 945: (v + 7) * 4370 >> 16 */
+static inline uint16_t blend_565(uint16_t fg, uint16_t bg, int a) {
+    int ia = ALPHA_MAX - a;
+    int r = (fg >> 11) + ((((bg >> 11) * ia + 7) * 4370) >> 16);
+    int g = ((fg >> 5) & 0x3F) + (((((bg >> 5) & 0x3F) * ia + 7) * 4370) >> 16);
+    int b = (fg & 0x1F) + ((((bg & 0x1F) * ia + 7) * 4370) >> 16);
+    if (r > 0x1F) r = 0x1F;
+    if (g > 0x3F) g = 0x3F;
+    if (b > 0x1F) b = 0x1F;
+    return (r << 11) | (g << 5) | b;
+}
+
+/* dst[0..n) = fg over bg, 8 pixels per step */
+static void blend_run(uint16_t *dst, const uint16_t *fg, const uint8_t *a, const uint16_t *bg, int n) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i amax = _mm_set1_epi16(ALPHA_MAX);
+    const __m128i round = _mm_set1_epi16(7);
+    const __m128i div15 = _mm_set1_epi16(4370);
+    const __m128i m5 = _mm_set1_epi16(0x1F);
+    const __m128i m6 = _mm_set1_epi16(0x3F);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i f = _mm_loadu_si128((const __m128i *)(fg + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(bg + i));
+        __m128i ia = _mm_sub_epi16(amax, _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(a + i)), zero));
+        __m128i br = _mm_mulhi_epu16(_mm_add_epi16(_mm_mullo_epi16(_mm_srli_epi16(b, 11), ia), round), div15);
+        __m128i bgc = _mm_mulhi_epu16(_mm_add_epi16(_mm_mullo_epi16(_mm_and_si128(_mm_srli_epi16(b, 5), m6), ia),
+                                                    round), div15);
+        __m128i bb = _mm_mulhi_epu16(_mm_add_epi16(_mm_mullo_epi16(_mm_and_si128(b, m5), ia), round), div15);
+        __m128i r = _mm_min_epi16(_mm_add_epi16(_mm_srli_epi16(f, 11), br), m5);
+        __m128i g = _mm_min_epi16(_mm_add_epi16(_mm_and_si128(_mm_srli_epi16(f, 5), m6), bgc), m6);
+        __m128i bl = _mm_min_epi16(_mm_add_epi16(_mm_and_si128(f, m5), bb), m5);
+        __m128i out = _mm_or_si128(_mm_or_si128(_mm_slli_epi16(r, 11), _mm_slli_epi16(g, 5)), bl);
+        _mm_storeu_si128((__m128i *)(dst + i), out);
+    }
+    for (; i < n; i++) dst[i] = blend_565(fg[i], bg[i], a[i]);
+}
+
+/* Blend rect r of the frame, placed at screen (x, y), into comp_buffer. */
+/* Pixels off the background image blend over BACKGROUND_COLOR; the image */
+/* part is bg_rect of it, which covers the frame. */
+static void alpha_compose(const dirty_rect_t *r, int x, int y) {
+    const uint16_t *fill = comp_buffer + FRAME_W * FRAME_H;
+    int bg_stride = bg_rect.x1 - bg_rect.x0;
+    for (int fy = r->y0; fy < r->y1; fy++) {
+        int o = fy * FRAME_W;
+        int sy = y + fy;
+        int x0 = r->x0, x1 = r->x1;
+        /* Columns over the image: [bx0, bx1) */
+        int bx0 = x0, bx1 = x0;
+        if (bg_buffer && sy >= bg_rect.y0 && sy < bg_rect.y1) {
+            bx0 = bg_rect.x0 - x > x0 ? bg_rect.x0 - x : x0;
+            bx1 = bg_rect.x1 - x < x1 ? bg_rect.x1 - x : x1;
+            if (bx0 > x1) bx0 = x1;
+            if (bx1 < bx0) bx1 = bx0;
+        }
+        if (bx0 > x0) {
+            blend_run(comp_buffer + o + x0, frame_buffer + o + x0, alpha_buffer + o + x0, fill, bx0 - x0);
+        }
+        if (bx1 > bx0) {
+            blend_run(comp_buffer + o + bx0, frame_buffer + o + bx0, alpha_buffer + o + bx0,
+                      bg_buffer + (sy - bg_rect.y0) * bg_stride + x + bx0 - bg_rect.x0, bx1 - bx0);
+        }
+        if (x1 > bx1) {
+            blend_run(comp_buffer + o + bx1, frame_buffer + o + bx1, alpha_buffer + o + bx1, fill, x1 - bx1);
+        }
+    }
+}
+
+/* Frames reach the screen through comp_buffer */
+#define FRAME_OUT comp_buffer
+#else
+#define FRAME_OUT frame_buffer
+#endif
+
+/* Apply delta of frame f based on compression method */
+static void apply_delta(const uint8_t *delta, size_t delta_size, int f) {
+#if COMPRESS_METHOD == 6
+    if (delta_size > 0 && delta[0] < 8 && delta_codecs[delta[0]]) {
+        delta_codecs[delta[0]](delta + 1, delta_size - 1, delta_start(f));
+    }
+#elif COMPRESS_METHOD == 7
+    apply_delta_tile(delta, delta_size, delta_start(f));
+#elif COMPRESS_METHOD == 0
+    apply_delta_rle_xor(delta, delta_size, delta_start(f));
+#elif COMPRESS_METHOD == 1
+    apply_delta_rle_direct(delta, delta_size, delta_start(f));
+#elif COMPRESS_METHOD == 2
+    apply_delta_sparse_xor(delta, delta_size);
+#elif COMPRESS_METHOD == 3
+    apply_delta_raw(delta, delta_size);
+    if (TRACK_DIRTY) dirty_mark_full(&dirty);
+#endif
+#ifdef FRAME_ALPHA
+    apply_alpha(alphas[f], alpha_sizes[f], delta_start(f));
+#endif
+#ifdef TILE_REF
+    tile_mark_stale(f);
+#endif
+    dirty_add_frame(&dirty, f);
+}
+
+/* Load frame 0 based on its own method (raw for headers without FRAME0_METHOD) */
+#ifndef FRAME0_METHOD
+#define FRAME0_METHOD 3
+#endif
+
+static void load_frame_0(const uint8_t *data, size_t size) {
+#ifdef ASSET_PATH
+    if (asset->frame0_method == 5) {
+        decompress_palette_lzss(data, size, frame0_palette, FRAME0_PALETTE_SIZE,
+                                frame_buffer, FRAME_W * FRAME_H);
+    } else if (asset->frame0_method == 1) {
+        apply_delta_rle_direct(data, size, 0);
+    } else {
+        apply_delta_raw(data, size);
+    }
+#elif FRAME0_METHOD == 5
+    decompress_palette_lzss(data, size, frame0_palette, FRAME0_PALETTE_SIZE,
+                            frame_buffer, FRAME_W * FRAME_H);
+#elif FRAME0_METHOD == 1
+    apply_delta_rle_direct(data, size, 0);
+#else
+    apply_delta_raw(data, size);
+#endif
+#ifdef FRAME_ALPHA
+    memset(alpha_buffer, 0, FRAME_W * FRAME_H);
+    apply_alpha(alphas[0], alpha_sizes[0], 0);
+#endif
+    dirty_mark_full(&dirty);
+#ifdef TILE_REF
+    dirty_mark_full(&tile_stale);
+#endif
+}
+
+/* --- CPU feature detection --- */
+/* The binary targets baseline x86-64 (SSE2). Faster kernels are compiled with */
+/* per-function target attributes and only called when cpuid reports them. */
+
+#define CPU_SSSE3   (1 << 0)
+#define CPU_AVX2    (1 << 1)
+
+static int cpu_features = 0;
+
+static inline void cpuid(uint32_t leaf, uint32_t sub,
+                         uint32_t *a, uint32_t *b, uint32_t *c, uint32_t *d) {
+    __asm__ volatile ("cpuid" : "=a"(*a), "=b"(*b), "=c"(*c), "=d"(*d) : "a"(leaf), "c"(sub));
+}
+
+static void cpu_detect(void) {
+    uint32_t a, b, c, d;
+    
+    cpuid(0, 0, &a, &b, &c, &d);
+    uint32_t max_leaf = a;
+    
+    cpuid(1, 0, &a, &b, &c, &d);
+    if (c & (1 << 9)) cpu_features |= CPU_SSSE3;
+    
+    /* AVX2 also needs the kernel to save YMM state: OSXSAVE + AVX, XCR0 bits 1-2 */
+    if (max_leaf >= 7 && (c & (1 << 27)) && (c & (1 << 28))) {
+        uint32_t xcr0_lo, xcr0_hi;
+        __asm__ volatile ("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+        if ((xcr0_lo & 6) == 6) {
+            cpuid(7, 0, &a, &b, &c, &d);
+            if (b & (1 << 5)) cpu_features |= CPU_AVX2;
+        }
+    }
+}
+
+/* --- Streaming (non-temporal) stores --- */
+/* Framebuffer mappings are write-combined or uncached: ordinary stores there */
+/* are slow, while movntdq/movnti fill whole WC lines and bypass the cache. */
+/* Every streaming path ends with a single sfence before returning. */
+
+/* Expand one RGB565 pixel to 32bpp with arbitrary component bit offsets */
+static inline uint32_t rgb565_to_32(uint16_t pixel, int r_off, int g_off, int b_off) {
+    uint32_t r = (pixel >> 11) & 0x1F;
+    uint32_t g = (pixel >> 5) & 0x3F;
+    uint32_t b = pixel & 0x1F;
+    return ((r << 3) << r_off) | ((g << 2) << g_off) | ((b << 3) << b_off);
+}
+
+/* Fill row_bytes bytes (multiple of 2, dst 2-byte aligned) with a 32-bit pattern */
+/* A dst that is only 2-byte aligned is a 16bpp row, whose pattern halves are equal */
+static void stream_fill_row(uint8_t *dst, uint32_t pattern, int row_bytes) {
+    uint8_t *end = dst + row_bytes;
+    
+    if (((unsigned long)dst & 2) && dst < end) {
+        *(uint16_t *)dst = (uint16_t)pattern;
+        dst += 2;
+    }
+    
+    /* Head: 4-byte streaming stores up to 16-byte alignment */
+    while (((unsigned long)dst & 15) && dst + 4 <= end) {
+        _mm_stream_si32((int *)dst, (int)pattern);
+        dst += 4;
+    }
+    
+    /* Body: 64 bytes (one WC line) per iteration */
+    __m128i v = _mm_set1_epi32((int)pattern);
+    for (; dst + 64 <= end; dst += 64) {
+        _mm_stream_si128((__m128i *)dst, v);
+        _mm_stream_si128((__m128i *)(dst + 16), v);
+        _mm_stream_si128((__m128i *)(dst + 32), v);
+        _mm_stream_si128((__m128i *)(dst + 48), v);
+    }
+    for (; dst + 16 <= end; dst += 16) {
+        _mm_stream_si128((__m128i *)dst, v);
+    }
+    
+    /* Tail */
+    for (; dst + 4 <= end; dst += 4) {
+        _mm_stream_si32((int *)dst, (int)pattern);
+    }
+    if (dst + 2 <= end) {
+        *(uint16_t *)dst = (uint16_t)pattern;
+    }
+}
+
+/* Fill framebuffer with solid color - optimized */
+static void fill_fb_color(uint8_t *fbmem, int fb_w, int fb_h, int line_len, 
+                          int bpp, uint16_t color, int r_off, int g_off, int b_off) {
+    /* Video memory: streaming stores for every color, black included */
+    if (fb_stream && (bpp == 32 || bpp == 16)) {
+        uint32_t pixel;
+        if (bpp == 32) {
+            pixel = rgb565_to_32(color, r_off, g_off, b_off);
+        } else {
+            pixel = color | ((uint32_t)color << 16);
+        }
+        int row_bytes = fb_w * (bpp / 8);
+        for (int y = 0; y < fb_h; y++) {
+            stream_fill_row(fbmem + y * line_len, pixel, row_bytes);
+        }
+        _mm_sfence();
+        return;
+    }
+    
+    /* Fast path for black (0x0000) - use memset */
+    if (color == 0x0000) {
+        for (int y = 0; y < fb_h; y++) {
+            memset(fbmem + y * line_len, 0, line_len);
+        }
+        return;
+    }
+    
+    /* For 32bpp with standard layout, use SSE2 */
+    if (bpp == 32 && r_off == 16 && g_off == 8 && b_off == 0) {
+        /* XRGB8888 standard layout */
+        uint32_t r = (color >> 11) & 0x1F;
+        uint32_t g = (color >> 5) & 0x3F;
+        uint32_t b = color & 0x1F;
+        uint32_t pixel = (r << 19) | (g << 10) | (b << 3);
         
-        /* R5 (bits 11-15) -> R8 (bits 16-23): shift left by 5 (to bit 16), then 3 more for expansion */
-        __m128i r_mask = _mm_set1_epi32(0x0000F800);  /* bits 11-15 */
-        __m128i r_lo = _mm_and_si128(lo, r_mask);
-        __m128i r_hi = _mm_and_si128(hi, r_mask);
-        r_lo = _mm_slli_epi32(r_lo, 5 + 3);  /* shift to bit 16, then expand 5->8 bits */
-        r_hi = _mm_slli_epi32(r_hi, 5 + 3);
+        /* Fill with SSE2 (4 pixels at a time) */
+        __m128i fill_val = _mm_set1_epi32(pixel);
         
-        /* G6 (bits 5-10) -> G8 (bits 8-15): shift left by 3 (to bit 8), then 2 more for expansion */
-        __m128i g_mask = _mm_set1_epi32(0x000007E0);  /* bits 5-10 */
-        __m128i g_lo = _mm_and_si128(lo, g_mask);
-        __m128i g_hi = _mm_and_si128(hi, g_mask);
-        g_lo = _mm_slli_epi32(g_lo, 3 + 2);  /* shift to bit 8, then expand 6->8 bits */
-        g_hi = _mm_slli_epi32(g_hi, 3 + 2);
-        
-        /* B5 (bits 0-4) -> B8 (bits 0-7): no shift needed, just expand by 3 */
-        __m128i b_mask = _mm_set1_epi32(0x0000001F);  /* bits 0-4 */
-        __m128i b_lo = _mm_and_si128(lo, b_mask);
-        __m128i b_hi = _mm_and_si128(hi, b_mask);
-        b_lo = _mm_slli_epi32(b_lo, 3);  /* expand 5->8 bits */
+        for (int y = 0; y < fb_h; y++) {
+            uint32_t *dst = (uint32_t *)(fbmem + y * line_len);
+            int x = 0;
+            for (; x + 3 < fb_w; x += 4) {
+                _mm_storeu_si128((__m128i*)(dst + x), fill_val);
+            }
+            for (; x < fb_w; x++) dst[x] = pixel;
+        }
+        return;
+    }
+    
+    /* Fallback for other cases */
+    for (int y = 0; y < fb_h; y++) {
+        if (bpp == 32) {
+            uint32_t *dst = (uint32_t *)(fbmem + y * line_len);
+            uint32_t r = (color >> 11) & 0x1F;
+            uint32_t g = (color >> 5) & 0x3F;
+            uint32_t b = color & 0x1F;
+            uint32_t pixel = ((r << 3) << r_off) | ((g << 2) << g_off) | ((b << 3) << b_off);
+            for (int x = 0; x < fb_w; x++) dst[x] = pixel;
+        } else if (bpp == 16) {
+            uint16_t *dst = (uint16_t *)(fbmem + y * line_len);
+            uint16_t pattern = color;
+            for (int x = 0; x < fb_w; x++) dst[x] = pattern;
+        } else if (bpp == 24) {
+            uint8_t *dst = fbmem + y * line_len;
+            uint32_t r = (color >> 11) & 0x1F;
+            uint32_t g = (color >> 5) & 0x3F;
+            uint32_t b = color & 0x1F;
+            uint8_t r8 = r << 3;
+            uint8_t g8 = g << 2;
+            uint8_t b8 = b << 3;
+            for (int x = 0; x < fb_w; x++) {
+                uint8_t *pixel = dst + x * 3;
+                pixel[r_off] = r8;
+                pixel[g_off] = g8;
+                pixel[b_off] = b8;
+            }
+        }
+    }
+}
+
+/* Fill a rectangular area with solid color - for partial clearing */
+/* Also draws the control channel's progress bar */
+#if DISPLAY_MODE == 0 || USE_CONTROL
+static void fill_rect(uint8_t *fbmem, int fb_w, int fb_h, int line_len, int bpp,
+                      int rect_x, int rect_y, int rect_w, int rect_h,
+                      uint16_t color, int r_off, int g_off, int b_off) {
+    /* Clip to framebuffer bounds */
+    if (rect_x < 0) { rect_w += rect_x; rect_x = 0; }
+    if (rect_y < 0) { rect_h += rect_y; rect_y = 0; }
+    if (rect_x + rect_w > fb_w) rect_w = fb_w - rect_x;
+    if (rect_y + rect_h > fb_h) rect_h = fb_h - rect_y;
+    if (rect_w <= 0 || rect_h <= 0) return;
+    if (bpp != 16 && bpp != 24 && bpp != 32) return;
+    
+    /* Fast path for black */
+    if (color == 0x0000) {
+        int bytes_pp = bpp / 8;
+        for (int y = rect_y; y < rect_y + rect_h; y++) {
+            memset(fbmem + y * line_len + rect_x * bytes_pp, 0, rect_w * bytes_pp);
+        }
+        return;
+    }
+    
+    /* Fill rect with color */
+    for (int y = rect_y; y < rect_y + rect_h; y++) {
+        if (bpp == 32) {
+            uint32_t *dst = (uint32_t *)(fbmem + y * line_len + rect_x * 4);
+            uint32_t r = (color >> 11) & 0x1F;
+            uint32_t g = (color >> 5) & 0x3F;
+            uint32_t b = color & 0x1F;
+            uint32_t pixel = ((r << 3) << r_off) | ((g << 2) << g_off) | ((b << 3) << b_off);
+            for (int x = 0; x < rect_w; x++) dst[x] = pixel;
+        } else if (bpp == 16) {
+            uint16_t *dst = (uint16_t *)(fbmem + y * line_len + rect_x * 2);
+            for (int x = 0; x < rect_w; x++) dst[x] = color;
+        } else if (bpp == 24) {
+            /* r_off, g_off, b_off are byte positions here */
+            uint8_t *dst = fbmem + y * line_len + rect_x * 3;
+            uint8_t r8 = ((color >> 11) & 0x1F) << 3;
+            uint8_t g8 = ((color >> 5) & 0x3F) << 2;
+            uint8_t b8 = (color & 0x1F) << 3;
+            for (int x = 0; x < rect_w; x++) {
+                dst[x * 3 + r_off] = r8;
+                dst[x * 3 + g_off] = g8;
+                dst[x * 3 + b_off] = b8;
+            }
+        }
+    }
+}
+#endif
+
+/* Expand 8 RGB565 pixels to 32bpp: XRGB8888 (R=16, G=8, B=0) or, with bgr, */
+/* BGRX8888 (R=0, G=8, B=16). Requires SSE2 capable CPU (all x86_64 have it). */
+static inline __attribute__((always_inline))
+void rgb565_expand_sse2(__m128i pixels, int bgr, __m128i *out_lo, __m128i *out_hi) {
+    /* Expand to 32-bit: unpack low 4 pixels */
+    __m128i lo = _mm_unpacklo_epi16(pixels, _mm_setzero_si128());
+    /* Expand to 32-bit: unpack high 4 pixels */
+    __m128i hi = _mm_unpackhi_epi16(pixels, _mm_setzero_si128());
+    
+    /* RGB565 layout: RRRRRGGGGGGBBBBB (R5@11-15, G6@5-10, B5@0-4) */
+    __m128i r_mask = _mm_set1_epi32(0x0000F800);  /* bits 11-15 */
+    __m128i g_mask = _mm_set1_epi32(0x000007E0);  /* bits 5-10 */
+    __m128i b_mask = _mm_set1_epi32(0x0000001F);  /* bits 0-4 */
+    __m128i r_lo = _mm_and_si128(lo, r_mask);
+    __m128i r_hi = _mm_and_si128(hi, r_mask);
+    __m128i g_lo = _mm_and_si128(lo, g_mask);
+    __m128i g_hi = _mm_and_si128(hi, g_mask);
+    __m128i b_lo = _mm_and_si128(lo, b_mask);
+    __m128i b_hi = _mm_and_si128(hi, b_mask);
+    
+    /* G6 (bits 5-10) -> G8 (bits 8-15): shift left by 3 (to bit 8), then 2 more for expansion */
+    g_lo = _mm_slli_epi32(g_lo, 3 + 2);
+    g_hi = _mm_slli_epi32(g_hi, 3 + 2);
+    
+    if (!bgr) {
+        /* XRGB8888 target: R@16-23, G@8-15, B@0-7 */
+        /* R5 (bits 11-15) -> R8 (bits 16-23): shift to bit 16, then expand 5->8 bits */
+        r_lo = _mm_slli_epi32(r_lo, 5 + 3);
+        r_hi = _mm_slli_epi32(r_hi, 5 + 3);
+        /* B5 (bits 0-4) -> B8 (bits 0-7): just expand by 3 */
+        b_lo = _mm_slli_epi32(b_lo, 3);
         b_hi = _mm_slli_epi32(b_hi, 3);
-        
-        /* Combine R, G, B */
-        __m128i result_lo = _mm_or_si128(_mm_or_si128(r_lo, g_lo), b_lo);
-        __m128i result_hi = _mm_or_si128(_mm_or_si128(r_hi, g_hi), b_hi);
+    } else {
+        /* BGRX8888 target: R@0-7, G@8-15, B@16-23 */
+        /* R5 (bits 11-15) -> R8 (bits 0-7): effectively >>11 then <<3 */
+        r_lo = _mm_srli_epi32(r_lo, 11 - 3);
+        r_hi = _mm_srli_epi32(r_hi, 11 - 3);
+        /* B5 (bits 0-4) -> B8 (bits 16-23): shift left 16, then expand */
+        b_lo = _mm_slli_epi32(b_lo, 16 + 3);
+        b_hi = _mm_slli_epi32(b_hi, 16 + 3);
+    }
+    
+    /* Combine R, G, B */
+    *out_lo = _mm_or_si128(_mm_or_si128(r_lo, g_lo), b_lo);
+    *out_hi = _mm_or_si128(_mm_or_si128(r_hi, g_hi), b_hi);
+}
+
+/* SSE2 optimized RGB565 to XRGB8888 conversion (standard layout: R=16, G=8, B=0) */
+/* Processes 8 pixels at once */
+static void blit_to_fb_32bpp_sse2(uint32_t *dst, const uint16_t *src, int count) {
+    int i = 0;
+    
+    /* Process 8 pixels at a time */
+    for (; i + 7 < count; i += 8) {
+        __m128i lo, hi;
+        rgb565_expand_sse2(_mm_loadu_si128((__m128i*)(src + i)), 0, &lo, &hi);
         
         /* Store 8 XRGB8888 pixels (32 bytes) */
-        _mm_storeu_si128((__m128i*)(dst + i), result_lo);
-        _mm_storeu_si128((__m128i*)(dst + i + 4), result_hi);
+        _mm_storeu_si128((__m128i*)(dst + i), lo);
+        _mm_storeu_si128((__m128i*)(dst + i + 4), hi);
     }
     
     /* Handle remaining pixels with scalar code */
     for (; i < count; i++) {
-        uint16_t pixel = src[i];
-        uint32_t r = (pixel >> 11) & 0x1F;
-        uint32_t g = (pixel >> 5) & 0x3F;
-        uint32_t b = pixel & 0x1F;
-        dst[i] = (r << 19) | (g << 10) | (b << 3);  /* XRGB8888: R@16, G@8, B@0 */
+        dst[i] = rgb565_to_32(src[i], 16, 8, 0);  /* XRGB8888: R@16, G@8, B@0 */
     }
 }
 
@@ -392,166 +1181,1125 @@ static void blit_to_fb_32bpp_sse2_bgr(uint32_t *dst, const uint16_t *src, int co
     int i = 0;
     
     for (; i + 7 < count; i += 8) {
-        __m128i pixels = _mm_loadu_si128((__m128i*)(src + i));
-        __m128i lo = _mm_unpacklo_epi16(pixels, _mm_setzero_si128());
-        __m128i hi = _mm_unpackhi_epi16(pixels, _mm_setzero_si128());
+        __m128i lo, hi;
+        rgb565_expand_sse2(_mm_loadu_si128((__m128i*)(src + i)), 1, &lo, &hi);
         
-        /* RGB565 -> BGRX8888: R@0-7, G@8-15, B@16-23 */
+        _mm_storeu_si128((__m128i*)(dst + i), lo);
+        _mm_storeu_si128((__m128i*)(dst + i + 4), hi);
+    }
+    
+    for (; i < count; i++) {
+        dst[i] = rgb565_to_32(src[i], 0, 8, 16);  /* BGRX8888: B@16, G@8, R@0 */
+    }
+}
+
+/* Streaming variant of the above for video memory (either layout) */
+/* Scalar head up to 16-byte alignment, then movntdq; caller issues the sfence */
+static void blit_to_fb_32bpp_sse2_nt(uint32_t *dst, const uint16_t *src, int count, int bgr) {
+    int r_off = bgr ? 0 : 16;
+    int b_off = bgr ? 16 : 0;
+    int i = 0;
+    
+    for (; i < count && ((unsigned long)(dst + i) & 15); i++) {
+        _mm_stream_si32((int *)(dst + i), (int)rgb565_to_32(src[i], r_off, 8, b_off));
+    }
+    
+    for (; i + 7 < count; i += 8) {
+        __m128i lo, hi;
+        rgb565_expand_sse2(_mm_loadu_si128((__m128i*)(src + i)), bgr, &lo, &hi);
         
-        /* R5 (bits 11-15) -> R8 (bits 0-7): shift right by 11, then left 3 for expansion */
-        __m128i r_mask = _mm_set1_epi32(0x0000F800);
-        __m128i r_lo = _mm_and_si128(lo, r_mask);
-        __m128i r_hi = _mm_and_si128(hi, r_mask);
-        r_lo = _mm_srli_epi32(r_lo, 11 - 3);  /* shift right 8 to get to bit 0, effectively >>11 then <<3 */
-        r_hi = _mm_srli_epi32(r_hi, 11 - 3);
+        _mm_stream_si128((__m128i*)(dst + i), lo);
+        _mm_stream_si128((__m128i*)(dst + i + 4), hi);
+    }
+    
+    for (; i < count; i++) {
+        _mm_stream_si32((int *)(dst + i), (int)rgb565_to_32(src[i], r_off, 8, b_off));
+    }
+}
+
+/* Expand 8 RGB565 pixels to 32-bit lanes with each 8-bit component shifted */
+/* left by a runtime count (bit offset for 32bpp, byte position * 8 for 24bpp) */
+static inline __attribute__((always_inline))
+void rgb565_expand_any_sse2(__m128i pixels, __m128i r_sh, __m128i g_sh, __m128i b_sh,
+                            __m128i *out_lo, __m128i *out_hi) {
+    __m128i lo = _mm_unpacklo_epi16(pixels, _mm_setzero_si128());
+    __m128i hi = _mm_unpackhi_epi16(pixels, _mm_setzero_si128());
+    
+    /* R8 = (p >> 8) & 0xF8, G8 = (p >> 3) & 0xFC, B8 = (p << 3) & 0xF8 */
+    __m128i r_mask = _mm_set1_epi32(0xF8);
+    __m128i g_mask = _mm_set1_epi32(0xFC);
+    __m128i r_lo = _mm_sll_epi32(_mm_and_si128(_mm_srli_epi32(lo, 8), r_mask), r_sh);
+    __m128i r_hi = _mm_sll_epi32(_mm_and_si128(_mm_srli_epi32(hi, 8), r_mask), r_sh);
+    __m128i g_lo = _mm_sll_epi32(_mm_and_si128(_mm_srli_epi32(lo, 3), g_mask), g_sh);
+    __m128i g_hi = _mm_sll_epi32(_mm_and_si128(_mm_srli_epi32(hi, 3), g_mask), g_sh);
+    __m128i b_lo = _mm_sll_epi32(_mm_and_si128(_mm_slli_epi32(lo, 3), r_mask), b_sh);
+    __m128i b_hi = _mm_sll_epi32(_mm_and_si128(_mm_slli_epi32(hi, 3), r_mask), b_sh);
+    
+    *out_lo = _mm_or_si128(_mm_or_si128(r_lo, g_lo), b_lo);
+    *out_hi = _mm_or_si128(_mm_or_si128(r_hi, g_hi), b_hi);
+}
+
+/* SSE2 RGB565 to 32bpp for exotic component offsets (anything but XRGB/BGRX) */
+static void blit_to_fb_32bpp_sse2_any(uint32_t *dst, const uint16_t *src, int count,
+                                      int r_off, int g_off, int b_off, int stream) {
+    __m128i r_sh = _mm_cvtsi32_si128(r_off);
+    __m128i g_sh = _mm_cvtsi32_si128(g_off);
+    __m128i b_sh = _mm_cvtsi32_si128(b_off);
+    int i = 0;
+    
+    if (stream) {
+        for (; i < count && ((unsigned long)(dst + i) & 15); i++) {
+            _mm_stream_si32((int *)(dst + i), (int)rgb565_to_32(src[i], r_off, g_off, b_off));
+        }
+    }
+    
+    for (; i + 7 < count; i += 8) {
+        __m128i lo, hi;
+        rgb565_expand_any_sse2(_mm_loadu_si128((__m128i*)(src + i)), r_sh, g_sh, b_sh, &lo, &hi);
+        if (stream) {
+            _mm_stream_si128((__m128i*)(dst + i), lo);
+            _mm_stream_si128((__m128i*)(dst + i + 4), hi);
+        } else {
+            _mm_storeu_si128((__m128i*)(dst + i), lo);
+            _mm_storeu_si128((__m128i*)(dst + i + 4), hi);
+        }
+    }
+    
+    for (; i < count; i++) {
+        uint32_t pixel = rgb565_to_32(src[i], r_off, g_off, b_off);
+        if (stream) {
+            _mm_stream_si32((int *)(dst + i), (int)pixel);
+        } else {
+            dst[i] = pixel;
+        }
+    }
+}
+
+/* AVX2: expand 8 RGB565 pixels to XRGB8888 (or BGRX8888 with bgr) in one ymm */
+static inline __attribute__((always_inline, target("avx2")))
+__m256i rgb565_expand_avx2(__m128i pixels, int bgr) {
+    __m256i v = _mm256_cvtepu16_epi32(pixels);
+    __m256i r = _mm256_and_si256(v, _mm256_set1_epi32(0x0000F800));
+    __m256i g = _mm256_slli_epi32(_mm256_and_si256(v, _mm256_set1_epi32(0x000007E0)), 3 + 2);
+    __m256i b = _mm256_and_si256(v, _mm256_set1_epi32(0x0000001F));
+    
+    if (!bgr) {
+        r = _mm256_slli_epi32(r, 5 + 3);
+        b = _mm256_slli_epi32(b, 3);
+    } else {
+        r = _mm256_srli_epi32(r, 11 - 3);
+        b = _mm256_slli_epi32(b, 16 + 3);
+    }
+    
+    return _mm256_or_si256(_mm256_or_si256(r, g), b);
+}
+
+/* AVX2 RGB565 to XRGB8888/BGRX8888, 16 pixels (64 bytes, one WC line) per iteration */
+/* With stream: movnti head up to 32-byte alignment, then vmovntdq */
+__attribute__((target("avx2")))
+static void blit_to_fb_32bpp_avx2(uint32_t *dst, const uint16_t *src, int count, int bgr, int stream) {
+    int r_off = bgr ? 0 : 16;
+    int b_off = bgr ? 16 : 0;
+    int i = 0;
+    
+    if (stream) {
+        for (; i < count && ((unsigned long)(dst + i) & 31); i++) {
+            _mm_stream_si32((int *)(dst + i), (int)rgb565_to_32(src[i], r_off, 8, b_off));
+        }
+    }
+    
+    for (; i + 15 < count; i += 16) {
+        __m256i a = rgb565_expand_avx2(_mm_loadu_si128((__m128i*)(src + i)), bgr);
+        __m256i b = rgb565_expand_avx2(_mm_loadu_si128((__m128i*)(src + i + 8)), bgr);
+        if (stream) {
+            _mm256_stream_si256((__m256i*)(dst + i), a);
+            _mm256_stream_si256((__m256i*)(dst + i + 8), b);
+        } else {
+            _mm256_storeu_si256((__m256i*)(dst + i), a);
+            _mm256_storeu_si256((__m256i*)(dst + i + 8), b);
+        }
+    }
+    
+    for (; i < count; i++) {
+        uint32_t pixel = rgb565_to_32(src[i], r_off, 8, b_off);
+        if (stream) {
+            _mm_stream_si32((int *)(dst + i), (int)pixel);
+        } else {
+            dst[i] = pixel;
+        }
+    }
+}
+
+/* Blit RGB565 frame to framebuffer (32bpp) - dispatches to AVX2, SSE2 or generic SSE2 */
+static void blit_to_fb_32bpp(uint8_t *fbmem, int fb_w, int fb_h, int line_len,
+                             const uint16_t *frame, int stride, int fw, int fh, int x, int y,
+                             int r_off, int g_off, int b_off) {
+    /* Detect standard layouts for the fixed-shift kernels */
+    int use_sse2_rgb = (r_off == 16 && g_off == 8 && b_off == 0);   /* XRGB8888 */
+    int use_sse2_bgr = (r_off == 0 && g_off == 8 && b_off == 16);   /* BGRX8888 */
+    int use_avx2 = (cpu_features & CPU_AVX2) && (use_sse2_rgb || use_sse2_bgr);
+    
+    for (int row = 0; row < fh; row++) {
+        if (y + row >= fb_h || y + row < 0) continue;
         
-        /* G6 (bits 5-10) -> G8 (bits 8-15): same as XRGB */
-        __m128i g_mask = _mm_set1_epi32(0x000007E0);
-        __m128i g_lo = _mm_and_si128(lo, g_mask);
-        __m128i g_hi = _mm_and_si128(hi, g_mask);
-        g_lo = _mm_slli_epi32(g_lo, 3 + 2);
-        g_hi = _mm_slli_epi32(g_hi, 3 + 2);
+        uint32_t *dst = (uint32_t *)(fbmem + (y + row) * line_len + x * 4);
+        const uint16_t *src = frame + row * stride;
         
-        /* B5 (bits 0-4) -> B8 (bits 16-23): shift left 16, then expand */
-        __m128i b_mask = _mm_set1_epi32(0x0000001F);
-        __m128i b_lo = _mm_and_si128(lo, b_mask);
-        __m128i b_hi = _mm_and_si128(hi, b_mask);
-        b_lo = _mm_slli_epi32(b_lo, 16 + 3);
-        b_hi = _mm_slli_epi32(b_hi, 16 + 3);
+        /* Calculate visible columns */
+        int col_start = (x < 0) ? -x : 0;
+        int col_end = fw;
+        if (x + col_end > fb_w) col_end = fb_w - x;
+        int visible_count = col_end - col_start;
+        
+        if (visible_count <= 0) continue;
+        
+        dst += col_start;
+        src += col_start;
+        
+        if (use_avx2) {
+            blit_to_fb_32bpp_avx2(dst, src, visible_count, use_sse2_bgr, fb_stream);
+        } else if (fb_stream && (use_sse2_rgb || use_sse2_bgr)) {
+            blit_to_fb_32bpp_sse2_nt(dst, src, visible_count, use_sse2_bgr);
+        } else if (use_sse2_rgb) {
+            blit_to_fb_32bpp_sse2(dst, src, visible_count);
+        } else if (use_sse2_bgr) {
+            blit_to_fb_32bpp_sse2_bgr(dst, src, visible_count);
+        } else {
+            /* Exotic RGB layouts: runtime shift counts */
+            blit_to_fb_32bpp_sse2_any(dst, src, visible_count, r_off, g_off, b_off, fb_stream);
+        }
+    }
+    
+    if (fb_stream) _mm_sfence();
+}
+
+/* Streaming copy of one row: byte head up to 16-byte alignment, then movntdq */
+static void stream_copy_row(uint8_t *dst, const uint8_t *src, int bytes) {
+    int i = 0;
+    
+    for (; i < bytes && ((unsigned long)(dst + i) & 15); i++) {
+        dst[i] = src[i];
+    }
+    
+    for (; i + 63 < bytes; i += 64) {
+        _mm_stream_si128((__m128i*)(dst + i), _mm_loadu_si128((__m128i*)(src + i)));
+        _mm_stream_si128((__m128i*)(dst + i + 16), _mm_loadu_si128((__m128i*)(src + i + 16)));
+        _mm_stream_si128((__m128i*)(dst + i + 32), _mm_loadu_si128((__m128i*)(src + i + 32)));
+        _mm_stream_si128((__m128i*)(dst + i + 48), _mm_loadu_si128((__m128i*)(src + i + 48)));
+    }
+    for (; i + 15 < bytes; i += 16) {
+        _mm_stream_si128((__m128i*)(dst + i), _mm_loadu_si128((__m128i*)(src + i)));
+    }
+    
+    for (; i < bytes; i++) {
+        dst[i] = src[i];
+    }
+}
+
+/* Blit RGB565 frame to framebuffer (16bpp) */
+static void blit_to_fb_16bpp(uint8_t *fbmem, int fb_w, int fb_h, int line_len,
+                             const uint16_t *frame, int stride, int fw, int fh, int x, int y) {
+    for (int row = 0; row < fh; row++) {
+        if (y + row >= fb_h || y + row < 0) continue;
+        
+        uint16_t *dst = (uint16_t *)(fbmem + (y + row) * line_len + x * 2);
+        const uint16_t *src = frame + row * stride;
+        
+        int copy_len = fw;
+        if (x + copy_len > fb_w) copy_len = fb_w - x;
+        if (x < 0) {
+            src -= x;
+            copy_len += x;
+            dst -= x;
+        }
+        
+        if (copy_len > 0) {
+            if (fb_stream) {
+                stream_copy_row((uint8_t *)dst, (const uint8_t *)src, copy_len * sizeof(uint16_t));
+            } else {
+                memcpy(dst, src, copy_len * sizeof(uint16_t));
+            }
+        }
+    }
+    
+    if (fb_stream) _mm_sfence();
+}
+
+/* Store one RGB565 pixel as 3 bytes at byte positions r_off/g_off/b_off */
+static inline void put_pixel_24(uint8_t *dst, uint16_t pixel, int r_off, int g_off, int b_off) {
+    dst[r_off] = (pixel >> 8) & 0xF8;
+    dst[g_off] = (pixel >> 3) & 0xFC;
+    dst[b_off] = (pixel << 3) & 0xF8;
+}
+
+/* SSSE3 RGB565 to packed 24bpp: 16 pixels -> 48 bytes per iteration */
+/* Pixels are expanded to 32-bit lanes, pshufb drops every 4th byte, and the */
+/* four 12-byte groups are spliced into three 16-byte stores */
+__attribute__((target("ssse3")))
+static void blit_to_fb_24bpp_ssse3(uint8_t *dst, const uint16_t *src, int count,
+                                   int r_off, int g_off, int b_off, int stream) {
+    __m128i r_sh = _mm_cvtsi32_si128(r_off * 8);
+    __m128i g_sh = _mm_cvtsi32_si128(g_off * 8);
+    __m128i b_sh = _mm_cvtsi32_si128(b_off * 8);
+    __m128i pack = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    int i = 0;
+    
+    /* 3 is odd, so 16-byte alignment is reached within 16 pixels */
+    if (stream) {
+        for (; i < count && ((unsigned long)(dst + i * 3) & 15); i++) {
+            put_pixel_24(dst + i * 3, src[i], r_off, g_off, b_off);
+        }
+    }
+    
+    for (; i + 15 < count; i += 16) {
+        __m128i p0, p1, p2, p3;
+        rgb565_expand_any_sse2(_mm_loadu_si128((__m128i*)(src + i)), r_sh, g_sh, b_sh, &p0, &p1);
+        rgb565_expand_any_sse2(_mm_loadu_si128((__m128i*)(src + i + 8)), r_sh, g_sh, b_sh, &p2, &p3);
+        
+        /* 12 meaningful bytes at the bottom of each */
+        p0 = _mm_shuffle_epi8(p0, pack);
+        p1 = _mm_shuffle_epi8(p1, pack);
+        p2 = _mm_shuffle_epi8(p2, pack);
+        p3 = _mm_shuffle_epi8(p3, pack);
+        
+        __m128i o0 = _mm_or_si128(p0, _mm_slli_si128(p1, 12));
+        __m128i o1 = _mm_or_si128(_mm_srli_si128(p1, 4), _mm_slli_si128(p2, 8));
+        __m128i o2 = _mm_or_si128(_mm_srli_si128(p2, 8), _mm_slli_si128(p3, 4));
+        
+        uint8_t *d = dst + i * 3;
+        if (stream) {
+            _mm_stream_si128((__m128i*)d, o0);
+            _mm_stream_si128((__m128i*)(d + 16), o1);
+            _mm_stream_si128((__m128i*)(d + 32), o2);
+        } else {
+            _mm_storeu_si128((__m128i*)d, o0);
+            _mm_storeu_si128((__m128i*)(d + 16), o1);
+            _mm_storeu_si128((__m128i*)(d + 32), o2);
+        }
+    }
+    
+    for (; i < count; i++) {
+        put_pixel_24(dst + i * 3, src[i], r_off, g_off, b_off);
+    }
+}
+
+/* Blit RGB565 frame to framebuffer (24bpp - RGB888 packed) */
+/* Note: 24bpp is rare but some hardware uses it. Format is typically RGB in memory order. */
+static void blit_to_fb_24bpp(uint8_t *fbmem, int fb_w, int fb_h, int line_len,
+                             const uint16_t *frame, int stride, int fw, int fh, int x, int y,
+                             int r_off, int g_off, int b_off) {
+    /* 24bpp: typically 3 bytes per pixel, RGB or BGR order */
+    /* r_off/g_off/b_off indicate byte position (0, 1, or 2) for each component */
+    int use_ssse3 = cpu_features & CPU_SSSE3;
+    
+    for (int row = 0; row < fh; row++) {
+        if (y + row >= fb_h || y + row < 0) continue;
+        
+        uint8_t *dst = fbmem + (y + row) * line_len + x * 3;
+        const uint16_t *src = frame + row * stride;
+        
+        /* Calculate visible columns once per row */
+        int col_start = (x < 0) ? -x : 0;
+        int col_end = fw;
+        if (x + col_end > fb_w) col_end = fb_w - x;
+        int visible_count = col_end - col_start;
+        
+        if (visible_count <= 0) continue;
         
-        __m128i result_lo = _mm_or_si128(_mm_or_si128(r_lo, g_lo), b_lo);
-        __m128i result_hi = _mm_or_si128(_mm_or_si128(r_hi, g_hi), b_hi);
+        dst += col_start * 3;
+        src += col_start;
         
-        _mm_storeu_si128((__m128i*)(dst + i), result_lo);
-        _mm_storeu_si128((__m128i*)(dst + i + 4), result_hi);
+        if (use_ssse3) {
+            blit_to_fb_24bpp_ssse3(dst, src, visible_count, r_off, g_off, b_off, fb_stream);
+        } else {
+            for (int col = 0; col < visible_count; col++) {
+                put_pixel_24(dst + col * 3, src[col], r_off, g_off, b_off);
+            }
+        }
+    }
+    
+    if (fb_stream) _mm_sfence();
+}
+
+/* Blit frame with position handling */
+static void blit_frame(uint8_t *fbmem, int fb_w, int fb_h, int line_len, int bpp,
+                       const uint16_t *frame, int stride, int fw, int fh, int x, int y,
+                       int r_off, int g_off, int b_off) {
+    if (bpp == 32) {
+        blit_to_fb_32bpp(fbmem, fb_w, fb_h, line_len, frame, stride, fw, fh, x, y, r_off, g_off, b_off);
+    } else if (bpp == 16) {
+        blit_to_fb_16bpp(fbmem, fb_w, fb_h, line_len, frame, stride, fw, fh, x, y);
+    } else if (bpp == 24) {
+        blit_to_fb_24bpp(fbmem, fb_w, fb_h, line_len, frame, stride, fw, fh, x, y, r_off, g_off, b_off);
+    }
+}
+
+/* --- Control channel (make CONTROL_FIFO=...) --- */
+/* Boot scripts write one command per line to a FIFO, e.g. */
+/*   echo "progress 40" > /run/xbootsplash.ctl */
+/* It is watched by the same ppoll that waits for the next frame, so commands */
+/* are served within a frame period and cost nothing in between: */
+/*   progress N   bar below the animation, N = 0..100 */
+/*   seq A B      loop frames A..B (from the next frame) */
+/*   finish       play the last FINISH_FRAMES frames once and hold the last one */
+/*   quit         same as SIGTERM */
+/* A progress update only redraws the columns between the old and new fill. */
+#if USE_CONTROL
+/* Trailing frames kept out of the normal loop for "finish" */
+#ifndef FINISH_FRAMES
+#define FINISH_FRAMES 0
+#endif
+
+/* Progress bar: PROGRESS_W x PROGRESS_H (0 = frame width), centred */
+/* PROGRESS_GAP pixels below the animation */
+#ifndef PROGRESS_W
+#define PROGRESS_W 0
+#endif
+#ifndef PROGRESS_H
+#define PROGRESS_H 4
+#endif
+#ifndef PROGRESS_GAP
+#define PROGRESS_GAP 16
+#endif
+#ifndef PROGRESS_COLOR
+#define PROGRESS_COLOR 0xFFFF
+#endif
+
+static int control_fd = -1;
+static char control_line[64];           /* Command being received */
+static int control_len = 0;
+
+/* Frames played: seq_first..seq_last, wrapping to seq_first if seq_loop */
+static int seq_first, seq_last, seq_loop;
+
+/* Screen the bar is drawn on (commands arrive while waiting, not from main) */
+static uint8_t *ctl_fbmem;
+static int ctl_fb_w, ctl_bpp, ctl_r_off, ctl_g_off, ctl_b_off;
+static int progress_x, progress_y, progress_w;
+static int progress_filled = 0;         /* Columns drawn in PROGRESS_COLOR, on every page */
+
+/* Next frame to show after f, or -1 to hold f: frames before the range jump */
+/* into it, frames past it wrap or stop */
+static int seq_next(int f) {
+    f++;
+    if (f < seq_first) return seq_first;
+    if (f > seq_last) return seq_loop ? seq_first : -1;
+    return f;
+}
+
+/* Redraw bar columns [c0, c1) on every page: filled, or what lies under the bar */
+static void progress_span(int c0, int c1, int filled) {
+    int sx = progress_x + c0, w = c1 - c0;
+    int pages = fb_has_dblbuf ? 2 : 1;
+    
+    for (int p = 0; p < pages; p++) {
+        uint8_t *page = ctl_fbmem + p * fb_yres * fb_line_len;
+        if (filled) {
+            fill_rect(page, ctl_fb_w, fb_yres, fb_line_len, ctl_bpp, sx, progress_y, w, PROGRESS_H,
+                      PROGRESS_COLOR, ctl_r_off, ctl_g_off, ctl_b_off);
+            continue;
+        }
+#if DISPLAY_MODE == 1 || DISPLAY_MODE == 2
+        if (bg_buffer) {
+            /* The background image sits at (0, 0): copy the part under the span */
+            /* (bg_buffer holds bg_rect of it, which covers the bar) */
+            int bg_stride = bg_rect.x1 - bg_rect.x0;
+            int bx0 = sx < bg_rect.x0 ? bg_rect.x0 : sx;
+            int by0 = progress_y < bg_rect.y0 ? bg_rect.y0 : progress_y;
+            int bx1 = sx + w > bg_rect.x1 ? bg_rect.x1 : sx + w;
+            int by1 = progress_y + PROGRESS_H > bg_rect.y1 ? bg_rect.y1 : progress_y + PROGRESS_H;
+            if (bx1 > bx0 && by1 > by0) {
+                blit_frame(page, ctl_fb_w, fb_yres, fb_line_len, ctl_bpp,
+                           bg_buffer + (by0 - bg_rect.y0) * bg_stride + bx0 - bg_rect.x0, bg_stride,
+                           bx1 - bx0, by1 - by0, bx0, by0, ctl_r_off, ctl_g_off, ctl_b_off);
+            }
+            continue;
+        }
+#endif
+        fill_rect(page, ctl_fb_w, fb_yres, fb_line_len, ctl_bpp, sx, progress_y, w, PROGRESS_H,
+                  BACKGROUND_COLOR, ctl_r_off, ctl_g_off, ctl_b_off);
+    }
+}
+
+/* Bar geometry for an animation at screen (x, y) */
+static void progress_place(int x, int y) {
+    progress_w = PROGRESS_W > 0 ? PROGRESS_W : FRAME_W;
+    progress_x = x + (FRAME_W - progress_w) / 2;
+    progress_y = y + FRAME_H + PROGRESS_GAP;
+}
+
+static void progress_set(int percent) {
+    if (percent > 100) percent = 100;
+    int w = progress_w * percent / 100;
+    
+    if (w > progress_filled) {
+        progress_span(progress_filled, w, 1);
+    } else if (w < progress_filled) {
+        progress_span(w, progress_filled, 0);
+    }
+    progress_filled = w;
+}
+
+/* If line starts with word (and a space or its end), return what follows */
+static const char *control_word(const char *line, const char *word) {
+    while (*word) {
+        if (*line++ != *word++) return NULL;
+    }
+    if (*line != '\0' && *line != ' ') return NULL;
+    while (*line == ' ') line++;
+    return line;
+}
+
+/* Decimal number at *p, advancing past it and any spaces; -1 if there is none */
+static int control_number(const char **p) {
+    const char *s = *p;
+    int n = 0;
+    if (*s < '0' || *s > '9') return -1;
+    while (*s >= '0' && *s <= '9' && n < 100000000) n = n * 10 + (*s++ - '0');
+    while (*s == ' ') s++;
+    *p = s;
+    return n;
+}
+
+/* Malformed or unknown commands are ignored */
+static void control_command(const char *line) {
+    const char *arg;
+    
+    if ((arg = control_word(line, "progress"))) {
+        int n = control_number(&arg);
+        if (n >= 0) progress_set(n);
+    } else if ((arg = control_word(line, "seq"))) {
+        int a = control_number(&arg);
+        int b = control_number(&arg);
+        if (a >= 0 && b >= a && b < NFRAMES) {
+            seq_first = a;
+            seq_last = b;
+            seq_loop = 1;
+        }
+    } else if (control_word(line, "finish")) {
+        if (FINISH_FRAMES > 0 && FINISH_FRAMES < NFRAMES) seq_first = NFRAMES - FINISH_FRAMES;
+        seq_last = NFRAMES - 1;
+        seq_loop = 0;
+    } else if (control_word(line, "quit")) {
+        terminate_requested = 1;
+    }
+}
+
+/* Drain the FIFO, running every complete line */
+static void control_read(void) {
+    char buf[256];
+    ssize_t n;
+    
+    while ((n = read(control_fd, buf, sizeof(buf))) > 0) {
+        for (ssize_t i = 0; i < n; i++) {
+            char c = buf[i];
+            if (c == '\n') {
+                control_line[control_len] = '\0';
+                control_command(control_line);
+                control_len = 0;
+            } else if (c != '\r' && control_len < (int)sizeof(control_line) - 1) {
+                control_line[control_len++] = c;
+            }
+        }
+    }
+    
+    /* Only a path that is not a FIFO reaches end of file: stop polling it */
+    if (n == 0) {
+        close(control_fd);
+        control_fd = -1;
+    }
+}
+
+/* ppoll with SIGTERM/SIGINT unblocked, serving commands if the FIFO has any */
+/* (a closed channel has fd -1, which ppoll ignores) */
+static void control_wait(const struct timespec *timeout) {
+    struct pollfd pfd = { .fd = control_fd, .events = POLLIN, .revents = 0 };
+    
+    if (ppoll(&pfd, 1, timeout, &wait_sigmask) > 0 && (pfd.revents & POLLIN)) {
+        control_read();
+    }
+}
+
+/* Hold frame f until a command gives playback somewhere to go; 0 on termination */
+static int control_hold(int f) {
+    while (!terminate_requested) {
+        if (seq_next(f) >= 0) return 1;
+        control_wait(NULL);
+    }
+    return 0;
+}
+
+/* Create and open the FIFO, and remember where the progress bar goes. */
+/* (x, y) is the animation's position; a missing channel only loses commands. */
+static void control_init(uint8_t *fbmem, int fb_w, int bpp, int r_off, int g_off, int b_off,
+                         int x, int y) {
+    seq_first = 0;
+    seq_last = NFRAMES - 1;
+    if (FINISH_FRAMES > 0 && FINISH_FRAMES < NFRAMES) seq_last -= FINISH_FRAMES;
+#ifdef LOOP
+    seq_loop = LOOP ? 1 : 0;
+#else
+    seq_loop = 1;
+#endif
+    
+    ctl_fbmem = fbmem;
+    ctl_fb_w = fb_w;
+    ctl_bpp = bpp;
+    ctl_r_off = r_off;
+    ctl_g_off = g_off;
+    ctl_b_off = b_off;
+    progress_place(x, y);
+    
+    /* Fails harmlessly if the scripts created it first */
+    mknod(CONTROL_FIFO, S_IFIFO | 0600, 0);
+    
+    /* Read-write: with ourselves as a writer the FIFO never hangs up or reports */
+    /* end of file when a script's echo closes it */
+    control_fd = open(CONTROL_FIFO, O_RDWR | O_NONBLOCK | O_CLOEXEC, 0);
+    if (control_fd < 0) control_fd = -1;
+}
+#endif
+
+/* --- Background image (modes 1/2) --- */
+/* The device is opened and BACKGROUND_COLOR plus frame 0 shown before the */
+/* background is decoded; it is then streamed BG_BAND_ROWS rows at a time */
+/* through a scratch band, each band going on screen as soon as it is done. */
+/* Frames cover their area, so once drawn the image is only needed where */
+/* alpha frames are blended over it and under the progress bar: bg_buffer */
+/* keeps just that part (bg_rect), not a screen-sized copy. */
+#if DISPLAY_MODE == 1 || DISPLAY_MODE == 2
+#ifndef BG_BAND_ROWS
+#define BG_BAND_ROWS 64
+#endif
+
+/* Fullscreen themes may carry the background at several resolutions */
+/* (generate_splash -r WxH,WxH,...). The closest one to the screen is drawn; */
+/* when it is within BG_SCALE_PCT percent of the screen in both directions it */
+/* is resampled to the screen size as it streams, else drawn as it is. */
+#ifndef BG_FULLSCREEN
+#define BG_FULLSCREEN (DISPLAY_MODE == 2)
+#endif
+#ifndef BG_SCALE_PCT
+#define BG_SCALE_PCT 25
+#endif
+
+/* One resolution of the background */
+typedef struct {
+    int w, h;
+    int palette_size;
+    uint32_t size;
+    const uint16_t *palette;
+    const uint8_t *data;
+} bg_image_t;
+
+static int bg_variant_count(void) {
+#if defined(ASSET_PATH)
+    return 1 + asset_bg_nvariants;
+#elif defined(BG_VARIANTS)
+    return BG_VARIANTS;
+#else
+    return 1;
+#endif
+}
+
+/* Variant i; 0 is BG_W x BG_H */
+static void bg_variant(int i, bg_image_t *img) {
+#if defined(BG_VARIANTS) && !defined(ASSET_PATH)
+    img->w = bg_variant_dims[i][0];
+    img->h = bg_variant_dims[i][1];
+    img->palette_size = bg_variant_palette_sizes[i];
+    img->size = bg_variant_sizes[i];
+    img->palette = bg_variant_palettes[i];
+    img->data = bg_variant_data[i];
+#else
+#ifdef ASSET_PATH
+    if (i > 0) {
+        const xbs_bg_variant_t *v = &asset_bg_variants[i - 1];
+        img->w = v->w;
+        img->h = v->h;
+        img->palette_size = v->palette_size;
+        img->size = v->size;
+        img->palette = (const uint16_t *)(asset_base + v->palette_offset);
+        img->data = asset_base + v->offset;
+        return;
+    }
+#endif
+    (void)i;
+    img->w = BG_W;
+    img->h = BG_H;
+    img->palette_size = BG_PALETTE_SIZE;
+    img->size = BG_COMPRESSED_SIZE;
+    img->palette = bg_palette;
+    img->data = bg_compressed;
+#endif
+}
+
+/* The variant closest to a w x h screen into img, and the size it is drawn */
+/* at into (*dw, *dh) */
+static void bg_pick(int w, int h, bg_image_t *img, int *dw, int *dh) {
+    long best = -1;
+    for (int i = 0; i < bg_variant_count(); i++) {
+        bg_image_t v;
+        bg_variant(i, &v);
+        /* Mismatch in per mille of the screen, both directions */
+        int ex = v.w > w ? v.w - w : w - v.w;
+        int ey = v.h > h ? v.h - h : h - v.h;
+        long cost = (long)ex * 1000 / w + (long)ey * 1000 / h;
+        if (best < 0 || cost < best) {
+            best = cost;
+            *img = v;
+        }
+    }
+    
+    *dw = img->w;
+    *dh = img->h;
+    int ex = img->w > w ? img->w - w : w - img->w;
+    int ey = img->h > h ? img->h - h : h - img->h;
+    if (BG_FULLSCREEN && BG_SCALE_PCT > 0 && (ex || ey) &&
+        ex * 100 <= w * BG_SCALE_PCT && ey * 100 <= h * BG_SCALE_PCT) {
+        *dw = w;
+        *dh = h;
+    }
+}
+
+/* a + (b - a) * w / 256 rounded, per RGB565 channel, w 0-255 */
+static inline uint16_t lerp_565(uint16_t a, uint16_t b, int w) {
+    int r = (a >> 11) + ((((b >> 11) - (a >> 11)) * w + 128) >> 8);
+    int g = ((a >> 5) & 0x3F) + (((((b >> 5) & 0x3F) - ((a >> 5) & 0x3F)) * w + 128) >> 8);
+    int bl = (a & 0x1F) + ((((b & 0x1F) - (a & 0x1F)) * w + 128) >> 8);
+    return (r << 11) | (g << 5) | bl;
+}
+
+/* lerp_565 on 8 pixels */
+static inline __m128i lerp_565_x8(__m128i a, __m128i b, __m128i w) {
+    const __m128i m5 = _mm_set1_epi16(0x1F);
+    const __m128i m6 = _mm_set1_epi16(0x3F);
+    const __m128i half = _mm_set1_epi16(128);
+    __m128i ar = _mm_srli_epi16(a, 11), br = _mm_srli_epi16(b, 11);
+    __m128i ag = _mm_and_si128(_mm_srli_epi16(a, 5), m6), bg = _mm_and_si128(_mm_srli_epi16(b, 5), m6);
+    __m128i ab = _mm_and_si128(a, m5), bb = _mm_and_si128(b, m5);
+    __m128i r = _mm_add_epi16(ar, _mm_srai_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_sub_epi16(br, ar), w), half), 8));
+    __m128i g = _mm_add_epi16(ag, _mm_srai_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_sub_epi16(bg, ag), w), half), 8));
+    __m128i bl = _mm_add_epi16(ab, _mm_srai_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_sub_epi16(bb, ab), w), half), 8));
+    return _mm_or_si128(_mm_or_si128(_mm_slli_epi16(r, 11), _mm_slli_epi16(g, 5)), bl);
+}
+
+/* Background rows at the drawn size: straight from the LZSS stream, or */
+/* resampled bilinearly from it, 16.16 fixed point with pixel centres */
+/* aligned. Source rows are decoded one at a time as the output needs them. */
+typedef struct {
+    lzss_stream_t lzss;
+    int src_w, src_h, dst_w, dst_h;
+    int y;                          /* Next output row */
+    int top;                        /* Source row in row[0], row[1] holds the next */
+    uint16_t *row[2], *vrow;        /* src_w + 1 pixels each */
+    uint16_t *xs, *wx;              /* Per output column: source column, weight 0-255 */
+} bg_reader_t;
+
+/* Scratch bytes bg_begin needs to draw img at dw x dh */
+static long bg_scratch_size(const bg_image_t *img, int dw, int dh) {
+    if (dw == img->w && dh == img->h) return 0;
+    return (3L * (img->w + 1) + 2L * dw) * 2;
+}
+
+/* Source position for output o: index and 8-bit weight of the next one */
+static inline void bg_map(int o, int src, int dst, int *idx, int *w) {
+    long p = ((2L * o + 1) * src << 15) / dst - 32768;
+    if (p < 0) p = 0;
+    *idx = p >> 16;
+    *w = (p >> 8) & 255;
+    if (*idx >= src - 1) {
+        *idx = src - 1;
+        *w = 0;
+    }
+}
+
+static void bg_begin(bg_reader_t *rd, const bg_image_t *img, int dw, int dh, uint16_t *scratch) {
+    lzss_begin(&rd->lzss, img->data, img->size, img->palette, img->palette_size);
+    rd->src_w = img->w;
+    rd->src_h = img->h;
+    rd->dst_w = dw;
+    rd->dst_h = dh;
+    rd->y = 0;
+    if (!scratch) return;
+    
+    rd->row[0] = scratch;
+    rd->row[1] = rd->row[0] + img->w + 1;
+    rd->vrow = rd->row[1] + img->w + 1;
+    rd->xs = rd->vrow + img->w + 1;
+    rd->wx = rd->xs + dw;
+    for (int x = 0; x < dw; x++) {
+        int idx, w;
+        bg_map(x, img->w, dw, &idx, &w);
+        rd->xs[x] = idx;
+        rd->wx[x] = w;
     }
     
-    for (; i < count; i++) {
-        uint16_t pixel = src[i];
-        uint32_t r = (pixel >> 11) & 0x1F;
-        uint32_t g = (pixel >> 5) & 0x3F;
-        uint32_t b = pixel & 0x1F;
-        dst[i] = (b << 19) | (g << 10) | (r << 3);  /* BGRX8888: B@16, G@8, R@0 */
+    rd->top = 0;
+    lzss_decode(&rd->lzss, rd->row[0], img->w);
+    if (img->h > 1) {
+        lzss_decode(&rd->lzss, rd->row[1], img->w);
+    } else {
+        memcpy(rd->row[1], rd->row[0], img->w * 2);
     }
 }
 
-/* Blit RGB565 frame to framebuffer (32bpp) - dispatches to SSE2 or scalar */
-static void blit_to_fb_32bpp(uint8_t *fbmem, int fb_w, int fb_h, int line_len,
-                             const uint16_t *frame, int fw, int fh, int x, int y,
-                             int r_off, int g_off, int b_off) {
-    /* Detect standard layouts for SSE2 optimization */
-    int use_sse2_rgb = (r_off == 16 && g_off == 8 && b_off == 0);   /* XRGB8888 */
-    int use_sse2_bgr = (r_off == 0 && g_off == 8 && b_off == 16);   /* BGRX8888 */
+/* The next rows output rows into out, dst_w pixels apart */
+static void bg_read(bg_reader_t *rd, uint16_t *out, int rows) {
+    if (rd->src_w == rd->dst_w && rd->src_h == rd->dst_h) {
+        lzss_decode(&rd->lzss, out, rows * rd->dst_w);
+        rd->y += rows;
+        return;
+    }
     
-    for (int row = 0; row < fh; row++) {
-        if (y + row >= fb_h || y + row < 0) continue;
-        
-        uint32_t *dst = (uint32_t *)(fbmem + (y + row) * line_len + x * 4);
-        const uint16_t *src = frame + row * fw;
-        
-        /* Calculate visible columns */
-        int col_start = (x < 0) ? -x : 0;
-        int col_end = fw;
-        if (x + col_end > fb_w) col_end = fb_w - x;
-        int visible_count = col_end - col_start;
-        
-        if (visible_count <= 0) continue;
+    int sw = rd->src_w;
+    for (int r = 0; r < rows; r++, rd->y++) {
+        int sy, wy;
+        bg_map(rd->y, rd->src_h, rd->dst_h, &sy, &wy);
+        while (rd->top < sy) {
+            uint16_t *t = rd->row[0];
+            rd->row[0] = rd->row[1];
+            rd->row[1] = t;
+            if (++rd->top + 1 < rd->src_h) {
+                lzss_decode(&rd->lzss, rd->row[1], sw);
+            } else {
+                memcpy(rd->row[1], rd->row[0], sw * 2);
+            }
+        }
         
-        dst += col_start;
-        src += col_start;
+        /* Between the two source rows, then between columns */
+        const uint16_t *a = rd->row[0], *b = rd->row[1];
+        uint16_t *v = rd->vrow;
+        __m128i vwy = _mm_set1_epi16(wy);
+        int i = 0;
+        for (; i + 8 <= sw; i += 8) {
+            __m128i pa = _mm_loadu_si128((const __m128i *)(a + i));
+            __m128i pb = _mm_loadu_si128((const __m128i *)(b + i));
+            _mm_storeu_si128((__m128i *)(v + i), lerp_565_x8(pa, pb, vwy));
+        }
+        for (; i < sw; i++) v[i] = lerp_565(a[i], b[i], wy);
+        v[sw] = v[sw - 1];
         
-        /* Use SSE2 for standard layouts, scalar for exotic configs */
-        if (use_sse2_rgb) {
-            blit_to_fb_32bpp_sse2(dst, src, visible_count);
-        } else if (use_sse2_bgr) {
-            blit_to_fb_32bpp_sse2_bgr(dst, src, visible_count);
-        } else {
-            /* Scalar fallback for exotic RGB layouts */
-            for (int col = 0; col < visible_count; col++) {
-                uint16_t pixel = src[col];
-                uint32_t r = (pixel >> 11) & 0x1F;
-                uint32_t g = (pixel >> 5) & 0x3F;
-                uint32_t b = pixel & 0x1F;
-                dst[col] = ((r << 3) << r_off) | ((g << 2) << g_off) | ((b << 3) << b_off);
-            }
+        uint16_t *dst = out + r * rd->dst_w;
+        const uint16_t *xs = rd->xs;
+        int x = 0;
+        for (; x + 8 <= rd->dst_w; x += 8) {
+            __m128i pa = _mm_setr_epi16(v[xs[x]], v[xs[x + 1]], v[xs[x + 2]], v[xs[x + 3]],
+                                        v[xs[x + 4]], v[xs[x + 5]], v[xs[x + 6]], v[xs[x + 7]]);
+            __m128i pb = _mm_setr_epi16(v[xs[x] + 1], v[xs[x + 1] + 1], v[xs[x + 2] + 1], v[xs[x + 3] + 1],
+                                        v[xs[x + 4] + 1], v[xs[x + 5] + 1], v[xs[x + 6] + 1], v[xs[x + 7] + 1]);
+            __m128i w = _mm_loadu_si128((const __m128i *)(rd->wx + x));
+            _mm_storeu_si128((__m128i *)(dst + x), lerp_565_x8(pa, pb, w));
         }
+        for (; x < rd->dst_w; x++) dst[x] = lerp_565(v[xs[x]], v[xs[x] + 1], rd->wx[x]);
     }
 }
 
-/* Blit RGB565 frame to framebuffer (16bpp) */
-static void blit_to_fb_16bpp(uint8_t *fbmem, int fb_w, int fb_h, int line_len,
-                             const uint16_t *frame, int fw, int fh, int x, int y) {
-    for (int row = 0; row < fh; row++) {
-        if (y + row >= fb_h || y + row < 0) continue;
-        
-        uint16_t *dst = (uint16_t *)(fbmem + (y + row) * line_len + x * 2);
-        const uint16_t *src = frame + row * fw;
+/* Image rows [by0, by1), w pixels wide from src, around the hole [hx0, hx1) */
+static void bg_blit_band(uint8_t *fbmem, int fb_w, int fb_h, int line_len, int bpp,
+                         const uint16_t *src, int w, int by0, int by1, int hx0, int hx1,
+                         int r_off, int g_off, int b_off) {
+    if (by1 <= by0) return;
+    if (hx0 < 0) hx0 = 0;
+    if (hx1 > w) hx1 = w;
+    if (hx1 <= hx0) {
+        hx0 = w;
+        hx1 = w;
+    }
+    if (hx0 > 0) {
+        blit_frame(fbmem, fb_w, fb_h, line_len, bpp, src, w,
+                   hx0, by1 - by0, 0, by0, r_off, g_off, b_off);
+    }
+    if (hx1 < w) {
+        blit_frame(fbmem, fb_w, fb_h, line_len, bpp, src + hx1, w,
+                   w - hx1, by1 - by0, hx1, by0, r_off, g_off, b_off);
+    }
+}
+
+/* Decode the background closest to the fb_w x fb_h screen onto front, */
+/* around frame 0 at (x, y) unless frames are blended (nothing is over the */
+/* background yet then), and whole onto back (NULL when single-buffered), */
+/* keeping bg_rect of it in bg_buffer. */
+/* Returns 0 if nothing could be drawn: the screen stays on the solid colour. */
+static int bg_load(uint8_t *front, uint8_t *back, int fb_w, int fb_h, int line_len, int bpp,
+                   int x, int y, int r_off, int g_off, int b_off) {
+    if (BG_W <= 0) return 0;
+    bg_image_t img;
+    int bw, bh;
+    bg_pick(fb_w, fb_h, &img, &bw, &bh);
+    long band_size = (long)bw * BG_BAND_ROWS * 2 + bg_scratch_size(&img, bw, bh);
+    uint16_t *band = mmap(NULL, band_size, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (band == MAP_FAILED) return 0;
+    
+    /* Part of the image redrawn later, clipped to it */
+    dirty_rect_t keep = { bw, bh, 0, 0 };
+#ifdef FRAME_ALPHA
+    dirty_rect_t under = { x, y, x + FRAME_W, y + FRAME_H };
+    dirty_union(&keep, &under);
+#endif
+#if USE_CONTROL
+    dirty_rect_t bar = { progress_x, progress_y, progress_x + progress_w, progress_y + PROGRESS_H };
+    dirty_union(&keep, &bar);
+#endif
+    if (keep.x0 < 0) keep.x0 = 0;
+    if (keep.y0 < 0) keep.y0 = 0;
+    if (keep.x1 > bw) keep.x1 = bw;
+    if (keep.y1 > bh) keep.y1 = bh;
+    int keep_w = keep.x1 - keep.x0;
+    if (!dirty_empty(&keep)) {
+        bg_buffer = mmap(NULL, keep_w * (keep.y1 - keep.y0) * 2, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+        if (bg_buffer == MAP_FAILED) bg_buffer = NULL;
+    }
+    bg_rect = keep;
+    
+#ifdef FRAME_ALPHA
+    int fy0 = 0, fy1 = 0;
+#else
+    int fy0 = y, fy1 = y + FRAME_H;
+#endif
+    bg_reader_t rd;
+    bg_begin(&rd, &img, bw, bh, bw != img.w || bh != img.h ? band + bw * BG_BAND_ROWS : NULL);
+    for (int by0 = 0; by0 < bh; by0 += BG_BAND_ROWS) {
+        int by1 = by0 + BG_BAND_ROWS < bh ? by0 + BG_BAND_ROWS : bh;
+        bg_read(&rd, band, by1 - by0);
         
-        int copy_len = fw;
-        if (x + copy_len > fb_w) copy_len = fb_w - x;
-        if (x < 0) {
-            src -= x;
-            copy_len += x;
-            dst += x;
+        /* Full rows above and below frame 0, the sides of it in between */
+        int hy0 = fy0 > by0 ? (fy0 < by1 ? fy0 : by1) : by0;
+        int hy1 = fy1 > hy0 ? (fy1 < by1 ? fy1 : by1) : hy0;
+        bg_blit_band(front, fb_w, fb_h, line_len, bpp, band, bw, by0, hy0, 0, 0, r_off, g_off, b_off);
+        bg_blit_band(front, fb_w, fb_h, line_len, bpp, band + (hy0 - by0) * bw, bw, hy0, hy1,
+                     x, x + FRAME_W, r_off, g_off, b_off);
+        bg_blit_band(front, fb_w, fb_h, line_len, bpp, band + (hy1 - by0) * bw, bw, hy1, by1,
+                     0, 0, r_off, g_off, b_off);
+        if (back) {
+            bg_blit_band(back, fb_w, fb_h, line_len, bpp, band, bw, by0, by1, 0, 0, r_off, g_off, b_off);
         }
         
-        if (copy_len > 0) {
-            memcpy(dst, src, copy_len * sizeof(uint16_t));
+        /* Kept rows of this band */
+        int ky0 = by0 > keep.y0 ? by0 : keep.y0;
+        int ky1 = by1 < keep.y1 ? by1 : keep.y1;
+        for (int ky = ky0; bg_buffer && ky < ky1; ky++) {
+            memcpy(bg_buffer + (ky - keep.y0) * keep_w, band + (ky - by0) * bw + keep.x0, keep_w * 2);
         }
     }
+    
+    munmap(band, band_size);
+    return 1;
+}
+#endif
+
+/* --- Boot instrumentation (xbootsplash.stats on the kernel cmdline) --- */
+/* main() stamps each startup step and bins every frame's decode and blit */
+/* time; one summary line goes to /dev/kmsg on exit. Disabled, it costs the */
+/* clock read at entry and a test of stats.on per probe. The record is this */
+/* static struct: nothing is allocated. */
+enum { STATS_CMDLINE, STATS_DECODE, STATS_OPEN, STATS_BLIT, STATS_PRESENT, STATS_EXIT, STATS_MARKS };
+#define STATS_BINS 8    /* Up to 0.25, 0.5, 1, 2, 4, 8, 16 ms, then longer */
+
+typedef struct {
+    int on;
+    long start;                         /* main() entry, CLOCK_MONOTONIC ns */
+    long mark[STATS_MARKS];             /* When each step finished, 0 if never */
+    long pan;                           /* Blit handed over to the vblank wait */
+    unsigned int decode[STATS_BINS], blit[STATS_BINS];
+    long decode_max, blit_max;
+    unsigned int frames;                /* Presented */
+    unsigned int late;                  /* Not decoded by their deadline */
+    unsigned int dropped;               /* Decoded but skipped to catch up */
+} boot_stats_t;
+static boot_stats_t stats;
+
+static long stats_clock(void) {
+    if (!stats.on) return 0;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static void stats_mark(int m) {
+    if (stats.on && !stats.mark[m]) stats.mark[m] = stats_clock();
+}
+
+#if DISPLAY_MODE != 3 && DISPLAY_MODE != 4
+/* Bin the time since t0 (a stats_clock() reading), up to end if later than t0 */
+static void stats_bin(unsigned int *bins, long *max, long t0, long end) {
+    if (!stats.on) return;
+    long d = (end > t0 ? end : stats_clock()) - t0;
+    int b = 0;
+    for (long limit = 250000; b < STATS_BINS - 1 && d >= limit; limit <<= 1) b++;
+    bins[b]++;
+    if (d > *max) *max = d;
+}
+#endif
+
+static char *stats_str(char *p, const char *s) {
+    while (*s) *p++ = *s++;
+    return p;
+}
+
+static char *stats_uint(char *p, unsigned long v) {
+    char tmp[20];
+    int n = 0;
+    do {
+        tmp[n++] = '0' + v % 10;
+        v /= 10;
+    } while (v);
+    while (n) *p++ = tmp[--n];
+    return p;
+}
+
+/* Nanoseconds as milliseconds with two decimals */
+static char *stats_ms(char *p, long ns) {
+    unsigned long c = ns > 0 ? ns / 10000 : 0;
+    p = stats_uint(p, c / 100);
+    *p++ = '.';
+    *p++ = '0' + c / 10 % 10;
+    *p++ = '0' + c % 10;
+    return p;
+}
+
+static char *stats_bins(char *p, const char *name, const unsigned int *bins, long max) {
+    p = stats_str(p, " ");
+    p = stats_str(p, name);
+    p = stats_str(p, "_hist=");
+    for (int i = 0; i < STATS_BINS; i++) {
+        if (i) *p++ = '/';
+        p = stats_uint(p, bins[i]);
+    }
+    p = stats_str(p, " ");
+    p = stats_str(p, name);
+    p = stats_str(p, "_max=");
+    return stats_ms(p, max);
 }
 
-/* Blit RGB565 frame to framebuffer (24bpp - RGB888 packed) */
-/* Note: 24bpp is rare but some hardware uses it. Format is typically RGB in memory order. */
-static void blit_to_fb_24bpp(uint8_t *fbmem, int fb_w, int fb_h, int line_len,
-                             const uint16_t *frame, int fw, int fh, int x, int y,
-                             int r_off, int g_off, int b_off) {
-    /* 24bpp: typically 3 bytes per pixel, RGB or BGR order */
-    /* r_off/g_off/b_off indicate byte position (0, 1, or 2) for each component */
-    for (int row = 0; row < fh; row++) {
-        if (y + row >= fb_h || y + row < 0) continue;
-        
-        uint8_t *dst = fbmem + (y + row) * line_len + x * 3;
-        const uint16_t *src = frame + row * fw;
-        
-        for (int col = 0; col < fw; col++) {
-            if (x + col >= fb_w || x + col < 0) continue;
-            
-            uint16_t pixel = src[col];
-            uint8_t r = (pixel >> 11) & 0x1F;
-            uint8_t g = (pixel >> 5) & 0x3F;
-            uint8_t b = pixel & 0x1F;
-            
-            /* Expand to 8-bit */
-            r <<= 3;
-            g <<= 2;
-            b <<= 3;
-            
-            /* Use byte positions from offsets (0, 1, or 2) */
-            uint8_t *pixel_dst = dst + col * 3;
-            pixel_dst[r_off] = r;
-            pixel_dst[g_off] = g;
-            pixel_dst[b_off] = b;
-        }
+/* One line, times in ms: t0 since boot, steps relative to t0 */
+static void stats_report(void) {
+    static const char *const names[STATS_MARKS] = {
+        " cmdline=+", " decode=+", " open=+", " blit=+", " present=+", " exit=+"
+    };
+    char line[512];
+    
+    if (!stats.on) return;
+    stats_mark(STATS_EXIT);
+    
+    char *p = stats_str(line, "<6>xbootsplash: t0=");
+    p = stats_ms(p, stats.start);
+    for (int m = 0; m < STATS_MARKS; m++) {
+        if (!stats.mark[m]) continue;
+        p = stats_str(p, names[m]);
+        p = stats_ms(p, stats.mark[m] - stats.start);
     }
+    p = stats_str(p, " frames=");
+    p = stats_uint(p, stats.frames);
+    p = stats_str(p, " late=");
+    p = stats_uint(p, stats.late);
+    p = stats_str(p, " dropped=");
+    p = stats_uint(p, stats.dropped);
+    p = stats_bins(p, "decode", stats.decode, stats.decode_max);
+    p = stats_bins(p, "blit", stats.blit, stats.blit_max);
+    *p++ = '\n';
+    
+    int fd = open("/dev/kmsg", O_WRONLY | O_CLOEXEC, 0);
+    if (fd < 0) return;
+    write(fd, line, p - line);
+    close(fd);
 }
 
-/* Blit frame with position handling */
-static void blit_frame(uint8_t *fbmem, int fb_w, int fb_h, int line_len, int bpp,
-                       const uint16_t *frame, int fw, int fh, int x, int y,
-                       int r_off, int g_off, int b_off) {
-    if (bpp == 32) {
-        blit_to_fb_32bpp(fbmem, fb_w, fb_h, line_len, frame, fw, fh, x, y, r_off, g_off, b_off);
-    } else if (bpp == 16) {
-        blit_to_fb_16bpp(fbmem, fb_w, fb_h, line_len, frame, fw, fh, x, y);
-    } else if (bpp == 24) {
-        blit_to_fb_24bpp(fbmem, fb_w, fb_h, line_len, frame, fw, fh, x, y, r_off, g_off, b_off);
+/* --- Frame scheduling --- */
+/* Frames are due at absolute CLOCK_MONOTONIC deadlines (CLOCK_MONOTONIC_RAW */
+/* cannot be slept on), so decode, blit and vsync waits never stretch the period. */
+#ifdef FRAME_DURATION_MS
+#define FRAME_NS ((long)FRAME_DURATION_MS * 1000000L)
+#endif
+
+/* Lock presentation to vblank when FRAME_DURATION_MS is a whole number of refresh periods */
+#ifndef VSYNC_LOCK
+#define VSYNC_LOCK 1
+#endif
+
+static long vsync_period_ns = 0;    /* Measured refresh period, 0 if unknown */
+static int vsync_frames = 0;        /* Vblanks per animation frame, 0 = not locked */
+static long last_vblank_ns = 0;     /* When the last FBIO_WAITFORVSYNC returned */
+
+static long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+/* Sleep until an absolute CLOCK_MONOTONIC time or a termination signal, */
+/* serving control commands that arrive meanwhile. */
+/* ppoll's timeout is relative, so it is recomputed from the deadline after */
+/* every wakeup and the error never carries over to the next frame. */
+static void sleep_until_ns(long deadline) {
+    while (!terminate_requested) {
+        long left = deadline - now_ns();
+        if (left <= 0) break;
+        struct timespec ts = {
+            .tv_sec = left / 1000000000L,
+            .tv_nsec = left % 1000000000L
+        };
+#if USE_CONTROL
+        control_wait(&ts);
+#else
+        ppoll(NULL, 0, &ts, &wait_sigmask);
+#endif
     }
 }
 
+/* Block until the next vblank; returns -1 if the driver cannot report it */
+static int fb_wait_vsync(void) {
+    unsigned int crtc = 0;
+    if (ioctl(fb_fd, FBIO_WAITFORVSYNC, &crtc) < 0) return -1;
+    last_vblank_ns = now_ns();
+    return 0;
+}
+
+/* Measure the refresh period from two consecutive vblanks (pixclock is 0 on */
+/* most firmware framebuffers) and lock if FRAME_NS is within 1/32 of a multiple */
+#ifdef FRAME_NS
+static void vsync_lock_detect(void) {
+    if (!VSYNC_LOCK) return;
+    if (fb_wait_vsync() < 0) return;
+    long t0 = last_vblank_ns;
+    if (fb_wait_vsync() < 0) return;
+    long period = last_vblank_ns - t0;
+    
+    /* Drivers that return immediately (or a missed vblank) give nonsense */
+    if (period < 2000000L || period > 50000000L) return;
+    
+    long n = (FRAME_NS + period / 2) / period;
+    long err = n * period - FRAME_NS;
+    if (err < 0) err = -err;
+    if (n < 1 || err * 32 > FRAME_NS) return;
+    
+    vsync_period_ns = period;
+    vsync_frames = (int)n;
+}
+#endif
+
+/* Make the back page visible: wait for VSync, pan, swap pages */
+static void fb_pan_to_back(void) {
+    int back_page = 1 - fb_page;
+    
+    /* Pan to back buffer (the rest of the mode must be the real one) */
+    struct fb_var_screeninfo vinfo = fb_vinfo;
+    vinfo.yoffset = back_page * fb_yres;
+    vinfo.xoffset = 0;
+    
+    /* Wait for VSync then pan */
+    stats.pan = stats_clock();
+    fb_wait_vsync();
+    ioctl(fb_fd, FBIOPAN_DISPLAY, &vinfo);
+    
+    fb_page = back_page;
+}
+
 /* Blit with double buffering - write to back buffer and pan */
 static void blit_frame_dblbuf(uint8_t *fbmem, int fb_w, int fb_h, int line_len, int bpp,
-                              const uint16_t *frame, int fw, int fh, int x, int y,
+                              const uint16_t *frame, int stride, int fw, int fh, int x, int y,
                               int r_off, int g_off, int b_off) {
     /* Calculate back buffer offset (alternate page) */
     int back_page = 1 - fb_page;
@@ -559,40 +2307,217 @@ static void blit_frame_dblbuf(uint8_t *fbmem, int fb_w, int fb_h, int line_len,
     
     /* Blit to back buffer */
     if (bpp == 32) {
-        blit_to_fb_32bpp(back_buf, fb_w, fb_h, line_len, frame, fw, fh, x, y, r_off, g_off, b_off);
+        blit_to_fb_32bpp(back_buf, fb_w, fb_h, line_len, frame, stride, fw, fh, x, y, r_off, g_off, b_off);
     } else if (bpp == 16) {
-        blit_to_fb_16bpp(back_buf, fb_w, fb_h, line_len, frame, fw, fh, x, y);
+        blit_to_fb_16bpp(back_buf, fb_w, fb_h, line_len, frame, stride, fw, fh, x, y);
     } else if (bpp == 24) {
-        blit_to_fb_24bpp(back_buf, fb_w, fb_h, line_len, frame, fw, fh, x, y, r_off, g_off, b_off);
+        blit_to_fb_24bpp(back_buf, fb_w, fb_h, line_len, frame, stride, fw, fh, x, y, r_off, g_off, b_off);
     }
     
-    /* Pan to back buffer */
-    struct fb_var_screeninfo vinfo;
-    vinfo.yoffset = back_page * fb_yres;
-    vinfo.xoffset = 0;
+    fb_pan_to_back();
+}
+
+/* --- Native-format frame cache --- */
+/* Optional (FRAME_CACHE_KB > 0, looping animations only): the first pass */
+/* converts every decoded frame once into the framebuffer pixel format; later */
+/* passes skip decoding and conversion and just copy the dirty rows. Alpha */
+/* themes blend over the background every frame and are not cached, nor are */
+/* builds with a control channel, which can jump anywhere in the animation. */
+#ifndef FRAME_CACHE_KB
+#define FRAME_CACHE_KB 0
+#endif
+
+#if FRAME_CACHE_KB > 0 && (DISPLAY_MODE == 0 || DISPLAY_MODE == 1 || DISPLAY_MODE == 2) && !defined(FRAME_ALPHA) && !USE_CONTROL
+#define USE_FRAME_CACHE 1
+
+static uint8_t *frame_cache = NULL;         /* NFRAMES converted frames, contiguous */
+static int frame_cache_pitch = 0;           /* Bytes per cached row */
+static dirty_rect_t *frame_cache_dirty;     /* Per-frame dirty boxes, after the frames */
+static int frame_cache_on = 0;              /* Cache allocated: first pass fills it */
+static int frame_cache_ready = 0;           /* Whole loop stored: later passes replay it */
+static int frame_cache_bpp, frame_cache_r_off, frame_cache_g_off, frame_cache_b_off;
+
+/* Allocate the cache if the whole loop fits the budget; returns 1 on success */
+static int frame_cache_init(int bpp, int r_off, int g_off, int b_off) {
+#if defined(LOOP)
+    if (!LOOP) return 0;
+#endif
+    if (bpp != 16 && bpp != 24 && bpp != 32) return 0;
     
-    /* Wait for VSync then pan */
-    ioctl(fb_fd, FBIO_WAITFORVSYNC, 0);
-    ioctl(fb_fd, FBIOPAN_DISPLAY, &vinfo);
+    frame_cache_bpp = bpp;
+    frame_cache_r_off = r_off;
+    frame_cache_g_off = g_off;
+    frame_cache_b_off = b_off;
     
-    fb_page = back_page;
+    frame_cache_pitch = FRAME_W * (bpp / 8);
+    size_t size = (size_t)NFRAMES * FRAME_H * frame_cache_pitch;
+    if (size > (size_t)FRAME_CACHE_KB * 1024) return 0;
+    
+    size_t dirty_off = (size + 15) & ~(size_t)15;
+    frame_cache = mmap(NULL, dirty_off + NFRAMES * sizeof(dirty_rect_t), PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if ((unsigned long)frame_cache >= (unsigned long)-4095) {
+        frame_cache = NULL;
+        return 0;
+    }
+    frame_cache_dirty = (dirty_rect_t *)(frame_cache + dirty_off);
+    return 1;
 }
 
-/* High-precision sleep with EINTR handling */
-static void sleep_ms(unsigned int ms) {
-    struct timespec req = {
-        .tv_sec = ms / 1000,
-        .tv_nsec = (ms % 1000) * 1000000L
-    };
-    struct timespec rem;
-    while (nanosleep(&req, &rem) != 0) {
-        /* Retry with remaining time if interrupted by signal */
-        req = rem;
+static inline uint8_t *frame_cache_slot(int f) {
+    return frame_cache + (size_t)f * FRAME_H * frame_cache_pitch;
+}
+
+/* Convert the current frame_buffer (frame f, changed region r) into its slot */
+static void frame_cache_store(int f, const dirty_rect_t *r) {
+    /* In-memory destination: ordinary stores, it is read back every loop */
+    int stream = fb_stream;
+    fb_stream = 0;
+    blit_frame(frame_cache_slot(f), FRAME_W, FRAME_H, frame_cache_pitch, frame_cache_bpp,
+               frame_buffer, FRAME_W, FRAME_W, FRAME_H, 0, 0,
+               frame_cache_r_off, frame_cache_g_off, frame_cache_b_off);
+    fb_stream = stream;
+    frame_cache_dirty[f] = *r;
+}
+
+/* Copy rect r of cached frame f to the framebuffer at (x, y), then pan if double buffered */
+static void frame_cache_blit(uint8_t *fbmem, int fb_w, int fb_h, int line_len, int bpp,
+                             int f, const dirty_rect_t *r, int x, int y) {
+    int bytes_pp = bpp / 8;
+    int x0 = r->x0, y0 = r->y0, x1 = r->x1, y1 = r->y1;
+    
+    /* Clip to framebuffer bounds */
+    if (x + x0 < 0) x0 = -x;
+    if (y + y0 < 0) y0 = -y;
+    if (x + x1 > fb_w) x1 = fb_w - x;
+    if (y + y1 > fb_h) y1 = fb_h - y;
+    
+    if (x1 > x0 && y1 > y0) {
+        uint8_t *dst_base = fbmem;
+        if (fb_has_dblbuf) dst_base += (1 - fb_page) * fb_yres * line_len;
+        
+        const uint8_t *src = frame_cache_slot(f) + y0 * frame_cache_pitch + x0 * bytes_pp;
+        uint8_t *dst = dst_base + (y + y0) * line_len + (x + x0) * bytes_pp;
+        int bytes = (x1 - x0) * bytes_pp;
+        
+        for (int row = y0; row < y1; row++) {
+            if (fb_stream) {
+                stream_copy_row(dst, src, bytes);
+            } else {
+                memcpy(dst, src, bytes);
+            }
+            src += frame_cache_pitch;
+            dst += line_len;
+        }
+        if (fb_stream) _mm_sfence();
+    }
+    
+    if (fb_has_dblbuf) fb_pan_to_back();
+}
+#else
+#define USE_FRAME_CACHE 0
+#endif
+
+#if USE_CONTROL
+/* Decode frame `to` over frame `from`. Deltas only run forward, so going back */
+/* restarts from frame 0 (through the closing delta when leaving the last frame) */
+static void frame_seek(int from, int to) {
+    if (to == from) return;
+    if (to < from) {
+#ifdef LOOP_DELTA
+        if (LOOP_DELTA && from == NFRAMES - 1) {
+            apply_delta(frames[NFRAMES], frame_sizes[NFRAMES], NFRAMES);
+        } else
+#endif
+        load_frame_0(frames[0], frame_sizes[0]);
+        from = 0;
+    }
+    while (from < to) {
+        from++;
+        apply_delta(frames[from], frame_sizes[from], from);
+    }
+}
+#endif
+
+#if DISPLAY_MODE != 3 && DISPLAY_MODE != 4
+/* Step to the next frame and grow dirty by what it changes, so frames decoded */
+/* without being presented still reach the screen. Returns 0 at the end of a */
+/* non-looping animation (nothing changes). */
+static int advance_frame(int *frame_idx) {
+#if USE_CONTROL
+    /* Range set over the control channel; jumps decode the frames in between */
+    int next = seq_next(*frame_idx);
+    if (next < 0) return 0;
+    frame_seek(*frame_idx, next);
+    *frame_idx = next;
+    return 1;
+#else
+    int f = *frame_idx + 1;
+    if (f >= NFRAMES) {
+#ifdef LOOP
+        if (!LOOP) return 0;  /* Stay on last frame */
+#endif
+        f = 0;
+    }
+    *frame_idx = f;
+    
+#if USE_FRAME_CACHE
+    /* Whole loop converted: from now on frames come from the cache */
+    if (frame_cache_on && f == 0) {
+        frame_cache_ready = 1;
+#if defined(LOOP_DELTA) && !TRACK_DIRTY
+        /* Replayed wraps only change what the closing delta touches */
+        if (LOOP_DELTA) {
+            dirty_reset(&frame_cache_dirty[0]);
+            dirty_add_frame(&frame_cache_dirty[0], NFRAMES);
+        }
+#endif
+    }
+    if (frame_cache_ready) {
+        dirty_union(&dirty, &frame_cache_dirty[f]);
+        return 1;
+    }
+    /* The cache needs this frame's own region, not the accumulated one */
+    dirty_rect_t pending = dirty;
+    dirty_reset(&dirty);
+#endif
+    
+    /* Apply delta to get next frame */
+    if (f > 0) {
+        apply_delta(frames[f], frame_sizes[f], f);
+#ifdef LOOP_DELTA
+    } else if (LOOP_DELTA) {
+        /* Closing delta from the last frame is smaller than frame 0 */
+        apply_delta(frames[NFRAMES], frame_sizes[NFRAMES], NFRAMES);
+#endif
+    } else {
+        load_frame_0(frames[0], frame_sizes[0]);
+    }
+    
+#if USE_FRAME_CACHE
+    if (frame_cache_on) {
+        frame_cache_store(f, &dirty);
     }
+    dirty_union(&dirty, &pending);
+#endif
+    return 1;
+#endif
+}
+#endif
+
+/* Length of key if the parameter at p is exactly key, or key=1 */
+static int cmdline_flag(const char *p, const char *key) {
+    int i = 0;
+    while (key[i] && p[i] == key[i]) i++;
+    if (key[i]) return 0;
+    if (p[i] == '=' && p[i + 1] == '1') i += 2;
+    char next = p[i];
+    return (next == ' ' || next == '\t' || next == '\n' || next == '\0') ? i : 0;
 }
 
 /* Check if splash is disabled via kernel cmdline */
 /* Returns 1 if disabled (should exit), 0 if enabled */
+/* Also turns on boot instrumentation for xbootsplash.stats */
 static int check_cmdline_disable(void) {
     int fd = open("/proc/cmdline", 0, 0);  /* O_RDONLY = 0 */
     if (fd < 0) return 0;  /* Can't read cmdline, assume enabled */
@@ -633,6 +2558,11 @@ static int check_cmdline_disable(void) {
             }
         }
         
+        /* Check for xbootsplash.stats (or xbootsplash.stats=1) */
+        if (cmdline_flag(p, "xbootsplash.stats")) {
+            stats.on = 1;
+        }
+        
         /* Skip to next parameter */
         while (*p && *p != ' ' && *p != '\t' && *p != '\n') p++;
     }
@@ -640,48 +2570,62 @@ static int check_cmdline_disable(void) {
     return 0;  /* Not found, splash enabled */
 }
 
-/* Get current time in milliseconds using CLOCK_MONOTONIC_RAW */
-static long get_time_ms(void) {
-    struct timespec ts;
-    /* Use syscall directly for clock_gettime */
-    syscall2(228, (long)CLOCK_MONOTONIC_RAW, (long)&ts);  /* SYS_clock_gettime = 228 on x86_64 */
-    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000L;
-}
-
 /* Entry point */
 int main(void) {
-    int fb_fd = -1;
     void *fbmem = NULL;
     size_t fb_size = 0;
     struct fb_var_screeninfo vinfo;
     struct fb_fix_screeninfo finfo;
     
+    /* Startup timeline origin, before the cmdline says whether it is wanted */
+    stats.start = now_ns();
+    
     /* Kill switch: check kernel cmdline for nosplash or xbootsplash=0 */
     if (check_cmdline_disable()) {
         return 0;  /* Splash disabled, exit cleanly */
     }
+    stats_mark(STATS_CMDLINE);
     
     /* Setup signal handlers for graceful termination */
-    signal(SIGTERM, signal_handler);
-    signal(SIGINT, signal_handler);
+    signals_init();
+    
+    /* Select SIMD kernels for this CPU */
+    cpu_detect();
+    
+#ifdef ASSET_PATH
+    /* Theme container: no theme, no splash */
+    if (asset_load() != 0) {
+        return 1;
+    }
+#endif
     
     /* Allocate frame buffer */
     frame_buffer = mmap(NULL, FRAME_W * FRAME_H * 2, PROT_READ | PROT_WRITE,
-                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
     if (frame_buffer == MAP_FAILED) {
         return 1;
     }
+#ifdef TILE_REF
+    /* Previous-frame reference for tile copies */
+    if (TILE_REF) {
+        tile_ref = mmap(NULL, FRAME_W * FRAME_H * 2, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+        if (tile_ref == MAP_FAILED) {
+            return 1;
+        }
+    }
+#endif
     
-#if DISPLAY_MODE == 1 || DISPLAY_MODE == 2
-    /* Allocate background buffer for animation-on-image modes */
-    bg_buffer = mmap(NULL, BG_W * BG_H * 2, PROT_READ | PROT_WRITE,
-                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-    if (bg_buffer == MAP_FAILED) {
+#ifdef FRAME_ALPHA
+    /* Coverage plane and blend target (last row: BACKGROUND_COLOR off the image) */
+    alpha_buffer = mmap(NULL, FRAME_W * FRAME_H, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    comp_buffer = mmap(NULL, FRAME_W * (FRAME_H + 1) * 2, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (alpha_buffer == MAP_FAILED || comp_buffer == MAP_FAILED) {
         return 1;
     }
-    /* Decompress background from palette + LZSS */
-    decompress_palette_lzss(bg_compressed, BG_COMPRESSED_SIZE, bg_palette, BG_PALETTE_SIZE,
-                            bg_buffer, BG_W * BG_H);
+    for (int i = 0; i < FRAME_W; i++) comp_buffer[FRAME_W * FRAME_H + i] = BACKGROUND_COLOR;
 #endif
     
     /* Load initial frame */
@@ -701,6 +2645,9 @@ int main(void) {
     /* Animation: load frame 0 compressed */
     load_frame_0(frames[0], frame_sizes[0]);
 #endif
+#if DISPLAY_MODE != 1 && DISPLAY_MODE != 2
+    stats_mark(STATS_DECODE);
+#endif
     
     /* Open framebuffer */
     fb_fd = open("/dev/fb0", O_RDWR, 0);
@@ -723,7 +2670,14 @@ int main(void) {
         return 1;
     }
     
+    /* /dev/fb0 maps video memory write-combined or uncached (fb_pgprotect): */
+    /* stream into it. Shadow-buffered fbdev emulation only loses cache hits */
+    /* the kernel's damage worker would never get from a full-screen blit anyway. */
+    fb_stream = 1;
+    stats_mark(STATS_OPEN);
+    
     /* Detect double buffer capability */
+    fb_vinfo = vinfo;
     fb_yres = vinfo.yres;
     fb_line_len = finfo.line_length;
     
@@ -772,9 +2726,26 @@ int main(void) {
     /* Animation on background image (centered or fullscreen) */
     x = (vinfo.xres - FRAME_W) / 2 + HORIZONTAL_OFFSET;
     y = (vinfo.yres - FRAME_H) / 2 + VERTICAL_OFFSET;
-    /* Draw background first */
+    /* First pixels: the colour, and frame 0 unless it is blended over the image */
+    fill_fb_color(fbmem, vinfo.xres, vinfo.yres, finfo.line_length,
+                  vinfo.bits_per_pixel, BACKGROUND_COLOR, r_off, g_off, b_off);
+#ifndef FRAME_ALPHA
     blit_frame(fbmem, vinfo.xres, vinfo.yres, finfo.line_length, vinfo.bits_per_pixel,
-               bg_buffer, BG_W, BG_H, 0, 0, r_off, g_off, b_off);
+               frame_buffer, FRAME_W, FRAME_W, FRAME_H, x, y, r_off, g_off, b_off);
+    stats_mark(STATS_PRESENT);
+#endif
+    /* Then the background around it, band by band as it is decoded, and whole */
+    /* on the back page, where the first frame goes over it before the pan */
+#if USE_CONTROL
+    progress_place(x, y);
+#endif
+    uint8_t *back = fb_has_dblbuf ? (uint8_t *)fbmem + (1 - fb_page) * fb_yres * fb_line_len : NULL;
+    if (!bg_load(fbmem, back, vinfo.xres, vinfo.yres, finfo.line_length, vinfo.bits_per_pixel,
+                 x, y, r_off, g_off, b_off) && back) {
+        fill_fb_color(back, vinfo.xres, vinfo.yres, finfo.line_length,
+                      vinfo.bits_per_pixel, BACKGROUND_COLOR, r_off, g_off, b_off);
+    }
+    stats_mark(STATS_DECODE);
 #else
     /* Animation or static on solid background */
     x = (vinfo.xres - FRAME_W) / 2 + HORIZONTAL_OFFSET;
@@ -783,75 +2754,128 @@ int main(void) {
     fill_fb_color(fbmem, vinfo.xres, vinfo.yres, finfo.line_length,
                   vinfo.bits_per_pixel, BACKGROUND_COLOR, r_off, g_off, b_off);
 #endif
+    stats_mark(STATS_BLIT);
     
     /* Main loop */
 #if DISPLAY_MODE == 3 || DISPLAY_MODE == 4
     /* Static image: just display and wait for termination signal */
     blit_func(fbmem, vinfo.xres, vinfo.yres, finfo.line_length, vinfo.bits_per_pixel,
-              frame_buffer, FRAME_W, FRAME_H, x, y, r_off, g_off, b_off);
+              frame_buffer, FRAME_W, FRAME_W, FRAME_H, x, y, r_off, g_off, b_off);
+    stats_mark(STATS_PRESENT);
     
     /* Sleep until signal received */
-    while (!terminate_requested) {
-        sleep_ms(1000);
-    }
+    wait_for_signal();
 #else
     /* Animation loop */
-    /* Draw background once - animation frames completely cover their area */
-#if DISPLAY_MODE == 1 || DISPLAY_MODE == 2
-    blit_func(fbmem, vinfo.xres, vinfo.yres, finfo.line_length, vinfo.bits_per_pixel,
-              bg_buffer, BG_W, BG_H, 0, 0, r_off, g_off, b_off);
+    /* Region changed by the previous delta: with double buffering the back page */
+    /* is two frames old, so it needs both the current and the previous dirty rect */
+    dirty_rect_t prev_dirty;
+    dirty_mark_full(&prev_dirty);
+    
+#if USE_FRAME_CACHE
+    /* First pass fills the cache, later passes replay it */
+    frame_cache_on = frame_cache_init(vinfo.bits_per_pixel, r_off, g_off, b_off);
+    if (frame_cache_on) {
+        frame_cache_store(0, &dirty);
+    }
+#endif
+    
+    /* Frame 0 is due now; with a vblank lock every frame lands N vblanks after */
+    /* the previous one, otherwise on a FRAME_NS grid */
+    vsync_lock_detect();
+    long deadline = now_ns();
+    
+#if USE_CONTROL
+    control_init(fbmem, vinfo.xres, vinfo.bits_per_pixel, r_off, g_off, b_off, x, y);
 #endif
     
     int frame_idx = 0;
     while (!terminate_requested) {
-        /* Measure frame start time */
-        long frame_start = get_time_ms();
+        long vblank_before = last_vblank_ns;
+        
+        /* Single buffer: the lock has to come from an explicit vblank wait */
+        if (vsync_frames && !fb_has_dblbuf) {
+            fb_wait_vsync();
+        }
+        
+        /* Blit only the changed region via function pointer (double buffer or single) */
+        dirty_rect_t blit_rect = dirty;
+        if (fb_has_dblbuf) {
+            dirty_union(&blit_rect, &prev_dirty);
+        }
+        long blit_t0 = stats_clock();
+        if (!dirty_empty(&blit_rect)) {
+#ifdef FRAME_ALPHA
+            /* No frame cache with alpha: every blit is blended first */
+            alpha_compose(&blit_rect, x, y);
+#endif
+#if USE_FRAME_CACHE
+            if (frame_cache_ready) {
+                frame_cache_blit(fbmem, vinfo.xres, vinfo.yres, finfo.line_length,
+                                 vinfo.bits_per_pixel, frame_idx, &blit_rect, x, y);
+            } else
+#endif
+            blit_func(fbmem, vinfo.xres, vinfo.yres, finfo.line_length, vinfo.bits_per_pixel,
+                      FRAME_OUT + blit_rect.y0 * FRAME_W + blit_rect.x0, FRAME_W,
+                      blit_rect.x1 - blit_rect.x0, blit_rect.y1 - blit_rect.y0,
+                      x + blit_rect.x0, y + blit_rect.y0, r_off, g_off, b_off);
+        }
+        prev_dirty = dirty;
+        dirty_reset(&dirty);
         
-        /* Blit current frame via function pointer (double buffer or single) */
-        blit_func(fbmem, vinfo.xres, vinfo.yres, finfo.line_length, vinfo.bits_per_pixel,
-                  frame_buffer, FRAME_W, FRAME_H, x, y, r_off, g_off, b_off);
+        /* Blit time stops where the vblank wait of a page flip starts */
+        if (stats.on) {
+            stats_bin(stats.blit, &stats.blit_max, blit_t0, stats.pan);
+            stats_mark(STATS_PRESENT);
+            stats.frames++;
+        }
         
         /* Check for termination signal */
         if (terminate_requested) break;
         
-        /* Next frame */
-        frame_idx++;
+        /* Next deadline: when locked, re-anchored on the vblank this frame went out on */
+        long period = FRAME_NS;
+        if (vsync_frames) {
+            period = vsync_frames * vsync_period_ns;
+            if (last_vblank_ns != vblank_before) deadline = last_vblank_ns;
+        }
+        deadline += period;
         
-        /* Check loop mode */
-        if (frame_idx >= NFRAMES) {
-#ifdef LOOP
-            if (LOOP) {
-                frame_idx = 0;
-            } else {
-                /* Stay on last frame until terminated */
-                while (!terminate_requested) {
-                    sleep_ms(1000);
-                }
-                break;
+        /* Next frame */
+        long decode_t0 = stats_clock();
+        if (!advance_frame(&frame_idx)) {
+#if USE_CONTROL
+            /* Hold the frame, still serving commands; "seq" resumes playback */
+            if (control_hold(frame_idx) && advance_frame(&frame_idx)) {
+                deadline = now_ns();
+                continue;
             }
 #else
-            /* Default: loop */
-            frame_idx = 0;
+            /* Stay on last frame until terminated */
+            wait_for_signal();
 #endif
+            break;
         }
         
-        /* Apply delta to get next frame */
-        if (frame_idx == 0) {
-            load_frame_0(frames[0], frame_sizes[0]);
-        } else {
-            apply_delta(frames[frame_idx], frame_sizes[frame_idx]);
-        }
-        
-        /* Delta-time: subtract processing time from sleep duration */
-        long frame_end = get_time_ms();
-        long elapsed = frame_end - frame_start;
-        long sleep_time = FRAME_DURATION_MS - elapsed;
+        stats_bin(stats.decode, &stats.decode_max, decode_t0, 0);
         
-        if (sleep_time > 0) {
-            sleep_ms((unsigned int)sleep_time);
+        /* A whole period behind (slow blit, busy CPU): decode the frames that are */
+        /* already due without presenting them, so the animation keeps its speed */
+        long now = now_ns();
+        if (stats.on && now > deadline) stats.late++;
+        while (now - deadline >= period && !terminate_requested) {
+            decode_t0 = stats_clock();
+            if (!advance_frame(&frame_idx)) break;
+            stats_bin(stats.decode, &stats.decode_max, decode_t0, 0);
+            if (stats.on) stats.dropped++;
+            deadline += period;
         }
+        
+        /* Locked: wake half a refresh early, the vblank wait does the rest */
+        sleep_until_ns(vsync_frames ? deadline - vsync_period_ns / 2 : deadline);
     }
 #endif
+    stats_report();
     
     /* Graceful cleanup: clear framebuffer to black */
     memset(fbmem, 0, fb_size);
@@ -8,46 +8,134 @@
  * Uses the same frames_delta.h format as the fbdev version.
  */
 
+#define _GNU_SOURCE     /* ppoll */
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <signal.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
 #include <time.h>
 #include <unistd.h>
 
+#include <emmintrin.h>
+#include <immintrin.h>  /* AVX2 - only reached through cpuid dispatch */
+
 #include <xf86drm.h>
 #include <xf86drmMode.h>
+#include <drm_fourcc.h>
 
 /* Generated frame data */
 #include "frames_delta.h"
 
+/* Headers without FRAME0_METHOD store frame 0 as raw RGB565 */
+#ifndef FRAME0_METHOD
+#define FRAME0_METHOD 3
+#endif
+
+/* On exit, leave the last frame scanned out for the next DRM master instead
+ * of restoring the previous CRTC (needs DRM_IOCTL_MODE_CLOSEFB, Linux 6.8) */
+#ifndef DRM_HANDOFF
+#define DRM_HANDOFF 1
+#endif
+
+/* Animation modes: scan the frame out of its own overlay plane (atomic KMS)
+ * above a primary buffer that only holds the backdrop, so a frame flips a
+ * FRAME_W x FRAME_H sprite instead of touching the full-screen buffers.
+ * Outputs without a usable plane composite as before; 0 = always composite.
+ * Alpha frames are blended against the background and always composite. */
+#ifndef DRM_PLANES
+#define DRM_PLANES 1
+#endif
+
+#if DRM_PLANES && DISPLAY_MODE != 3 && DISPLAY_MODE != 4 && !defined(FRAME_ALPHA)
+#define USE_PLANES 1
+#else
+#define USE_PLANES 0
+#endif
+
+/* Older libdrm headers predate CLOSEFB */
+#ifndef DRM_IOCTL_MODE_CLOSEFB
+struct drm_mode_closefb {
+    uint32_t fb_id;
+    uint32_t pad;
+};
+#define DRM_IOCTL_MODE_CLOSEFB DRM_IOWR(0xD0, struct drm_mode_closefb)
+#endif
+
 /* ============================================================================
  * DRM/KMS Context
  * ============================================================================ */
 
+/* One dumb buffer + DRM framebuffer object */
+typedef struct {
+    uint32_t fb_id;
+    uint32_t handle;
+    uint32_t pitch;
+    uint32_t size;
+    uint8_t *map;
+} xbs_drm_buf_t;
+
+/* Upper bound on simultaneously driven connectors (docks, dual-head kiosks) */
+#ifndef DRM_MAX_OUTPUTS
+#define DRM_MAX_OUTPUTS 4
+#endif
+
+/* Plane properties set by the sprite commits */
+enum {
+    PLANE_FB_ID, PLANE_CRTC_ID,
+    PLANE_SRC_X, PLANE_SRC_Y, PLANE_SRC_W, PLANE_SRC_H,
+    PLANE_CRTC_X, PLANE_CRTC_Y, PLANE_CRTC_W, PLANE_CRTC_H,
+    PLANE_NPROPS
+};
+
+/* One connector, its CRTC and the buffers it scans out */
 typedef struct {
-    int fd;
-    
     /* Connector and CRTC */
     uint32_t conn_id;
     uint32_t crtc_id;
+    int crtc_index;         /* Position in drmModeRes.crtcs (possible_crtcs bit) */
     drmModeModeInfo mode;
     drmModeCrtc *saved_crtc;
+    bool crtc_attached;     /* crtc_id already drives conn_id */
+    bool foreign_scanout;   /* Mode kept: the CRTC still shows the previous master's fb */
     
-    /* Framebuffer */
-    uint32_t fb_id;
-    uint32_t handle;
-    uint32_t pitch;
-    uint32_t size;
-    uint8_t *map;
+    /* Framebuffers: bufs[front] is scanned out. With two buffers we draw
+     * into the other one and page flip; with one we draw into front. */
+    xbs_drm_buf_t bufs[2];
+    int nbufs;
+    int front;
+    bool flip_pending;      /* Page flip queued, waiting for its event */
+    bool no_dirtyfb;        /* Driver has no dirty callback: front writes are live */
+    long flip_ns;           /* CLOCK_MONOTONIC vblank of the last completed flip, 0 = unknown */
+    long refresh_ns;        /* Refresh period of the mode, 0 = unknown */
     
-    /* Dimensions */
+    /* Dimensions, and where the animation frame sits on this output */
     uint32_t width;
     uint32_t height;
+    int x, y;
+    
+    /* Sprite plane (DRM_PLANES): the frame is scanned out of sprite[] on
+     * plane_id, flipped like the primary buffers; plane_id 0 = composited */
+    uint32_t plane_id;
+    uint32_t plane_props[PLANE_NPROPS];
+    xbs_drm_buf_t sprite[2];
+    int sprite_front;
+    bool sprite_on;         /* Plane enabled: later commits only change FB_ID */
+} xbs_drm_output_t;
+
+/* Every connected connector shares the one decoded frame_buffer.
+ * outs[0] is the pacing output: its vblanks drive the frame schedule. */
+typedef struct {
+    int fd;
+    xbs_drm_output_t outs[DRM_MAX_OUTPUTS];
+    int nouts;
+    bool mono_stamps;       /* Flip event timestamps are CLOCK_MONOTONIC */
+    bool atomic;            /* Atomic commits allowed: sprite planes can be used */
 } xbs_drm_ctx_t;
 
 /* Global for signal handler */
@@ -57,8 +145,16 @@ static xbs_drm_ctx_t *g_drm_ctx = NULL;
 /* Frame buffer for animation (RGB565) */
 static uint16_t *frame_buffer = NULL;
 
+/* Dirty rectangle in frame coordinates (half-open: x0 <= x < x1, y0 <= y < y1)
+ * Accumulated by the delta decoders, consumed by the blit in the animation loop */
+typedef struct {
+    int x0, y0, x1, y1;
+} dirty_rect_t;
+static dirty_rect_t dirty;
+
 #if DISPLAY_MODE == 1 || DISPLAY_MODE == 2
-static uint16_t *bg_buffer = NULL;
+static uint16_t *bg_buffer = NULL;      /* See bg_load() */
+static dirty_rect_t bg_rect;            /* Part of the background image in bg_buffer */
 #endif
 
 /* ============================================================================
@@ -70,10 +166,174 @@ static void signal_handler(int sig) {
     terminate_requested = 1;
 }
 
+/* SIGTERM/SIGINT stay blocked except inside the waits below, which unblock
+ * them atomically with ppoll: a signal can never land between checking
+ * terminate_requested and going to sleep, and it always ends the wait at once */
+static sigset_t wait_sigmask;
+
+static void signals_init(void) {
+    sigset_t block;
+    sigemptyset(&block);
+    sigaddset(&block, SIGTERM);
+    sigaddset(&block, SIGINT);
+    
+    signal(SIGTERM, signal_handler);
+    signal(SIGINT, signal_handler);
+    sigprocmask(SIG_BLOCK, &block, &wait_sigmask);
+    
+    /* Mask while waiting: whatever we inherited, minus the two we handle */
+    sigdelset(&wait_sigmask, SIGTERM);
+    sigdelset(&wait_sigmask, SIGINT);
+}
+
+/* Block until a termination signal has been handled */
+static void wait_for_signal(void) {
+    while (!terminate_requested) {
+        ppoll(NULL, 0, NULL, &wait_sigmask);
+    }
+}
+
+/* ============================================================================
+ * Dirty Rectangle Tracking (same as fbdev version)
+ * ============================================================================ */
+
+/* With a generator-provided frame_dirty[] table the decoders skip all tracking
+ * and delta streams start at the first changed row; otherwise track at runtime */
+#ifdef FRAME_DIRTY_TABLE
+#define TRACK_DIRTY 0
+#else
+#define TRACK_DIRTY 1
+#endif
+
+/* Reset to empty (x1 <= x0) */
+static inline void dirty_reset(dirty_rect_t *r) {
+    r->x0 = FRAME_W;
+    r->y0 = FRAME_H;
+    r->x1 = 0;
+    r->y1 = 0;
+}
+
+static inline void dirty_mark_full(dirty_rect_t *r) {
+    r->x0 = 0;
+    r->y0 = 0;
+    r->x1 = FRAME_W;
+    r->y1 = FRAME_H;
+}
+
+static inline bool dirty_empty(const dirty_rect_t *r) {
+    return r->x1 <= r->x0 || r->y1 <= r->y0;
+}
+
+/* Grow r to cover a linear pixel span [start, end) of the frame.
+ * Called once per decoded run, never per pixel (except sparse). */
+static inline void dirty_add_span(dirty_rect_t *r, int start, int end) {
+    if (end <= start) return;
+    int y0 = start / FRAME_W;
+    int y1 = (end - 1) / FRAME_W;
+    int x0, x1;
+    if (y0 == y1) {
+        x0 = start - y0 * FRAME_W;
+        x1 = end - y0 * FRAME_W;
+    } else {
+        /* Span wraps a row boundary: covers full width */
+        x0 = 0;
+        x1 = FRAME_W;
+    }
+    if (x0 < r->x0) r->x0 = x0;
+    if (x1 > r->x1) r->x1 = x1;
+    if (y0 < r->y0) r->y0 = y0;
+    if (y1 + 1 > r->y1) r->y1 = y1 + 1;
+}
+
+/* Grow r to also cover o */
+static inline void dirty_union(dirty_rect_t *r, const dirty_rect_t *o) {
+    if (dirty_empty(o)) return;
+    if (o->x0 < r->x0) r->x0 = o->x0;
+    if (o->y0 < r->y0) r->y0 = o->y0;
+    if (o->x1 > r->x1) r->x1 = o->x1;
+    if (o->y1 > r->y1) r->y1 = o->y1;
+}
+
+/* Grow r to cover the precomputed region of frame f (no-op without table) */
+static inline void dirty_add_frame(dirty_rect_t *r, int f) {
+#if TRACK_DIRTY
+    (void)r;
+    (void)f;
+#else
+    if (frame_dirty[f][2] <= frame_dirty[f][0]) return;
+    if (frame_dirty[f][0] < r->x0) r->x0 = frame_dirty[f][0];
+    if (frame_dirty[f][1] < r->y0) r->y0 = frame_dirty[f][1];
+    if (frame_dirty[f][2] > r->x1) r->x1 = frame_dirty[f][2];
+    if (frame_dirty[f][3] > r->y1) r->y1 = frame_dirty[f][3];
+#endif
+}
+
+/* First pixel covered by the delta stream of frame f */
+static inline int delta_start(int f) {
+#if TRACK_DIRTY
+    (void)f;
+    return 0;
+#else
+    return frame_dirty[f][1] * FRAME_W;
+#endif
+}
+
 /* ============================================================================
  * Frame Decompression (same as fbdev version)
  * ============================================================================ */
 
+/* SSE2 pixel runs (same as fbdev version). Stream payloads are little-endian
+ * RGB565 like frame_buffer, so literal runs are loaded 8 pixels at a time
+ * straight from the stream; neither side is aligned in general. */
+static inline void run_xor(uint16_t *dst, const uint8_t *src, int n) {
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + i * 2));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_xor_si128(d, s));
+    }
+    for (src += i * 2; i < n; i++, src += 2) dst[i] ^= src[0] | (src[1] << 8);
+}
+
+static inline void run_copy(uint16_t *dst, const uint8_t *src, int n) {
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_loadu_si128((const __m128i *)(src + i * 2)));
+    }
+    for (src += i * 2; i < n; i++, src += 2) dst[i] = src[0] | (src[1] << 8);
+}
+
+static inline void run_fill(uint16_t *dst, uint16_t val, int n) {
+    __m128i v = _mm_set1_epi16((short)val);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) _mm_storeu_si128((__m128i *)(dst + i), v);
+    for (; i < n; i++) dst[i] = val;
+}
+
+/* Extend dirty by the pixels a copy/fill run at frame_buffer[pos] would change */
+static inline void dirty_add_copy(int pos, const uint8_t *src, int n) {
+    int lo = -1, hi = -1;
+    for (int j = 0; j < n; j++) {
+        if (frame_buffer[pos + j] != (uint16_t)(src[j * 2] | (src[j * 2 + 1] << 8))) {
+            if (lo < 0) lo = j;
+            hi = j;
+        }
+    }
+    if (lo >= 0) dirty_add_span(&dirty, pos + lo, pos + hi + 1);
+}
+
+static inline void dirty_add_fill(int pos, uint16_t value, int n) {
+    int lo = -1, hi = -1;
+    for (int j = 0; j < n; j++) {
+        if (frame_buffer[pos + j] != value) {
+            if (lo < 0) lo = j;
+            hi = j;
+        }
+    }
+    if (lo >= 0) dirty_add_span(&dirty, pos + lo, pos + hi + 1);
+}
+
+#if FRAME0_METHOD == 1
 /* RLE decode for frame 0 (RLE direct format)
  * 0x00 = end of frame
  * 0x01-0x7F = next N uint16_t literal values
@@ -92,28 +352,29 @@ static int decode_rle(const uint8_t *src, size_t src_len, uint16_t *dst, int dst
             /* Literal run: next N uint16_t values */
             int n = cmd;
             if (i + n * 2 > src_len) n = (src_len - i) / 2;
-            for (int j = 0; j < n && pos < dst_count; j++) {
-                dst[pos++] = src[i] | (src[i+1] << 8);
-                i += 2;
-            }
+            if (n > dst_count - pos) n = dst_count - pos;
+            run_copy(dst + pos, src + i, n);
+            pos += n;
+            i += n * 2;
         } else {
             /* RLE run: repeat next value (cmd & 0x7F) times */
             int count = cmd & 0x7F;
             if (i + 1 >= src_len) break;
             uint16_t value = src[i] | (src[i+1] << 8);
             i += 2;
-            for (int j = 0; j < count && pos < dst_count; j++) {
-                dst[pos++] = value;
-            }
+            if (count > dst_count - pos) count = dst_count - pos;
+            run_fill(dst + pos, value, count);
+            pos += count;
         }
     }
     
     return pos;
 }
+#endif
 
-/* Apply XOR delta (RLE XOR format - for COMPRESS_METHOD 0) */
-static void apply_delta_rle_xor(const uint8_t *src, size_t src_len) {
-    int pos = 0;
+/* Apply XOR delta (RLE XOR format - for COMPRESS_METHOD 0), starting at pixel start */
+static void apply_delta_rle_xor(const uint8_t *src, size_t src_len, int start) {
+    int pos = start;
     size_t i = 0;
     int count = FRAME_W * FRAME_H;
     
@@ -126,11 +387,11 @@ static void apply_delta_rle_xor(const uint8_t *src, size_t src_len) {
             /* XOR values */
             int n = cmd;
             if (i + n * 2 > src_len) n = (src_len - i) / 2;
-            for (int j = 0; j < n && pos < count; j++) {
-                uint16_t delta = src[i] | (src[i+1] << 8);
-                frame_buffer[pos++] ^= delta;
-                i += 2;
-            }
+            if (n > count - pos) n = count - pos;
+            run_xor(frame_buffer + pos, src + i, n);
+            if (TRACK_DIRTY) dirty_add_span(&dirty, pos, pos + n);
+            pos += n;
+            i += n * 2;
         } else {
             /* Skip unchanged pixels */
             pos += (cmd & 0x7F) + 1;
@@ -138,10 +399,10 @@ static void apply_delta_rle_xor(const uint8_t *src, size_t src_len) {
     }
 }
 
-/* Apply RLE Direct delta (COMPRESS_METHOD 1) 
+/* Apply RLE Direct delta (COMPRESS_METHOD 1), starting at pixel start
  * Same format as RLE decode: 0x01-0x7F=literal, 0x80-0xFF=repeat */
-static void apply_delta_rle_direct(const uint8_t *src, size_t src_len) {
-    int pos = 0;
+static void apply_delta_rle_direct(const uint8_t *src, size_t src_len, int start) {
+    int pos = start;
     size_t i = 0;
     int count = FRAME_W * FRAME_H;
     
@@ -154,92 +415,476 @@ static void apply_delta_rle_direct(const uint8_t *src, size_t src_len) {
             /* Literal run: next N uint16_t values */
             int n = cmd;
             if (i + n * 2 > src_len) n = (src_len - i) / 2;
-            for (int j = 0; j < n && pos < count; j++) {
-                frame_buffer[pos++] = src[i] | (src[i+1] << 8);
-                i += 2;
-            }
+            if (n > count - pos) n = count - pos;
+            if (TRACK_DIRTY) dirty_add_copy(pos, src + i, n);
+            run_copy(frame_buffer + pos, src + i, n);
+            pos += n;
+            i += n * 2;
         } else {
             /* RLE run: repeat next value (cmd & 0x7F) times */
             int repeat = cmd & 0x7F;
             if (i + 1 >= src_len) break;
             uint16_t value = src[i] | (src[i+1] << 8);
             i += 2;
-            for (int j = 0; j < repeat && pos < count; j++) {
-                frame_buffer[pos++] = value;
-            }
+            if (repeat > count - pos) repeat = count - pos;
+            /* Every pixel is rewritten: only changed ones extend the dirty span */
+            if (TRACK_DIRTY) dirty_add_fill(pos, value, repeat);
+            run_fill(frame_buffer + pos, value, repeat);
+            pos += repeat;
         }
     }
 }
 
-/* Apply delta based on compression method */
-static void apply_delta(const uint8_t *src, size_t src_len) {
-#if COMPRESS_METHOD == 0
-    apply_delta_rle_xor(src, src_len);
-#elif COMPRESS_METHOD == 1
-    apply_delta_rle_direct(src, src_len);
-#else
-    /* Fallback: treat as raw */
-    decode_raw(src, src_len, frame_buffer, FRAME_W * FRAME_H);
-#endif
+/* Apply Sparse XOR delta (COMPRESS_METHOD 2)
+ * Header: changed pixel count (16-bit), then position (16-bit) + XOR value (16-bit) */
+static void apply_delta_sparse_xor(const uint8_t *src, size_t src_len) {
+    if (src_len < 2) return;
+    
+    size_t i = 2;
+    int changed = src[0] | (src[1] << 8);
+    
+    for (int j = 0; j < changed && i + 3 < src_len; j++) {
+        int idx = src[i] | (src[i+1] << 8);
+        uint16_t delta = src[i+2] | (src[i+3] << 8);
+        i += 4;
+        
+        if (idx < FRAME_W * FRAME_H) {
+            frame_buffer[idx] ^= delta;
+            if (TRACK_DIRTY) dirty_add_span(&dirty, idx, idx + 1);
+        }
+    }
 }
 
+#if FRAME0_METHOD == 3 || COMPRESS_METHOD == 3
 /* Decode Raw RGB565 (direct pixel values, no compression) */
 static void decode_raw(const uint8_t *src, size_t src_len, uint16_t *dst, int dst_count) {
     int pixels = src_len / 2;
     if (pixels > dst_count) pixels = dst_count;
     
-    for (int i = 0; i < pixels; i++) {
-        dst[i] = src[i * 2] | (src[i * 2 + 1] << 8);
+    run_copy(dst, src, pixels);
+}
+#endif
+
+#ifdef TILE_REF
+/* Tile codec (COMPRESS_METHOD 7, or tag 7 under 6)
+ * 8x8 tiles in raster order. Copies read the previous frame from tile_ref,
+ * which only gets the area decoded since the last tile frame copied back in */
+#define TILE 8
+#define TILES_X ((FRAME_W + TILE - 1) / TILE)
+#define TILES_N (TILES_X * ((FRAME_H + TILE - 1) / TILE))
+
+static uint16_t *tile_ref = NULL;
+static dirty_rect_t tile_stale;  /* Where frame_buffer may differ from tile_ref */
+
+/* Record that frame f has been decoded into frame_buffer */
+static inline void tile_mark_stale(int f) {
+#if TRACK_DIRTY
+    (void)f;
+    dirty_mark_full(&tile_stale);
+#else
+    dirty_add_frame(&tile_stale, f);
+#endif
+}
+
+static void tile_ref_sync(void) {
+    if (dirty_empty(&tile_stale)) return;
+    int bytes = (tile_stale.x1 - tile_stale.x0) * 2;
+    for (int y = tile_stale.y0; y < tile_stale.y1; y++) {
+        int o = y * FRAME_W + tile_stale.x0;
+        memcpy(tile_ref + o, frame_buffer + o, bytes);
     }
+    dirty_reset(&tile_stale);
 }
 
-/* Load frame 0 - always stored as raw RGB565 */
-static void load_frame_0(const uint8_t *data, size_t size) {
-    decode_raw(data, size, frame_buffer, FRAME_W * FRAME_H);
+/* Pixel rect of tile t, clipped to the frame */
+static inline dirty_rect_t tile_rect(int t) {
+    dirty_rect_t r;
+    r.x0 = (t % TILES_X) * TILE;
+    r.y0 = (t / TILES_X) * TILE;
+    r.x1 = r.x0 + TILE < FRAME_W ? r.x0 + TILE : FRAME_W;
+    r.y1 = r.y0 + TILE < FRAME_H ? r.y0 + TILE : FRAME_H;
+    return r;
 }
 
-/* Palette + LZSS decompression */
-static void decompress_palette_lzss(const uint8_t *compressed, size_t comp_size,
-                                     const uint16_t *palette, size_t palette_size,
-                                     uint16_t *dst, int pixel_count) {
-    /* Simple LZSS: copy palette indices */
-    int pos = 0;
-    size_t i = 0;
+static void tile_copy(int t, int dx, int dy) {
+    dirty_rect_t r = tile_rect(t);
+    int sx = r.x0 + dx, sy = r.y0 + dy;
+    if (sx < 0 || sy < 0 || sx + (r.x1 - r.x0) > FRAME_W || sy + (r.y1 - r.y0) > FRAME_H) return;
+    
+    int bytes = (r.x1 - r.x0) * 2;
+    for (int y = r.y0; y < r.y1; y++, sy++) {
+        memcpy(frame_buffer + y * FRAME_W + r.x0, tile_ref + sy * FRAME_W + sx, bytes);
+    }
+    if (TRACK_DIRTY) dirty_union(&dirty, &r);
+}
+
+static void tile_fill(int t, uint16_t val) {
+    dirty_rect_t r = tile_rect(t);
+    for (int y = r.y0; y < r.y1; y++) {
+        uint16_t *row = frame_buffer + y * FRAME_W;
+        for (int x = r.x0; x < r.x1; x++) row[x] = val;
+    }
+    if (TRACK_DIRTY) dirty_union(&dirty, &r);
+}
+
+/* RLE XOR over the tile's pixels in place; returns the position after its 0x00 */
+static size_t tile_xor(int t, const uint8_t *src, size_t src_len, size_t pos) {
+    dirty_rect_t r = tile_rect(t);
+    int tw = r.x1 - r.x0;
+    int n = tw * (r.y1 - r.y0);
+    int i = 0;
+    
+    while (pos < src_len) {
+        uint8_t cmd = src[pos++];
+        if (cmd == 0x00) break;
+        if (cmd & 0x80) {
+            i += (cmd & 0x7F) + 1;
+            continue;
+        }
+        for (int k = 0; k < cmd && i < n; k++, i++) {
+            /* Bounds check before reading 2 bytes */
+            if (pos + 1 >= src_len) return src_len;
+            uint16_t xor_val = src[pos] | (src[pos + 1] << 8);
+            pos += 2;
+            frame_buffer[(r.y0 + i / tw) * FRAME_W + r.x0 + i % tw] ^= xor_val;
+        }
+    }
+    if (TRACK_DIRTY) dirty_union(&dirty, &r);
+    return pos;
+}
+
+/* Decode a tile stream; start is the first pixel of the frame's dirty rows */
+static void apply_delta_tile(const uint8_t *src, size_t src_len, int start) {
+    tile_ref_sync();
     
-    while (i < comp_size && pos < pixel_count) {
-        uint8_t b = compressed[i++];
+    size_t pos = 0;
+    int t = (start / FRAME_W / TILE) * TILES_X;
+    
+    while (pos < src_len && t < TILES_N) {
+        uint8_t cmd = src[pos++];
+        int n = (cmd & 0x3F) + 1;
         
-        if (b < 0x80) {
-            /* Literal palette index */
-            if (b < palette_size) {
-                dst[pos++] = palette[b];
+        if (cmd == 0x00) {
+            break;
+        } else if (cmd < 0x40) {
+            /* Skip unchanged tiles, 0x3F carries a 16-bit count */
+            if (cmd == 0x3F) {
+                if (pos + 1 >= src_len) break;
+                t += src[pos] | (src[pos + 1] << 8);
+                pos += 2;
+            } else {
+                t += cmd;
             }
-        } else if (b >= 0x80 && b <= 0xBF) {
-            /* Short match: (b - 0x80) + 2 bytes */
-            /* Simplified: just copy next N bytes as palette indices */
-            int n = (b - 0x80) + 2;
-            for (int j = 0; j < n && pos < pixel_count && i < comp_size; j++) {
-                uint8_t idx = compressed[i++];
-                if (idx < palette_size) {
-                    dst[pos++] = palette[idx];
-                }
+        } else if (cmd < 0x80) {
+            /* Copy from the previous frame at a fixed displacement */
+            if (pos + 1 >= src_len) break;
+            int dx = (int8_t)src[pos];
+            int dy = (int8_t)src[pos + 1];
+            pos += 2;
+            for (; n > 0 && t < TILES_N; n--) tile_copy(t++, dx, dy);
+        } else if (cmd < 0xC0) {
+            if (pos + 1 >= src_len) break;
+            uint16_t val = src[pos] | (src[pos + 1] << 8);
+            pos += 2;
+            for (; n > 0 && t < TILES_N; n--) tile_fill(t++, val);
+        } else {
+            for (; n > 0 && t < TILES_N; n--) pos = tile_xor(t++, src, src_len, pos);
+        }
+    }
+}
+#endif
+
+#if COMPRESS_METHOD == 6
+/* Sparse indices are absolute, so the start row is not needed */
+static void apply_delta_sparse_tagged(const uint8_t *src, size_t src_len, int start) {
+    (void)start;
+    apply_delta_sparse_xor(src, src_len);
+}
+
+/* Per-frame codec (COMPRESS_METHOD 6)
+ * Byte 0 of each delta stream is the method (0-2, 7) it was encoded with */
+static void (*const delta_codecs[8])(const uint8_t *, size_t, int) = {
+    [0] = apply_delta_rle_xor,        /* RLE XOR */
+    [1] = apply_delta_rle_direct,     /* RLE Direct */
+    [2] = apply_delta_sparse_tagged,  /* Sparse XOR */
+#ifdef TILE_REF
+    [7] = apply_delta_tile,           /* 8x8 tiles */
+#endif
+};
+#endif
+
+#ifdef FRAME_ALPHA
+/* ============================================================================
+ * Alpha Frames (same as fbdev version)
+ * ============================================================================ */
+
+/* Frames carry a 4-bit coverage plane next to premultiplied colours; each
+ * delta has an RLE XOR alpha stream over the same rows (0x00 end, 0x01-0x7F
+ * N XOR nibbles packed low first, 0x80-0xFF skip (cmd & 0x7F) + 1 pixels).
+ * Before a blit the dirty region is blended over the background into comp_buffer:
+ * out = fg + bg * (15 - a) / 15 per RGB565 channel. */
+#define ALPHA_MAX 15
+
+static uint8_t *alpha_buffer = NULL;    /* FRAME_W * FRAME_H coverage, 0-15 */
+static uint16_t *comp_buffer = NULL;    /* Blended frame, plus one BACKGROUND_COLOR row */
+
+static void apply_alpha(const uint8_t *src, size_t src_len, int start) {
+    size_t i = 0;
+    int pos = start;
+    
+    while (i < src_len) {
+        uint8_t cmd = src[i++];
+        if (cmd == 0x00) break;
+        if (cmd & 0x80) {
+            pos += (cmd & 0x7F) + 1;
+            continue;
+        }
+        if (i + (cmd + 1) / 2 > src_len) break;
+        if (TRACK_DIRTY) dirty_add_span(&dirty, pos, pos + cmd);
+        for (int j = 0; j < cmd; j += 2) {
+            uint8_t b = src[i++];
+            alpha_buffer[pos + j] ^= b & 0x0F;
+            if (j + 1 < cmd) alpha_buffer[pos + j + 1] ^= b >> 4;
+        }
+        pos += cmd;
+    }
+}
+
+/* c * (15 - a) / 15 rounded, exact for c * (15 - a) <= 945: (v + 7) * 4370 >> 16 */
+static inline uint16_t blend_565(uint16_t fg, uint16_t bg, int a) {
+    int ia = ALPHA_MAX - a;
+    int r = (fg >> 11) + ((((bg >> 11) * ia + 7) * 4370) >> 16);
+    int g = ((fg >> 5) & 0x3F) + (((((bg >> 5) & 0x3F) * ia + 7) * 4370) >> 16);
+    int b = (fg & 0x1F) + ((((bg & 0x1F) * ia + 7) * 4370) >> 16);
+    if (r > 0x1F) r = 0x1F;
+    if (g > 0x3F) g = 0x3F;
+    if (b > 0x1F) b = 0x1F;
+    return (r << 11) | (g << 5) | b;
+}
+
+/* dst[0..n) = fg over bg, 8 pixels per step */
+static void blend_run(uint16_t *dst, const uint16_t *fg, const uint8_t *a, const uint16_t *bg, int n) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i amax = _mm_set1_epi16(ALPHA_MAX);
+    const __m128i round = _mm_set1_epi16(7);
+    const __m128i div15 = _mm_set1_epi16(4370);
+    const __m128i m5 = _mm_set1_epi16(0x1F);
+    const __m128i m6 = _mm_set1_epi16(0x3F);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i f = _mm_loadu_si128((const __m128i *)(fg + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(bg + i));
+        __m128i ia = _mm_sub_epi16(amax, _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(a + i)), zero));
+        __m128i br = _mm_mulhi_epu16(_mm_add_epi16(_mm_mullo_epi16(_mm_srli_epi16(b, 11), ia), round), div15);
+        __m128i bgc = _mm_mulhi_epu16(_mm_add_epi16(_mm_mullo_epi16(_mm_and_si128(_mm_srli_epi16(b, 5), m6), ia),
+                                                    round), div15);
+        __m128i bb = _mm_mulhi_epu16(_mm_add_epi16(_mm_mullo_epi16(_mm_and_si128(b, m5), ia), round), div15);
+        __m128i r = _mm_min_epi16(_mm_add_epi16(_mm_srli_epi16(f, 11), br), m5);
+        __m128i g = _mm_min_epi16(_mm_add_epi16(_mm_and_si128(_mm_srli_epi16(f, 5), m6), bgc), m6);
+        __m128i bl = _mm_min_epi16(_mm_add_epi16(_mm_and_si128(f, m5), bb), m5);
+        __m128i out = _mm_or_si128(_mm_or_si128(_mm_slli_epi16(r, 11), _mm_slli_epi16(g, 5)), bl);
+        _mm_storeu_si128((__m128i *)(dst + i), out);
+    }
+    for (; i < n; i++) dst[i] = blend_565(fg[i], bg[i], a[i]);
+}
+
+/* Blend rect r of the frame, placed at output (x, y), into comp_buffer.
+ * Pixels off the background image blend over BACKGROUND_COLOR; the image
+ * part is bg_rect of it, which covers the frame on every output. */
+static void alpha_compose(const dirty_rect_t *r, int x, int y) {
+    const uint16_t *fill = comp_buffer + FRAME_W * FRAME_H;
+    int bg_stride = bg_rect.x1 - bg_rect.x0;
+    for (int fy = r->y0; fy < r->y1; fy++) {
+        int o = fy * FRAME_W;
+        int sy = y + fy;
+        int x0 = r->x0, x1 = r->x1;
+        /* Columns over the image: [bx0, bx1) */
+        int bx0 = x0, bx1 = x0;
+        if (bg_buffer && sy >= bg_rect.y0 && sy < bg_rect.y1) {
+            bx0 = bg_rect.x0 - x > x0 ? bg_rect.x0 - x : x0;
+            bx1 = bg_rect.x1 - x < x1 ? bg_rect.x1 - x : x1;
+            if (bx0 > x1) bx0 = x1;
+            if (bx1 < bx0) bx1 = bx0;
+        }
+        if (bx0 > x0) {
+            blend_run(comp_buffer + o + x0, frame_buffer + o + x0, alpha_buffer + o + x0, fill, bx0 - x0);
+        }
+        if (bx1 > bx0) {
+            blend_run(comp_buffer + o + bx0, frame_buffer + o + bx0, alpha_buffer + o + bx0,
+                      bg_buffer + (sy - bg_rect.y0) * bg_stride + x + bx0 - bg_rect.x0, bx1 - bx0);
+        }
+        if (x1 > bx1) {
+            blend_run(comp_buffer + o + bx1, frame_buffer + o + bx1, alpha_buffer + o + bx1, fill, x1 - bx1);
+        }
+    }
+}
+
+/* Frames reach the outputs through comp_buffer */
+#define FRAME_OUT comp_buffer
+#else
+#define FRAME_OUT frame_buffer
+#endif
+
+/* Apply delta of frame f based on compression method */
+static void apply_delta(const uint8_t *src, size_t src_len, int f) {
+#if COMPRESS_METHOD == 6
+    if (src_len > 0 && src[0] < 8 && delta_codecs[src[0]]) {
+        delta_codecs[src[0]](src + 1, src_len - 1, delta_start(f));
+    }
+#elif COMPRESS_METHOD == 7
+    apply_delta_tile(src, src_len, delta_start(f));
+#elif COMPRESS_METHOD == 0
+    apply_delta_rle_xor(src, src_len, delta_start(f));
+#elif COMPRESS_METHOD == 1
+    apply_delta_rle_direct(src, src_len, delta_start(f));
+#elif COMPRESS_METHOD == 2
+    apply_delta_sparse_xor(src, src_len);
+#else
+    /* Fallback: treat as raw */
+    decode_raw(src, src_len, frame_buffer, FRAME_W * FRAME_H);
+    if (TRACK_DIRTY) dirty_mark_full(&dirty);
+#endif
+#ifdef FRAME_ALPHA
+    apply_alpha(alphas[f], alpha_sizes[f], delta_start(f));
+#endif
+#ifdef TILE_REF
+    tile_mark_stale(f);
+#endif
+    dirty_add_frame(&dirty, f);
+}
+
+/* Palette + LZSS decompression */
+#define LZSS_WINDOW_SIZE 4096   /* Power of two: positions wrap with a mask */
+#define LZSS_MIN_MATCH  3
+
+/* Decoder state, so a stream can be expanded a piece at a time (same format
+ * as the fbdev version: flag byte per 8 items, 1 = literal, 0 = 12-bit
+ * offset + 4-bit length back-reference) */
+typedef struct {
+    const uint8_t *in;
+    size_t in_pos, in_size;
+    const uint16_t *pal;
+    int num_colors;
+    int flag;                       /* Current flag byte, shifted as it is used */
+    int bits;                       /* Flag bits left in it */
+    int match_offset, match_left;   /* Back-reference cut short by the last call */
+    int window_pos;
+    uint8_t window[LZSS_WINDOW_SIZE];
+} lzss_stream_t;
+
+static void lzss_begin(lzss_stream_t *s, const uint8_t *compressed, size_t comp_size,
+                       const uint16_t *pal, int num_colors) {
+    s->in = compressed;
+    s->in_pos = 0;
+    s->in_size = comp_size;
+    s->pal = pal;
+    s->num_colors = num_colors;
+    s->flag = 0;
+    s->bits = 0;
+    s->match_offset = 0;
+    s->match_left = 0;
+    s->window_pos = 0;
+    memset(s->window, 0, sizeof(s->window));
+}
+
+/* Expand the next pixel_count pixels of the stream into out. Returns how
+ * many were written: fewer only once the stream runs out. */
+static int lzss_decode(lzss_stream_t *s, uint16_t *out, int pixel_count) {
+    const uint8_t *compressed = s->in;
+    const uint16_t *pal = s->pal;
+    uint8_t *window = s->window;
+    size_t in_pos = s->in_pos, comp_size = s->in_size;
+    int num_colors = s->num_colors;
+    int flag = s->flag, bits = s->bits;
+    int offset = s->match_offset, left = s->match_left;
+    int window_pos = s->window_pos;
+    int out_pos = 0;
+    
+    while (out_pos < pixel_count) {
+        if (left) {
+            /* Copy from window */
+            int length = left < pixel_count - out_pos ? left : pixel_count - out_pos;
+            left -= length;
+            for (int i = 0; i < length; i++) {
+                int win_idx = (window_pos - offset + LZSS_WINDOW_SIZE) & (LZSS_WINDOW_SIZE - 1);
+                uint8_t val = window[win_idx];
+                window[window_pos] = val;
+                window_pos = (window_pos + 1) & (LZSS_WINDOW_SIZE - 1);
+                
+                /* Expand via palette */
+                out[out_pos++] = pal[val < num_colors ? val : 0];
             }
+            continue;
+        }
+        
+        if (in_pos >= comp_size) break;
+        if (!bits) {
+            flag = compressed[in_pos++];
+            bits = 8;
+            if (in_pos >= comp_size) break;
+        }
+        int literal = flag & 1;
+        flag >>= 1;
+        bits--;
+        
+        if (literal) {
+            /* Literal byte */
+            uint8_t val = compressed[in_pos++];
+            window[window_pos] = val;
+            window_pos = (window_pos + 1) & (LZSS_WINDOW_SIZE - 1);
+            
+            /* Expand via palette */
+            out[out_pos++] = pal[val < num_colors ? val : 0];
         } else {
-            /* Long match or RLE */
-            if (i < comp_size) {
-                int n = compressed[i++];
-                for (int j = 0; j < n && pos < pixel_count; j++) {
-                    /* Use previous pixel or palette[0] */
-                    if (pos > 0) {
-                        dst[pos] = dst[pos - 1];
-                    } else if (palette_size > 0) {
-                        dst[pos] = palette[0];
-                    }
-                    pos++;
-                }
+            /* Back-reference: 2 bytes */
+            if (in_pos + 1 >= comp_size) {
+                in_pos = comp_size;
+                break;
             }
+            uint8_t b1 = compressed[in_pos++];
+            uint8_t b2 = compressed[in_pos++];
+            
+            offset = (b1 | ((b2 & 0xF0) << 4));
+            left = (b2 & 0x0F) + LZSS_MIN_MATCH;
         }
     }
+    
+    s->in_pos = in_pos;
+    s->flag = flag;
+    s->bits = bits;
+    s->match_offset = offset;
+    s->match_left = left;
+    s->window_pos = window_pos;
+    return out_pos;
+}
+
+/* Decompress LZSS data to indices, then expand via palette */
+static void decompress_palette_lzss(const uint8_t *compressed, size_t comp_size,
+                                     const uint16_t *pal, int num_colors,
+                                     uint16_t *out, int pixel_count) {
+    lzss_stream_t s;
+    lzss_begin(&s, compressed, comp_size, pal, num_colors);
+    lzss_decode(&s, out, pixel_count);
+}
+
+/* Load frame 0 with its own method */
+static void load_frame_0(const uint8_t *data, size_t size) {
+#if FRAME0_METHOD == 5
+    decompress_palette_lzss(data, size, frame0_palette, FRAME0_PALETTE_SIZE,
+                            frame_buffer, FRAME_W * FRAME_H);
+#elif FRAME0_METHOD == 1
+    decode_rle(data, size, frame_buffer, FRAME_W * FRAME_H);
+#else
+    decode_raw(data, size, frame_buffer, FRAME_W * FRAME_H);
+#endif
+#ifdef FRAME_ALPHA
+    memset(alpha_buffer, 0, FRAME_W * FRAME_H);
+    apply_alpha(alphas[0], alpha_sizes[0], 0);
+#endif
+    dirty_mark_full(&dirty);
+#ifdef TILE_REF
+    dirty_mark_full(&tile_stale);
+#endif
 }
 
 /* ============================================================================
@@ -248,52 +893,58 @@ static void decompress_palette_lzss(const uint8_t *compressed, size_t comp_size,
 
 static void drm_cleanup(xbs_drm_ctx_t *ctx);  /* forward declaration */
 
-static int drm_find_connector(int fd, drmModeRes *res, xbs_drm_ctx_t *ctx) {
-    drmModeConnector *conn = NULL;
+/* Fill out from conn_id if it is connected and has a mode */
+static int drm_find_connector(int fd, uint32_t conn_id, xbs_drm_output_t *out) {
+    drmModeConnector *conn = drmModeGetConnector(fd, conn_id);
+    if (!conn) return -ENOENT;
     
-    for (int i = 0; i < res->count_connectors; i++) {
-        conn = drmModeGetConnector(fd, res->connectors[i]);
-        if (!conn) continue;
-        
-        if (conn->connection == DRM_MODE_CONNECTED && conn->count_modes > 0) {
-            ctx->conn_id = conn->connector_id;
-            memcpy(&ctx->mode, &conn->modes[0], sizeof(ctx->mode));
-            ctx->width = conn->modes[0].hdisplay;
-            ctx->height = conn->modes[0].vdisplay;
-            drmModeFreeConnector(conn);
-            return 0;
-        }
-        
+    if (conn->connection == DRM_MODE_CONNECTED && conn->count_modes > 0) {
+        out->conn_id = conn->connector_id;
+        memcpy(&out->mode, &conn->modes[0], sizeof(out->mode));
+        out->width = conn->modes[0].hdisplay;
+        out->height = conn->modes[0].vdisplay;
         drmModeFreeConnector(conn);
+        return 0;
     }
     
+    drmModeFreeConnector(conn);
     return -ENOENT;
 }
 
-static int drm_find_crtc(int fd, drmModeRes *res, xbs_drm_ctx_t *ctx) {
-    drmModeConnector *conn = drmModeGetConnector(fd, ctx->conn_id);
+/* Pick a CRTC for out that no other output uses yet (bit j of *used = res->crtcs[j]) */
+static int drm_find_crtc(int fd, drmModeRes *res, uint32_t *used, xbs_drm_output_t *out) {
+    drmModeConnector *conn = drmModeGetConnector(fd, out->conn_id);
     if (!conn) return -ENOENT;
     
     /* Try currently attached encoder first */
     if (conn->encoder_id) {
         drmModeEncoder *enc = drmModeGetEncoder(fd, conn->encoder_id);
         if (enc && enc->crtc_id) {
-            ctx->crtc_id = enc->crtc_id;
-            drmModeFreeEncoder(enc);
-            drmModeFreeConnector(conn);
-            return 0;
+            for (int j = 0; j < res->count_crtcs && j < 32; j++) {
+                if (res->crtcs[j] == enc->crtc_id && !(*used & (1u << j))) {
+                    *used |= 1u << j;
+                    out->crtc_id = enc->crtc_id;
+                    out->crtc_index = j;
+                    out->crtc_attached = true;
+                    drmModeFreeEncoder(enc);
+                    drmModeFreeConnector(conn);
+                    return 0;
+                }
+            }
         }
         if (enc) drmModeFreeEncoder(enc);
     }
     
-    /* Find a CRTC that works with this connector */
+    /* Find a free CRTC that works with this connector */
     for (int i = 0; i < conn->count_encoders; i++) {
         drmModeEncoder *enc = drmModeGetEncoder(fd, conn->encoders[i]);
         if (!enc) continue;
         
-        for (int j = 0; j < res->count_crtcs; j++) {
-            if (enc->possible_crtcs & (1 << j)) {
-                ctx->crtc_id = res->crtcs[j];
+        for (int j = 0; j < res->count_crtcs && j < 32; j++) {
+            if ((enc->possible_crtcs & (1u << j)) && !(*used & (1u << j))) {
+                *used |= 1u << j;
+                out->crtc_id = res->crtcs[j];
+                out->crtc_index = j;
                 drmModeFreeEncoder(enc);
                 drmModeFreeConnector(conn);
                 return 0;
@@ -307,10 +958,24 @@ static int drm_find_crtc(int fd, drmModeRes *res, xbs_drm_ctx_t *ctx) {
     return -ENOENT;
 }
 
-static int drm_create_fb(int fd, xbs_drm_ctx_t *ctx) {
+static void drm_destroy_buf(int fd, xbs_drm_buf_t *buf) {
+    if (buf->map && buf->map != MAP_FAILED) {
+        munmap(buf->map, buf->size);
+    }
+    if (buf->fb_id) {
+        drmModeRmFB(fd, buf->fb_id);
+    }
+    if (buf->handle) {
+        struct drm_mode_destroy_dumb dreq = { .handle = buf->handle };
+        drmIoctl(fd, DRM_IOCTL_MODE_DESTROY_DUMB, &dreq);
+    }
+    memset(buf, 0, sizeof(*buf));
+}
+
+static int drm_create_buf(int fd, uint32_t width, uint32_t height, xbs_drm_buf_t *buf) {
     struct drm_mode_create_dumb creq = {
-        .width = ctx->width,
-        .height = ctx->height,
+        .width = width,
+        .height = height,
         .bpp = 32
     };
     
@@ -318,57 +983,153 @@ static int drm_create_fb(int fd, xbs_drm_ctx_t *ctx) {
         return -errno;
     }
     
-    ctx->handle = creq.handle;
-    ctx->pitch = creq.pitch;
-    ctx->size = creq.size;
+    buf->handle = creq.handle;
+    buf->pitch = creq.pitch;
+    buf->size = creq.size;
     
     /* Create framebuffer */
-    if (drmModeAddFB(fd, ctx->width, ctx->height, 24, 32, ctx->pitch, 
-                     ctx->handle, &ctx->fb_id) < 0) {
-        struct drm_mode_destroy_dumb dreq = { .handle = ctx->handle };
-        drmIoctl(fd, DRM_IOCTL_MODE_DESTROY_DUMB, &dreq);
-        return -errno;
+    if (drmModeAddFB(fd, width, height, 24, 32, buf->pitch, 
+                     buf->handle, &buf->fb_id) < 0) {
+        int err = -errno;
+        drm_destroy_buf(fd, buf);
+        return err;
     }
     
     /* Map dumb buffer */
-    struct drm_mode_map_dumb mreq = { .handle = ctx->handle };
+    struct drm_mode_map_dumb mreq = { .handle = buf->handle };
     if (drmIoctl(fd, DRM_IOCTL_MODE_MAP_DUMB, &mreq) < 0) {
-        drmModeRmFB(fd, ctx->fb_id);
-        struct drm_mode_destroy_dumb dreq = { .handle = ctx->handle };
-        drmIoctl(fd, DRM_IOCTL_MODE_DESTROY_DUMB, &dreq);
-        return -errno;
+        int err = -errno;
+        drm_destroy_buf(fd, buf);
+        return err;
     }
     
-    ctx->map = mmap(NULL, ctx->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, mreq.offset);
-    if (ctx->map == MAP_FAILED) {
-        drmModeRmFB(fd, ctx->fb_id);
-        struct drm_mode_destroy_dumb dreq = { .handle = ctx->handle };
-        drmIoctl(fd, DRM_IOCTL_MODE_DESTROY_DUMB, &dreq);
-        return -errno;
+    buf->map = mmap(NULL, buf->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, mreq.offset);
+    if (buf->map == MAP_FAILED) {
+        int err = -errno;
+        drm_destroy_buf(fd, buf);
+        return err;
     }
     
     /* Clear to black */
-    memset(ctx->map, 0, ctx->size);
+    memset(buf->map, 0, buf->size);
     
     return 0;
 }
 
-static int drm_init(xbs_drm_ctx_t *ctx) {
-    int ret;
+/* Allocate front + back buffers; a missing back buffer is not fatal,
+ * we then render single-buffered into the scanout buffer */
+static int drm_create_fb(int fd, xbs_drm_output_t *out) {
+    int ret = drm_create_buf(fd, out->width, out->height, &out->bufs[0]);
+    if (ret < 0) return ret;
     
-    /* Open DRM device */
-    const char *cards[] = { "/dev/dri/card0", "/dev/dri/card1", NULL };
-    int fd = -1;
+    out->nbufs = (drm_create_buf(fd, out->width, out->height, &out->bufs[1]) == 0) ? 2 : 1;
+    out->front = 0;
     
-    for (int i = 0; cards[i]; i++) {
-        fd = open(cards[i], O_RDWR | O_CLOEXEC);
-        if (fd >= 0) {
-            uint64_t has_dumb;
-            if (drmGetCap(fd, DRM_CAP_DUMB_BUFFER, &has_dumb) >= 0 && has_dumb) {
-                break;
-            }
-            close(fd);
-            fd = -1;
+    return 0;
+}
+
+/* Same timings as far as the hardware is concerned (name, type and vrefresh aside) */
+static bool drm_mode_equal(const drmModeModeInfo *a, const drmModeModeInfo *b) {
+    return a->clock == b->clock &&
+           a->hdisplay == b->hdisplay && a->hsync_start == b->hsync_start &&
+           a->hsync_end == b->hsync_end && a->htotal == b->htotal && a->hskew == b->hskew &&
+           a->vdisplay == b->vdisplay && a->vsync_start == b->vsync_start &&
+           a->vsync_end == b->vsync_end && a->vtotal == b->vtotal && a->vscan == b->vscan &&
+           a->flags == b->flags;
+}
+
+/* Save the CRTC state and light the output up with our front buffer */
+static int drm_set_mode(int fd, xbs_drm_output_t *out) {
+    out->saved_crtc = drmModeGetCrtc(fd, out->crtc_id);
+    
+    /* Firmware or fbcon already drives the connector in our mode: skip the
+     * modeset (no resync, no black frame) and let the first present flip
+     * our buffer over theirs */
+    drmModeCrtc *cur = out->saved_crtc;
+    if (out->crtc_attached && cur && cur->mode_valid && cur->buffer_id &&
+        cur->x == 0 && cur->y == 0 && drm_mode_equal(&cur->mode, &out->mode)) {
+        out->foreign_scanout = true;
+        return 0;
+    }
+    
+    return drmModeSetCrtc(fd, out->crtc_id, out->bufs[out->front].fb_id, 0, 0, 
+                          &out->conn_id, 1, &out->mode);
+}
+
+#if USE_PLANES
+/* Atomic update of out's sprite plane: show fb_id (placing the plane on the
+ * first commit), or disable the plane with fb_id 0 */
+static int drm_sprite_commit(int fd, xbs_drm_output_t *out, uint32_t fb_id, uint32_t flags) {
+    drmModeAtomicReq *req = drmModeAtomicAlloc();
+    if (!req) return -ENOMEM;
+    
+    const uint32_t *p = out->plane_props;
+    uint32_t id = out->plane_id;
+    drmModeAtomicAddProperty(req, id, p[PLANE_FB_ID], fb_id);
+    if (!fb_id) {
+        drmModeAtomicAddProperty(req, id, p[PLANE_CRTC_ID], 0);
+    } else if (!out->sprite_on) {
+        /* Source rectangle in 16.16 fixed point, 1:1 onto the frame position */
+        drmModeAtomicAddProperty(req, id, p[PLANE_CRTC_ID], out->crtc_id);
+        drmModeAtomicAddProperty(req, id, p[PLANE_SRC_X], 0);
+        drmModeAtomicAddProperty(req, id, p[PLANE_SRC_Y], 0);
+        drmModeAtomicAddProperty(req, id, p[PLANE_SRC_W], (uint64_t)FRAME_W << 16);
+        drmModeAtomicAddProperty(req, id, p[PLANE_SRC_H], (uint64_t)FRAME_H << 16);
+        drmModeAtomicAddProperty(req, id, p[PLANE_CRTC_X], out->x);
+        drmModeAtomicAddProperty(req, id, p[PLANE_CRTC_Y], out->y);
+        drmModeAtomicAddProperty(req, id, p[PLANE_CRTC_W], FRAME_W);
+        drmModeAtomicAddProperty(req, id, p[PLANE_CRTC_H], FRAME_H);
+    }
+    
+    int ret = drmModeAtomicCommit(fd, req, flags, out);
+    drmModeAtomicFree(req);
+    return ret;
+}
+#endif
+
+/* Undo drm_set_mode and free the output's buffers */
+static void drm_destroy_output(int fd, xbs_drm_output_t *out) {
+#if USE_PLANES
+    /* Take the sprite down before its buffers go */
+    if (out->sprite_on) {
+        drm_sprite_commit(fd, out, 0, 0);
+        out->sprite_on = false;
+    }
+    for (int i = 0; i < 2; i++) {
+        drm_destroy_buf(fd, &out->sprite[i]);
+    }
+#endif
+    
+    /* Restore previous CRTC state */
+    if (out->saved_crtc) {
+        drmModeSetCrtc(fd, out->saved_crtc->crtc_id,
+                       out->saved_crtc->buffer_id,
+                       out->saved_crtc->x, out->saved_crtc->y,
+                       &out->conn_id, 1, &out->saved_crtc->mode);
+        drmModeFreeCrtc(out->saved_crtc);
+        out->saved_crtc = NULL;
+    }
+    
+    /* Unmap, remove framebuffers and destroy dumb buffers */
+    for (int i = 0; i < 2; i++) {
+        drm_destroy_buf(fd, &out->bufs[i]);
+    }
+}
+
+static int drm_init(xbs_drm_ctx_t *ctx) {
+    /* Open DRM device */
+    const char *cards[] = { "/dev/dri/card0", "/dev/dri/card1", NULL };
+    int fd = -1;
+    
+    for (int i = 0; cards[i]; i++) {
+        fd = open(cards[i], O_RDWR | O_CLOEXEC);
+        if (fd >= 0) {
+            uint64_t has_dumb;
+            if (drmGetCap(fd, DRM_CAP_DUMB_BUFFER, &has_dumb) >= 0 && has_dumb) {
+                break;
+            }
+            close(fd);
+            fd = -1;
         }
     }
     
@@ -394,155 +1155,367 @@ static int drm_init(xbs_drm_ctx_t *ctx) {
         return -errno;
     }
     
-    /* Find connected connector */
-    ret = drm_find_connector(fd, res, ctx);
-    if (ret < 0) {
-        write(2, "DRM: No connector\n", 18);
-        drmModeFreeResources(res);
-        close(fd);
-        return ret;
-    }
-    
-    /* Find CRTC */
-    ret = drm_find_crtc(fd, res, ctx);
-    if (ret < 0) {
-        write(2, "DRM: No CRTC\n", 13);
-        drmModeFreeResources(res);
-        close(fd);
-        return ret;
+    /* Every connected connector gets its own CRTC and buffers sized to its
+     * mode; one that cannot be set up is skipped, not fatal */
+    uint32_t used_crtcs = 0;
+    bool connected = false;
+    for (int i = 0; i < res->count_connectors && ctx->nouts < DRM_MAX_OUTPUTS; i++) {
+        xbs_drm_output_t *out = &ctx->outs[ctx->nouts];
+        if (drm_find_connector(fd, res->connectors[i], out) < 0) continue;
+        connected = true;
+        
+        if (drm_find_crtc(fd, res, &used_crtcs, out) < 0) {
+            write(2, "DRM: No CRTC\n", 13);
+        } else if (drm_create_fb(fd, out) < 0) {
+            write(2, "DRM: No framebuffer\n", 20);
+        } else {
+            if (out->mode.clock) {
+                out->refresh_ns = (long)out->mode.htotal * out->mode.vtotal * 1000000L / out->mode.clock;
+            }
+            ctx->nouts++;
+            continue;
+        }
+        memset(out, 0, sizeof(*out));
     }
     
     drmModeFreeResources(res);
     
-    /* Create framebuffer */
-    ret = drm_create_fb(fd, ctx);
-    if (ret < 0) {
-        write(2, "DRM: No framebuffer\n", 20);
+    if (!ctx->nouts) {
+        if (!connected) write(2, "DRM: No connector\n", 18);
         close(fd);
-        return ret;
+        return -ENOENT;
     }
     
-    /* Save current CRTC state */
-    ctx->saved_crtc = drmModeGetCrtc(fd, ctx->crtc_id);
+    /* Frame pacing can lock to vblank when the flip timestamps share our clock */
+    uint64_t mono = 0;
+    ctx->mono_stamps = drmGetCap(fd, DRM_CAP_TIMESTAMP_MONOTONIC, &mono) == 0 && mono;
     
-    /* Set mode */
-    ret = drmModeSetCrtc(fd, ctx->crtc_id, ctx->fb_id, 0, 0, 
-                         &ctx->conn_id, 1, &ctx->mode);
-    if (ret < 0) {
-        write(2, "DRM: CRTC failed\n", 17);
+#if USE_PLANES
+    /* Sprite planes are driven with atomic commits */
+    ctx->atomic = drmSetClientCap(fd, DRM_CLIENT_CAP_ATOMIC, 1) == 0;
+#endif
+    
+    /* Set modes; outputs the CRTC refuses are dropped */
+    int n = 0;
+    for (int i = 0; i < ctx->nouts; i++) {
+        xbs_drm_output_t *out = &ctx->outs[i];
+        if (drm_set_mode(fd, out) < 0) {
+            write(2, "DRM: CRTC failed\n", 17);
+            drm_destroy_output(fd, out);
+            continue;
+        }
+        if (n != i) ctx->outs[n] = *out;
+        n++;
+    }
+    ctx->nouts = n;
+    
+    if (!ctx->nouts) {
         drm_cleanup(ctx);
-        return ret;
+        return -EINVAL;
     }
     
     return 0;
 }
 
-static void drm_cleanup(xbs_drm_ctx_t *ctx) {
-    if (!ctx || ctx->fd < 0) return;
+/* ============================================================================
+ * Presentation (page flip, or dirty flush when single-buffered)
+ * ============================================================================ */
+
+static void drm_page_flip_handler(int fd, unsigned int sequence, unsigned int tv_sec,
+                                  unsigned int tv_usec, void *user_data) {
+    (void)fd; (void)sequence;
+    xbs_drm_output_t *out = user_data;
+    out->flip_pending = false;
+    out->flip_ns = tv_sec * 1000000000L + tv_usec * 1000L;
+}
+
+static bool drm_flips_pending(const xbs_drm_ctx_t *ctx) {
+    for (int i = 0; i < ctx->nouts; i++) {
+        if (ctx->outs[i].flip_pending) return true;
+    }
+    return false;
+}
+
+/* Block until every queued page flip has completed (next vblank of each
+ * output). Must be called before drawing into the back buffers again. */
+static void drm_wait_flip(xbs_drm_ctx_t *ctx) {
+    drmEventContext evctx = {
+        .version = 2,
+        .page_flip_handler = drm_page_flip_handler
+    };
+    struct pollfd pfd = { .fd = ctx->fd, .events = POLLIN };
+    struct timespec timeout = { .tv_sec = 1 };
     
-    /* Restore previous CRTC state */
-    if (ctx->saved_crtc) {
-        drmModeSetCrtc(ctx->fd, ctx->saved_crtc->crtc_id,
-                       ctx->saved_crtc->buffer_id,
-                       ctx->saved_crtc->x, ctx->saved_crtc->y,
-                       &ctx->conn_id, 1, &ctx->saved_crtc->mode);
-        drmModeFreeCrtc(ctx->saved_crtc);
+    /* Signals are handled during the wait, but the flips are still waited for */
+    while (drm_flips_pending(ctx)) {
+        int ret = ppoll(&pfd, 1, &timeout, &wait_sigmask);
+        if (ret < 0 && errno == EINTR) continue;
+        if (ret <= 0) {
+            /* Event lost or device gone: don't hang the splash */
+            for (int i = 0; i < ctx->nouts; i++) {
+                ctx->outs[i].flip_pending = false;
+            }
+            break;
+        }
+        drmHandleEvent(ctx->fd, &evctx);
+    }
+}
+
+/* Buffer to draw the next frame into */
+static inline xbs_drm_buf_t *drm_back(xbs_drm_output_t *out) {
+    return &out->bufs[out->nbufs == 2 ? out->front ^ 1 : out->front];
+}
+
+/* Present the output's back buffer. (x, y, w, h) is the changed screen region,
+ * used to flush single-buffered drivers that need it (virtio, udl, ...).
+ * Flips queued for several outputs back to back land on the same vblank. */
+static void drm_present(xbs_drm_ctx_t *ctx, xbs_drm_output_t *out, int x, int y, int w, int h) {
+    if (out->nbufs == 2 || out->foreign_scanout) {
+        int back = out->nbufs == 2 ? out->front ^ 1 : out->front;
+        bool foreign = out->foreign_scanout;
+        out->foreign_scanout = false;
+        if (drmModePageFlip(ctx->fd, out->crtc_id, out->bufs[back].fb_id,
+                            DRM_MODE_PAGE_FLIP_EVENT, out) == 0) {
+            out->flip_pending = true;
+            out->front = back;
+            return;
+        }
+        
+        /* No page flip support: scan out what we just drew, and keep
+         * rendering single-buffered into it from now on. Flipping away
+         * from a foreign fb can also fail on a format or pitch change
+         * alone; that costs the one modeset, not the back buffer. */
+        drmModeSetCrtc(ctx->fd, out->crtc_id, out->bufs[back].fb_id, 0, 0,
+                       &out->conn_id, 1, &out->mode);
+        out->front = back;
+        if (!foreign) out->nbufs = 1;
+        return;
     }
     
-    /* Release DRM master */
-    drmDropMaster(ctx->fd);
+    /* Single-buffered: front writes are live unless the driver needs a flush */
+    if (out->no_dirtyfb) return;
+    
+    if (x < 0) { w += x; x = 0; }
+    if (y < 0) { h += y; y = 0; }
+    if (x + w > (int)out->width) w = out->width - x;
+    if (y + h > (int)out->height) h = out->height - y;
+    if (w <= 0 || h <= 0) return;
     
-    /* Unmap buffer */
-    if (ctx->map && ctx->map != MAP_FAILED) {
-        munmap(ctx->map, ctx->size);
+    drmModeClip clip = {
+        .x1 = x, .y1 = y,
+        .x2 = x + w, .y2 = y + h
+    };
+    if (drmModeDirtyFB(ctx->fd, out->bufs[out->front].fb_id, &clip, 1) == -ENOSYS) {
+        out->no_dirtyfb = true;
     }
+}
+
+/* Hand the output's scanned-out frame to whoever opens the device next:
+ * CLOSEFB drops our handle without disabling the CRTC (RmFB and close()
+ * would), and the previous CRTC state is not restored. Older kernels keep
+ * the previous behaviour; returns false then. */
+static bool drm_handoff(xbs_drm_ctx_t *ctx, xbs_drm_output_t *out) {
+    if (out->foreign_scanout) return false;  /* Nothing of ours on screen yet */
     
-    /* Remove framebuffer */
-    if (ctx->fb_id) {
-        drmModeRmFB(ctx->fd, ctx->fb_id);
+    drm_wait_flip(ctx);
+    struct drm_mode_closefb cfb = { .fb_id = out->bufs[out->front].fb_id };
+    if (drmIoctl(ctx->fd, DRM_IOCTL_MODE_CLOSEFB, &cfb) < 0) return false;
+    
+    out->bufs[out->front].fb_id = 0;
+    if (out->saved_crtc) {
+        drmModeFreeCrtc(out->saved_crtc);
+        out->saved_crtc = NULL;
     }
+    return true;
+}
+
+static void drm_cleanup(xbs_drm_ctx_t *ctx) {
+    if (!ctx || ctx->fd < 0) return;
+    
+    /* Never tear down a buffer the kernel is still flipping to */
+    drm_wait_flip(ctx);
     
-    /* Destroy dumb buffer */
-    if (ctx->handle) {
-        struct drm_mode_destroy_dumb dreq = { .handle = ctx->handle };
-        drmIoctl(ctx->fd, DRM_IOCTL_MODE_DESTROY_DUMB, &dreq);
+    for (int i = 0; i < ctx->nouts; i++) {
+        drm_destroy_output(ctx->fd, &ctx->outs[i]);
     }
+    ctx->nouts = 0;
+    
+    /* Release DRM master */
+    drmDropMaster(ctx->fd);
     
     close(ctx->fd);
     ctx->fd = -1;
 }
 
 /* ============================================================================
- * Blitting Functions (SSE2 optimized for VRAM Write-Combining)
+ * CPU Feature Detection (cpuid)
  * ============================================================================ */
 
-#include <emmintrin.h>
+/* Baseline is x86-64 + SSE2; the AVX2 kernel has a per-function target
+ * attribute and is only called when the CPU and kernel support it */
+#define CPU_AVX2    (1 << 1)
+
+static int cpu_features = 0;
+
+static inline void cpuid(uint32_t leaf, uint32_t sub,
+                         uint32_t *a, uint32_t *b, uint32_t *c, uint32_t *d) {
+    __asm__ volatile ("cpuid" : "=a"(*a), "=b"(*b), "=c"(*c), "=d"(*d) : "a"(leaf), "c"(sub));
+}
+
+static void cpu_detect(void) {
+    uint32_t a, b, c, d;
+    
+    cpuid(0, 0, &a, &b, &c, &d);
+    uint32_t max_leaf = a;
+    
+    /* AVX2 also needs the kernel to save YMM state: OSXSAVE + AVX, XCR0 bits 1-2 */
+    cpuid(1, 0, &a, &b, &c, &d);
+    if (max_leaf >= 7 && (c & (1 << 27)) && (c & (1 << 28))) {
+        uint32_t xcr0_lo, xcr0_hi;
+        __asm__ volatile ("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+        if ((xcr0_lo & 6) == 6) {
+            cpuid(7, 0, &a, &b, &c, &d);
+            if (b & (1 << 5)) cpu_features |= CPU_AVX2;
+        }
+    }
+}
+
+/* ============================================================================
+ * Blitting Functions (SSE2/AVX2 optimized for VRAM Write-Combining)
+ * ============================================================================ */
+
+/* Dumb buffers are write-combined (or uncached) mappings of video memory:
+ * plain stores there are slow, movntdq/movnti fill whole WC lines without
+ * touching the cache. Each streaming blit/fill ends with one sfence. */
+static bool fb_stream = 1;
+
+/* Expand 8 RGB565 pixels to XRGB8888 */
+static inline __attribute__((always_inline))
+void rgb565_to_xrgb8888_sse2(__m128i pixels, __m128i *out_lo, __m128i *out_hi) {
+    /* Expand to 32-bit: unpack low and high 4 pixels */
+    __m128i lo = _mm_unpacklo_epi16(pixels, _mm_setzero_si128());
+    __m128i hi = _mm_unpackhi_epi16(pixels, _mm_setzero_si128());
+    
+    /* RGB565 layout: RRRRRGGGGGGBBBBB (R5@11-15, G6@5-10, B5@0-4) */
+    /* XRGB8888 target: R@16-23, G@8-15, B@0-7 */
+    
+    /* R5 (bits 11-15) -> R8 (bits 16-23): shift left by 5 (to bit 16), then 3 more for expansion */
+    __m128i r_mask = _mm_set1_epi32(0x0000F800);
+    __m128i r_lo = _mm_slli_epi32(_mm_and_si128(lo, r_mask), 5 + 3);
+    __m128i r_hi = _mm_slli_epi32(_mm_and_si128(hi, r_mask), 5 + 3);
+    
+    /* G6 (bits 5-10) -> G8 (bits 8-15): shift left by 3 (to bit 8), then 2 more for expansion */
+    __m128i g_mask = _mm_set1_epi32(0x000007E0);
+    __m128i g_lo = _mm_slli_epi32(_mm_and_si128(lo, g_mask), 3 + 2);
+    __m128i g_hi = _mm_slli_epi32(_mm_and_si128(hi, g_mask), 3 + 2);
+    
+    /* B5 (bits 0-4) -> B8 (bits 0-7): just expand by 3 */
+    __m128i b_mask = _mm_set1_epi32(0x0000001F);
+    __m128i b_lo = _mm_slli_epi32(_mm_and_si128(lo, b_mask), 3);
+    __m128i b_hi = _mm_slli_epi32(_mm_and_si128(hi, b_mask), 3);
+    
+    /* Combine R, G, B */
+    *out_lo = _mm_or_si128(_mm_or_si128(r_lo, g_lo), b_lo);
+    *out_hi = _mm_or_si128(_mm_or_si128(r_hi, g_hi), b_hi);
+}
+
+static inline uint32_t rgb565_to_xrgb8888(uint16_t pixel) {
+    uint32_t r = (pixel >> 11) & 0x1F;
+    uint32_t g = (pixel >> 5) & 0x3F;
+    uint32_t b = pixel & 0x1F;
+    return (r << 19) | (g << 10) | (b << 3);  /* XRGB8888: R@16, G@8, B@0 */
+}
 
 /* SSE2 optimized RGB565 to XRGB8888 conversion - processes 8 pixels at once
- * Critical for VRAM: uses _mm_storeu_si128 (16-byte writes) for optimal PCIe bandwidth
- * Write-Combining requires contiguous 64-byte blocks for best performance */
+ * Regular 16-byte stores, for cached destinations */
 static void blit_rgb565_to_xrgb8888_sse2(uint32_t *dst, const uint16_t *src, int count) {
     int i = 0;
     
     /* Process 8 pixels at a time */
     for (; i + 7 < count; i += 8) {
-        /* Load 8 RGB565 pixels (16 bytes) */
-        __m128i pixels = _mm_loadu_si128((__m128i const *)(src + i));
-        
-        /* Expand to 32-bit: unpack low 4 pixels */
-        __m128i lo = _mm_unpacklo_epi16(pixels, _mm_setzero_si128());
-        /* Expand to 32-bit: unpack high 4 pixels */
-        __m128i hi = _mm_unpackhi_epi16(pixels, _mm_setzero_si128());
-        
-        /* RGB565 layout: RRRRRGGGGGGBBBBB (R5@11-15, G6@5-10, B5@0-4) */
-        /* XRGB8888 target: R@16-23, G@8-15, B@0-7 */
-        
-        /* R5 (bits 11-15) -> R8 (bits 16-23): shift left by 5 (to bit 16), then 3 more for expansion */
-        __m128i r_mask = _mm_set1_epi32(0x0000F800);  /* bits 11-15 */
-        __m128i r_lo = _mm_and_si128(lo, r_mask);
-        __m128i r_hi = _mm_and_si128(hi, r_mask);
-        r_lo = _mm_slli_epi32(r_lo, 5 + 3);  /* shift to bit 16, then expand 5->8 bits */
-        r_hi = _mm_slli_epi32(r_hi, 5 + 3);
-        
-        /* G6 (bits 5-10) -> G8 (bits 8-15): shift left by 3 (to bit 8), then 2 more for expansion */
-        __m128i g_mask = _mm_set1_epi32(0x000007E0);  /* bits 5-10 */
-        __m128i g_lo = _mm_and_si128(lo, g_mask);
-        __m128i g_hi = _mm_and_si128(hi, g_mask);
-        g_lo = _mm_slli_epi32(g_lo, 3 + 2);  /* shift to bit 8, then expand 6->8 bits */
-        g_hi = _mm_slli_epi32(g_hi, 3 + 2);
-        
-        /* B5 (bits 0-4) -> B8 (bits 0-7): no shift needed, just expand by 3 */
-        __m128i b_mask = _mm_set1_epi32(0x0000001F);  /* bits 0-4 */
-        __m128i b_lo = _mm_and_si128(lo, b_mask);
-        __m128i b_hi = _mm_and_si128(hi, b_mask);
-        b_lo = _mm_slli_epi32(b_lo, 3);  /* expand 5->8 bits */
-        b_hi = _mm_slli_epi32(b_hi, 3);
-        
-        /* Combine R, G, B */
-        __m128i result_lo = _mm_or_si128(_mm_or_si128(r_lo, g_lo), b_lo);
-        __m128i result_hi = _mm_or_si128(_mm_or_si128(r_hi, g_hi), b_hi);
-        
-        /* Store 8 XRGB8888 pixels (32 bytes) - 16-byte aligned stores for WC efficiency */
-        _mm_storeu_si128((__m128i *)(dst + i), result_lo);
-        _mm_storeu_si128((__m128i *)(dst + i + 4), result_hi);
+        __m128i lo, hi;
+        rgb565_to_xrgb8888_sse2(_mm_loadu_si128((__m128i const *)(src + i)), &lo, &hi);
+        _mm_storeu_si128((__m128i *)(dst + i), lo);
+        _mm_storeu_si128((__m128i *)(dst + i + 4), hi);
     }
     
     /* Handle remaining pixels with scalar code */
     for (; i < count; i++) {
-        uint16_t pixel = src[i];
-        uint32_t r = (pixel >> 11) & 0x1F;
-        uint32_t g = (pixel >> 5) & 0x3F;
-        uint32_t b = pixel & 0x1F;
-        dst[i] = (r << 19) | (g << 10) | (b << 3);  /* XRGB8888: R@16, G@8, B@0 */
+        dst[i] = rgb565_to_xrgb8888(src[i]);
+    }
+}
+
+/* Streaming variant for VRAM: movnti head up to 16-byte alignment, then
+ * movntdq (32 bytes per 8 pixels); caller issues the sfence */
+static void blit_rgb565_to_xrgb8888_sse2_nt(uint32_t *dst, const uint16_t *src, int count) {
+    int i = 0;
+    
+    for (; i < count && ((uintptr_t)(dst + i) & 15); i++) {
+        _mm_stream_si32((int *)(dst + i), (int)rgb565_to_xrgb8888(src[i]));
+    }
+    
+    for (; i + 7 < count; i += 8) {
+        __m128i lo, hi;
+        rgb565_to_xrgb8888_sse2(_mm_loadu_si128((__m128i const *)(src + i)), &lo, &hi);
+        _mm_stream_si128((__m128i *)(dst + i), lo);
+        _mm_stream_si128((__m128i *)(dst + i + 4), hi);
+    }
+    
+    for (; i < count; i++) {
+        _mm_stream_si32((int *)(dst + i), (int)rgb565_to_xrgb8888(src[i]));
+    }
+}
+
+/* AVX2 variant: 16 pixels (64 bytes, one WC line) per iteration.
+ * With stream: movnti head up to 32-byte alignment, then vmovntdq */
+__attribute__((target("avx2")))
+static void blit_rgb565_to_xrgb8888_avx2(uint32_t *dst, const uint16_t *src, int count, int stream) {
+    const __m256i r_mask = _mm256_set1_epi32(0x0000F800);
+    const __m256i g_mask = _mm256_set1_epi32(0x000007E0);
+    const __m256i b_mask = _mm256_set1_epi32(0x0000001F);
+    int i = 0;
+    
+    if (stream) {
+        for (; i < count && ((uintptr_t)(dst + i) & 31); i++) {
+            _mm_stream_si32((int *)(dst + i), (int)rgb565_to_xrgb8888(src[i]));
+        }
+    }
+    
+    for (; i + 15 < count; i += 16) {
+        __m256i v[2];
+        for (int k = 0; k < 2; k++) {
+            __m256i p = _mm256_cvtepu16_epi32(_mm_loadu_si128((__m128i const *)(src + i + k * 8)));
+            __m256i r = _mm256_slli_epi32(_mm256_and_si256(p, r_mask), 5 + 3);
+            __m256i g = _mm256_slli_epi32(_mm256_and_si256(p, g_mask), 3 + 2);
+            __m256i b = _mm256_slli_epi32(_mm256_and_si256(p, b_mask), 3);
+            v[k] = _mm256_or_si256(_mm256_or_si256(r, g), b);
+        }
+        if (stream) {
+            _mm256_stream_si256((__m256i *)(dst + i), v[0]);
+            _mm256_stream_si256((__m256i *)(dst + i + 8), v[1]);
+        } else {
+            _mm256_storeu_si256((__m256i *)(dst + i), v[0]);
+            _mm256_storeu_si256((__m256i *)(dst + i + 8), v[1]);
+        }
+    }
+    
+    for (; i < count; i++) {
+        uint32_t pixel = rgb565_to_xrgb8888(src[i]);
+        if (stream) {
+            _mm_stream_si32((int *)(dst + i), (int)pixel);
+        } else {
+            dst[i] = pixel;
+        }
     }
 }
 
-/* Blit RGB565 frame to XRGB8888 DRM framebuffer */
+/* Blit RGB565 frame to XRGB8888 DRM framebuffer
+ * stride is the source row pitch in pixels, so sub-rectangles of a frame can be blitted */
 static void blit_to_drm(uint8_t *fb, int fb_w, int fb_h, int fb_pitch,
-                        const uint16_t *frame, int fw, int fh, int x, int y) {
+                        const uint16_t *frame, int stride, int fw, int fh, int x, int y) {
     /* Clip to framebuffer bounds */
     if (x < 0) { fw += x; frame -= x; x = 0; }
-    if (y < 0) { fh += y; frame -= y * FRAME_W; y = 0; }
+    if (y < 0) { fh += y; frame -= y * stride; y = 0; }
     if (x + fw > fb_w) fw = fb_w - x;
     if (y + fh > fb_h) fh = fb_h - y;
     if (fw <= 0 || fh <= 0) return;
@@ -550,26 +1523,49 @@ static void blit_to_drm(uint8_t *fb, int fb_w, int fb_h, int fb_pitch,
     /* Convert RGB565 to XRGB8888 with SSE2 - row by row */
     for (int row = 0; row < fh; row++) {
         uint32_t *dst = (uint32_t *)(fb + (y + row) * fb_pitch + x * 4);
-        const uint16_t *src = frame + row * FRAME_W;
-        blit_rgb565_to_xrgb8888_sse2(dst, src, fw);
+        const uint16_t *src = frame + row * stride;
+        if (cpu_features & CPU_AVX2) {
+            blit_rgb565_to_xrgb8888_avx2(dst, src, fw, fb_stream);
+        } else if (fb_stream) {
+            blit_rgb565_to_xrgb8888_sse2_nt(dst, src, fw);
+        } else {
+            blit_rgb565_to_xrgb8888_sse2(dst, src, fw);
+        }
     }
+    
+    if (fb_stream) _mm_sfence();
 }
 
 /* Fill framebuffer with solid color - SSE2 optimized for VRAM */
 static void fill_fb_color(uint8_t *fb, int fb_w, int fb_h, int fb_pitch, uint16_t color) {
-    uint32_t r = (color >> 11) & 0x1F;
-    uint32_t g = (color >> 5) & 0x3F;
-    uint32_t b = color & 0x1F;
-    uint32_t pixel = (r << 19) | (g << 10) | (b << 3);
-    
-    /* Use SSE2 for optimal VRAM write-combining */
+    uint32_t pixel = rgb565_to_xrgb8888(color);
     __m128i vpixel = _mm_set1_epi32((int)pixel);
     
     for (int y = 0; y < fb_h; y++) {
         uint32_t *dst = (uint32_t *)(fb + y * fb_pitch);
         int x = 0;
         
-        /* Fill 4 pixels (16 bytes) at a time - optimal for WC */
+        if (fb_stream) {
+            /* Head up to 16-byte alignment, then one 64-byte WC line per iteration */
+            for (; x < fb_w && ((uintptr_t)(dst + x) & 15); x++) {
+                _mm_stream_si32((int *)(dst + x), (int)pixel);
+            }
+            for (; x + 15 < fb_w; x += 16) {
+                _mm_stream_si128((__m128i *)(dst + x), vpixel);
+                _mm_stream_si128((__m128i *)(dst + x + 4), vpixel);
+                _mm_stream_si128((__m128i *)(dst + x + 8), vpixel);
+                _mm_stream_si128((__m128i *)(dst + x + 12), vpixel);
+            }
+            for (; x + 3 < fb_w; x += 4) {
+                _mm_stream_si128((__m128i *)(dst + x), vpixel);
+            }
+            for (; x < fb_w; x++) {
+                _mm_stream_si32((int *)(dst + x), (int)pixel);
+            }
+            continue;
+        }
+        
+        /* Fill 4 pixels (16 bytes) at a time */
         for (; x + 3 < fb_w; x += 4) {
             _mm_storeu_si128((__m128i *)(dst + x), vpixel);
         }
@@ -579,12 +1575,254 @@ static void fill_fb_color(uint8_t *fb, int fb_w, int fb_h, int fb_pitch, uint16_
             dst[x] = pixel;
         }
     }
+    
+    if (fb_stream) _mm_sfence();
+}
+
+/* ============================================================================
+ * Sprite Plane (DRM_PLANES)
+ * ============================================================================ */
+
+#if USE_PLANES
+/* Property ids of an overlay plane; false for primary/cursor planes or when
+ * one of the properties the sprite commits set is missing */
+static bool drm_plane_props(int fd, uint32_t plane_id, uint32_t *ids) {
+    static const char *const names[PLANE_NPROPS] = {
+        "FB_ID", "CRTC_ID", "SRC_X", "SRC_Y", "SRC_W", "SRC_H",
+        "CRTC_X", "CRTC_Y", "CRTC_W", "CRTC_H"
+    };
+    drmModeObjectProperties *props = drmModeObjectGetProperties(fd, plane_id, DRM_MODE_OBJECT_PLANE);
+    if (!props) return false;
+    
+    uint64_t type = DRM_PLANE_TYPE_PRIMARY;
+    memset(ids, 0, PLANE_NPROPS * sizeof(*ids));
+    for (uint32_t i = 0; i < props->count_props; i++) {
+        drmModePropertyRes *prop = drmModeGetProperty(fd, props->props[i]);
+        if (!prop) continue;
+        if (strcmp(prop->name, "type") == 0) type = props->prop_values[i];
+        for (int k = 0; k < PLANE_NPROPS; k++) {
+            if (strcmp(prop->name, names[k]) == 0) ids[k] = prop->prop_id;
+        }
+        drmModeFreeProperty(prop);
+    }
+    drmModeFreeObjectProperties(props);
+    
+    if (type != DRM_PLANE_TYPE_OVERLAY) return false;
+    for (int k = 0; k < PLANE_NPROPS; k++) {
+        if (!ids[k]) return false;
+    }
+    return true;
+}
+
+/* Pick an XRGB8888 overlay plane for out's CRTC that no other output uses */
+static bool drm_find_plane(xbs_drm_ctx_t *ctx, xbs_drm_output_t *out) {
+    drmModePlaneRes *pres = drmModeGetPlaneResources(ctx->fd);
+    if (!pres) return false;
+    
+    for (uint32_t i = 0; i < pres->count_planes && !out->plane_id; i++) {
+        uint32_t id = pres->planes[i];
+        bool taken = false;
+        for (int k = 0; k < ctx->nouts; k++) {
+            if (ctx->outs[k].plane_id == id) taken = true;
+        }
+        if (taken) continue;
+        
+        drmModePlane *plane = drmModeGetPlane(ctx->fd, id);
+        if (!plane) continue;
+        
+        /* Planes still showing another CRTC's content are left alone */
+        bool usable = (plane->possible_crtcs & (1u << out->crtc_index)) &&
+                      (!plane->crtc_id || plane->crtc_id == out->crtc_id);
+        bool xrgb = false;
+        for (uint32_t f = 0; f < plane->count_formats; f++) {
+            if (plane->formats[f] == DRM_FORMAT_XRGB8888) xrgb = true;
+        }
+        drmModeFreePlane(plane);
+        
+        if (usable && xrgb && drm_plane_props(ctx->fd, id, out->plane_props)) {
+            out->plane_id = id;
+        }
+    }
+    
+    drmModeFreePlaneResources(pres);
+    return out->plane_id != 0;
+}
+
+/* Move the frame to a sprite plane. The whole frame has to be on screen
+ * (not every driver clips planes), and the kernel has to accept the plane
+ * in a test commit; otherwise the output keeps compositing. */
+static bool drm_sprite_init(xbs_drm_ctx_t *ctx, xbs_drm_output_t *out) {
+    if (!ctx->atomic) return false;
+    if (out->x < 0 || out->y < 0 ||
+        out->x + FRAME_W > (int)out->width || out->y + FRAME_H > (int)out->height) {
+        return false;
+    }
+    if (!drm_find_plane(ctx, out)) return false;
+    
+    if (drm_create_buf(ctx->fd, FRAME_W, FRAME_H, &out->sprite[0]) == 0 &&
+        drm_create_buf(ctx->fd, FRAME_W, FRAME_H, &out->sprite[1]) == 0 &&
+        drm_sprite_commit(ctx->fd, out, out->sprite[0].fb_id, DRM_MODE_ATOMIC_TEST_ONLY) == 0) {
+        out->sprite_front = 0;
+        return true;
+    }
+    
+    for (int i = 0; i < 2; i++) {
+        drm_destroy_buf(ctx->fd, &out->sprite[i]);
+    }
+    out->plane_id = 0;
+    return false;
+}
+
+/* Hand the frame back to the primary buffers and take the plane down: on
+ * exit, so the next master finds the last frame in the primary fb, or when
+ * a sprite commit is refused. The frame goes in underneath the opaque
+ * sprite first, so the screen does not change when the plane goes. */
+static void drm_sprite_fold(xbs_drm_ctx_t *ctx, xbs_drm_output_t *out) {
+    drm_wait_flip(ctx);
+    for (int i = 0; i < out->nbufs; i++) {
+        xbs_drm_buf_t *buf = &out->bufs[i];
+        blit_to_drm(buf->map, out->width, out->height, buf->pitch,
+                    frame_buffer, FRAME_W, FRAME_W, FRAME_H, out->x, out->y);
+    }
+    if (out->nbufs == 1) {
+        drm_present(ctx, out, out->x, out->y, FRAME_W, FRAME_H);
+    }
+    
+    if (out->sprite_on) {
+        drm_sprite_commit(ctx->fd, out, 0, 0);
+        out->sprite_on = false;
+    }
+    for (int i = 0; i < 2; i++) {
+        drm_destroy_buf(ctx->fd, &out->sprite[i]);
+    }
+    out->plane_id = 0;
+}
+
+/* Flip the sprite back buffer onto the plane; completes through the same
+ * page flip event as drm_present */
+static void drm_sprite_present(xbs_drm_ctx_t *ctx, xbs_drm_output_t *out) {
+    int back = out->sprite_front ^ 1;
+    if (drm_sprite_commit(ctx->fd, out, out->sprite[back].fb_id,
+                          DRM_MODE_ATOMIC_NONBLOCK | DRM_MODE_PAGE_FLIP_EVENT) == 0) {
+        out->sprite_on = true;
+        out->sprite_front = back;
+        out->flip_pending = true;
+        return;
+    }
+    
+    /* Refused at runtime: composite from now on */
+    drm_sprite_fold(ctx, out);
+}
+#endif
+
+/* ============================================================================
+ * Boot Instrumentation (xbootsplash.stats on the kernel cmdline)
+ * ============================================================================ */
+
+/* main() stamps each startup step and bins every frame's decode and blit
+ * time; one summary line goes to /dev/kmsg on exit. Disabled, it costs the
+ * clock read at entry and a test of stats.on per probe. The record is this
+ * static struct: nothing is allocated. */
+enum { STATS_CMDLINE, STATS_DECODE, STATS_OPEN, STATS_BLIT, STATS_PRESENT, STATS_EXIT, STATS_MARKS };
+#define STATS_BINS 8    /* Up to 0.25, 0.5, 1, 2, 4, 8, 16 ms, then longer */
+
+typedef struct {
+    bool on;
+    long start;                         /* main() entry, CLOCK_MONOTONIC ns */
+    long mark[STATS_MARKS];             /* When each step finished, 0 if never */
+    unsigned int decode[STATS_BINS], blit[STATS_BINS];
+    long decode_max, blit_max;
+    unsigned int frames;                /* Presented */
+    unsigned int late;                  /* Not decoded by their deadline */
+    unsigned int dropped;               /* Decoded but skipped to catch up */
+} boot_stats_t;
+static boot_stats_t stats;
+
+static long stats_clock(void) {
+    if (!stats.on) return 0;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static void stats_mark(int m) {
+    if (stats.on && !stats.mark[m]) stats.mark[m] = stats_clock();
+}
+
+#if DISPLAY_MODE != 3 && DISPLAY_MODE != 4
+/* Bin the time since t0 (a stats_clock() reading), up to end if later than t0 */
+static void stats_bin(unsigned int *bins, long *max, long t0, long end) {
+    if (!stats.on) return;
+    long d = (end > t0 ? end : stats_clock()) - t0;
+    int b = 0;
+    for (long limit = 250000; b < STATS_BINS - 1 && d >= limit; limit <<= 1) b++;
+    bins[b]++;
+    if (d > *max) *max = d;
+}
+#endif
+
+/* Nanoseconds as milliseconds with two decimals */
+static int stats_ms(char *p, size_t size, const char *name, long ns) {
+    long c = ns > 0 ? ns / 10000 : 0;
+    return snprintf(p, size, "%s%ld.%02ld", name, c / 100, c % 100);
+}
+
+static int stats_bins(char *p, size_t size, const char *name, const unsigned int *bins, long max) {
+    int n = snprintf(p, size, " %s_hist=", name);
+    for (int i = 0; i < STATS_BINS && (size_t)n < size; i++) {
+        n += snprintf(p + n, size - n, i ? "/%u" : "%u", bins[i]);
+    }
+    if ((size_t)n < size) n += snprintf(p + n, size - n, " %s_max=", name);
+    if ((size_t)n < size) n += stats_ms(p + n, size - n, "", max);
+    return n;
+}
+
+/* One line, times in ms: t0 since boot, steps relative to t0 */
+static void stats_report(void) {
+    static const char *const names[STATS_MARKS] = {
+        " cmdline=+", " decode=+", " open=+", " blit=+", " present=+", " exit=+"
+    };
+    char line[512];
+    size_t n;
+    
+    if (!stats.on) return;
+    stats_mark(STATS_EXIT);
+    
+    n = stats_ms(line, sizeof(line), "<6>xbootsplash: t0=", stats.start);
+    for (int m = 0; m < STATS_MARKS && n < sizeof(line); m++) {
+        if (!stats.mark[m]) continue;
+        n += stats_ms(line + n, sizeof(line) - n, names[m], stats.mark[m] - stats.start);
+    }
+    if (n < sizeof(line)) {
+        n += snprintf(line + n, sizeof(line) - n, " frames=%u late=%u dropped=%u",
+                      stats.frames, stats.late, stats.dropped);
+    }
+    if (n < sizeof(line)) n += stats_bins(line + n, sizeof(line) - n, "decode", stats.decode, stats.decode_max);
+    if (n < sizeof(line)) n += stats_bins(line + n, sizeof(line) - n, "blit", stats.blit, stats.blit_max);
+    if (n >= sizeof(line) - 1) n = sizeof(line) - 2;
+    line[n++] = '\n';
+    
+    int fd = open("/dev/kmsg", O_WRONLY | O_CLOEXEC);
+    if (fd < 0) return;
+    write(fd, line, n);
+    close(fd);
 }
 
 /* ============================================================================
  * Kill Switch - Check /proc/cmdline
  * ============================================================================ */
 
+/* Length of key if the parameter at p is exactly key, or key=1 */
+static size_t cmdline_flag(const char *p, const char *key) {
+    size_t i = strlen(key);
+    if (strncmp(p, key, i) != 0) return 0;
+    if (p[i] == '=' && p[i + 1] == '1') i += 2;
+    char next = p[i];
+    return (next == ' ' || next == '\t' || next == '\n' || next == '\0') ? i : 0;
+}
+
+/* 1 for nosplash or xbootsplash=0; also turns on the boot instrumentation
+ * for xbootsplash.stats */
 static int check_cmdline_disable(void) {
     int fd = open("/proc/cmdline", O_RDONLY);
     if (fd < 0) return 0;
@@ -617,6 +1855,11 @@ static int check_cmdline_disable(void) {
             }
         }
         
+        /* Check for xbootsplash.stats (or xbootsplash.stats=1) */
+        if (cmdline_flag(p, "xbootsplash.stats")) {
+            stats.on = true;
+        }
+        
         while (*p && *p != ' ' && *p != '\t' && *p != '\n') p++;
     }
     
@@ -627,20 +1870,358 @@ static int check_cmdline_disable(void) {
  * Timing
  * ============================================================================ */
 
-static long get_time_ms(void) {
+/* Frames are due at absolute CLOCK_MONOTONIC deadlines (CLOCK_MONOTONIC_RAW
+ * cannot be slept on), so decode, blit and flip waits never stretch the period. */
+
+/* Lock presentation to vblank when FRAME_DURATION_MS is a whole number of refresh periods */
+#ifndef VSYNC_LOCK
+#define VSYNC_LOCK 1
+#endif
+
+static long now_ns(void) {
     struct timespec ts;
-    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
-    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000L;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
 }
 
-static void sleep_ms(unsigned int ms) {
-    struct timespec req = {
-        .tv_sec = ms / 1000,
-        .tv_nsec = (ms % 1000) * 1000000L
-    };
-    nanosleep(&req, NULL);
+/* Sleep until an absolute CLOCK_MONOTONIC time or a termination signal.
+ * ppoll's timeout is relative, so it is recomputed from the deadline after
+ * every wakeup and the error never carries over to the next frame. */
+static void sleep_until_ns(long deadline) {
+    while (!terminate_requested) {
+        long left = deadline - now_ns();
+        if (left <= 0) break;
+        struct timespec ts = {
+            .tv_sec = left / 1000000000L,
+            .tv_nsec = left % 1000000000L
+        };
+        ppoll(NULL, 0, &ts, &wait_sigmask);
+    }
 }
 
+#if DISPLAY_MODE != 3 && DISPLAY_MODE != 4
+#define FRAME_NS ((long)FRAME_DURATION_MS * 1000000L)
+
+/* Vblanks per animation frame if FRAME_NS is within 1/32 of a whole number
+ * of the pacing output's refresh periods and its flips can be timed, else 0 */
+static int drm_vsync_frames(const xbs_drm_ctx_t *ctx) {
+    if (!VSYNC_LOCK || ctx->outs[0].nbufs != 2 || !ctx->mono_stamps) return 0;
+    long period = ctx->outs[0].refresh_ns;
+    if (period < 2000000L || period > 50000000L) return 0;
+    
+    long n = (FRAME_NS + period / 2) / period;
+    long err = n * period - FRAME_NS;
+    if (err < 0) err = -err;
+    if (n < 1 || err * 32 > FRAME_NS) return 0;
+    return (int)n;
+}
+
+/* Step to the next frame and grow dirty by what it changes, so frames decoded
+ * without being presented still reach the screen. Returns false at the end of
+ * a non-looping animation (nothing changes). */
+static bool advance_frame(int *frame_idx) {
+    int f = *frame_idx + 1;
+    if (f >= NFRAMES) {
+#ifdef LOOP
+        if (!LOOP) return false;  /* Stay on last frame */
+#endif
+        f = 0;
+    }
+    *frame_idx = f;
+    
+    if (f == 0) {
+#ifdef LOOP_DELTA
+        /* Closing delta from the last frame is smaller than frame 0 */
+        apply_delta(frames[NFRAMES], frame_sizes[NFRAMES], NFRAMES);
+#else
+        load_frame_0(frames[0], frame_sizes[0]);
+#endif
+    } else {
+        apply_delta(frames[f], frame_sizes[f], f);
+    }
+    return true;
+}
+#endif
+
+#if DISPLAY_MODE == 1 || DISPLAY_MODE == 2
+/* ============================================================================
+ * Background Image (modes 1/2)
+ * ============================================================================ */
+
+/* The background is streamed BG_BAND_ROWS rows at a time through a scratch
+ * band into every buffer of every output. Frames cover their area, so once
+ * drawn the image is only needed where alpha frames are blended over it:
+ * bg_buffer keeps just that part (bg_rect), not a screen-sized copy. */
+#ifndef BG_BAND_ROWS
+#define BG_BAND_ROWS 64
+#endif
+
+/* Background variants (generate_splash -r WxH,WxH,...): the closest to the
+ * first output's mode is drawn, resampled to it within BG_SCALE_PCT percent,
+ * as in the fbdev version. Other outputs get the same image. */
+#define BG_FULLSCREEN (DISPLAY_MODE == 2)
+#ifndef BG_SCALE_PCT
+#define BG_SCALE_PCT 25
+#endif
+
+/* One resolution of the background */
+typedef struct {
+    int w, h;
+    int palette_size;
+    uint32_t size;
+    const uint16_t *palette;
+    const uint8_t *data;
+} bg_image_t;
+
+static int bg_variant_count(void) {
+#ifdef BG_VARIANTS
+    return BG_VARIANTS;
+#else
+    return 1;
+#endif
+}
+
+/* Variant i; 0 is BG_W x BG_H */
+static void bg_variant(int i, bg_image_t *img) {
+#ifdef BG_VARIANTS
+    img->w = bg_variant_dims[i][0];
+    img->h = bg_variant_dims[i][1];
+    img->palette_size = bg_variant_palette_sizes[i];
+    img->size = bg_variant_sizes[i];
+    img->palette = bg_variant_palettes[i];
+    img->data = bg_variant_data[i];
+#else
+    (void)i;
+    img->w = BG_W;
+    img->h = BG_H;
+    img->palette_size = BG_PALETTE_SIZE;
+    img->size = BG_COMPRESSED_SIZE;
+    img->palette = bg_palette;
+    img->data = bg_compressed;
+#endif
+}
+
+/* The variant closest to a w x h screen into img, and the size it is drawn
+ * at into (*dw, *dh) */
+static void bg_pick(int w, int h, bg_image_t *img, int *dw, int *dh) {
+    long best = -1;
+    for (int i = 0; i < bg_variant_count(); i++) {
+        bg_image_t v;
+        bg_variant(i, &v);
+        /* Mismatch in per mille of the screen, both directions */
+        int ex = v.w > w ? v.w - w : w - v.w;
+        int ey = v.h > h ? v.h - h : h - v.h;
+        long cost = (long)ex * 1000 / w + (long)ey * 1000 / h;
+        if (best < 0 || cost < best) {
+            best = cost;
+            *img = v;
+        }
+    }
+    
+    *dw = img->w;
+    *dh = img->h;
+    int ex = img->w > w ? img->w - w : w - img->w;
+    int ey = img->h > h ? img->h - h : h - img->h;
+    if (BG_FULLSCREEN && BG_SCALE_PCT > 0 && (ex || ey) &&
+        ex * 100 <= w * BG_SCALE_PCT && ey * 100 <= h * BG_SCALE_PCT) {
+        *dw = w;
+        *dh = h;
+    }
+}
+
+/* a + (b - a) * w / 256 rounded, per RGB565 channel, w 0-255 */
+static inline uint16_t lerp_565(uint16_t a, uint16_t b, int w) {
+    int r = (a >> 11) + ((((b >> 11) - (a >> 11)) * w + 128) >> 8);
+    int g = ((a >> 5) & 0x3F) + (((((b >> 5) & 0x3F) - ((a >> 5) & 0x3F)) * w + 128) >> 8);
+    int bl = (a & 0x1F) + ((((b & 0x1F) - (a & 0x1F)) * w + 128) >> 8);
+    return (r << 11) | (g << 5) | bl;
+}
+
+/* lerp_565 on 8 pixels */
+static inline __m128i lerp_565_x8(__m128i a, __m128i b, __m128i w) {
+    const __m128i m5 = _mm_set1_epi16(0x1F);
+    const __m128i m6 = _mm_set1_epi16(0x3F);
+    const __m128i half = _mm_set1_epi16(128);
+    __m128i ar = _mm_srli_epi16(a, 11), br = _mm_srli_epi16(b, 11);
+    __m128i ag = _mm_and_si128(_mm_srli_epi16(a, 5), m6), bg = _mm_and_si128(_mm_srli_epi16(b, 5), m6);
+    __m128i ab = _mm_and_si128(a, m5), bb = _mm_and_si128(b, m5);
+    __m128i r = _mm_add_epi16(ar, _mm_srai_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_sub_epi16(br, ar), w), half), 8));
+    __m128i g = _mm_add_epi16(ag, _mm_srai_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_sub_epi16(bg, ag), w), half), 8));
+    __m128i bl = _mm_add_epi16(ab, _mm_srai_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_sub_epi16(bb, ab), w), half), 8));
+    return _mm_or_si128(_mm_or_si128(_mm_slli_epi16(r, 11), _mm_slli_epi16(g, 5)), bl);
+}
+
+/* Background rows at the drawn size: straight from the LZSS stream, or
+ * resampled bilinearly from it, 16.16 fixed point with pixel centres
+ * aligned. Source rows are decoded one at a time as the output needs them. */
+typedef struct {
+    lzss_stream_t lzss;
+    int src_w, src_h, dst_w, dst_h;
+    int y;                          /* Next output row */
+    int top;                        /* Source row in row[0], row[1] holds the next */
+    uint16_t *row[2], *vrow;        /* src_w + 1 pixels each */
+    uint16_t *xs, *wx;              /* Per output column: source column, weight 0-255 */
+} bg_reader_t;
+
+/* Scratch bytes bg_begin needs to draw img at dw x dh */
+static long bg_scratch_size(const bg_image_t *img, int dw, int dh) {
+    if (dw == img->w && dh == img->h) return 0;
+    return (3L * (img->w + 1) + 2L * dw) * 2;
+}
+
+/* Source position for output o: index and 8-bit weight of the next one */
+static inline void bg_map(int o, int src, int dst, int *idx, int *w) {
+    long p = ((2L * o + 1) * src << 15) / dst - 32768;
+    if (p < 0) p = 0;
+    *idx = p >> 16;
+    *w = (p >> 8) & 255;
+    if (*idx >= src - 1) {
+        *idx = src - 1;
+        *w = 0;
+    }
+}
+
+static void bg_begin(bg_reader_t *rd, const bg_image_t *img, int dw, int dh, uint16_t *scratch) {
+    lzss_begin(&rd->lzss, img->data, img->size, img->palette, img->palette_size);
+    rd->src_w = img->w;
+    rd->src_h = img->h;
+    rd->dst_w = dw;
+    rd->dst_h = dh;
+    rd->y = 0;
+    if (!scratch) return;
+    
+    rd->row[0] = scratch;
+    rd->row[1] = rd->row[0] + img->w + 1;
+    rd->vrow = rd->row[1] + img->w + 1;
+    rd->xs = rd->vrow + img->w + 1;
+    rd->wx = rd->xs + dw;
+    for (int x = 0; x < dw; x++) {
+        int idx, w;
+        bg_map(x, img->w, dw, &idx, &w);
+        rd->xs[x] = idx;
+        rd->wx[x] = w;
+    }
+    
+    rd->top = 0;
+    lzss_decode(&rd->lzss, rd->row[0], img->w);
+    if (img->h > 1) {
+        lzss_decode(&rd->lzss, rd->row[1], img->w);
+    } else {
+        memcpy(rd->row[1], rd->row[0], img->w * 2);
+    }
+}
+
+/* The next rows output rows into out, dst_w pixels apart */
+static void bg_read(bg_reader_t *rd, uint16_t *out, int rows) {
+    if (rd->src_w == rd->dst_w && rd->src_h == rd->dst_h) {
+        lzss_decode(&rd->lzss, out, rows * rd->dst_w);
+        rd->y += rows;
+        return;
+    }
+    
+    int sw = rd->src_w;
+    for (int r = 0; r < rows; r++, rd->y++) {
+        int sy, wy;
+        bg_map(rd->y, rd->src_h, rd->dst_h, &sy, &wy);
+        while (rd->top < sy) {
+            uint16_t *t = rd->row[0];
+            rd->row[0] = rd->row[1];
+            rd->row[1] = t;
+            if (++rd->top + 1 < rd->src_h) {
+                lzss_decode(&rd->lzss, rd->row[1], sw);
+            } else {
+                memcpy(rd->row[1], rd->row[0], sw * 2);
+            }
+        }
+        
+        /* Between the two source rows, then between columns */
+        const uint16_t *a = rd->row[0], *b = rd->row[1];
+        uint16_t *v = rd->vrow;
+        __m128i vwy = _mm_set1_epi16(wy);
+        int i = 0;
+        for (; i + 8 <= sw; i += 8) {
+            __m128i pa = _mm_loadu_si128((const __m128i *)(a + i));
+            __m128i pb = _mm_loadu_si128((const __m128i *)(b + i));
+            _mm_storeu_si128((__m128i *)(v + i), lerp_565_x8(pa, pb, vwy));
+        }
+        for (; i < sw; i++) v[i] = lerp_565(a[i], b[i], wy);
+        v[sw] = v[sw - 1];
+        
+        uint16_t *dst = out + r * rd->dst_w;
+        const uint16_t *xs = rd->xs;
+        int x = 0;
+        for (; x + 8 <= rd->dst_w; x += 8) {
+            __m128i pa = _mm_setr_epi16(v[xs[x]], v[xs[x + 1]], v[xs[x + 2]], v[xs[x + 3]],
+                                        v[xs[x + 4]], v[xs[x + 5]], v[xs[x + 6]], v[xs[x + 7]]);
+            __m128i pb = _mm_setr_epi16(v[xs[x] + 1], v[xs[x + 1] + 1], v[xs[x + 2] + 1], v[xs[x + 3] + 1],
+                                        v[xs[x + 4] + 1], v[xs[x + 5] + 1], v[xs[x + 6] + 1], v[xs[x + 7] + 1]);
+            __m128i w = _mm_loadu_si128((const __m128i *)(rd->wx + x));
+            _mm_storeu_si128((__m128i *)(dst + x), lerp_565_x8(pa, pb, w));
+        }
+        for (; x < rd->dst_w; x++) dst[x] = lerp_565(v[xs[x]], v[xs[x] + 1], rd->wx[x]);
+    }
+}
+
+/* Decode the background closest to the first output's mode into every
+ * buffer of every output, and keep bg_rect of it in bg_buffer. Without
+ * memory for the band the buffers stay on the solid colour. */
+static void bg_load(xbs_drm_ctx_t *ctx) {
+    bg_image_t img;
+    int bw, bh;
+    bg_pick(ctx->outs[0].width, ctx->outs[0].height, &img, &bw, &bh);
+    long band_size = (long)bw * BG_BAND_ROWS * 2 + bg_scratch_size(&img, bw, bh);
+    uint16_t *band = mmap(NULL, band_size, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (band == MAP_FAILED) return;
+    
+    /* Part of the image blended over later on any output, clipped to it */
+    dirty_rect_t keep = { bw, bh, 0, 0 };
+#ifdef FRAME_ALPHA
+    for (int o = 0; o < ctx->nouts; o++) {
+        xbs_drm_output_t *out = &ctx->outs[o];
+        dirty_rect_t under = { out->x, out->y, out->x + FRAME_W, out->y + FRAME_H };
+        dirty_union(&keep, &under);
+    }
+#endif
+    if (keep.x0 < 0) keep.x0 = 0;
+    if (keep.y0 < 0) keep.y0 = 0;
+    if (keep.x1 > bw) keep.x1 = bw;
+    if (keep.y1 > bh) keep.y1 = bh;
+    int keep_w = keep.x1 - keep.x0;
+    if (!dirty_empty(&keep)) {
+        bg_buffer = mmap(NULL, keep_w * (keep.y1 - keep.y0) * 2, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+        if (bg_buffer == MAP_FAILED) bg_buffer = NULL;
+    }
+    bg_rect = keep;
+    
+    bg_reader_t rd;
+    bg_begin(&rd, &img, bw, bh, bw != img.w || bh != img.h ? band + bw * BG_BAND_ROWS : NULL);
+    for (int by0 = 0; by0 < bh; by0 += BG_BAND_ROWS) {
+        int by1 = by0 + BG_BAND_ROWS < bh ? by0 + BG_BAND_ROWS : bh;
+        bg_read(&rd, band, by1 - by0);
+        
+        for (int o = 0; o < ctx->nouts; o++) {
+            xbs_drm_output_t *out = &ctx->outs[o];
+            for (int i = 0; i < out->nbufs; i++) {
+                xbs_drm_buf_t *buf = &out->bufs[i];
+                blit_to_drm(buf->map, out->width, out->height, buf->pitch,
+                            band, bw, bw, by1 - by0, 0, by0);
+            }
+        }
+        
+        /* Kept rows of this band */
+        int ky0 = by0 > keep.y0 ? by0 : keep.y0;
+        int ky1 = by1 < keep.y1 ? by1 : keep.y1;
+        for (int ky = ky0; bg_buffer && ky < ky1; ky++) {
+            memcpy(bg_buffer + (ky - keep.y0) * keep_w, band + (ky - by0) * bw + keep.x0, keep_w * 2);
+        }
+    }
+    
+    munmap(band, band_size);
+}
+#endif
+
 /* ============================================================================
  * Main
  * ============================================================================ */
@@ -649,14 +2230,20 @@ int main(void) {
     xbs_drm_ctx_t drm_ctx = {0};
     int ret;
     
+    /* Startup timeline origin, before the cmdline says whether it is wanted */
+    stats.start = now_ns();
+    
     /* Kill switch */
     if (check_cmdline_disable()) {
         return 0;
     }
+    stats_mark(STATS_CMDLINE);
     
     /* Setup signal handlers */
-    signal(SIGTERM, signal_handler);
-    signal(SIGINT, signal_handler);
+    signals_init();
+    
+    /* Select SIMD kernels for this CPU */
+    cpu_detect();
     
     /* Initialize DRM */
     ret = drm_init(&drm_ctx);
@@ -664,115 +2251,257 @@ int main(void) {
         write(2, "DRM: Init failed\n", 17);
         return 1;
     }
+    stats_mark(STATS_OPEN);
     
     g_drm_ctx = &drm_ctx;
     
     /* Allocate frame buffer */
     frame_buffer = mmap(NULL, FRAME_W * FRAME_H * 2, PROT_READ | PROT_WRITE,
-                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
     if (frame_buffer == MAP_FAILED) {
         write(2, "DRM: No memory\n", 14);
         drm_cleanup(&drm_ctx);
         return 1;
     }
     
-#if DISPLAY_MODE == 1 || DISPLAY_MODE == 2
-    /* Allocate and decompress background */
-    bg_buffer = mmap(NULL, BG_W * BG_H * 2, PROT_READ | PROT_WRITE,
-                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-    if (bg_buffer == MAP_FAILED) {
+#ifdef TILE_REF
+    /* Previous-frame reference for tile copies */
+    tile_ref = mmap(NULL, FRAME_W * FRAME_H * 2, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (tile_ref == MAP_FAILED) {
+        write(2, "DRM: No memory\n", 14);
         munmap(frame_buffer, FRAME_W * FRAME_H * 2);
         drm_cleanup(&drm_ctx);
         return 1;
     }
-    decompress_palette_lzss(bg_compressed, BG_COMPRESSED_SIZE, bg_palette, BG_PALETTE_SIZE,
-                            bg_buffer, BG_W * BG_H);
 #endif
     
-    /* Calculate position */
-    int x, y;
+#ifdef FRAME_ALPHA
+    /* Coverage plane and blend target (last row: BACKGROUND_COLOR off the image) */
+    alpha_buffer = mmap(NULL, FRAME_W * FRAME_H, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    comp_buffer = mmap(NULL, FRAME_W * (FRAME_H + 1) * 2, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (alpha_buffer == MAP_FAILED || comp_buffer == MAP_FAILED) {
+        write(2, "DRM: No memory\n", 15);
+        drm_cleanup(&drm_ctx);
+        return 1;
+    }
+    for (int i = 0; i < FRAME_W; i++) comp_buffer[FRAME_W * FRAME_H + i] = BACKGROUND_COLOR;
+#endif
     
-#if DISPLAY_MODE == 4
-    x = (drm_ctx.width - FRAME_W) / 2 + HORIZONTAL_OFFSET;
-    y = (drm_ctx.height - FRAME_H) / 2 + VERTICAL_OFFSET;
-    fill_fb_color(drm_ctx.map, drm_ctx.width, drm_ctx.height, drm_ctx.pitch, BACKGROUND_COLOR);
-#elif DISPLAY_MODE == 1 || DISPLAY_MODE == 2
-    x = (drm_ctx.width - FRAME_W) / 2 + HORIZONTAL_OFFSET;
-    y = (drm_ctx.height - FRAME_H) / 2 + VERTICAL_OFFSET;
-    blit_to_drm(drm_ctx.map, drm_ctx.width, drm_ctx.height, drm_ctx.pitch,
-                bg_buffer, BG_W, BG_H, 0, 0);
+#if DISPLAY_MODE == 3 || DISPLAY_MODE == 4
+    /* Static image */
+#if defined(COMPRESS_METHOD) && COMPRESS_METHOD == 5
+    decompress_palette_lzss(img_compressed, IMG_COMPRESSED_SIZE, palette, PALETTE_SIZE,
+                            frame_buffer, FRAME_W * FRAME_H);
 #else
-    x = (drm_ctx.width - FRAME_W) / 2 + HORIZONTAL_OFFSET;
-    y = (drm_ctx.height - FRAME_H) / 2 + VERTICAL_OFFSET;
-    fill_fb_color(drm_ctx.map, drm_ctx.width, drm_ctx.height, drm_ctx.pitch, BACKGROUND_COLOR);
+    memcpy(frame_buffer, frame_0, FRAME_W * FRAME_H * 2);
+#endif
+    stats_mark(STATS_DECODE);
+#endif
+    
+    /* Paint the backdrop into every buffer so flips never expose a stale one,
+     * and centre the frame on each output */
+    for (int o = 0; o < drm_ctx.nouts; o++) {
+        xbs_drm_output_t *out = &drm_ctx.outs[o];
+#if DISPLAY_MODE != 1 && DISPLAY_MODE != 2
+        for (int i = 0; i < out->nbufs; i++) {
+            xbs_drm_buf_t *buf = &out->bufs[i];
+            fill_fb_color(buf->map, out->width, out->height, buf->pitch, BACKGROUND_COLOR);
+        }
 #endif
+        out->x = ((int)out->width - FRAME_W) / 2 + HORIZONTAL_OFFSET;
+        out->y = ((int)out->height - FRAME_H) / 2 + VERTICAL_OFFSET;
+    }
+#if DISPLAY_MODE == 1 || DISPLAY_MODE == 2
+    bg_load(&drm_ctx);
+#endif
+    stats_mark(STATS_BLIT);
     
     /* Main loop */
 #if DISPLAY_MODE == 3 || DISPLAY_MODE == 4
     /* Static image */
-    blit_to_drm(drm_ctx.map, drm_ctx.width, drm_ctx.height, drm_ctx.pitch,
-                frame_buffer, FRAME_W, FRAME_H, x, y);
-    
-    while (!terminate_requested) {
-        sleep_ms(1000);
+    for (int o = 0; o < drm_ctx.nouts; o++) {
+        xbs_drm_output_t *out = &drm_ctx.outs[o];
+        for (int i = 0; i < out->nbufs; i++) {
+            xbs_drm_buf_t *buf = &out->bufs[i];
+            blit_to_drm(buf->map, out->width, out->height, buf->pitch,
+                        frame_buffer, FRAME_W, FRAME_W, FRAME_H, out->x, out->y);
+        }
     }
+    for (int o = 0; o < drm_ctx.nouts; o++) {
+        xbs_drm_output_t *out = &drm_ctx.outs[o];
+        drm_present(&drm_ctx, out, 0, 0, out->width, out->height);
+    }
+    stats_mark(STATS_PRESENT);
+    
+    wait_for_signal();
 #else
     /* Animation */
     int frame_idx = 0;
     
+    /* Region changed since the back buffers were last drawn; with two
+     * buffers that is the previous delta plus the current one */
+    dirty_rect_t prev_dirty;
+    dirty_mark_full(&prev_dirty);
+    
     /* Load first frame */
     load_frame_0(frames[0], frame_sizes[0]);
+    stats_mark(STATS_DECODE);
+    
+#if USE_PLANES
+    /* Where an overlay plane is free, the frame moves onto it. The primary
+     * buffers get frame 0 underneath and are not touched again until exit. */
+    for (int o = 0; o < drm_ctx.nouts; o++) {
+        xbs_drm_output_t *out = &drm_ctx.outs[o];
+        if (!drm_sprite_init(&drm_ctx, out)) continue;
+        for (int i = 0; i < out->nbufs; i++) {
+            xbs_drm_buf_t *buf = &out->bufs[i];
+            blit_to_drm(buf->map, out->width, out->height, buf->pitch,
+                        frame_buffer, FRAME_W, FRAME_W, FRAME_H, out->x, out->y);
+        }
+        if (out->foreign_scanout) {
+            drm_present(&drm_ctx, out, 0, 0, out->width, out->height);
+        }
+    }
+#endif
+    
+    /* Locked: every frame goes out N vblanks after the previous flip on the
+     * pacing output, otherwise frames sit on a FRAME_NS grid starting now */
+    xbs_drm_output_t *pace = &drm_ctx.outs[0];
+    int vsync_frames = drm_vsync_frames(&drm_ctx);
+    long period = vsync_frames ? vsync_frames * pace->refresh_ns : FRAME_NS;
+    long deadline = now_ns();
     
     while (!terminate_requested) {
-        long frame_start = get_time_ms();
+        long flip_before = pace->flip_ns;
         
-        /* Blit current frame */
-        blit_to_drm(drm_ctx.map, drm_ctx.width, drm_ctx.height, drm_ctx.pitch,
-                    frame_buffer, FRAME_W, FRAME_H, x, y);
+        dirty_rect_t flip_rect = dirty;
+        dirty_union(&flip_rect, &prev_dirty);
         
-        /* Force CRTC refresh - required for dumb buffer updates to be visible */
-        drmModeSetCrtc(drm_ctx.fd, drm_ctx.crtc_id, drm_ctx.fb_id, 0, 0,
-                      &drm_ctx.conn_id, 1, &drm_ctx.mode);
+        /* Blit only the region changed by the last delta(s): the frame is
+         * decoded once, then every output gets a copy and all flips are
+         * queued together */
+        if (!dirty_empty(&flip_rect)) {
+            /* Back buffers are still being scanned out until the flips land */
+            drm_wait_flip(&drm_ctx);
+            long blit_t0 = stats_clock();
+            
+#ifdef FRAME_ALPHA
+            /* Blended for the last output's offset and rect: mirrored outputs share it */
+            const dirty_rect_t *comp_rect = NULL;
+            int comp_x = 0, comp_y = 0;
+#endif
+            for (int o = 0; o < drm_ctx.nouts; o++) {
+                xbs_drm_output_t *out = &drm_ctx.outs[o];
+                const dirty_rect_t *r = out->nbufs == 2 || out->plane_id ? &flip_rect : &dirty;
+                if (dirty_empty(r)) continue;
+                
+#if USE_PLANES
+                if (out->plane_id) {
+                    /* Sprite buffers are the size of the frame */
+                    xbs_drm_buf_t *back = &out->sprite[out->sprite_front ^ 1];
+                    blit_to_drm(back->map, FRAME_W, FRAME_H, back->pitch,
+                                frame_buffer + r->y0 * FRAME_W + r->x0, FRAME_W,
+                                r->x1 - r->x0, r->y1 - r->y0, r->x0, r->y0);
+                    continue;
+                }
+#endif
+#ifdef FRAME_ALPHA
+                if (r != comp_rect || out->x != comp_x || out->y != comp_y) {
+                    alpha_compose(r, out->x, out->y);
+                    comp_rect = r;
+                    comp_x = out->x;
+                    comp_y = out->y;
+                }
+#endif
+                xbs_drm_buf_t *back = drm_back(out);
+                blit_to_drm(back->map, out->width, out->height, back->pitch,
+                            FRAME_OUT + r->y0 * FRAME_W + r->x0, FRAME_W,
+                            r->x1 - r->x0, r->y1 - r->y0,
+                            out->x + r->x0, out->y + r->y0);
+            }
+            stats_bin(stats.blit, &stats.blit_max, blit_t0, 0);
+            
+            for (int o = 0; o < drm_ctx.nouts; o++) {
+                xbs_drm_output_t *out = &drm_ctx.outs[o];
+                const dirty_rect_t *r = out->nbufs == 2 || out->plane_id ? &flip_rect : &dirty;
+                if (dirty_empty(r)) continue;
+                
+#if USE_PLANES
+                if (out->plane_id) {
+                    drm_sprite_present(&drm_ctx, out);
+                    continue;
+                }
+#endif
+                drm_present(&drm_ctx, out, out->x + r->x0, out->y + r->y0,
+                            r->x1 - r->x0, r->y1 - r->y0);
+            }
+            stats_mark(STATS_PRESENT);
+            if (stats.on) stats.frames++;
+        }
+        prev_dirty = dirty;
+        dirty_reset(&dirty);
         
         if (terminate_requested) break;
         
-        /* Next frame */
-        frame_idx++;
-        
-        if (frame_idx >= NFRAMES) {
-#ifdef LOOP
-            if (LOOP) {
-                frame_idx = 0;
-                load_frame_0(frames[0], frame_sizes[0]);
-            } else {
-                while (!terminate_requested) sleep_ms(1000);
-                break;
-            }
-#else
-            frame_idx = 0;
-            load_frame_0(frames[0], frame_sizes[0]);
-#endif
+        /* Next deadline: when locked, re-anchored on the vblank this frame went out on */
+        if (vsync_frames) {
+            drm_wait_flip(&drm_ctx);
+            if (pace->flip_ns != flip_before) deadline = pace->flip_ns;
         }
+        deadline += period;
         
-        /* Apply delta */
-        if (frame_idx > 0) {
-            apply_delta(frames[frame_idx], frame_sizes[frame_idx]);
+        /* Next frame */
+        long decode_t0 = stats_clock();
+        if (!advance_frame(&frame_idx)) {
+            wait_for_signal();
+            break;
         }
+        stats_bin(stats.decode, &stats.decode_max, decode_t0, 0);
         
-        /* Delta-time sleep */
-        long elapsed = get_time_ms() - frame_start;
-        long sleep_time = FRAME_DURATION_MS - elapsed;
-        if (sleep_time > 0) {
-            sleep_ms((unsigned int)sleep_time);
+        /* A whole period behind (slow blit, busy CPU): decode the frames that are
+         * already due without presenting them, so the animation keeps its speed */
+        long now = now_ns();
+        if (stats.on && now > deadline) stats.late++;
+        while (now - deadline >= period && !terminate_requested) {
+            decode_t0 = stats_clock();
+            if (!advance_frame(&frame_idx)) break;
+            stats_bin(stats.decode, &stats.decode_max, decode_t0, 0);
+            if (stats.on) stats.dropped++;
+            deadline += period;
         }
+        
+        /* Locked: wake half a refresh early so the flips are queued before the vblank */
+        sleep_until_ns(vsync_frames ? deadline - pace->refresh_ns / 2 : deadline);
     }
 #endif
+    stats_report();
     
-    /* Cleanup */
-    memset(drm_ctx.map, 0, drm_ctx.size);  /* Clear to black */
+    /* Cleanup: keep the last frame up for the next master, or clear to black
+     * and restore the previous CRTC */
+    drm_wait_flip(&drm_ctx);
+    for (int o = 0; o < drm_ctx.nouts; o++) {
+        xbs_drm_output_t *out = &drm_ctx.outs[o];
+#if USE_PLANES
+        if (DRM_HANDOFF && out->plane_id) drm_sprite_fold(&drm_ctx, out);
+#endif
+        if (DRM_HANDOFF && drm_handoff(&drm_ctx, out)) continue;
+        for (int i = 0; i < out->nbufs; i++) {
+            memset(out->bufs[i].map, 0, out->bufs[i].size);  /* Clear to black */
+        }
+    }
     munmap(frame_buffer, FRAME_W * FRAME_H * 2);
+#ifdef TILE_REF
+    munmap(tile_ref, FRAME_W * FRAME_H * 2);
+#endif
 #if DISPLAY_MODE == 1 || DISPLAY_MODE == 2
-    munmap(bg_buffer, BG_W * BG_H * 2);
+    if (bg_buffer) munmap(bg_buffer, (bg_rect.x1 - bg_rect.x0) * (bg_rect.y1 - bg_rect.y0) * 2);
+#endif
+#ifdef FRAME_ALPHA
+    munmap(alpha_buffer, FRAME_W * FRAME_H);
+    munmap(comp_buffer, FRAME_W * (FRAME_H + 1) * 2);
 #endif
     drm_cleanup(&drm_ctx);
     
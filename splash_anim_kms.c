@@ -0,0 +1,2182 @@
+/*
+ * splash_anim_kms.c - Boot splash animation on DRM/KMS, freestanding
+ * by seb3773 - https://github.com/seb3773
+ * 
+ * Architecture: Linux x86_64, freestanding (no libc, no libdrm)
+ * Dependencies: nolibc.h only
+ * 
+ * Same display path as splash_anim_drm.c (dumb buffers, page flip,
+ * DirtyFB fallback) but issuing the DRM ioctls directly, so the binary
+ * is static like the fbdev version: no ld.so, no relocations, no libc
+ * init, nothing to copy into the initramfs besides the binary itself.
+ * 
+ * Display and compression modes: same as splash_anim_delta.c
+ * 
+ * Constraints:
+ *   - Complexity: O(n) per frame where n = changed pixels
+ *   - Memory: single frame buffer + two dumb buffers
+ *   - No dynamic allocation (KMS object lists live on the stack)
+ *   - No PNG decoding
+ */
+
+#include "nolibc.h"
+#include <emmintrin.h>  /* SSE2 intrinsics for x86_64 */
+#include <immintrin.h>  /* AVX2 intrinsics - only reached through cpuid dispatch */
+
+/* Frame buffer - allocated via mmap at runtime */
+static uint16_t *frame_buffer = NULL;
+static uint16_t *bg_buffer = NULL;  /* For modes 1/2, see bg_load() */
+
+/* Dirty rectangle in frame coordinates (half-open: x0 <= x < x1, y0 <= y < y1) */
+/* Accumulated by the delta decoders, consumed by the blit in the animation loop */
+typedef struct {
+    int x0, y0, x1, y1;
+} dirty_rect_t;
+static dirty_rect_t dirty;
+static dirty_rect_t bg_rect;            /* Part of the background image in bg_buffer */
+
+/* Volatile flag for signal handling */
+static volatile int terminate_requested = 0;
+
+/* Signal handler for graceful termination */
+static void signal_handler(int sig) {
+    (void)sig;
+    terminate_requested = 1;
+}
+
+/* SIGTERM/SIGINT stay blocked except inside the waits below, which unblock */
+/* them atomically with ppoll: a signal can never land between checking */
+/* terminate_requested and going to sleep, and it always ends the wait at once */
+static kernel_sigset_t wait_sigmask;
+
+static void signals_init(void) {
+    kernel_sigset_t block;
+    sigemptyset(&block);
+    sigaddset(&block, SIGTERM);
+    sigaddset(&block, SIGINT);
+    
+    signal(SIGTERM, signal_handler);
+    signal(SIGINT, signal_handler);
+    sigprocmask(SIG_BLOCK, &block, &wait_sigmask);
+    
+    /* Mask while waiting: whatever we inherited, minus the two we handle */
+    sigdelset(&wait_sigmask, SIGTERM);
+    sigdelset(&wait_sigmask, SIGINT);
+}
+
+/* Block until a termination signal has been handled */
+static void wait_for_signal(void) {
+    while (!terminate_requested) {
+        ppoll(NULL, 0, NULL, &wait_sigmask);
+    }
+}
+
+#include "frames_delta.h"
+
+
+/* --- Dirty rectangle tracking --- */
+
+/* With a generator-provided frame_dirty[] table the decoders skip all tracking */
+/* and delta streams start at the first changed row; otherwise track at runtime */
+#ifdef FRAME_DIRTY_TABLE
+#define TRACK_DIRTY 0
+#else
+#define TRACK_DIRTY 1
+#endif
+
+/* Reset to empty (x1 <= x0) */
+static inline void dirty_reset(dirty_rect_t *r) {
+    r->x0 = FRAME_W;
+    r->y0 = FRAME_H;
+    r->x1 = 0;
+    r->y1 = 0;
+}
+
+static inline void dirty_mark_full(dirty_rect_t *r) {
+    r->x0 = 0;
+    r->y0 = 0;
+    r->x1 = FRAME_W;
+    r->y1 = FRAME_H;
+}
+
+static inline int dirty_empty(const dirty_rect_t *r) {
+    return r->x1 <= r->x0 || r->y1 <= r->y0;
+}
+
+/* Grow r to cover a linear pixel span [start, end) of the frame */
+/* Called once per decoded run, never per pixel (except sparse) */
+static inline void dirty_add_span(dirty_rect_t *r, int start, int end) {
+    if (end <= start) return;
+    int y0 = start / FRAME_W;
+    int y1 = (end - 1) / FRAME_W;
+    int x0, x1;
+    if (y0 == y1) {
+        x0 = start - y0 * FRAME_W;
+        x1 = end - y0 * FRAME_W;
+    } else {
+        /* Span wraps a row boundary: covers full width */
+        x0 = 0;
+        x1 = FRAME_W;
+    }
+    if (x0 < r->x0) r->x0 = x0;
+    if (x1 > r->x1) r->x1 = x1;
+    if (y0 < r->y0) r->y0 = y0;
+    if (y1 + 1 > r->y1) r->y1 = y1 + 1;
+}
+
+/* Grow r to also cover o */
+static inline void dirty_union(dirty_rect_t *r, const dirty_rect_t *o) {
+    if (dirty_empty(o)) return;
+    if (o->x0 < r->x0) r->x0 = o->x0;
+    if (o->y0 < r->y0) r->y0 = o->y0;
+    if (o->x1 > r->x1) r->x1 = o->x1;
+    if (o->y1 > r->y1) r->y1 = o->y1;
+}
+
+/* Grow r to cover the precomputed region of frame f (no-op without table) */
+static inline void dirty_add_frame(dirty_rect_t *r, int f) {
+#if TRACK_DIRTY
+    (void)r;
+    (void)f;
+#else
+    dirty_rect_t box = { frame_dirty[f][0], frame_dirty[f][1], frame_dirty[f][2], frame_dirty[f][3] };
+    dirty_union(r, &box);
+#endif
+}
+
+/* First pixel covered by the delta stream of frame f */
+static inline int delta_start(int f) {
+#if TRACK_DIRTY
+    (void)f;
+    return 0;
+#else
+    return frame_dirty[f][1] * FRAME_W;
+#endif
+}
+
+/* --- LZSS decompression for palette+LZSS compressed data --- */
+#if (defined(COMPRESS_METHOD) && COMPRESS_METHOD == 5) || (defined(FRAME0_METHOD) && FRAME0_METHOD == 5) || \
+    (defined(DISPLAY_MODE) && (DISPLAY_MODE == 1 || DISPLAY_MODE == 2))
+
+#define LZSS_WINDOW_SIZE 4096   /* Power of two: positions wrap with a mask */
+#define LZSS_MIN_MATCH  3
+
+/* Decoder state, so a stream can be expanded a piece at a time */
+typedef struct {
+    const uint8_t *in;
+    size_t in_pos, in_size;
+    const uint16_t *pal;
+    int num_colors;
+    int flag;                       /* Current flag byte, shifted as it is used */
+    int bits;                       /* Flag bits left in it */
+    int match_offset, match_left;   /* Back-reference cut short by the last call */
+    int window_pos;
+    uint8_t window[LZSS_WINDOW_SIZE];
+} lzss_stream_t;
+
+static void lzss_begin(lzss_stream_t *s, const uint8_t *compressed, size_t comp_size,
+                       const uint16_t *pal, int num_colors) {
+    s->in = compressed;
+    s->in_pos = 0;
+    s->in_size = comp_size;
+    s->pal = pal;
+    s->num_colors = num_colors;
+    s->bits = 0;
+    s->match_left = 0;
+    s->window_pos = 0;
+    
+    /* Initialize window */
+    for (int i = 0; i < LZSS_WINDOW_SIZE; i++) s->window[i] = 0;
+}
+
+/* Expand the next pixel_count pixels of the stream into out. Returns how */
+/* many were written: fewer only once the stream runs out. */
+static int lzss_decode(lzss_stream_t *s, uint16_t *out, int pixel_count) {
+    const uint8_t *compressed = s->in;
+    const uint16_t *pal = s->pal;
+    uint8_t *window = s->window;
+    size_t in_pos = s->in_pos, comp_size = s->in_size;
+    int num_colors = s->num_colors;
+    int flag = s->flag, bits = s->bits;
+    int offset = s->match_offset, left = s->match_left;
+    int window_pos = s->window_pos;
+    int out_pos = 0;
+    
+    while (out_pos < pixel_count) {
+        if (left) {
+            /* Copy from window */
+            int length = left < pixel_count - out_pos ? left : pixel_count - out_pos;
+            left -= length;
+            for (int i = 0; i < length; i++) {
+                int win_idx = (window_pos - offset + LZSS_WINDOW_SIZE) & (LZSS_WINDOW_SIZE - 1);
+                uint8_t val = window[win_idx];
+                window[window_pos] = val;
+                window_pos = (window_pos + 1) & (LZSS_WINDOW_SIZE - 1);
+                
+                /* Expand via palette */
+                out[out_pos++] = pal[val < num_colors ? val : 0];
+            }
+            continue;
+        }
+        
+        if (in_pos >= comp_size) break;
+        if (!bits) {
+            flag = compressed[in_pos++];
+            bits = 8;
+            if (in_pos >= comp_size) break;
+        }
+        int literal = flag & 1;
+        flag >>= 1;
+        bits--;
+        
+        if (literal) {
+            /* Literal byte */
+            uint8_t val = compressed[in_pos++];
+            window[window_pos] = val;
+            window_pos = (window_pos + 1) & (LZSS_WINDOW_SIZE - 1);
+            
+            /* Expand via palette */
+            out[out_pos++] = pal[val < num_colors ? val : 0];
+        } else {
+            /* Back-reference: 2 bytes */
+            if (in_pos + 1 >= comp_size) {
+                in_pos = comp_size;
+                break;
+            }
+            uint8_t b1 = compressed[in_pos++];
+            uint8_t b2 = compressed[in_pos++];
+            
+            offset = (b1 | ((b2 & 0xF0) << 4));
+            left = (b2 & 0x0F) + LZSS_MIN_MATCH;
+        }
+    }
+    
+    s->in_pos = in_pos;
+    s->flag = flag;
+    s->bits = bits;
+    s->match_offset = offset;
+    s->match_left = left;
+    s->window_pos = window_pos;
+    return out_pos;
+}
+
+/* Decompress LZSS data to indices, then expand via palette */
+static void decompress_palette_lzss(const uint8_t *compressed, size_t comp_size,
+                                     const uint16_t *pal, int num_colors,
+                                     uint16_t *out, int pixel_count) {
+    lzss_stream_t s;
+    lzss_begin(&s, compressed, comp_size, pal, num_colors);
+    lzss_decode(&s, out, pixel_count);
+}
+#endif
+
+/* --- SSE2 pixel runs --- */
+/* Stream payloads are little-endian RGB565, the same layout as frame_buffer, */
+/* so literal runs are loaded 8 pixels at a time straight from the stream. */
+/* Neither side is aligned in general (runs start anywhere): loadu/storeu. */
+
+/* dst[0..n) ^= n stream pixels at src */
+static inline void run_xor(uint16_t *dst, const uint8_t *src, int n) {
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + i * 2));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_xor_si128(d, s));
+    }
+    for (src += i * 2; i < n; i++, src += 2) dst[i] ^= src[0] | (src[1] << 8);
+}
+
+/* dst[0..n) = n stream pixels at src */
+static inline void run_copy(uint16_t *dst, const uint8_t *src, int n) {
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_loadu_si128((const __m128i *)(src + i * 2)));
+    }
+    for (src += i * 2; i < n; i++, src += 2) dst[i] = src[0] | (src[1] << 8);
+}
+
+/* dst[0..n) = val */
+static inline void run_fill(uint16_t *dst, uint16_t val, int n) {
+    __m128i v = _mm_set1_epi16((short)val);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) _mm_storeu_si128((__m128i *)(dst + i), v);
+    for (; i < n; i++) dst[i] = val;
+}
+
+/* Extend dirty by the pixels a copy/fill run at frame_buffer[idx] would change */
+static inline void dirty_add_copy(int idx, const uint8_t *src, int n) {
+    int lo = -1, hi = -1;
+    for (int i = 0; i < n; i++) {
+        if (frame_buffer[idx + i] != (uint16_t)(src[i * 2] | (src[i * 2 + 1] << 8))) {
+            if (lo < 0) lo = i;
+            hi = i;
+        }
+    }
+    if (lo >= 0) dirty_add_span(&dirty, idx + lo, idx + hi + 1);
+}
+
+static inline void dirty_add_fill(int idx, uint16_t val, int n) {
+    int lo = -1, hi = -1;
+    for (int i = 0; i < n; i++) {
+        if (frame_buffer[idx + i] != val) {
+            if (lo < 0) lo = i;
+            hi = i;
+        }
+    }
+    if (lo >= 0) dirty_add_span(&dirty, idx + lo, idx + hi + 1);
+}
+
+/* Decode RLE XOR delta and apply to frame_buffer, starting at pixel start */
+static void apply_delta_rle_xor(const uint8_t *delta, size_t delta_size, int start) {
+    size_t pos = 0;
+    int pixel_idx = start;
+    int max_pixels = FRAME_W * FRAME_H;
+    
+    while (pos < delta_size) {
+        uint8_t cmd = delta[pos++];
+        
+        if (cmd == 0x00) {
+            break;
+        } else if (cmd & 0x80) {
+            /* Skip: advance pixel index */
+            int skip = (cmd & 0x7F) + 1;
+            pixel_idx += skip;
+            /* Clamp to max to prevent overflow in next iteration */
+            if (pixel_idx > max_pixels) pixel_idx = max_pixels;
+        } else {
+            /* Clip the run to the frame and to the bytes left in the stream */
+            int count = cmd;
+            if (count > max_pixels - pixel_idx) count = max_pixels - pixel_idx;
+            if (count > (int)((delta_size - pos) / 2)) count = (delta_size - pos) / 2;
+            run_xor(frame_buffer + pixel_idx, delta + pos, count);
+            if (TRACK_DIRTY) dirty_add_span(&dirty, pixel_idx, pixel_idx + count);
+            pixel_idx += count;
+            pos += count * 2;
+        }
+    }
+}
+
+/* Decode RLE Direct (no XOR, direct pixel values), starting at pixel start */
+static void apply_delta_rle_direct(const uint8_t *delta, size_t delta_size, int start) {
+    size_t pos = 0;
+    int pixel_idx = start;
+    int max_pixels = FRAME_W * FRAME_H;
+    
+    while (pos < delta_size) {
+        uint8_t cmd = delta[pos++];
+        
+        if (cmd == 0x00) {
+            break;
+        } else if (cmd & 0x80) {
+            int count = cmd & 0x7F;
+            /* Bounds check before reading 2 bytes */
+            if (pos + 1 >= delta_size) break;
+            uint16_t val = delta[pos] | (delta[pos + 1] << 8);
+            pos += 2;
+            if (count > max_pixels - pixel_idx) count = max_pixels - pixel_idx;
+            /* Every pixel is rewritten: only changed ones extend the dirty span */
+            if (TRACK_DIRTY) dirty_add_fill(pixel_idx, val, count);
+            run_fill(frame_buffer + pixel_idx, val, count);
+            pixel_idx += count;
+        } else {
+            int count = cmd;
+            if (count > max_pixels - pixel_idx) count = max_pixels - pixel_idx;
+            if (count > (int)((delta_size - pos) / 2)) count = (delta_size - pos) / 2;
+            if (TRACK_DIRTY) dirty_add_copy(pixel_idx, delta + pos, count);
+            run_copy(frame_buffer + pixel_idx, delta + pos, count);
+            pixel_idx += count;
+            pos += count * 2;
+        }
+    }
+}
+
+/* Decode Sparse XOR delta (position + value for changed pixels) */
+static void apply_delta_sparse_xor(const uint8_t *delta, size_t delta_size) {
+    if (delta_size < 2) return;
+    
+    size_t pos = 0;
+    int changed = delta[pos] | (delta[pos + 1] << 8);
+    pos += 2;
+    
+    for (int i = 0; i < changed && pos + 3 < delta_size; i++) {
+        int idx = delta[pos] | (delta[pos + 1] << 8);
+        uint16_t xor_val = delta[pos + 2] | (delta[pos + 3] << 8);
+        pos += 4;
+        
+        if (idx < FRAME_W * FRAME_H) {
+            frame_buffer[idx] ^= xor_val;
+            if (TRACK_DIRTY) dirty_add_span(&dirty, idx, idx + 1);
+        }
+    }
+}
+
+/* Decode Raw RGB565 (direct pixel values, no compression) */
+static void apply_delta_raw(const uint8_t *raw, size_t size) {
+    int pixels = size / 2;
+    if (pixels > FRAME_W * FRAME_H) pixels = FRAME_W * FRAME_H;
+    
+    run_copy(frame_buffer, raw, pixels);
+}
+
+#ifdef TILE_REF
+/* --- Tile codec (COMPRESS_METHOD 7, or tag 7 under 6) --- */
+/* 8x8 tiles in raster order. Copies read the previous frame from tile_ref, */
+/* which only gets the area decoded since the last tile frame copied back in */
+#define TILE 8
+#define TILES_X ((FRAME_W + TILE - 1) / TILE)
+#define TILES_N (TILES_X * ((FRAME_H + TILE - 1) / TILE))
+
+static uint16_t *tile_ref = NULL;
+static dirty_rect_t tile_stale;  /* Where frame_buffer may differ from tile_ref */
+
+/* Record that frame f has been decoded into frame_buffer */
+static inline void tile_mark_stale(int f) {
+#if TRACK_DIRTY
+    (void)f;
+    dirty_mark_full(&tile_stale);
+#else
+    dirty_add_frame(&tile_stale, f);
+#endif
+}
+
+static void tile_ref_sync(void) {
+    if (dirty_empty(&tile_stale)) return;
+    int bytes = (tile_stale.x1 - tile_stale.x0) * 2;
+    for (int y = tile_stale.y0; y < tile_stale.y1; y++) {
+        int o = y * FRAME_W + tile_stale.x0;
+        memcpy(tile_ref + o, frame_buffer + o, bytes);
+    }
+    dirty_reset(&tile_stale);
+}
+
+/* Pixel rect of tile t, clipped to the frame */
+static inline dirty_rect_t tile_rect(int t) {
+    dirty_rect_t r;
+    r.x0 = (t % TILES_X) * TILE;
+    r.y0 = (t / TILES_X) * TILE;
+    r.x1 = r.x0 + TILE < FRAME_W ? r.x0 + TILE : FRAME_W;
+    r.y1 = r.y0 + TILE < FRAME_H ? r.y0 + TILE : FRAME_H;
+    return r;
+}
+
+static void tile_copy(int t, int dx, int dy) {
+    dirty_rect_t r = tile_rect(t);
+    int sx = r.x0 + dx, sy = r.y0 + dy;
+    if (sx < 0 || sy < 0 || sx + (r.x1 - r.x0) > FRAME_W || sy + (r.y1 - r.y0) > FRAME_H) return;
+    
+    int bytes = (r.x1 - r.x0) * 2;
+    for (int y = r.y0; y < r.y1; y++, sy++) {
+        memcpy(frame_buffer + y * FRAME_W + r.x0, tile_ref + sy * FRAME_W + sx, bytes);
+    }
+    if (TRACK_DIRTY) dirty_union(&dirty, &r);
+}
+
+static void tile_fill(int t, uint16_t val) {
+    dirty_rect_t r = tile_rect(t);
+    for (int y = r.y0; y < r.y1; y++) {
+        uint16_t *row = frame_buffer + y * FRAME_W;
+        for (int x = r.x0; x < r.x1; x++) row[x] = val;
+    }
+    if (TRACK_DIRTY) dirty_union(&dirty, &r);
+}
+
+/* RLE XOR over the tile's pixels in place; returns the position after its 0x00 */
+static size_t tile_xor(int t, const uint8_t *delta, size_t delta_size, size_t pos) {
+    dirty_rect_t r = tile_rect(t);
+    int tw = r.x1 - r.x0;
+    int n = tw * (r.y1 - r.y0);
+    int i = 0;
+    
+    while (pos < delta_size) {
+        uint8_t cmd = delta[pos++];
+        if (cmd == 0x00) break;
+        if (cmd & 0x80) {
+            i += (cmd & 0x7F) + 1;
+            continue;
+        }
+        for (int k = 0; k < cmd && i < n; k++, i++) {
+            /* Bounds check before reading 2 bytes */
+            if (pos + 1 >= delta_size) return delta_size;
+            uint16_t xor_val = delta[pos] | (delta[pos + 1] << 8);
+            pos += 2;
+            frame_buffer[(r.y0 + i / tw) * FRAME_W + r.x0 + i % tw] ^= xor_val;
+        }
+    }
+    if (TRACK_DIRTY) dirty_union(&dirty, &r);
+    return pos;
+}
+
+/* Decode a tile stream; start is the first pixel of the frame's dirty rows */
+static void apply_delta_tile(const uint8_t *delta, size_t delta_size, int start) {
+    tile_ref_sync();
+    
+    size_t pos = 0;
+    int t = (start / FRAME_W / TILE) * TILES_X;
+    
+    while (pos < delta_size && t < TILES_N) {
+        uint8_t cmd = delta[pos++];
+        int n = (cmd & 0x3F) + 1;
+        
+        if (cmd == 0x00) {
+            break;
+        } else if (cmd < 0x40) {
+            /* Skip unchanged tiles, 0x3F carries a 16-bit count */
+            if (cmd == 0x3F) {
+                if (pos + 1 >= delta_size) break;
+                t += delta[pos] | (delta[pos + 1] << 8);
+                pos += 2;
+            } else {
+                t += cmd;
+            }
+        } else if (cmd < 0x80) {
+            /* Copy from the previous frame at a fixed displacement */
+            if (pos + 1 >= delta_size) break;
+            int dx = (int8_t)delta[pos];
+            int dy = (int8_t)delta[pos + 1];
+            pos += 2;
+            for (; n > 0 && t < TILES_N; n--) tile_copy(t++, dx, dy);
+        } else if (cmd < 0xC0) {
+            if (pos + 1 >= delta_size) break;
+            uint16_t val = delta[pos] | (delta[pos + 1] << 8);
+            pos += 2;
+            for (; n > 0 && t < TILES_N; n--) tile_fill(t++, val);
+        } else {
+            for (; n > 0 && t < TILES_N; n--) pos = tile_xor(t++, delta, delta_size, pos);
+        }
+    }
+}
+#endif
+
+#if COMPRESS_METHOD == 6
+/* Sparse indices are absolute, so the start row is not needed */
+static void apply_delta_sparse_tagged(const uint8_t *delta, size_t delta_size, int start) {
+    (void)start;
+    apply_delta_sparse_xor(delta, delta_size);
+}
+
+/* Per-frame codec: byte 0 of a delta stream selects its decoder */
+static void (*const delta_codecs[8])(const uint8_t *, size_t, int) = {
+    [0] = apply_delta_rle_xor,        /* RLE XOR */
+    [1] = apply_delta_rle_direct,     /* RLE Direct */
+    [2] = apply_delta_sparse_tagged,  /* Sparse XOR */
+#ifdef TILE_REF
+    [7] = apply_delta_tile,           /* 8x8 tiles */
+#endif
+};
+#endif
+
+#ifdef FRAME_ALPHA
+/* --- Alpha frames (generate_splash -a) --- */
+/* Frames carry a 4-bit coverage plane next to premultiplied colours. Each */
+/* delta has an alpha stream over the same rows (RLE XOR, see the generator): */
+/*   0x00 end, 0x01-0x7F N XOR nibbles (two per byte, low first), */
+/*   0x80-0xFF skip (cmd & 0x7F) + 1 pixels. */
+/* Before a blit the dirty region is blended over the background into comp_buffer: */
+/* out = fg + bg * (15 - a) / 15 per RGB565 channel. */
+#define ALPHA_MAX 15
+
+static uint8_t *alpha_buffer = NULL;    /* FRAME_W * FRAME_H coverage, 0-15 */
+static uint16_t *comp_buffer = NULL;    /* Blended frame, plus one BACKGROUND_COLOR row */
+
+static void apply_alpha(const uint8_t *delta, size_t delta_size, int start) {
+    size_t pos = 0;
+    int idx = start;
+    
+    while (pos < delta_size) {
+        uint8_t cmd = delta[pos++];
+        if (cmd == 0x00) break;
+        if (cmd & 0x80) {
+            idx += (cmd & 0x7F) + 1;
+            continue;
+        }
+        if (pos + (cmd + 1) / 2 > delta_size) break;
+        if (TRACK_DIRTY) dirty_add_span(&dirty, idx, idx + cmd);
+        for (int i = 0; i < cmd; i += 2) {
+            uint8_t b = delta[pos++];
+            alpha_buffer[idx + i] ^= b & 0x0F;
+            if (i + 1 < cmd) alpha_buffer[idx + i + 1] ^= b >> 4;
+        }
+        idx += cmd;
+    }
+}
+
+/* c * (15 - a) / 15 rounded, exact for c * (15 - a) <= 945: (v + 7) * 4370 >> 16 */
+static inline uint16_t blend_565(uint16_t fg, uint16_t bg, int a) {
+    int ia = ALPHA_MAX - a;
+    int r = (fg >> 11) + ((((bg >> 11) * ia + 7) * 4370) >> 16);
+    int g = ((fg >> 5) & 0x3F) + (((((bg >> 5) & 0x3F) * ia + 7) * 4370) >> 16);
+    int b = (fg & 0x1F) + ((((bg & 0x1F) * ia + 7) * 4370) >> 16);
+    if (r > 0x1F) r = 0x1F;
+    if (g > 0x3F) g = 0x3F;
+    if (b > 0x1F) b = 0x1F;
+    return (r << 11) | (g << 5) | b;
+}
+
+/* dst[0..n) = fg over bg, 8 pixels per step */
+static void blend_run(uint16_t *dst, const uint16_t *fg, const uint8_t *a, const uint16_t *bg, int n) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i amax = _mm_set1_epi16(ALPHA_MAX);
+    const __m128i round = _mm_set1_epi16(7);
+    const __m128i div15 = _mm_set1_epi16(4370);
+    const __m128i m5 = _mm_set1_epi16(0x1F);
+    const __m128i m6 = _mm_set1_epi16(0x3F);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i f = _mm_loadu_si128((const __m128i *)(fg + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(bg + i));
+        __m128i ia = _mm_sub_epi16(amax, _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(a + i)), zero));
+        __m128i br = _mm_mulhi_epu16(_mm_add_epi16(_mm_mullo_epi16(_mm_srli_epi16(b, 11), ia), round), div15);
+        __m128i bgc = _mm_mulhi_epu16(_mm_add_epi16(_mm_mullo_epi16(_mm_and_si128(_mm_srli_epi16(b, 5), m6), ia),
+                                                    round), div15);
+        __m128i bb = _mm_mulhi_epu16(_mm_add_epi16(_mm_mullo_epi16(_mm_and_si128(b, m5), ia), round), div15);
+        __m128i r = _mm_min_epi16(_mm_add_epi16(_mm_srli_epi16(f, 11), br), m5);
+        __m128i g = _mm_min_epi16(_mm_add_epi16(_mm_and_si128(_mm_srli_epi16(f, 5), m6), bgc), m6);
+        __m128i bl = _mm_min_epi16(_mm_add_epi16(_mm_and_si128(f, m5), bb), m5);
+        __m128i out = _mm_or_si128(_mm_or_si128(_mm_slli_epi16(r, 11), _mm_slli_epi16(g, 5)), bl);
+        _mm_storeu_si128((__m128i *)(dst + i), out);
+    }
+    for (; i < n; i++) dst[i] = blend_565(fg[i], bg[i], a[i]);
+}
+
+/* Blend rect r of the frame, placed at screen (x, y), into comp_buffer. */
+/* Pixels off the background image blend over BACKGROUND_COLOR. */
+static void alpha_compose(const dirty_rect_t *r, int x, int y) {
+    const uint16_t *fill = comp_buffer + FRAME_W * FRAME_H;
+    int bg_stride = bg_rect.x1 - bg_rect.x0;
+    for (int fy = r->y0; fy < r->y1; fy++) {
+        int o = fy * FRAME_W;
+        int sy = y + fy;
+        int x0 = r->x0, x1 = r->x1;
+        /* Columns over the image: [bx0, bx1) */
+        int bx0 = x0, bx1 = x0;
+        if (bg_buffer && sy >= bg_rect.y0 && sy < bg_rect.y1) {
+            bx0 = bg_rect.x0 - x > x0 ? bg_rect.x0 - x : x0;
+            bx1 = bg_rect.x1 - x < x1 ? bg_rect.x1 - x : x1;
+            if (bx0 > x1) bx0 = x1;
+            if (bx1 < bx0) bx1 = bx0;
+        }
+        if (bx0 > x0) {
+            blend_run(comp_buffer + o + x0, frame_buffer + o + x0, alpha_buffer + o + x0, fill, bx0 - x0);
+        }
+        if (bx1 > bx0) {
+            blend_run(comp_buffer + o + bx0, frame_buffer + o + bx0, alpha_buffer + o + bx0,
+                      bg_buffer + (sy - bg_rect.y0) * bg_stride + x + bx0 - bg_rect.x0, bx1 - bx0);
+        }
+        if (x1 > bx1) {
+            blend_run(comp_buffer + o + bx1, frame_buffer + o + bx1, alpha_buffer + o + bx1, fill, x1 - bx1);
+        }
+    }
+}
+
+/* Frames reach the screen through comp_buffer */
+#define FRAME_OUT comp_buffer
+#else
+#define FRAME_OUT frame_buffer
+#endif
+
+/* Apply delta of frame f based on compression method */
+static void apply_delta(const uint8_t *delta, size_t delta_size, int f) {
+#if COMPRESS_METHOD == 6
+    if (delta_size > 0 && delta[0] < 8 && delta_codecs[delta[0]]) {
+        delta_codecs[delta[0]](delta + 1, delta_size - 1, delta_start(f));
+    }
+#elif COMPRESS_METHOD == 7
+    apply_delta_tile(delta, delta_size, delta_start(f));
+#elif COMPRESS_METHOD == 0
+    apply_delta_rle_xor(delta, delta_size, delta_start(f));
+#elif COMPRESS_METHOD == 1
+    apply_delta_rle_direct(delta, delta_size, delta_start(f));
+#elif COMPRESS_METHOD == 2
+    apply_delta_sparse_xor(delta, delta_size);
+#elif COMPRESS_METHOD == 3
+    apply_delta_raw(delta, delta_size);
+    if (TRACK_DIRTY) dirty_mark_full(&dirty);
+#endif
+#ifdef FRAME_ALPHA
+    apply_alpha(alphas[f], alpha_sizes[f], delta_start(f));
+#endif
+#ifdef TILE_REF
+    tile_mark_stale(f);
+#endif
+    dirty_add_frame(&dirty, f);
+}
+
+/* Load frame 0 based on its own method (raw for headers without FRAME0_METHOD) */
+#ifndef FRAME0_METHOD
+#define FRAME0_METHOD 3
+#endif
+
+static void load_frame_0(const uint8_t *data, size_t size) {
+#if FRAME0_METHOD == 5
+    decompress_palette_lzss(data, size, frame0_palette, FRAME0_PALETTE_SIZE,
+                            frame_buffer, FRAME_W * FRAME_H);
+#elif FRAME0_METHOD == 1
+    apply_delta_rle_direct(data, size, 0);
+#else
+    apply_delta_raw(data, size);
+#endif
+#ifdef FRAME_ALPHA
+    memset(alpha_buffer, 0, FRAME_W * FRAME_H);
+    apply_alpha(alphas[0], alpha_sizes[0], 0);
+#endif
+    dirty_mark_full(&dirty);
+#ifdef TILE_REF
+    dirty_mark_full(&tile_stale);
+#endif
+}
+
+
+/* --- DRM/KMS via raw ioctls --- */
+
+/* Upper bounds for object lists queried into stack arrays */
+#define KMS_MAX_OBJS    32
+#define KMS_MAX_MODES   128
+
+/* On exit, leave the last frame scanned out for the next DRM master instead
+ * of restoring the previous CRTC (needs DRM_IOCTL_MODE_CLOSEFB, Linux 6.8) */
+#ifndef DRM_HANDOFF
+#define DRM_HANDOFF 1
+#endif
+
+/* One dumb buffer + DRM framebuffer object */
+typedef struct {
+    uint32_t fb_id;
+    uint32_t handle;
+    uint32_t pitch;
+    uint64_t size;
+    uint8_t *map;
+} kms_buf_t;
+
+typedef struct {
+    int fd;
+    
+    /* Connector and CRTC */
+    uint32_t conn_id;
+    uint32_t crtc_id;
+    struct drm_mode_modeinfo mode;
+    struct drm_mode_crtc saved_crtc;    /* Restored on exit (crtc_id 0 = none) */
+    int crtc_attached;      /* crtc_id already drives conn_id */
+    int foreign_scanout;    /* Mode kept: the CRTC still shows the previous master's fb */
+    
+    /* Framebuffers: bufs[front] is scanned out. With two buffers we draw
+     * into the other one and page flip; with one we draw into front. */
+    kms_buf_t bufs[2];
+    int nbufs;
+    int front;
+    int flip_pending;       /* Page flip queued, waiting for its event */
+    long flip_ns;           /* CLOCK_MONOTONIC vblank of the last completed flip, 0 = unknown */
+    long refresh_ns;        /* Refresh period of the mode, 0 = unknown */
+    int mono_stamps;        /* Flip event timestamps are CLOCK_MONOTONIC */
+    int no_dirtyfb;         /* Driver has no dirty callback: front writes are live */
+    
+    /* Dimensions */
+    uint32_t width;
+    uint32_t height;
+} kms_ctx_t;
+
+/* ioctl restarted on signals, like drmIoctl(); returns 0 or -errno */
+static int kms_ioctl(int fd, unsigned long req, void *arg) {
+    int ret;
+    do {
+        ret = ioctl(fd, req, arg);
+    } while (ret == -EINTR || ret == -EAGAIN);
+    return ret;
+}
+
+/* Pick the first connected connector and its preferred mode */
+static int kms_find_connector(kms_ctx_t *ctx, const uint32_t *conns, int nconns,
+                              uint32_t *encoders, int *nencoders, uint32_t *enc_id) {
+    struct drm_mode_modeinfo modes[KMS_MAX_MODES];
+    
+    for (int i = 0; i < nconns; i++) {
+        /* First pass with count_modes = 0 probes the connector and returns counts */
+        struct drm_mode_get_connector conn = { .connector_id = conns[i] };
+        if (kms_ioctl(ctx->fd, DRM_IOCTL_MODE_GETCONNECTOR, &conn) < 0) continue;
+        if (conn.connection != DRM_MODE_CONNECTED || conn.count_modes == 0) continue;
+        if (conn.count_modes > KMS_MAX_MODES || conn.count_encoders > KMS_MAX_OBJS) continue;
+        
+        /* Second pass fetches modes and encoders; no properties needed */
+        conn.modes_ptr = (uint64_t)modes;
+        conn.encoders_ptr = (uint64_t)encoders;
+        conn.count_props = 0;
+        if (kms_ioctl(ctx->fd, DRM_IOCTL_MODE_GETCONNECTOR, &conn) < 0) continue;
+        if (conn.count_modes == 0 || conn.count_modes > KMS_MAX_MODES ||
+            conn.count_encoders > KMS_MAX_OBJS) continue;
+        
+        int m = 0;
+        for (uint32_t j = 0; j < conn.count_modes; j++) {
+            if (modes[j].type & DRM_MODE_TYPE_PREFERRED) {
+                m = j;
+                break;
+            }
+        }
+        
+        ctx->conn_id = conn.connector_id;
+        ctx->mode = modes[m];
+        ctx->width = modes[m].hdisplay;
+        ctx->height = modes[m].vdisplay;
+        *nencoders = conn.count_encoders;
+        *enc_id = conn.encoder_id;
+        return 0;
+    }
+    
+    return -ENOENT;
+}
+
+static int kms_find_crtc(kms_ctx_t *ctx, const uint32_t *crtcs, int ncrtcs,
+                         const uint32_t *encoders, int nencoders, uint32_t enc_id) {
+    /* Try currently attached encoder first */
+    if (enc_id) {
+        struct drm_mode_get_encoder enc = { .encoder_id = enc_id };
+        if (kms_ioctl(ctx->fd, DRM_IOCTL_MODE_GETENCODER, &enc) == 0 && enc.crtc_id) {
+            ctx->crtc_id = enc.crtc_id;
+            ctx->crtc_attached = 1;
+            return 0;
+        }
+    }
+    
+    /* Find a CRTC that works with this connector */
+    for (int i = 0; i < nencoders; i++) {
+        struct drm_mode_get_encoder enc = { .encoder_id = encoders[i] };
+        if (kms_ioctl(ctx->fd, DRM_IOCTL_MODE_GETENCODER, &enc) < 0) continue;
+        
+        for (int j = 0; j < ncrtcs; j++) {
+            if (enc.possible_crtcs & (1u << j)) {
+                ctx->crtc_id = crtcs[j];
+                return 0;
+            }
+        }
+    }
+    
+    return -ENOENT;
+}
+
+static void kms_destroy_buf(int fd, kms_buf_t *buf) {
+    if (buf->map && buf->map != MAP_FAILED) {
+        munmap(buf->map, buf->size);
+    }
+    if (buf->fb_id) {
+        kms_ioctl(fd, DRM_IOCTL_MODE_RMFB, &buf->fb_id);
+    }
+    if (buf->handle) {
+        struct drm_mode_destroy_dumb dreq = { .handle = buf->handle };
+        kms_ioctl(fd, DRM_IOCTL_MODE_DESTROY_DUMB, &dreq);
+    }
+    memset(buf, 0, sizeof(*buf));
+}
+
+static int kms_create_buf(kms_ctx_t *ctx, kms_buf_t *buf) {
+    struct drm_mode_create_dumb creq = {
+        .width = ctx->width,
+        .height = ctx->height,
+        .bpp = 32
+    };
+    int ret = kms_ioctl(ctx->fd, DRM_IOCTL_MODE_CREATE_DUMB, &creq);
+    if (ret < 0) return ret;
+    
+    buf->handle = creq.handle;
+    buf->pitch = creq.pitch;
+    buf->size = creq.size;
+    
+    /* Create framebuffer (XRGB8888) */
+    struct drm_mode_fb_cmd fcmd = {
+        .width = ctx->width,
+        .height = ctx->height,
+        .pitch = buf->pitch,
+        .bpp = 32,
+        .depth = 24,
+        .handle = buf->handle
+    };
+    ret = kms_ioctl(ctx->fd, DRM_IOCTL_MODE_ADDFB, &fcmd);
+    if (ret < 0) {
+        kms_destroy_buf(ctx->fd, buf);
+        return ret;
+    }
+    buf->fb_id = fcmd.fb_id;
+    
+    /* Map dumb buffer */
+    struct drm_mode_map_dumb mreq = { .handle = buf->handle };
+    ret = kms_ioctl(ctx->fd, DRM_IOCTL_MODE_MAP_DUMB, &mreq);
+    if (ret < 0) {
+        kms_destroy_buf(ctx->fd, buf);
+        return ret;
+    }
+    
+    buf->map = mmap(NULL, buf->size, PROT_READ | PROT_WRITE, MAP_SHARED, ctx->fd, mreq.offset);
+    if ((unsigned long)buf->map >= (unsigned long)-4095) {
+        ret = (int)(long)buf->map;
+        buf->map = NULL;
+        kms_destroy_buf(ctx->fd, buf);
+        return ret;
+    }
+    
+    return 0;
+}
+
+static int kms_set_crtc(kms_ctx_t *ctx, uint32_t fb_id) {
+    struct drm_mode_crtc crtc = {
+        .set_connectors_ptr = (uint64_t)&ctx->conn_id,
+        .count_connectors = 1,
+        .crtc_id = ctx->crtc_id,
+        .fb_id = fb_id,
+        .mode_valid = 1,
+        .mode = ctx->mode
+    };
+    return kms_ioctl(ctx->fd, DRM_IOCTL_MODE_SETCRTC, &crtc);
+}
+
+/* Same timings as far as the hardware is concerned (name, type and vrefresh aside) */
+static int kms_mode_equal(const struct drm_mode_modeinfo *a, const struct drm_mode_modeinfo *b) {
+    return a->clock == b->clock &&
+           a->hdisplay == b->hdisplay && a->hsync_start == b->hsync_start &&
+           a->hsync_end == b->hsync_end && a->htotal == b->htotal && a->hskew == b->hskew &&
+           a->vdisplay == b->vdisplay && a->vsync_start == b->vsync_start &&
+           a->vsync_end == b->vsync_end && a->vtotal == b->vtotal && a->vscan == b->vscan &&
+           a->flags == b->flags;
+}
+
+static void kms_cleanup(kms_ctx_t *ctx);  /* forward declaration */
+
+static int kms_init(kms_ctx_t *ctx) {
+    static const char *const cards[] = { "/dev/dri/card0", "/dev/dri/card1", NULL };
+    uint32_t crtcs[KMS_MAX_OBJS], conns[KMS_MAX_OBJS], encoders[KMS_MAX_OBJS];
+    int fd = -1;
+    int ret;
+    
+    /* Open DRM device with dumb buffer support */
+    for (int i = 0; cards[i]; i++) {
+        fd = open(cards[i], O_RDWR | O_CLOEXEC, 0);
+        if (fd >= 0) {
+            struct drm_get_cap cap = { .capability = DRM_CAP_DUMB_BUFFER };
+            if (kms_ioctl(fd, DRM_IOCTL_GET_CAP, &cap) == 0 && cap.value) {
+                break;
+            }
+            close(fd);
+            fd = -1;
+        }
+    }
+    
+    if (fd < 0) {
+        write(2, "KMS: No device\n", 15);
+        return -ENODEV;
+    }
+    
+    ctx->fd = fd;
+    
+    /* Become DRM master (required for modesetting) */
+    if (kms_ioctl(fd, DRM_IOCTL_SET_MASTER, NULL) < 0) {
+        write(2, "KMS: Cannot become master\n", 26);
+        close(fd);
+        return -EBUSY;
+    }
+    
+    /* Get resources: counts first, then the CRTC and connector ids */
+    struct drm_mode_card_res res = {0};
+    ret = kms_ioctl(fd, DRM_IOCTL_MODE_GETRESOURCES, &res);
+    if (ret < 0 || res.count_crtcs > KMS_MAX_OBJS || res.count_connectors > KMS_MAX_OBJS) {
+        close(fd);
+        return ret < 0 ? ret : -ENOMEM;
+    }
+    res.fb_id_ptr = 0;
+    res.encoder_id_ptr = 0;
+    res.count_fbs = 0;
+    res.count_encoders = 0;
+    res.crtc_id_ptr = (uint64_t)crtcs;
+    res.connector_id_ptr = (uint64_t)conns;
+    ret = kms_ioctl(fd, DRM_IOCTL_MODE_GETRESOURCES, &res);
+    if (ret < 0) {
+        close(fd);
+        return ret;
+    }
+    
+    /* Find connected connector */
+    int nencoders = 0;
+    uint32_t enc_id = 0;
+    ret = kms_find_connector(ctx, conns, res.count_connectors, encoders, &nencoders, &enc_id);
+    if (ret < 0) {
+        write(2, "KMS: No connector\n", 18);
+        close(fd);
+        return ret;
+    }
+    
+    /* Find CRTC */
+    ret = kms_find_crtc(ctx, crtcs, res.count_crtcs, encoders, nencoders, enc_id);
+    if (ret < 0) {
+        write(2, "KMS: No CRTC\n", 13);
+        close(fd);
+        return ret;
+    }
+    
+    /* Create front + back buffers; without a back buffer render single-buffered */
+    ret = kms_create_buf(ctx, &ctx->bufs[0]);
+    if (ret < 0) {
+        write(2, "KMS: No framebuffer\n", 20);
+        close(fd);
+        return ret;
+    }
+    ctx->nbufs = (kms_create_buf(ctx, &ctx->bufs[1]) == 0) ? 2 : 1;
+    ctx->front = 0;
+    
+    /* Frame pacing can lock to vblank when the flip timestamps share our clock */
+    struct drm_get_cap mono = { .capability = DRM_CAP_TIMESTAMP_MONOTONIC };
+    ctx->mono_stamps = kms_ioctl(fd, DRM_IOCTL_GET_CAP, &mono) == 0 && mono.value;
+    if (ctx->mode.clock) {
+        ctx->refresh_ns = (long)ctx->mode.htotal * ctx->mode.vtotal * 1000000L / ctx->mode.clock;
+    }
+    
+    /* Save current CRTC state */
+    ctx->saved_crtc.crtc_id = ctx->crtc_id;
+    if (kms_ioctl(fd, DRM_IOCTL_MODE_GETCRTC, &ctx->saved_crtc) < 0) {
+        ctx->saved_crtc.crtc_id = 0;
+    }
+    
+    /* Firmware or fbcon already drives the connector in our mode: skip the
+     * modeset (no resync, no black frame) and let the first present flip
+     * our buffer over theirs */
+    struct drm_mode_crtc *cur = &ctx->saved_crtc;
+    if (ctx->crtc_attached && cur->crtc_id && cur->mode_valid && cur->fb_id &&
+        cur->x == 0 && cur->y == 0 && kms_mode_equal(&cur->mode, &ctx->mode)) {
+        ctx->foreign_scanout = 1;
+        return 0;
+    }
+    
+    /* Set mode */
+    ret = kms_set_crtc(ctx, ctx->bufs[ctx->front].fb_id);
+    if (ret < 0) {
+        write(2, "KMS: CRTC failed\n", 17);
+        kms_cleanup(ctx);
+        return ret;
+    }
+    
+    return 0;
+}
+
+/* Block until the queued page flip has completed (next vblank).
+ * Must be called before drawing into the back buffer again. */
+static void kms_wait_flip(kms_ctx_t *ctx) {
+    struct pollfd pfd = { .fd = ctx->fd, .events = POLLIN };
+    struct timespec timeout = { .tv_sec = 1 };
+    char buf[256];
+    
+    /* Signals are handled during the wait, but the flip is still waited for */
+    while (ctx->flip_pending) {
+        int ret = ppoll(&pfd, 1, &timeout, &wait_sigmask);
+        if (ret == -EINTR) continue;
+        if (ret <= 0) {
+            /* Event lost or device gone: don't hang the splash */
+            ctx->flip_pending = 0;
+            break;
+        }
+        
+        ssize_t n = read(ctx->fd, buf, sizeof(buf));
+        if (n == -EINTR || n == -EAGAIN) continue;
+        if (n < (ssize_t)sizeof(struct drm_event)) {
+            ctx->flip_pending = 0;
+            break;
+        }
+        
+        /* Walk the events; only flip completion matters */
+        for (ssize_t i = 0; i + (ssize_t)sizeof(struct drm_event) <= n; ) {
+            struct drm_event *ev = (struct drm_event *)(buf + i);
+            if (ev->length < sizeof(struct drm_event)) break;
+            if (ev->type == DRM_EVENT_FLIP_COMPLETE) {
+                ctx->flip_pending = 0;
+                if (ev->length >= sizeof(struct drm_event_vblank)) {
+                    struct drm_event_vblank *vbl = (struct drm_event_vblank *)ev;
+                    ctx->flip_ns = vbl->tv_sec * 1000000000L + vbl->tv_usec * 1000L;
+                }
+            }
+            i += ev->length;
+        }
+    }
+}
+
+/* Buffer to draw the next frame into */
+static inline kms_buf_t *kms_back(kms_ctx_t *ctx) {
+    return &ctx->bufs[ctx->nbufs == 2 ? ctx->front ^ 1 : ctx->front];
+}
+
+/* Present the back buffer. (x, y, w, h) is the changed screen region,
+ * used to flush single-buffered drivers that need it (virtio, udl, ...). */
+static void kms_present(kms_ctx_t *ctx, int x, int y, int w, int h) {
+    if (ctx->nbufs == 2 || ctx->foreign_scanout) {
+        int back = ctx->nbufs == 2 ? ctx->front ^ 1 : ctx->front;
+        int foreign = ctx->foreign_scanout;
+        ctx->foreign_scanout = 0;
+        struct drm_mode_crtc_page_flip flip = {
+            .crtc_id = ctx->crtc_id,
+            .fb_id = ctx->bufs[back].fb_id,
+            .flags = DRM_MODE_PAGE_FLIP_EVENT,
+            .user_data = (uint64_t)ctx
+        };
+        if (kms_ioctl(ctx->fd, DRM_IOCTL_MODE_PAGE_FLIP, &flip) == 0) {
+            ctx->flip_pending = 1;
+            ctx->front = back;
+            return;
+        }
+        
+        /* No page flip support: scan out what we just drew, and keep
+         * rendering single-buffered into it from now on. Flipping away
+         * from a foreign fb can also fail on a format or pitch change
+         * alone; that costs the one modeset, not the back buffer. */
+        kms_set_crtc(ctx, ctx->bufs[back].fb_id);
+        ctx->front = back;
+        if (!foreign) ctx->nbufs = 1;
+        return;
+    }
+    
+    /* Single-buffered: front writes are live unless the driver needs a flush */
+    if (ctx->no_dirtyfb) return;
+    
+    if (x < 0) { w += x; x = 0; }
+    if (y < 0) { h += y; y = 0; }
+    if (x + w > (int)ctx->width) w = ctx->width - x;
+    if (y + h > (int)ctx->height) h = ctx->height - y;
+    if (w <= 0 || h <= 0) return;
+    
+    struct drm_clip_rect clip = {
+        .x1 = x, .y1 = y,
+        .x2 = x + w, .y2 = y + h
+    };
+    struct drm_mode_fb_dirty_cmd dcmd = {
+        .fb_id = ctx->bufs[ctx->front].fb_id,
+        .num_clips = 1,
+        .clips_ptr = (uint64_t)&clip
+    };
+    if (kms_ioctl(ctx->fd, DRM_IOCTL_MODE_DIRTYFB, &dcmd) == -ENOSYS) {
+        ctx->no_dirtyfb = 1;
+    }
+}
+
+/* Hand the scanned-out frame to whoever opens the device next: CLOSEFB drops
+ * our handle without disabling the CRTC (RMFB and close() would), and the
+ * previous CRTC state is not restored. Older kernels keep the previous
+ * behaviour; returns 0 then. */
+static int kms_handoff(kms_ctx_t *ctx) {
+    if (ctx->foreign_scanout) return 0;  /* Nothing of ours on screen yet */
+    
+    kms_wait_flip(ctx);
+    struct drm_mode_closefb cfb = { .fb_id = ctx->bufs[ctx->front].fb_id };
+    if (kms_ioctl(ctx->fd, DRM_IOCTL_MODE_CLOSEFB, &cfb) < 0) return 0;
+    
+    ctx->bufs[ctx->front].fb_id = 0;
+    ctx->saved_crtc.crtc_id = 0;
+    return 1;
+}
+
+static void kms_cleanup(kms_ctx_t *ctx) {
+    if (!ctx || ctx->fd < 0) return;
+    
+    /* Never tear down a buffer the kernel is still flipping to */
+    kms_wait_flip(ctx);
+    
+    /* Restore previous CRTC state */
+    if (ctx->saved_crtc.crtc_id) {
+        ctx->saved_crtc.set_connectors_ptr = (uint64_t)&ctx->conn_id;
+        ctx->saved_crtc.count_connectors = 1;
+        kms_ioctl(ctx->fd, DRM_IOCTL_MODE_SETCRTC, &ctx->saved_crtc);
+    }
+    
+    /* Release DRM master */
+    kms_ioctl(ctx->fd, DRM_IOCTL_DROP_MASTER, NULL);
+    
+    /* Unmap, remove framebuffers and destroy dumb buffers */
+    for (int i = 0; i < 2; i++) {
+        kms_destroy_buf(ctx->fd, &ctx->bufs[i]);
+    }
+    
+    close(ctx->fd);
+    ctx->fd = -1;
+}
+
+/* --- CPU feature detection --- */
+/* Baseline is x86-64 + SSE2; the AVX2 kernel has a per-function target */
+/* attribute and is only called when the CPU and kernel support it */
+#define CPU_AVX2    (1 << 1)
+
+static int cpu_features = 0;
+
+static inline void cpuid(uint32_t leaf, uint32_t sub,
+                         uint32_t *a, uint32_t *b, uint32_t *c, uint32_t *d) {
+    __asm__ volatile ("cpuid" : "=a"(*a), "=b"(*b), "=c"(*c), "=d"(*d) : "a"(leaf), "c"(sub));
+}
+
+static void cpu_detect(void) {
+    uint32_t a, b, c, d;
+    
+    cpuid(0, 0, &a, &b, &c, &d);
+    uint32_t max_leaf = a;
+    
+    /* AVX2 also needs the kernel to save YMM state: OSXSAVE + AVX, XCR0 bits 1-2 */
+    cpuid(1, 0, &a, &b, &c, &d);
+    if (max_leaf >= 7 && (c & (1 << 27)) && (c & (1 << 28))) {
+        uint32_t xcr0_lo, xcr0_hi;
+        __asm__ volatile ("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+        if ((xcr0_lo & 6) == 6) {
+            cpuid(7, 0, &a, &b, &c, &d);
+            if (b & (1 << 5)) cpu_features |= CPU_AVX2;
+        }
+    }
+}
+
+/* --- Blitting (SSE2/AVX2, XRGB8888 dumb buffers) --- */
+
+/* Dumb buffers are write-combined (or uncached) mappings of video memory:
+ * plain stores there are slow, movntdq/movnti fill whole WC lines without
+ * touching the cache. Each streaming blit/fill ends with one sfence. */
+static int fb_stream = 1;
+
+/* Expand 8 RGB565 pixels to XRGB8888 */
+static inline __attribute__((always_inline))
+void rgb565_to_xrgb8888_sse2(__m128i pixels, __m128i *out_lo, __m128i *out_hi) {
+    /* Expand to 32-bit: unpack low and high 4 pixels */
+    __m128i lo = _mm_unpacklo_epi16(pixels, _mm_setzero_si128());
+    __m128i hi = _mm_unpackhi_epi16(pixels, _mm_setzero_si128());
+    
+    /* RGB565 layout: RRRRRGGGGGGBBBBB (R5@11-15, G6@5-10, B5@0-4) */
+    /* XRGB8888 target: R@16-23, G@8-15, B@0-7 */
+    
+    /* R5 (bits 11-15) -> R8 (bits 16-23): shift left by 5 (to bit 16), then 3 more for expansion */
+    __m128i r_mask = _mm_set1_epi32(0x0000F800);
+    __m128i r_lo = _mm_slli_epi32(_mm_and_si128(lo, r_mask), 5 + 3);
+    __m128i r_hi = _mm_slli_epi32(_mm_and_si128(hi, r_mask), 5 + 3);
+    
+    /* G6 (bits 5-10) -> G8 (bits 8-15): shift left by 3 (to bit 8), then 2 more for expansion */
+    __m128i g_mask = _mm_set1_epi32(0x000007E0);
+    __m128i g_lo = _mm_slli_epi32(_mm_and_si128(lo, g_mask), 3 + 2);
+    __m128i g_hi = _mm_slli_epi32(_mm_and_si128(hi, g_mask), 3 + 2);
+    
+    /* B5 (bits 0-4) -> B8 (bits 0-7): just expand by 3 */
+    __m128i b_mask = _mm_set1_epi32(0x0000001F);
+    __m128i b_lo = _mm_slli_epi32(_mm_and_si128(lo, b_mask), 3);
+    __m128i b_hi = _mm_slli_epi32(_mm_and_si128(hi, b_mask), 3);
+    
+    /* Combine R, G, B */
+    *out_lo = _mm_or_si128(_mm_or_si128(r_lo, g_lo), b_lo);
+    *out_hi = _mm_or_si128(_mm_or_si128(r_hi, g_hi), b_hi);
+}
+
+static inline uint32_t rgb565_to_xrgb8888(uint16_t pixel) {
+    uint32_t r = (pixel >> 11) & 0x1F;
+    uint32_t g = (pixel >> 5) & 0x3F;
+    uint32_t b = pixel & 0x1F;
+    return (r << 19) | (g << 10) | (b << 3);  /* XRGB8888: R@16, G@8, B@0 */
+}
+
+/* SSE2 optimized RGB565 to XRGB8888 conversion - processes 8 pixels at once
+ * Regular 16-byte stores, for cached destinations */
+static void blit_rgb565_to_xrgb8888_sse2(uint32_t *dst, const uint16_t *src, int count) {
+    int i = 0;
+    
+    /* Process 8 pixels at a time */
+    for (; i + 7 < count; i += 8) {
+        __m128i lo, hi;
+        rgb565_to_xrgb8888_sse2(_mm_loadu_si128((__m128i const *)(src + i)), &lo, &hi);
+        _mm_storeu_si128((__m128i *)(dst + i), lo);
+        _mm_storeu_si128((__m128i *)(dst + i + 4), hi);
+    }
+    
+    /* Handle remaining pixels with scalar code */
+    for (; i < count; i++) {
+        dst[i] = rgb565_to_xrgb8888(src[i]);
+    }
+}
+
+/* Streaming variant for VRAM: movnti head up to 16-byte alignment, then
+ * movntdq (32 bytes per 8 pixels); caller issues the sfence */
+static void blit_rgb565_to_xrgb8888_sse2_nt(uint32_t *dst, const uint16_t *src, int count) {
+    int i = 0;
+    
+    for (; i < count && ((unsigned long)(dst + i) & 15); i++) {
+        _mm_stream_si32((int *)(dst + i), (int)rgb565_to_xrgb8888(src[i]));
+    }
+    
+    for (; i + 7 < count; i += 8) {
+        __m128i lo, hi;
+        rgb565_to_xrgb8888_sse2(_mm_loadu_si128((__m128i const *)(src + i)), &lo, &hi);
+        _mm_stream_si128((__m128i *)(dst + i), lo);
+        _mm_stream_si128((__m128i *)(dst + i + 4), hi);
+    }
+    
+    for (; i < count; i++) {
+        _mm_stream_si32((int *)(dst + i), (int)rgb565_to_xrgb8888(src[i]));
+    }
+}
+
+/* AVX2 variant: 16 pixels (64 bytes, one WC line) per iteration.
+ * With stream: movnti head up to 32-byte alignment, then vmovntdq */
+__attribute__((target("avx2")))
+static void blit_rgb565_to_xrgb8888_avx2(uint32_t *dst, const uint16_t *src, int count, int stream) {
+    const __m256i r_mask = _mm256_set1_epi32(0x0000F800);
+    const __m256i g_mask = _mm256_set1_epi32(0x000007E0);
+    const __m256i b_mask = _mm256_set1_epi32(0x0000001F);
+    int i = 0;
+    
+    if (stream) {
+        for (; i < count && ((unsigned long)(dst + i) & 31); i++) {
+            _mm_stream_si32((int *)(dst + i), (int)rgb565_to_xrgb8888(src[i]));
+        }
+    }
+    
+    for (; i + 15 < count; i += 16) {
+        __m256i v[2];
+        for (int k = 0; k < 2; k++) {
+            __m256i p = _mm256_cvtepu16_epi32(_mm_loadu_si128((__m128i const *)(src + i + k * 8)));
+            __m256i r = _mm256_slli_epi32(_mm256_and_si256(p, r_mask), 5 + 3);
+            __m256i g = _mm256_slli_epi32(_mm256_and_si256(p, g_mask), 3 + 2);
+            __m256i b = _mm256_slli_epi32(_mm256_and_si256(p, b_mask), 3);
+            v[k] = _mm256_or_si256(_mm256_or_si256(r, g), b);
+        }
+        if (stream) {
+            _mm256_stream_si256((__m256i *)(dst + i), v[0]);
+            _mm256_stream_si256((__m256i *)(dst + i + 8), v[1]);
+        } else {
+            _mm256_storeu_si256((__m256i *)(dst + i), v[0]);
+            _mm256_storeu_si256((__m256i *)(dst + i + 8), v[1]);
+        }
+    }
+    
+    for (; i < count; i++) {
+        uint32_t pixel = rgb565_to_xrgb8888(src[i]);
+        if (stream) {
+            _mm_stream_si32((int *)(dst + i), (int)pixel);
+        } else {
+            dst[i] = pixel;
+        }
+    }
+}
+
+/* Blit RGB565 frame to XRGB8888 DRM framebuffer
+ * stride is the source row pitch in pixels, so sub-rectangles of a frame can be blitted */
+static void blit_to_drm(uint8_t *fb, int fb_w, int fb_h, int fb_pitch,
+                        const uint16_t *frame, int stride, int fw, int fh, int x, int y) {
+    /* Clip to framebuffer bounds */
+    if (x < 0) { fw += x; frame -= x; x = 0; }
+    if (y < 0) { fh += y; frame -= y * stride; y = 0; }
+    if (x + fw > fb_w) fw = fb_w - x;
+    if (y + fh > fb_h) fh = fb_h - y;
+    if (fw <= 0 || fh <= 0) return;
+    
+    /* Convert RGB565 to XRGB8888 with SSE2 - row by row */
+    for (int row = 0; row < fh; row++) {
+        uint32_t *dst = (uint32_t *)(fb + (y + row) * fb_pitch + x * 4);
+        const uint16_t *src = frame + row * stride;
+        if (cpu_features & CPU_AVX2) {
+            blit_rgb565_to_xrgb8888_avx2(dst, src, fw, fb_stream);
+        } else if (fb_stream) {
+            blit_rgb565_to_xrgb8888_sse2_nt(dst, src, fw);
+        } else {
+            blit_rgb565_to_xrgb8888_sse2(dst, src, fw);
+        }
+    }
+    
+    if (fb_stream) _mm_sfence();
+}
+
+/* Fill framebuffer with solid color - SSE2 optimized for VRAM */
+static void fill_fb_color(uint8_t *fb, int fb_w, int fb_h, int fb_pitch, uint16_t color) {
+    uint32_t pixel = rgb565_to_xrgb8888(color);
+    __m128i vpixel = _mm_set1_epi32((int)pixel);
+    
+    for (int y = 0; y < fb_h; y++) {
+        uint32_t *dst = (uint32_t *)(fb + y * fb_pitch);
+        int x = 0;
+        
+        if (fb_stream) {
+            /* Head up to 16-byte alignment, then one 64-byte WC line per iteration */
+            for (; x < fb_w && ((unsigned long)(dst + x) & 15); x++) {
+                _mm_stream_si32((int *)(dst + x), (int)pixel);
+            }
+            for (; x + 15 < fb_w; x += 16) {
+                _mm_stream_si128((__m128i *)(dst + x), vpixel);
+                _mm_stream_si128((__m128i *)(dst + x + 4), vpixel);
+                _mm_stream_si128((__m128i *)(dst + x + 8), vpixel);
+                _mm_stream_si128((__m128i *)(dst + x + 12), vpixel);
+            }
+            for (; x + 3 < fb_w; x += 4) {
+                _mm_stream_si128((__m128i *)(dst + x), vpixel);
+            }
+            for (; x < fb_w; x++) {
+                _mm_stream_si32((int *)(dst + x), (int)pixel);
+            }
+            continue;
+        }
+        
+        /* Fill 4 pixels (16 bytes) at a time */
+        for (; x + 3 < fb_w; x += 4) {
+            _mm_storeu_si128((__m128i *)(dst + x), vpixel);
+        }
+        
+        /* Handle remaining pixels */
+        for (; x < fb_w; x++) {
+            dst[x] = pixel;
+        }
+    }
+    
+    if (fb_stream) _mm_sfence();
+}
+
+/* --- Background image (modes 1/2) --- */
+/* The device is opened and BACKGROUND_COLOR plus frame 0 presented before */
+/* the background is decoded; it is then streamed BG_BAND_ROWS rows at a */
+/* time through a scratch band into every buffer, each band going on screen */
+/* as soon as it is done. Frames cover their area, so once drawn the image */
+/* is only needed where alpha frames are blended over it: bg_buffer keeps */
+/* just that part (bg_rect), not a screen-sized copy. */
+#if DISPLAY_MODE == 1 || DISPLAY_MODE == 2
+#ifndef BG_BAND_ROWS
+#define BG_BAND_ROWS 64
+#endif
+
+/* Background variants (generate_splash -r WxH,WxH,...): the closest to the */
+/* mode is drawn, resampled to it within BG_SCALE_PCT percent, as in the */
+/* fbdev version. */
+#define BG_FULLSCREEN (DISPLAY_MODE == 2)
+#ifndef BG_SCALE_PCT
+#define BG_SCALE_PCT 25
+#endif
+
+/* One resolution of the background */
+typedef struct {
+    int w, h;
+    int palette_size;
+    uint32_t size;
+    const uint16_t *palette;
+    const uint8_t *data;
+} bg_image_t;
+
+static int bg_variant_count(void) {
+#ifdef BG_VARIANTS
+    return BG_VARIANTS;
+#else
+    return 1;
+#endif
+}
+
+/* Variant i; 0 is BG_W x BG_H */
+static void bg_variant(int i, bg_image_t *img) {
+#ifdef BG_VARIANTS
+    img->w = bg_variant_dims[i][0];
+    img->h = bg_variant_dims[i][1];
+    img->palette_size = bg_variant_palette_sizes[i];
+    img->size = bg_variant_sizes[i];
+    img->palette = bg_variant_palettes[i];
+    img->data = bg_variant_data[i];
+#else
+    (void)i;
+    img->w = BG_W;
+    img->h = BG_H;
+    img->palette_size = BG_PALETTE_SIZE;
+    img->size = BG_COMPRESSED_SIZE;
+    img->palette = bg_palette;
+    img->data = bg_compressed;
+#endif
+}
+
+/* The variant closest to a w x h screen into img, and the size it is drawn */
+/* at into (*dw, *dh) */
+static void bg_pick(int w, int h, bg_image_t *img, int *dw, int *dh) {
+    long best = -1;
+    for (int i = 0; i < bg_variant_count(); i++) {
+        bg_image_t v;
+        bg_variant(i, &v);
+        /* Mismatch in per mille of the screen, both directions */
+        int ex = v.w > w ? v.w - w : w - v.w;
+        int ey = v.h > h ? v.h - h : h - v.h;
+        long cost = (long)ex * 1000 / w + (long)ey * 1000 / h;
+        if (best < 0 || cost < best) {
+            best = cost;
+            *img = v;
+        }
+    }
+    
+    *dw = img->w;
+    *dh = img->h;
+    int ex = img->w > w ? img->w - w : w - img->w;
+    int ey = img->h > h ? img->h - h : h - img->h;
+    if (BG_FULLSCREEN && BG_SCALE_PCT > 0 && (ex || ey) &&
+        ex * 100 <= w * BG_SCALE_PCT && ey * 100 <= h * BG_SCALE_PCT) {
+        *dw = w;
+        *dh = h;
+    }
+}
+
+/* a + (b - a) * w / 256 rounded, per RGB565 channel, w 0-255 */
+static inline uint16_t lerp_565(uint16_t a, uint16_t b, int w) {
+    int r = (a >> 11) + ((((b >> 11) - (a >> 11)) * w + 128) >> 8);
+    int g = ((a >> 5) & 0x3F) + (((((b >> 5) & 0x3F) - ((a >> 5) & 0x3F)) * w + 128) >> 8);
+    int bl = (a & 0x1F) + ((((b & 0x1F) - (a & 0x1F)) * w + 128) >> 8);
+    return (r << 11) | (g << 5) | bl;
+}
+
+/* lerp_565 on 8 pixels */
+static inline __m128i lerp_565_x8(__m128i a, __m128i b, __m128i w) {
+    const __m128i m5 = _mm_set1_epi16(0x1F);
+    const __m128i m6 = _mm_set1_epi16(0x3F);
+    const __m128i half = _mm_set1_epi16(128);
+    __m128i ar = _mm_srli_epi16(a, 11), br = _mm_srli_epi16(b, 11);
+    __m128i ag = _mm_and_si128(_mm_srli_epi16(a, 5), m6), bg = _mm_and_si128(_mm_srli_epi16(b, 5), m6);
+    __m128i ab = _mm_and_si128(a, m5), bb = _mm_and_si128(b, m5);
+    __m128i r = _mm_add_epi16(ar, _mm_srai_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_sub_epi16(br, ar), w), half), 8));
+    __m128i g = _mm_add_epi16(ag, _mm_srai_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_sub_epi16(bg, ag), w), half), 8));
+    __m128i bl = _mm_add_epi16(ab, _mm_srai_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_sub_epi16(bb, ab), w), half), 8));
+    return _mm_or_si128(_mm_or_si128(_mm_slli_epi16(r, 11), _mm_slli_epi16(g, 5)), bl);
+}
+
+/* Background rows at the drawn size: straight from the LZSS stream, or */
+/* resampled bilinearly from it, 16.16 fixed point with pixel centres */
+/* aligned. Source rows are decoded one at a time as the output needs them. */
+typedef struct {
+    lzss_stream_t lzss;
+    int src_w, src_h, dst_w, dst_h;
+    int y;                          /* Next output row */
+    int top;                        /* Source row in row[0], row[1] holds the next */
+    uint16_t *row[2], *vrow;        /* src_w + 1 pixels each */
+    uint16_t *xs, *wx;              /* Per output column: source column, weight 0-255 */
+} bg_reader_t;
+
+/* Scratch bytes bg_begin needs to draw img at dw x dh */
+static long bg_scratch_size(const bg_image_t *img, int dw, int dh) {
+    if (dw == img->w && dh == img->h) return 0;
+    return (3L * (img->w + 1) + 2L * dw) * 2;
+}
+
+/* Source position for output o: index and 8-bit weight of the next one */
+static inline void bg_map(int o, int src, int dst, int *idx, int *w) {
+    long p = ((2L * o + 1) * src << 15) / dst - 32768;
+    if (p < 0) p = 0;
+    *idx = p >> 16;
+    *w = (p >> 8) & 255;
+    if (*idx >= src - 1) {
+        *idx = src - 1;
+        *w = 0;
+    }
+}
+
+static void bg_begin(bg_reader_t *rd, const bg_image_t *img, int dw, int dh, uint16_t *scratch) {
+    lzss_begin(&rd->lzss, img->data, img->size, img->palette, img->palette_size);
+    rd->src_w = img->w;
+    rd->src_h = img->h;
+    rd->dst_w = dw;
+    rd->dst_h = dh;
+    rd->y = 0;
+    if (!scratch) return;
+    
+    rd->row[0] = scratch;
+    rd->row[1] = rd->row[0] + img->w + 1;
+    rd->vrow = rd->row[1] + img->w + 1;
+    rd->xs = rd->vrow + img->w + 1;
+    rd->wx = rd->xs + dw;
+    for (int x = 0; x < dw; x++) {
+        int idx, w;
+        bg_map(x, img->w, dw, &idx, &w);
+        rd->xs[x] = idx;
+        rd->wx[x] = w;
+    }
+    
+    rd->top = 0;
+    lzss_decode(&rd->lzss, rd->row[0], img->w);
+    if (img->h > 1) {
+        lzss_decode(&rd->lzss, rd->row[1], img->w);
+    } else {
+        memcpy(rd->row[1], rd->row[0], img->w * 2);
+    }
+}
+
+/* The next rows output rows into out, dst_w pixels apart */
+static void bg_read(bg_reader_t *rd, uint16_t *out, int rows) {
+    if (rd->src_w == rd->dst_w && rd->src_h == rd->dst_h) {
+        lzss_decode(&rd->lzss, out, rows * rd->dst_w);
+        rd->y += rows;
+        return;
+    }
+    
+    int sw = rd->src_w;
+    for (int r = 0; r < rows; r++, rd->y++) {
+        int sy, wy;
+        bg_map(rd->y, rd->src_h, rd->dst_h, &sy, &wy);
+        while (rd->top < sy) {
+            uint16_t *t = rd->row[0];
+            rd->row[0] = rd->row[1];
+            rd->row[1] = t;
+            if (++rd->top + 1 < rd->src_h) {
+                lzss_decode(&rd->lzss, rd->row[1], sw);
+            } else {
+                memcpy(rd->row[1], rd->row[0], sw * 2);
+            }
+        }
+        
+        /* Between the two source rows, then between columns */
+        const uint16_t *a = rd->row[0], *b = rd->row[1];
+        uint16_t *v = rd->vrow;
+        __m128i vwy = _mm_set1_epi16(wy);
+        int i = 0;
+        for (; i + 8 <= sw; i += 8) {
+            __m128i pa = _mm_loadu_si128((const __m128i *)(a + i));
+            __m128i pb = _mm_loadu_si128((const __m128i *)(b + i));
+            _mm_storeu_si128((__m128i *)(v + i), lerp_565_x8(pa, pb, vwy));
+        }
+        for (; i < sw; i++) v[i] = lerp_565(a[i], b[i], wy);
+        v[sw] = v[sw - 1];
+        
+        uint16_t *dst = out + r * rd->dst_w;
+        const uint16_t *xs = rd->xs;
+        int x = 0;
+        for (; x + 8 <= rd->dst_w; x += 8) {
+            __m128i pa = _mm_setr_epi16(v[xs[x]], v[xs[x + 1]], v[xs[x + 2]], v[xs[x + 3]],
+                                        v[xs[x + 4]], v[xs[x + 5]], v[xs[x + 6]], v[xs[x + 7]]);
+            __m128i pb = _mm_setr_epi16(v[xs[x] + 1], v[xs[x + 1] + 1], v[xs[x + 2] + 1], v[xs[x + 3] + 1],
+                                        v[xs[x + 4] + 1], v[xs[x + 5] + 1], v[xs[x + 6] + 1], v[xs[x + 7] + 1]);
+            __m128i w = _mm_loadu_si128((const __m128i *)(rd->wx + x));
+            _mm_storeu_si128((__m128i *)(dst + x), lerp_565_x8(pa, pb, w));
+        }
+        for (; x < rd->dst_w; x++) dst[x] = lerp_565(v[xs[x]], v[xs[x] + 1], rd->wx[x]);
+    }
+}
+
+/* Image rows [by0, by1), w pixels wide from src, around the hole [hx0, hx1), */
+/* into every buffer; single-buffered drivers get the rows flushed */
+static void bg_blit_band(kms_ctx_t *ctx, const uint16_t *src, int w, int by0, int by1, int hx0, int hx1) {
+    if (by1 <= by0) return;
+    if (hx0 < 0) hx0 = 0;
+    if (hx1 > w) hx1 = w;
+    if (hx1 <= hx0) {
+        hx0 = w;
+        hx1 = w;
+    }
+    for (int i = 0; i < ctx->nbufs; i++) {
+        kms_buf_t *buf = &ctx->bufs[i];
+        if (hx0 > 0) {
+            blit_to_drm(buf->map, ctx->width, ctx->height, buf->pitch,
+                        src, w, hx0, by1 - by0, 0, by0);
+        }
+        if (hx1 < w) {
+            blit_to_drm(buf->map, ctx->width, ctx->height, buf->pitch,
+                        src + hx1, w, w - hx1, by1 - by0, hx1, by0);
+        }
+    }
+    if (ctx->nbufs == 1) kms_present(ctx, 0, by0, w, by1 - by0);
+}
+
+/* Decode the background closest to the mode into every buffer, around */
+/* frame 0 at (x, y) unless frames are blended (nothing is over the */
+/* background yet then), keeping bg_rect of it in bg_buffer. Without memory */
+/* for the band the screen stays on the solid colour. */
+static void bg_load(kms_ctx_t *ctx, int x, int y) {
+    bg_image_t img;
+    int bw, bh;
+    bg_pick(ctx->width, ctx->height, &img, &bw, &bh);
+    long band_size = (long)bw * BG_BAND_ROWS * 2 + bg_scratch_size(&img, bw, bh);
+    uint16_t *band = mmap(NULL, band_size, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (band == MAP_FAILED) return;
+    
+    /* Part of the image blended over later, clipped to it */
+    dirty_rect_t keep = { bw, bh, 0, 0 };
+#ifdef FRAME_ALPHA
+    dirty_rect_t under = { x, y, x + FRAME_W, y + FRAME_H };
+    dirty_union(&keep, &under);
+#endif
+    if (keep.x0 < 0) keep.x0 = 0;
+    if (keep.y0 < 0) keep.y0 = 0;
+    if (keep.x1 > bw) keep.x1 = bw;
+    if (keep.y1 > bh) keep.y1 = bh;
+    int keep_w = keep.x1 - keep.x0;
+    if (!dirty_empty(&keep)) {
+        bg_buffer = mmap(NULL, keep_w * (keep.y1 - keep.y0) * 2, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+        if (bg_buffer == MAP_FAILED) bg_buffer = NULL;
+    }
+    bg_rect = keep;
+    
+#ifdef FRAME_ALPHA
+    int fy0 = 0, fy1 = 0;
+#else
+    int fy0 = y, fy1 = y + FRAME_H;
+#endif
+    bg_reader_t rd;
+    bg_begin(&rd, &img, bw, bh, bw != img.w || bh != img.h ? band + bw * BG_BAND_ROWS : NULL);
+    for (int by0 = 0; by0 < bh; by0 += BG_BAND_ROWS) {
+        int by1 = by0 + BG_BAND_ROWS < bh ? by0 + BG_BAND_ROWS : bh;
+        bg_read(&rd, band, by1 - by0);
+        
+        /* Full rows above and below frame 0, the sides of it in between */
+        int hy0 = fy0 > by0 ? (fy0 < by1 ? fy0 : by1) : by0;
+        int hy1 = fy1 > hy0 ? (fy1 < by1 ? fy1 : by1) : hy0;
+        bg_blit_band(ctx, band, bw, by0, hy0, 0, 0);
+        bg_blit_band(ctx, band + (hy0 - by0) * bw, bw, hy0, hy1, x, x + FRAME_W);
+        bg_blit_band(ctx, band + (hy1 - by0) * bw, bw, hy1, by1, 0, 0);
+        
+        /* Kept rows of this band */
+        int ky0 = by0 > keep.y0 ? by0 : keep.y0;
+        int ky1 = by1 < keep.y1 ? by1 : keep.y1;
+        for (int ky = ky0; bg_buffer && ky < ky1; ky++) {
+            memcpy(bg_buffer + (ky - keep.y0) * keep_w, band + (ky - by0) * bw + keep.x0, keep_w * 2);
+        }
+    }
+    
+    munmap(band, band_size);
+}
+#endif
+
+/* --- Boot instrumentation (xbootsplash.stats on the kernel cmdline) --- */
+/* main() stamps each startup step and bins every frame's decode and blit */
+/* time; one summary line goes to /dev/kmsg on exit. Disabled, it costs the */
+/* clock read at entry and a test of stats.on per probe. The record is this */
+/* static struct: nothing is allocated. */
+enum { STATS_CMDLINE, STATS_DECODE, STATS_OPEN, STATS_BLIT, STATS_PRESENT, STATS_EXIT, STATS_MARKS };
+#define STATS_BINS 8    /* Up to 0.25, 0.5, 1, 2, 4, 8, 16 ms, then longer */
+
+typedef struct {
+    int on;
+    long start;                         /* main() entry, CLOCK_MONOTONIC ns */
+    long mark[STATS_MARKS];             /* When each step finished, 0 if never */
+    unsigned int decode[STATS_BINS], blit[STATS_BINS];
+    long decode_max, blit_max;
+    unsigned int frames;                /* Presented */
+    unsigned int late;                  /* Not decoded by their deadline */
+    unsigned int dropped;               /* Decoded but skipped to catch up */
+} boot_stats_t;
+static boot_stats_t stats;
+
+static long stats_clock(void) {
+    if (!stats.on) return 0;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static void stats_mark(int m) {
+    if (stats.on && !stats.mark[m]) stats.mark[m] = stats_clock();
+}
+
+#if DISPLAY_MODE != 3 && DISPLAY_MODE != 4
+/* Bin the time since t0 (a stats_clock() reading), up to end if later than t0 */
+static void stats_bin(unsigned int *bins, long *max, long t0, long end) {
+    if (!stats.on) return;
+    long d = (end > t0 ? end : stats_clock()) - t0;
+    int b = 0;
+    for (long limit = 250000; b < STATS_BINS - 1 && d >= limit; limit <<= 1) b++;
+    bins[b]++;
+    if (d > *max) *max = d;
+}
+#endif
+
+static char *stats_str(char *p, const char *s) {
+    while (*s) *p++ = *s++;
+    return p;
+}
+
+static char *stats_uint(char *p, unsigned long v) {
+    char tmp[20];
+    int n = 0;
+    do {
+        tmp[n++] = '0' + v % 10;
+        v /= 10;
+    } while (v);
+    while (n) *p++ = tmp[--n];
+    return p;
+}
+
+/* Nanoseconds as milliseconds with two decimals */
+static char *stats_ms(char *p, long ns) {
+    unsigned long c = ns > 0 ? ns / 10000 : 0;
+    p = stats_uint(p, c / 100);
+    *p++ = '.';
+    *p++ = '0' + c / 10 % 10;
+    *p++ = '0' + c % 10;
+    return p;
+}
+
+static char *stats_bins(char *p, const char *name, const unsigned int *bins, long max) {
+    p = stats_str(p, " ");
+    p = stats_str(p, name);
+    p = stats_str(p, "_hist=");
+    for (int i = 0; i < STATS_BINS; i++) {
+        if (i) *p++ = '/';
+        p = stats_uint(p, bins[i]);
+    }
+    p = stats_str(p, " ");
+    p = stats_str(p, name);
+    p = stats_str(p, "_max=");
+    return stats_ms(p, max);
+}
+
+/* One line, times in ms: t0 since boot, steps relative to t0 */
+static void stats_report(void) {
+    static const char *const names[STATS_MARKS] = {
+        " cmdline=+", " decode=+", " open=+", " blit=+", " present=+", " exit=+"
+    };
+    char line[512];
+    
+    if (!stats.on) return;
+    stats_mark(STATS_EXIT);
+    
+    char *p = stats_str(line, "<6>xbootsplash: t0=");
+    p = stats_ms(p, stats.start);
+    for (int m = 0; m < STATS_MARKS; m++) {
+        if (!stats.mark[m]) continue;
+        p = stats_str(p, names[m]);
+        p = stats_ms(p, stats.mark[m] - stats.start);
+    }
+    p = stats_str(p, " frames=");
+    p = stats_uint(p, stats.frames);
+    p = stats_str(p, " late=");
+    p = stats_uint(p, stats.late);
+    p = stats_str(p, " dropped=");
+    p = stats_uint(p, stats.dropped);
+    p = stats_bins(p, "decode", stats.decode, stats.decode_max);
+    p = stats_bins(p, "blit", stats.blit, stats.blit_max);
+    *p++ = '\n';
+    
+    int fd = open("/dev/kmsg", O_WRONLY | O_CLOEXEC, 0);
+    if (fd < 0) return;
+    write(fd, line, p - line);
+    close(fd);
+}
+
+/* Length of key if the parameter at p is exactly key, or key=1 */
+static int cmdline_flag(const char *p, const char *key) {
+    int i = 0;
+    while (key[i] && p[i] == key[i]) i++;
+    if (key[i]) return 0;
+    if (p[i] == '=' && p[i + 1] == '1') i += 2;
+    char next = p[i];
+    return (next == ' ' || next == '\t' || next == '\n' || next == '\0') ? i : 0;
+}
+
+/* Check if splash is disabled via kernel cmdline */
+/* Returns 1 if disabled (should exit), 0 if enabled */
+/* Also turns on boot instrumentation for xbootsplash.stats */
+static int check_cmdline_disable(void) {
+    int fd = open("/proc/cmdline", 0, 0);  /* O_RDONLY = 0 */
+    if (fd < 0) return 0;  /* Can't read cmdline, assume enabled */
+    
+    /* 4096 bytes (page size) - standard for cmdline on modern systems */
+    char buf[4096];
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    
+    if (n <= 0) return 0;
+    buf[n] = '\0';
+    
+    /* Check for nosplash parameter */
+    char *p = buf;
+    while (*p) {
+        /* Skip whitespace (including \n sometimes present at end) */
+        while (*p == ' ' || *p == '\t' || *p == '\n') p++;
+        if (!*p) break;
+        
+        /* Check for nosplash */
+        if (p[0] == 'n' && p[1] == 'o' && p[2] == 's' && p[3] == 'p' && 
+            p[4] == 'l' && p[5] == 'a' && p[6] == 's' && p[7] == 'h') {
+            char next = p[8];
+            if (next == ' ' || next == '\t' || next == '\n' || next == '\0') {
+                return 1;  /* Found nosplash */
+            }
+        }
+        
+        /* Check for xbootsplash=0 */
+        if (p[0] == 'x' && p[1] == 'b' && p[2] == 'o' && p[3] == 'o' && 
+            p[4] == 't' && p[5] == 's' && p[6] == 'p' && p[7] == 'l' &&
+            p[8] == 'a' && p[9] == 's' && p[10] == 'h' && p[11] == '=') {
+            if (p[12] == '0') {
+                char next = p[13];
+                if (next == ' ' || next == '\t' || next == '\n' || next == '\0') {
+                    return 1;  /* Found xbootsplash=0 */
+                }
+            }
+        }
+        
+        /* Check for xbootsplash.stats (or xbootsplash.stats=1) */
+        if (cmdline_flag(p, "xbootsplash.stats")) {
+            stats.on = 1;
+        }
+        
+        /* Skip to next parameter */
+        while (*p && *p != ' ' && *p != '\t' && *p != '\n') p++;
+    }
+    
+    return 0;  /* Not found, splash enabled */
+}
+
+/* --- Frame scheduling --- */
+/* Frames are due at absolute CLOCK_MONOTONIC deadlines (CLOCK_MONOTONIC_RAW */
+/* cannot be slept on), so decode, blit and flip waits never stretch the period. */
+
+/* Lock presentation to vblank when FRAME_DURATION_MS is a whole number of refresh periods */
+#ifndef VSYNC_LOCK
+#define VSYNC_LOCK 1
+#endif
+
+static long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+/* Sleep until an absolute CLOCK_MONOTONIC time or a termination signal. */
+/* ppoll's timeout is relative, so it is recomputed from the deadline after */
+/* every wakeup and the error never carries over to the next frame. */
+static void sleep_until_ns(long deadline) {
+    while (!terminate_requested) {
+        long left = deadline - now_ns();
+        if (left <= 0) break;
+        struct timespec ts = {
+            .tv_sec = left / 1000000000L,
+            .tv_nsec = left % 1000000000L
+        };
+        ppoll(NULL, 0, &ts, &wait_sigmask);
+    }
+}
+
+#if DISPLAY_MODE != 3 && DISPLAY_MODE != 4
+#define FRAME_NS ((long)FRAME_DURATION_MS * 1000000L)
+
+/* Vblanks per animation frame if FRAME_NS is within 1/32 of a whole number */
+/* of refresh periods and flips can be timed, else 0 */
+static int kms_vsync_frames(const kms_ctx_t *ctx) {
+    if (!VSYNC_LOCK || ctx->nbufs != 2 || !ctx->mono_stamps) return 0;
+    long period = ctx->refresh_ns;
+    if (period < 2000000L || period > 50000000L) return 0;
+    
+    long n = (FRAME_NS + period / 2) / period;
+    long err = n * period - FRAME_NS;
+    if (err < 0) err = -err;
+    if (n < 1 || err * 32 > FRAME_NS) return 0;
+    return (int)n;
+}
+
+/* Step to the next frame and grow dirty by what it changes, so frames decoded */
+/* without being presented still reach the screen. Returns 0 at the end of a */
+/* non-looping animation (nothing changes). */
+static int advance_frame(int *frame_idx) {
+    int f = *frame_idx + 1;
+    if (f >= NFRAMES) {
+#ifdef LOOP
+        if (!LOOP) return 0;  /* Stay on last frame */
+#endif
+        f = 0;
+    }
+    *frame_idx = f;
+    
+    /* Apply delta to get next frame */
+    if (f == 0) {
+#ifdef LOOP_DELTA
+        /* Closing delta from the last frame is smaller than frame 0 */
+        apply_delta(frames[NFRAMES], frame_sizes[NFRAMES], NFRAMES);
+#else
+        load_frame_0(frames[0], frame_sizes[0]);
+#endif
+    } else {
+        apply_delta(frames[f], frame_sizes[f], f);
+    }
+    return 1;
+}
+#endif
+
+/* Entry point */
+int main(void) {
+    kms_ctx_t kms = { .fd = -1 };
+    
+    /* Startup timeline origin, before the cmdline says whether it is wanted */
+    stats.start = now_ns();
+    
+    /* Kill switch: check kernel cmdline for nosplash or xbootsplash=0 */
+    if (check_cmdline_disable()) {
+        return 0;  /* Splash disabled, exit cleanly */
+    }
+    stats_mark(STATS_CMDLINE);
+    
+    /* Setup signal handlers for graceful termination */
+    signals_init();
+    
+    /* Select SIMD kernels for this CPU */
+    cpu_detect();
+    
+    /* Allocate frame buffer */
+    frame_buffer = mmap(NULL, FRAME_W * FRAME_H * 2, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (frame_buffer == MAP_FAILED) {
+        return 1;
+    }
+#ifdef TILE_REF
+    /* Previous-frame reference for tile copies */
+    tile_ref = mmap(NULL, FRAME_W * FRAME_H * 2, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (tile_ref == MAP_FAILED) {
+        return 1;
+    }
+#endif
+    
+#ifdef FRAME_ALPHA
+    /* Coverage plane and blend target (last row: BACKGROUND_COLOR off the image) */
+    alpha_buffer = mmap(NULL, FRAME_W * FRAME_H, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    comp_buffer = mmap(NULL, FRAME_W * (FRAME_H + 1) * 2, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (alpha_buffer == MAP_FAILED || comp_buffer == MAP_FAILED) {
+        return 1;
+    }
+    for (int i = 0; i < FRAME_W; i++) comp_buffer[FRAME_W * FRAME_H + i] = BACKGROUND_COLOR;
+#endif
+    
+    /* Load initial frame */
+#if DISPLAY_MODE == 3 || DISPLAY_MODE == 4
+    /* Static image */
+#if defined(COMPRESS_METHOD) && COMPRESS_METHOD == 5
+    /* Palette + LZSS compressed */
+    decompress_palette_lzss(img_compressed, IMG_COMPRESSED_SIZE, palette, PALETTE_SIZE,
+                            frame_buffer, FRAME_W * FRAME_H);
+#else
+    /* Raw RGB565 */
+    for (int i = 0; i < FRAME_W * FRAME_H; i++) {
+        frame_buffer[i] = frame_0[i];
+    }
+#endif
+#else
+    /* Animation: load frame 0 compressed */
+    load_frame_0(frames[0], frame_sizes[0]);
+#endif
+#if DISPLAY_MODE != 1 && DISPLAY_MODE != 2
+    stats_mark(STATS_DECODE);
+#endif
+    
+    /* Open the DRM device and set the mode */
+    if (kms_init(&kms) < 0) {
+        return 1;
+    }
+    stats_mark(STATS_OPEN);
+    
+    /* Calculate position */
+    int x = ((int)kms.width - FRAME_W) / 2 + HORIZONTAL_OFFSET;
+    int y = ((int)kms.height - FRAME_H) / 2 + VERTICAL_OFFSET;
+    
+    /* Paint the backdrop into every buffer so flips never expose a stale one */
+    for (int i = 0; i < kms.nbufs; i++) {
+        kms_buf_t *buf = &kms.bufs[i];
+        fill_fb_color(buf->map, kms.width, kms.height, buf->pitch, BACKGROUND_COLOR);
+#if (DISPLAY_MODE == 1 || DISPLAY_MODE == 2) && !defined(FRAME_ALPHA)
+        blit_to_drm(buf->map, kms.width, kms.height, buf->pitch,
+                    frame_buffer, FRAME_W, FRAME_W, FRAME_H, x, y);
+#endif
+    }
+#if DISPLAY_MODE == 1 || DISPLAY_MODE == 2
+    /* First pixels: the colour, and frame 0 unless it is blended over the */
+    /* image. Then the background around it, band by band as it is decoded. */
+    kms_present(&kms, 0, 0, kms.width, kms.height);
+#ifndef FRAME_ALPHA
+    stats_mark(STATS_PRESENT);
+#endif
+    bg_load(&kms, x, y);
+    stats_mark(STATS_DECODE);
+#endif
+    stats_mark(STATS_BLIT);
+    
+    /* Main loop */
+#if DISPLAY_MODE == 3 || DISPLAY_MODE == 4
+    /* Static image: just display and wait for termination signal */
+    for (int i = 0; i < kms.nbufs; i++) {
+        kms_buf_t *buf = &kms.bufs[i];
+        blit_to_drm(buf->map, kms.width, kms.height, buf->pitch,
+                    frame_buffer, FRAME_W, FRAME_W, FRAME_H, x, y);
+    }
+    kms_present(&kms, 0, 0, kms.width, kms.height);
+    stats_mark(STATS_PRESENT);
+    
+    /* Sleep until signal received */
+    wait_for_signal();
+#else
+    /* Animation loop */
+    /* Region changed since the back buffer was last drawn; with two */
+    /* buffers that is the previous delta plus the current one */
+    dirty_rect_t prev_dirty;
+    dirty_mark_full(&prev_dirty);
+    
+    /* Locked: every frame goes out N vblanks after the previous flip, */
+    /* otherwise frames sit on a FRAME_NS grid starting now */
+    int vsync_frames = kms_vsync_frames(&kms);
+    long period = vsync_frames ? vsync_frames * kms.refresh_ns : FRAME_NS;
+    long deadline = now_ns();
+    
+    int frame_idx = 0;
+    while (!terminate_requested) {
+        long flip_before = kms.flip_ns;
+        
+        /* Blit only the changed region into the back buffer, then flip */
+        dirty_rect_t blit_rect = dirty;
+        if (kms.nbufs == 2) {
+            dirty_union(&blit_rect, &prev_dirty);
+        }
+        if (!dirty_empty(&blit_rect)) {
+#ifdef FRAME_ALPHA
+            /* Blending only touches comp_buffer: done before the flip wait */
+            alpha_compose(&blit_rect, x, y);
+#endif
+            /* Back buffer is still being scanned out until the flip lands */
+            kms_wait_flip(&kms);
+            
+            long blit_t0 = stats_clock();
+            kms_buf_t *back = kms_back(&kms);
+            blit_to_drm(back->map, kms.width, kms.height, back->pitch,
+                        FRAME_OUT + blit_rect.y0 * FRAME_W + blit_rect.x0, FRAME_W,
+                        blit_rect.x1 - blit_rect.x0, blit_rect.y1 - blit_rect.y0,
+                        x + blit_rect.x0, y + blit_rect.y0);
+            stats_bin(stats.blit, &stats.blit_max, blit_t0, 0);
+            
+            kms_present(&kms, x + blit_rect.x0, y + blit_rect.y0,
+                        blit_rect.x1 - blit_rect.x0, blit_rect.y1 - blit_rect.y0);
+            stats_mark(STATS_PRESENT);
+            if (stats.on) stats.frames++;
+        }
+        prev_dirty = dirty;
+        dirty_reset(&dirty);
+        
+        /* Check for termination signal */
+        if (terminate_requested) break;
+        
+        /* Next deadline: when locked, re-anchored on the vblank this frame went out on */
+        if (vsync_frames) {
+            kms_wait_flip(&kms);
+            if (kms.flip_ns != flip_before) deadline = kms.flip_ns;
+        }
+        deadline += period;
+        
+        /* Next frame */
+        long decode_t0 = stats_clock();
+        if (!advance_frame(&frame_idx)) {
+            /* Stay on last frame until terminated */
+            wait_for_signal();
+            break;
+        }
+        stats_bin(stats.decode, &stats.decode_max, decode_t0, 0);
+        
+        /* A whole period behind (slow blit, busy CPU): decode the frames that are */
+        /* already due without presenting them, so the animation keeps its speed */
+        long now = now_ns();
+        if (stats.on && now > deadline) stats.late++;
+        while (now - deadline >= period && !terminate_requested) {
+            decode_t0 = stats_clock();
+            if (!advance_frame(&frame_idx)) break;
+            stats_bin(stats.decode, &stats.decode_max, decode_t0, 0);
+            if (stats.on) stats.dropped++;
+            deadline += period;
+        }
+        
+        /* Locked: wake half a refresh early so the flip is queued before the vblank */
+        sleep_until_ns(vsync_frames ? deadline - kms.refresh_ns / 2 : deadline);
+    }
+#endif
+    stats_report();
+    
+    /* Graceful cleanup: keep the last frame up for the next master, or
+     * clear to black and restore the previous CRTC */
+    kms_wait_flip(&kms);
+    if (!DRM_HANDOFF || !kms_handoff(&kms)) {
+        for (int i = 0; i < kms.nbufs; i++) {
+            memset(kms.bufs[i].map, 0, kms.bufs[i].size);
+        }
+    }
+    kms_cleanup(&kms);
+    return 0;
+}
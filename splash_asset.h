@@ -0,0 +1,70 @@
+/*
+ * splash_asset.h - Binary theme container (generate_splash -A)
+ *
+ * An alternative to compiling frames_delta.h into the runtime: the fbdev
+ * binary built with ASSET_PATH maps this file read-only and decodes straight
+ * from the mapping, so one binary plays any theme and only the pages a frame
+ * touches are ever read.
+ *
+ * Layout (little-endian, offsets from the start of the file, 4-byte aligned):
+ *
+ *   xbs_header_t
+ *   background palette, background LZSS, frame 0 palette, frame streams
+ *   (more background palettes and LZSS, then their table)
+ *   uint32_t frame_offsets[nslots]     nslots = nframes (+1 with XBS_LOOP_DELTA)
+ *   uint32_t frame_sizes[nslots]
+ *   uint16_t frame_dirty[nslots][4]    x0, y0, x1, y1 as FRAME_DIRTY_TABLE
+ *
+ * The index comes last so the generator can stream frames out as it
+ * compresses them; readers only go through the header's offsets.
+ *
+ * Frame 0 is stored with frame0_method (1 = RLE Direct, 3 = raw, 5 = palette
+ * + LZSS). Every other stream starts with its codec tag byte, as with
+ * COMPRESS_METHOD 6 (0-3, 7). Static images are one-frame animations that
+ * do not loop.
+ *
+ * bg_variants_offset, when not 0, points at uint32_t count followed by count
+ * xbs_bg_variant_t: the same background at other resolutions (generate_splash
+ * -r WxH,WxH,...), the runtime drawing whichever is closest to the screen.
+ * Readers that do not know about it only see bg_w x bg_h.
+ */
+
+#pragma once
+
+#define XBS_MAGIC   0x41534258  /* "XBSA" */
+#define XBS_VERSION 1
+
+/* xbs_header_t.flags */
+#define XBS_LOOP        (1 << 0)  /* Restart after the last frame (LOOP) */
+#define XBS_LOOP_DELTA  (1 << 1)  /* Slot nframes closes the loop (LOOP_DELTA) */
+#define XBS_TILE_REF    (1 << 2)  /* Some stream uses the tile codec (TILE_REF) */
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t flags;
+    uint16_t display_mode;          /* DISPLAY_MODE the theme was generated for */
+    uint16_t frame_ms;              /* FRAME_DURATION_MS */
+    int16_t  x_offset, y_offset;    /* HORIZONTAL_OFFSET, VERTICAL_OFFSET */
+    uint16_t bg_color;              /* BACKGROUND_COLOR, RGB565 */
+    uint16_t frame0_method;
+    uint16_t frame_w, frame_h;
+    uint16_t bg_w, bg_h;            /* 0 without a background image */
+    uint16_t frame0_palette_size;
+    uint16_t bg_palette_size;
+    uint32_t nframes;
+    uint32_t index_offset;          /* frame_offsets; sizes and dirty boxes follow */
+    uint32_t frame0_palette_offset;
+    uint32_t bg_palette_offset;
+    uint32_t bg_offset, bg_size;    /* Background palette indices, LZSS */
+    uint32_t file_size;
+    uint32_t bg_variants_offset;    /* 0 when the background has one resolution */
+} xbs_header_t;
+
+typedef struct {
+    uint16_t w, h;
+    uint16_t palette_size;
+    uint16_t reserved;
+    uint32_t palette_offset;
+    uint32_t offset, size;          /* Palette indices, LZSS */
+} xbs_bg_variant_t;